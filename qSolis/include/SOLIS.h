@@ -18,15 +18,23 @@
 #ifndef MESH_ILLUMINATION_HEADER
 #define MESH_ILLUMINATION_HEADER
 
+//qSolis
+#include "SOLISCache.h"
+#include "SOLISCheckpoint.h"
+#include "SOLISHorizon.h"
+#include "SOLISShard.h"
+
 //CCCoreLib
 #include <GenericCloud.h>
 #include <GenericIndexedMesh.h>
 #include <GenericProgressCallback.h>
+#include <ScalarField.h>
 
 //Qt
 #include <QString>
 
 //System
+#include <cstdint>
 #include <vector>
 
 
@@ -35,59 +43,557 @@
 class SOLIS
 {
 public:
-	//! Simulates global illumination on a cloud (or a mesh) with OpenGL - shortcut version
+	//! Per-vertex accumulator precision
+	/** The result is always accumulated in (or written to) the output scalar field buffer.
+		Depending on the precision, an additional per-vertex buffer is used:
+		- ACCUMULATOR_COMPACT: 16 bits counts (diffuse) or float + compensated (Kahan) summation (direct) - 2 or 4 bytes per vertex
+		- ACCUMULATOR_FAST: plain float summation directly in the output scalar field - no extra memory
+		- ACCUMULATOR_DOUBLE: 32 bits counts (diffuse) or double summation (direct) - 4 or 8 bytes per vertex
+	**/
+	enum AccumulatorPrecision
+	{
+		ACCUMULATOR_COMPACT = 0,
+		ACCUMULATOR_FAST,
+		ACCUMULATOR_DOUBLE
+	};
+
+	//! Sampling density of the diffuse light directions
+	enum DiffuseSampling
+	{
+		DIFFUSE_UNIFORM = 0,	//!< equal solid angle (see GenerateDiffRays)
+		DIFFUSE_COSINE,			//!< proportional to the cosine of the zenith angle
+		DIFFUSE_SKY				//!< proportional to the diffuse energy of the sky (see SOLISSky::AddSkyRadiance)
+	};
+
+	//! Per-vertex sunshine statistics (structure of arrays, see Launch)
+	struct SunStatistics
+	{
+		std::vector<uint32_t> litCount;			//!< number of rays (timesteps) lighting the vertex
+		std::vector<float> firstSun;			//!< timestamp of the first ray lighting the vertex (NaN if never lit)
+		std::vector<float> lastSun;				//!< timestamp of the last ray lighting the vertex (NaN if never lit)
+		std::vector<float> peakIrradiance;		//!< maximum irradiance of a single ray lighting the vertex (0 if never lit)
+	};
+
+
+	//! Simulates global illumination on a cloud (or a mesh) with OpenGL
 	/** Computes per-vertex illumination intensity as a scalar field.
-		\param numberOfRays (approxiamate) number of rays to generate
+		\param rays light directions that will be used to compute global illumination
+		\param irradiance irradiance associated to each ray (direct mode) or total diffuse irradiance (first value, diffuse mode)
+		\param modeDirect whether to accumulate direct irradiance (true) or the visible sky portion (false)
+		\param conversion factor applied to the accumulated values
 		\param vertices vertices (eventually corresponding to a mesh - see below) to englight
+		\param output scalar field (with as many values as vertices) in which the result is accumulated
 		\param mesh optional mesh structure associated to the vertices
 		\param meshIsClosed if a mesh is passed as argument (see above), specifies if the mesh surface is closed (enables optimization)
 		\param width width  of the OpenGL context used to simulate illumination
 		\param height height of the OpenGL context used to simulate illumination
 		\param progressCb optional progress bar (optional)
 		\param entityName entity name (optional)
-		\return number of 'light' directions actually used (or a value <0 if an error occurred)
+		\param precision per-vertex accumulator precision (optional)
+		\param rayDoys timestamp of each ray (day of year, required by 'statistics')
+		\param[out] statistics per-vertex sunshine statistics, gathered in the same pass (direct mode only, optional)
+		\param checkpoint periodic snapshots of the accumulators, to resume an interrupted run (optional)
+		\return success
 	**/
-	static int Launch(	unsigned numberOfRays,
+	static bool Launch(	const std::vector<CCVector3>& rays,
+						const std::vector<double>& irradiance,
+						bool modeDirect,
+						double conversion,
 						CCCoreLib::GenericCloud* vertices,
+						CCCoreLib::ScalarField* output,
 						CCCoreLib::GenericMesh* mesh = nullptr,
 						bool meshIsClosed = false,
 						unsigned width = 1024,
 						unsigned height = 1024,
 						CCCoreLib::GenericProgressCallback* progressCb = nullptr,
-						const QString& entityName = QString());
+						const QString& entityName = QString(),
+						AccumulatorPrecision precision = ACCUMULATOR_COMPACT,
+						const std::vector<double>* rayDoys = nullptr,
+						SunStatistics* statistics = nullptr,
+						SOLISCheckpoint* checkpoint = nullptr);
 
-
-	//! Simulates global illumination on a cloud (or a mesh) with OpenGL
-	/** Computes per-vertex illumination intensity as a scalar field.
+	//! Simulates global illumination with several weighted outputs in a single pass
+	/** Each ray is rendered once and its weight for output k (weights[k][ray]) is added to the vertices it illuminates.
+		Rays with a null weight for all outputs are not rendered.
 		\param rays light directions that will be used to compute global illumination
+		\param weights per-output and per-ray weights ([output][ray])
+		\param conversion factor applied to the accumulated values
 		\param vertices vertices (eventually corresponding to a mesh - see below) to englight
+		\param outputs scalar fields (with as many values as vertices) in which the results are accumulated
 		\param mesh optional mesh structure associated to the vertices
 		\param meshIsClosed if a mesh is passed as argument (see above), specifies if the mesh surface is closed (enables optimization)
 		\param width width  of the OpenGL context used to simulate illumination
 		\param height height of the OpenGL context used to simulate illumination
 		\param progressCb optional progress bar (optional)
 		\param entityName entity name (optional)
+		\param precision per-vertex accumulator precision (optional)
+		\param checkpoint periodic snapshots of the accumulators, to resume an interrupted run (optional)
+		\param horizon far-field horizon: rays hidden for all the tiles aren't rendered, the others don't light the vertices of hidden tiles (optional)
 		\return success
 	**/
 	static bool Launch(	const std::vector<CCVector3>& rays,
-						const std::vector<double>& irradiance,
-						bool modeDirect,
-						double timestep,
+						const std::vector< std::vector<double> >& weights,
+						double conversion,
 						CCCoreLib::GenericCloud* vertices,
+						const std::vector<CCCoreLib::ScalarField*>& outputs,
 						CCCoreLib::GenericMesh* mesh = nullptr,
 						bool meshIsClosed = false,
 						unsigned width = 1024,
 						unsigned height = 1024,
 						CCCoreLib::GenericProgressCallback* progressCb = nullptr,
-						const QString& entityName = QString());
+						const QString& entityName = QString(),
+						AccumulatorPrecision precision = ACCUMULATOR_COMPACT,
+						SOLISCheckpoint* checkpoint = nullptr,
+						const SOLISHorizon* horizon = nullptr);
+
+	//! Flags the vertices that may be shadowed differently after a local geometry edit
+	/** A vertex is flagged if the half-line going from it toward the sky along one of the (weighted) rays crosses
+		the bounding box of the edit (i.e. the vertex lies in the shadow volume of the added or removed geometry),
+		or if one of its previous values is NaN (e.g. new vertices).
+		\param rays light directions
+		\param weights per-output and per-ray weights ([output][ray], rays with null weights are ignored)
+		\param changedMin minimum corner of the bounding box of the edit
+		\param changedMax maximum corner of the bounding box of the edit
+		\param vertices vertices
+		\param previous previous values (optional, see above)
+		\param[out] receiverMask per-vertex bits (64 vertices per word)
+		\return number of flagged vertices (or -1 if an error occurred)
+	**/
+	static int64_t AffectedReceivers(	const std::vector<CCVector3>& rays,
+										const std::vector< std::vector<double> >& weights,
+										const CCVector3& changedMin,
+										const CCVector3& changedMax,
+										CCCoreLib::GenericCloud* vertices,
+										const std::vector<CCCoreLib::ScalarField*>& previous,
+										std::vector<uint64_t>& receiverMask);
+
+	//! Updates the results of Launch (several weighted outputs version) after a local geometry edit
+	/** Only the vertices flagged by AffectedReceivers are re-evaluated (with all the rays), the other values
+		are kept. The view is fitted to the flagged vertices with the same pixel size as a full render, so that
+		both the OpenGL context and the per-vertex visibility tests shrink with the affected area.
+		\param rays light directions
+		\param weights per-output and per-ray weights ([output][ray])
+		\param conversion factor applied to the accumulated values
+		\param changedMin minimum corner of the bounding box of the edit
+		\param changedMax maximum corner of the bounding box of the edit
+		\param vertices vertices (eventually corresponding to a mesh - see below) to englight (after the edit)
+		\param outputs scalar fields holding the previous results (updated in place)
+		\param mesh optional mesh structure associated to the vertices
+		\param meshIsClosed if a mesh is passed as argument (see above), specifies if the mesh surface is closed (enables optimization)
+		\param width width  of the OpenGL context of a full render
+		\param height height of the OpenGL context of a full render
+		\param progressCb optional progress bar (optional)
+		\param entityName entity name (optional)
+		\param[out] updatedCount number of re-evaluated vertices (optional)
+		\return success
+	**/
+	static bool LaunchIncremental(	const std::vector<CCVector3>& rays,
+									const std::vector< std::vector<double> >& weights,
+									double conversion,
+									const CCVector3& changedMin,
+									const CCVector3& changedMax,
+									CCCoreLib::GenericCloud* vertices,
+									const std::vector<CCCoreLib::ScalarField*>& outputs,
+									CCCoreLib::GenericMesh* mesh = nullptr,
+									bool meshIsClosed = false,
+									unsigned width = 1024,
+									unsigned height = 1024,
+									CCCoreLib::GenericProgressCallback* progressCb = nullptr,
+									const QString& entityName = QString(),
+									size_t* updatedCount = nullptr);
 
 	//! Generates a given number of rays
 	/*static bool GenerateRays(	unsigned numberOfRays,
 								std::vector<CCVector3>& rays);
 	*/							
-	static double SOLIS::totalDiffIrradiance (double doyFrom,double doyTo,double timestep,double lat,double lon,double elevation);
-	static bool SOLIS::GenerateSunRays( double doyFrom,double doyTo,double timestep,double lat,double lon,double elevation, std::vector<CCVector3>& rays, std::vector<double>& irradiance);
-	static bool SOLIS::GenerateDiffRays(unsigned numberOfRays, std::vector<CCVector3>& rays);
+	static double totalDiffIrradiance (double doyFrom,double doyTo,double timestep,double lat,double lon,double elevation);
+	static bool GenerateSunRays( double doyFrom,double doyTo,double timestep,double lat,double lon,double elevation, std::vector<CCVector3>& rays, std::vector<double>& irradiance, std::vector<double>* rayDoys = nullptr);
+	static bool GenerateDiffRays(unsigned numberOfRays, std::vector<CCVector3>& rays);
+
+	//! Time periods of the multi-period maps
+	enum PeriodBinning
+	{
+		PERIODS_NONE = 0,	//!< no binning
+		PERIODS_MONTH,		//!< 12 months (non leap year)
+		PERIODS_HOUR		//!< 24 hours of the day (local solar time)
+	};
+
+	//! Returns the number of periods of a binning
+	static unsigned PeriodCount(PeriodBinning binning);
+
+	//! Returns the period of a timestamp (day of year, with fractional time)
+	static int PeriodIndex(PeriodBinning binning, double doy);
+
+	//! Returns the label of a period (used as scalar field name suffix, e.g. 'M01' or 'H13')
+	static QString PeriodLabel(PeriodBinning binning, unsigned index);
+
+	//! Maps each ray to its period
+	/** The result can be passed as is to the multi-output version of Launch: every ray is rendered once
+		and its weight is only added to the output of its period, so that a single sweep yields all the maps.
+		\param binning period binning
+		\param doys timestamp of each ray (see GenerateSunRays)
+		\param irradiance irradiance of each ray
+		\param[out] weights per-period and per-ray weights ([period][ray])
+		\return success
+	**/
+	static bool BinByPeriod(PeriodBinning binning, const std::vector<double>& doys, const std::vector<double>& irradiance, std::vector< std::vector<double> >& weights);
+
+	//! Integrates the diffuse irradiance of each period (same units as totalDiffIrradiance)
+	static bool PeriodDiffIrradiance(PeriodBinning binning, double doyFrom, double doyTo, double timestep, double lat, double lon, double elevation, std::vector<double>& irradiance);
+
+	//! Generates importance sampled diffuse light directions and their estimator weights
+	/** Directions are drawn with the density selected by 'sampling' (see SOLISSky::ImportanceDirections).
+		The weight of a direction is the sky energy of its grid cell divided by its sampling probability
+		and by the number of directions, so that the weighted visibility sum is an unbiased estimate of
+		the diffuse energy reaching a point. With DIFFUSE_SKY all the weights are equal, which minimizes
+		the per-point variance for a given number of renders.
+		\param numberOfRays number of directions
+		\param sampling sampling density
+		\param skyEnergy diffuse energy of each cell of the sky grid (see SOLISSky::SkyGrid)
+		\param[out] rays light directions
+		\param[out] weights estimator weight of each direction
+		\return success
+	**/
+	static bool GenerateDiffRays(	unsigned numberOfRays,
+									DiffuseSampling sampling,
+									const std::vector<double>& skyEnergy,
+									std::vector<CCVector3>& rays,
+									std::vector<double>& weights);
+
+	//! Computes the diffuse weights of sky directions for an anisotropic (Perez-type) clear sky
+	/** The radiance distribution of the sky follows the sun along the period (see SOLISSky::AddSkyRadiance),
+		so that the circumsolar and horizon regions receive more energy than with the isotropic distribution.
+		The sum of the weights equals totalDiffIrradiance * sum(solidAngles) / 2pi, i.e. the weights can
+		replace the isotropic ones without changing the conversion factor.
+		\param doyFrom start (day of year)
+		\param doyTo end (day of year)
+		\param timestep timestep (minutes)
+		\param lat latitude
+		\param lon longitude
+		\param elevation elevation
+		\param rays sky light directions
+		\param solidAngles solid angle of each direction
+		\param[out] weights diffuse weight of each direction
+		\return success
+	**/
+	static bool AnisotropicDiffuseWeights(	double doyFrom,
+											double doyTo,
+											double timestep,
+											double lat,
+											double lon,
+											double elevation,
+											const std::vector<CCVector3>& rays,
+											const std::vector<double>& solidAngles,
+											std::vector<double>& weights);
+
+	//! Simulates direct illumination along the sun path with adaptive temporal sampling
+	/** The sun path is first sampled every 'coarseFactor' timesteps. An interval is bisected (down to a single
+		timestep) only when the sets of vertices lit at its endpoints differ by more than 'threshold' (or when the
+		sun rises or sets in it). Between two samples, the visibility of each vertex is linearly interpolated and
+		weighted by the direct irradiance of every timestep, so that the result matches GenerateSunRays + Launch
+		when every interval is refined. The number of renders therefore follows the shadow-edge motion instead of
+		the duration.
+		\param doyFrom start (day of year)
+		\param doyTo end (day of year)
+		\param timestep finest timestep (minutes)
+		\param coarseFactor number of timesteps between two coarse samples
+		\param threshold fraction of the vertices whose visibility must change to refine an interval
+		\param lat latitude
+		\param lon longitude
+		\param elevation elevation
+		\param conversion factor applied to the accumulated values
+		\param vertices vertices (eventually corresponding to a mesh - see below) to englight
+		\param output scalar field (with as many values as vertices) in which the result is accumulated
+		\param mesh optional mesh structure associated to the vertices
+		\param meshIsClosed if a mesh is passed as argument (see above), specifies if the mesh surface is closed (enables optimization)
+		\param width width  of the OpenGL context used to simulate illumination
+		\param height height of the OpenGL context used to simulate illumination
+		\param progressCb optional progress bar (optional)
+		\param entityName entity name (optional)
+		\param precision per-vertex accumulator precision (optional)
+		\param[out] renderCount number of renders actually performed (optional)
+		\return success
+	**/
+	static bool LaunchAdaptiveSunPath(	double doyFrom,
+										double doyTo,
+										double timestep,
+										unsigned coarseFactor,
+										double threshold,
+										double lat,
+										double lon,
+										double elevation,
+										double conversion,
+										CCCoreLib::GenericCloud* vertices,
+										CCCoreLib::ScalarField* output,
+										CCCoreLib::GenericMesh* mesh = nullptr,
+										bool meshIsClosed = false,
+										unsigned width = 1024,
+										unsigned height = 1024,
+										CCCoreLib::GenericProgressCallback* progressCb = nullptr,
+										const QString& entityName = QString(),
+										AccumulatorPrecision precision = ACCUMULATOR_COMPACT,
+										size_t* renderCount = nullptr);
+
+	//! Simulates direct illumination of a large scene with a sun position varying across the scene
+	/** The scene is split in tiles of (about) 'tileSize' x 'tileSize' (horizontally). Each tile gets its own
+		latitude and longitude (local tangent plane around the center of the scene, X pointing east and Y north,
+		in meters) and its own sun rays. Timestamps are in the local solar time of the scene center, and are
+		shifted to the local solar time of each tile. The whole scene is rendered with the rays of each tile (so that shadows may
+		come from anywhere) and each vertex receives the irradiance of the (up to 4) tiles around it, with
+		bilinear weights, so that the result doesn't show any seam at the tile borders.
+		\param doyFrom start (day of year)
+		\param doyTo end (day of year)
+		\param timestep timestep (minutes)
+		\param lat latitude of the scene center
+		\param lon longitude of the scene center
+		\param elevation elevation
+		\param tileSize tile size (same units as the vertices, meters)
+		\param conversion factor applied to the accumulated values
+		\param vertices vertices (eventually corresponding to a mesh - see below) to englight
+		\param output scalar field (with as many values as vertices) in which the result is accumulated
+		\param mesh optional mesh structure associated to the vertices
+		\param meshIsClosed if a mesh is passed as argument (see above), specifies if the mesh surface is closed (enables optimization)
+		\param width width  of the OpenGL context used to simulate illumination
+		\param height height of the OpenGL context used to simulate illumination
+		\param progressCb optional progress bar (optional)
+		\param entityName entity name (optional)
+		\param precision per-vertex accumulator precision (optional)
+		\param[out] tileCount number of tiles (optional)
+		\return success
+	**/
+	static bool LaunchTiledSunPath(	double doyFrom,
+									double doyTo,
+									double timestep,
+									double lat,
+									double lon,
+									double elevation,
+									double tileSize,
+									double conversion,
+									CCCoreLib::GenericCloud* vertices,
+									CCCoreLib::ScalarField* output,
+									CCCoreLib::GenericMesh* mesh = nullptr,
+									bool meshIsClosed = false,
+									unsigned width = 1024,
+									unsigned height = 1024,
+									CCCoreLib::GenericProgressCallback* progressCb = nullptr,
+									const QString& entityName = QString(),
+									AccumulatorPrecision precision = ACCUMULATOR_COMPACT,
+									unsigned* tileCount = nullptr);
+
+	//! Merges sun rays with similar directions (cumulative sky)
+	/** Rays are binned so that no ray is farther than 'tolerance' from the direction of its bin.
+		The irradiance of all the rays of a bin is summed and the bin direction is the irradiance-weighted
+		mean direction. The number of renders then depends on the sky discretization instead of the timestep.
+		\param tolerance maximum angle (in degrees) between a ray and the direction of its bin
+		\param[in,out] rays sun rays (replaced by the bin directions)
+		\param[in,out] irradiance irradiance of each ray (replaced by the bin irradiance sums)
+		\param[out] maxError maximum angle (in degrees) between a ray and its bin direction (optional)
+		\param[out] meanError irradiance-weighted mean angle (in degrees) between a ray and its bin direction (optional)
+		\return success
+	**/
+	static bool BinSunRays(double tolerance, std::vector<CCVector3>& rays, std::vector<double>& irradiance, double* maxError = nullptr, double* meanError = nullptr);
+
+	//! Same as above with several weights per ray ([series][ray], e.g. one series per weather file)
+	/** The bin direction is weighted by the sum of the (positive) weights of all series.
+	**/
+	static bool BinSunRays(double tolerance, std::vector<CCVector3>& rays, std::vector< std::vector<double> >& weights, double* maxError = nullptr, double* meanError = nullptr);
+
+	//! Projects the visibility of each vertex on the spherical harmonics (see SOLISSky::HarmonicsBasis)
+	/** One render per sampling direction. The irradiance of a vertex for any set of weighted light directions
+		is then the dot product of its coefficients and of the lighting coefficients (see SOLISSky::LightingHarmonics),
+		i.e. a low-pass approximation of the visibility (shadow edges are smoothed, more with lower orders).
+		\param rays sampling directions (dense and covering the sky, see SOLISSky::SkyDirections)
+		\param solidAngles solid angle of each sampling direction
+		\param order maximum order l
+		\param vertices vertices (eventually corresponding to a mesh - see below)
+		\param[out] coefficients per-vertex coefficients (SOLISSky::HarmonicsCount(order) consecutive values per vertex)
+		\param mesh optional mesh structure associated to the vertices
+		\param meshIsClosed if a mesh is passed as argument (see above), specifies if the mesh surface is closed (enables optimization)
+		\param width width  of the OpenGL context used to simulate illumination
+		\param height height of the OpenGL context used to simulate illumination
+		\param progressCb optional progress bar (optional)
+		\param entityName entity name (optional)
+		\return success
+	**/
+	static bool ProjectVisibility(	const std::vector<CCVector3>& rays,
+									const std::vector<double>& solidAngles,
+									unsigned order,
+									CCCoreLib::GenericCloud* vertices,
+									std::vector<float>& coefficients,
+									CCCoreLib::GenericMesh* mesh = nullptr,
+									bool meshIsClosed = false,
+									unsigned width = 1024,
+									unsigned height = 1024,
+									CCCoreLib::GenericProgressCallback* progressCb = nullptr,
+									const QString& entityName = QString());
+
+	//! Renders the visibility of all vertices for a fixed set of directions and saves it (see SOLISCache::VisibilityMatrix)
+	/** One render per direction. Once saved, any sky or sun weighting over these directions (other dates,
+		sites or weather series) is a lookup in the matrix instead of new renders.
+		\param filename visibility matrix file
+		\param directions light directions (pointing downward)
+		\param geometryKey geometry key (see SOLISCache::GeometryKey)
+		\param directionsKey directions key (see SOLISCache::RaysKey)
+		\param vertices vertices (eventually corresponding to a mesh - see below)
+		\param mesh optional mesh structure associated to the vertices
+		\param meshIsClosed if a mesh is passed as argument (see above), specifies if the mesh surface is closed (enables optimization)
+		\param width width  of the OpenGL context used to simulate illumination
+		\param height height of the OpenGL context used to simulate illumination
+		\param progressCb optional progress bar (optional)
+		\param entityName entity name (optional)
+		\return success
+	**/
+	static bool ExportVisibilityMatrix(	const QString& filename,
+										const std::vector<CCVector3>& directions,
+										uint64_t geometryKey,
+										uint64_t directionsKey,
+										CCCoreLib::GenericCloud* vertices,
+										CCCoreLib::GenericMesh* mesh = nullptr,
+										bool meshIsClosed = false,
+										unsigned width = 1024,
+										unsigned height = 1024,
+										CCCoreLib::GenericProgressCallback* progressCb = nullptr,
+										const QString& entityName = QString());
+
+	//! Renders the sun direction bins that aren't stored yet (see SOLISCache::SunBinStore)
+	/** One render per missing bin, from the center of the bin. Bins already in the store are skipped.
+		\param store opened sun bin store
+		\param binKeys bin keys (see SOLISCache::SunBin)
+		\param directions light directions of the bin centers (pointing downward)
+		\param vertices vertices (eventually corresponding to a mesh - see below)
+		\param mesh optional mesh structure associated to the vertices
+		\param meshIsClosed if a mesh is passed as argument (see above), specifies if the mesh surface is closed (enables optimization)
+		\param width width  of the OpenGL context used to simulate illumination
+		\param height height of the OpenGL context used to simulate illumination
+		\param progressCb optional progress bar (optional)
+		\param entityName entity name (optional)
+		\param[out] renderedCount number of rendered bins (optional)
+		\return success
+	**/
+	static bool ExtendSunBins(	SOLISCache::SunBinStore& store,
+								const std::vector<uint64_t>& binKeys,
+								const std::vector<CCVector3>& directions,
+								CCCoreLib::GenericCloud* vertices,
+								CCCoreLib::GenericMesh* mesh = nullptr,
+								bool meshIsClosed = false,
+								unsigned width = 1024,
+								unsigned height = 1024,
+								CCCoreLib::GenericProgressCallback* progressCb = nullptr,
+								const QString& entityName = QString(),
+								size_t* renderedCount = nullptr);
+
+	//! Simulates illumination of a gridded surface model (DSM) with the 2.5D sweep engine (see SOLISHeightfield)
+	/** No OpenGL rendering: the shadows of each light direction are computed on a regular grid of the highest
+		vertex heights, in O(cells) per direction (directions are processed in parallel). The surface is the
+		grid of the highest vertex of each cell: overhangs (e.g. tree crowns over the ground) are not represented.
+		\param rays light directions (pointing downward)
+		\param weights weight of each ray for each output ([output][ray])
+		\param conversion factor applied to the final sums
+		\param cellSize grid cell size (0 = estimated from the vertex density)
+		\param vertices vertices (e.g. the nodes of a gridded DSM loaded as a cloud or a mesh)
+		\param outputs output scalar fields (one per weight series)
+		\param progressCb optional progress bar (optional)
+		\param entityName entity name (optional)
+		\param precision per-vertex accumulator precision (optional)
+		\return success
+	**/
+	static bool LaunchHeightfield(	const std::vector<CCVector3>& rays,
+									const std::vector< std::vector<double> >& weights,
+									double conversion,
+									double cellSize,
+									CCCoreLib::GenericCloud* vertices,
+									const std::vector<CCCoreLib::ScalarField*>& outputs,
+									CCCoreLib::GenericProgressCallback* progressCb = nullptr,
+									const QString& entityName = QString(),
+									AccumulatorPrecision precision = ACCUMULATOR_COMPACT);
+
+	//! Same as LaunchHeightfield with the scene split in receiver tiles processed in parallel
+	/** Each tile gets its own grid (context): its receivers and the occluders of a halo around it. Shadows can't
+		be longer than (highest - lowest vertex) / tan(lowest sun elevation of the rays), so the halo is sized
+		from the rays and the scene height: the results are the same as without tiles (no seam), with a memory
+		cost per thread bounded by the tile and halo size, and a total cost proportional to the area.
+		\param rays light directions (pointing downward)
+		\param weights weight of each ray for each output ([output][ray])
+		\param conversion factor applied to the final sums
+		\param cellSize grid cell size (0 = estimated from the vertex density)
+		\param tileSize receiver tile size (0 = automatic)
+		\param vertices vertices (e.g. the nodes of a gridded DSM loaded as a cloud or a mesh)
+		\param outputs output scalar fields (one per weight series)
+		\param progressCb optional progress bar (optional)
+		\param entityName entity name (optional)
+		\param precision per-vertex accumulator precision (optional)
+		\param[out] tileCount number of tiles (optional)
+		\param[out] haloSize halo width (optional)
+		\return success
+	**/
+	static bool LaunchHeightfieldTiled(	const std::vector<CCVector3>& rays,
+										const std::vector< std::vector<double> >& weights,
+										double conversion,
+										double cellSize,
+										double tileSize,
+										CCCoreLib::GenericCloud* vertices,
+										const std::vector<CCCoreLib::ScalarField*>& outputs,
+										CCCoreLib::GenericProgressCallback* progressCb = nullptr,
+										const QString& entityName = QString(),
+										AccumulatorPrecision precision = ACCUMULATOR_COMPACT,
+										unsigned* tileCount = nullptr,
+										double* haloSize = nullptr);
+
+	//! Simulates illumination of a gridded surface model (DSM) streamed from disk (out-of-core, see LaunchHeightfield)
+	/** Only the occluder grid (highest vertex of each cell) is kept in memory: the input file is read once to
+		get its extent, once to rasterize the occluders and once more, chunk by chunk, for the receivers. All the
+		rays are accumulated on each chunk of receivers, which is then converted and written to the output file.
+		Peak memory: grid cells x (4 bytes + 4 bytes per thread) + chunkSize x (8 bytes + 4 to 12 bytes per output).
+		\param rays light directions (pointing downward)
+		\param weights weight of each ray for each output ([output][ray])
+		\param conversion factor applied to the final sums
+		\param cellSize grid cell size (0 = estimated from the vertex density)
+		\param inputFilename input cloud or mesh (see SOLISFile::Reader - faces are ignored)
+		\param outputFilename output cloud (see SOLISFile::Writer)
+		\param fieldNames output scalar field names (one per weight series)
+		\param chunkSize number of receivers processed at once
+		\param progressCb optional progress bar (optional)
+		\param precision per-vertex accumulator precision (optional)
+		\param[out] error error message (optional)
+		\return success
+	**/
+	static bool LaunchStreamed(	const std::vector<CCVector3>& rays,
+								const std::vector< std::vector<double> >& weights,
+								double conversion,
+								double cellSize,
+								const QString& inputFilename,
+								const QString& outputFilename,
+								const std::vector<QString>& fieldNames,
+								size_t chunkSize,
+								CCCoreLib::GenericProgressCallback* progressCb = nullptr,
+								AccumulatorPrecision precision = ACCUMULATOR_COMPACT,
+								QString* error = nullptr);
+
+	//! Renders the slice of the rays of a shard and accumulates its partial results (see SOLISShard)
+	/** Same visibility as Launch (one render per ray), but only the rays selected by the shard are rendered
+		and the raw per-vertex sums are kept in the shard (the conversion is applied once all the shards are merged).
+		\param rays light directions (all the rays of the run)
+		\param vertices vertices (eventually corresponding to a mesh - see below) to englight
+		\param shard shard (initialized with the weights of all the rays and the number of vertices)
+		\param mesh optional mesh structure associated to the vertices
+		\param meshIsClosed if a mesh is passed as argument (see above), specifies if the mesh surface is closed (enables optimization)
+		\param width width  of the OpenGL context used to simulate illumination
+		\param height height of the OpenGL context used to simulate illumination
+		\param progressCb optional progress bar (optional)
+		\param entityName entity name (optional)
+		\param[out] renderedCount number of rays rendered by this shard (optional)
+		\return success
+	**/
+	static bool LaunchShard(	const std::vector<CCVector3>& rays,
+								CCCoreLib::GenericCloud* vertices,
+								SOLISShard& shard,
+								CCCoreLib::GenericMesh* mesh = nullptr,
+								bool meshIsClosed = false,
+								unsigned width = 1024,
+								unsigned height = 1024,
+								CCCoreLib::GenericProgressCallback* progressCb = nullptr,
+								const QString& entityName = QString(),
+								size_t* renderedCount = nullptr);
 };
 
 #endif
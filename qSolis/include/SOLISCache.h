@@ -0,0 +1,248 @@
+//##########################################################################
+//#                                                                        #
+//#                       CLOUDCOMPARE PLUGIN: qSOLIS                      #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                  COPYRIGHT: David Basler                               #
+//#                                                                        #
+//##########################################################################
+
+#ifndef SOLIS_CACHE_HEADER
+#define SOLIS_CACHE_HEADER
+
+//CCCoreLib
+#include <CCGeom.h>
+#include <GenericCloud.h>
+#include <GenericMesh.h>
+
+//Qt
+#include <QFile>
+#include <QString>
+
+//System
+#include <cstdint>
+#include <cstdio>
+#include <unordered_map>
+#include <vector>
+
+//! Persistent visibility results, reusable across dates, sites and weather series
+/** Rendered results only depend on the geometry and on the light directions. They are stored in
+	sidecar files named after a key of both, so that a later run on the same scene and the same
+	directions finds them without rendering anything.
+**/
+class SOLISCache
+{
+public:
+	//! Returns a key identifying a geometry and the rendering options
+	/** The key covers the vertex coordinates, the triangles (if any) and the options changing the visibility
+		(closed mesh, resolution).
+	**/
+	static uint64_t GeometryKey(CCCoreLib::GenericCloud* vertices, CCCoreLib::GenericMesh* mesh, bool meshIsClosed, unsigned resolution);
+
+	//! Returns a key identifying a set of light directions and their weights
+	static uint64_t RaysKey(const std::vector<CCVector3>& rays, const std::vector<double>& weights);
+
+	//! Returns a key identifying a set of light directions and their per-output weights ([output][ray])
+	static uint64_t RaysKey(const std::vector<CCVector3>& rays, const std::vector< std::vector<double> >& weights);
+
+	//! Returns the sidecar file of a sky-view factor
+	/** \param directory cache directory
+		\param geometryKey geometry key (see GeometryKey)
+		\param raysKey sky directions key (see RaysKey)
+	**/
+	static QString SkyViewFilename(const QString& directory, uint64_t geometryKey, uint64_t raysKey);
+
+	//! Loads a per-vertex sky-view factor
+	/** \param filename sidecar file (see SkyViewFilename)
+		\param geometryKey expected geometry key
+		\param raysKey expected sky directions key
+		\param[out] values sky-view factor (must already have the number of vertices)
+		\return whether the file exists and matches the geometry, the directions and the number of vertices
+	**/
+	static bool LoadSkyView(const QString& filename, uint64_t geometryKey, uint64_t raysKey, std::vector<ScalarType>& values);
+
+	//! Saves a per-vertex sky-view factor (see LoadSkyView)
+	static bool SaveSkyView(const QString& filename, uint64_t geometryKey, uint64_t raysKey, const std::vector<ScalarType>& values);
+
+	//! Returns the spherical harmonics visibility file of a geometry (see LoadHarmonics)
+	/** \param directory cache directory
+		\param geometryKey geometry key (see GeometryKey)
+		\param raysKey sampling directions key (see RaysKey)
+	**/
+	static QString HarmonicsFilename(const QString& directory, uint64_t geometryKey, uint64_t raysKey);
+
+	//! Loads per-vertex spherical harmonics visibility coefficients (see SOLIS::ProjectVisibility)
+	/** \param filename harmonics file
+		\param geometryKey expected geometry key
+		\param raysKey expected sampling directions key
+		\param order expected order
+		\param pointCount expected number of vertices
+		\param[out] coefficients coefficients (SOLISSky::HarmonicsCount(order) consecutive values per vertex)
+		\return whether the file exists and matches the keys, the order and the number of vertices
+	**/
+	static bool LoadHarmonics(const QString& filename, uint64_t geometryKey, uint64_t raysKey, unsigned order, size_t pointCount, std::vector<float>& coefficients);
+
+	//! Saves per-vertex spherical harmonics visibility coefficients (see LoadHarmonics)
+	static bool SaveHarmonics(const QString& filename, uint64_t geometryKey, uint64_t raysKey, unsigned order, const std::vector<float>& coefficients);
+
+	//! Returns the visibility matrix file of a geometry against a set of directions
+	/** \param directory cache directory
+		\param geometryKey geometry key (see GeometryKey)
+		\param directionsKey directions key (see RaysKey)
+	**/
+	static QString VisibilityMatrixFilename(const QString& directory, uint64_t geometryKey, uint64_t directionsKey);
+
+	//! Maps weighted light directions to the nearest directions of a fixed set
+	/** \param directions fixed set of directions (typically the ones of a visibility matrix)
+		\param rays light directions
+		\param weights per-output and per-ray weights ([output][ray])
+		\param[out] directionWeights per-output and per-direction summed weights ([output][direction])
+		\param[out] maxError maximum angle (in degrees) between a ray and its direction (optional)
+		\return success
+	**/
+	static bool MapToDirections(	const std::vector<CCVector3>& directions,
+									const std::vector<CCVector3>& rays,
+									const std::vector< std::vector<double> >& weights,
+									std::vector< std::vector<double> >& directionWeights,
+									double* maxError = nullptr);
+
+	//! Writes a visibility matrix file, one direction (column) at a time
+	/** Each column is the visibility of all the vertices for one direction, compressed as alternated
+		run lengths of hidden and visible vertices (LEB128 variable length integers). An offset table
+		gives direct access to each column.
+	**/
+	class VisibilityWriter
+	{
+	public:
+		//! Destructor (an unfinished file is removed)
+		~VisibilityWriter();
+
+		//! Creates the file
+		bool open(const QString& filename, uint64_t geometryKey, uint64_t directionsKey, size_t pointCount, const std::vector<CCVector3>& directions);
+
+		//! Appends the column of the next direction
+		/** \param visibilityMask per-vertex visibility bits (see SOLISContext::GLVisibilityMask)
+		**/
+		bool addColumn(const std::vector<uint64_t>& visibilityMask);
+
+		//! Writes the offset table and closes the file (all the columns must have been added)
+		bool close();
+
+	private:
+		FILE* m_file = nullptr;
+		QString m_filename;
+		size_t m_pointCount = 0;
+		std::vector<uint64_t> m_offsets;
+		size_t m_directionCount = 0;
+		std::vector<uint8_t> m_buffer;
+	};
+
+	//! Returns the fixed sun direction bin of a light direction
+	/** Bins don't depend on the simulated window: altitude bands of 'binSize' degrees, split in azimuth sectors
+		of about 'binSize' degrees (at the middle of the band), so that any window or timestep maps its sun
+		positions on the same bins.
+		\param ray light direction (pointing downward)
+		\param binSize bin size (degrees)
+		\param[out] center light direction of the center of the bin
+		\return bin key
+	**/
+	static uint64_t SunBin(const CCVector3& ray, double binSize, CCVector3& center);
+
+	//! Returns the sun bin store file of a geometry (see SunBinStore)
+	/** \param directory cache directory
+		\param geometryKey geometry key (see GeometryKey)
+		\param binSize bin size (degrees)
+	**/
+	static QString SunBinFilename(const QString& directory, uint64_t geometryKey, double binSize);
+
+	//! Extendable store of per-vertex visibility columns, one per sun direction bin (see SunBin)
+	/** Columns are appended as new bins are rendered (same encoding as the visibility matrix), so that a longer
+		window or a finer timestep only renders the bins that aren't covered yet. A truncated last column (e.g.
+		interrupted run) is dropped when the store is opened.
+	**/
+	class SunBinStore
+	{
+	public:
+		//! Destructor
+		~SunBinStore();
+
+		//! Opens (or creates) a store
+		/** \param[out] mismatch whether the file exists but doesn't match the keys, the number of vertices or the bin size (optional)
+			\return false if the file can't be opened or created, or if it doesn't match
+		**/
+		bool open(const QString& filename, uint64_t geometryKey, size_t pointCount, double binSize, bool* mismatch = nullptr);
+
+		//! Closes the file
+		void close();
+
+		//! Returns whether a bin has already been rendered
+		bool contains(uint64_t binKey) const { return m_index.find(binKey) != m_index.end(); }
+
+		//! Returns the number of stored bins
+		size_t size() const { return m_index.size(); }
+
+		//! Appends the column of a bin
+		/** \param binKey bin key (see SunBin)
+			\param visibilityMask per-vertex visibility bits (see SOLISContext::GLVisibilityMask)
+		**/
+		bool addColumn(uint64_t binKey, const std::vector<uint64_t>& visibilityMask);
+
+		//! Adds a weight to the vertices visible from a stored bin
+		bool accumulate(uint64_t binKey, double weight, std::vector<double>& sums);
+
+	private:
+		FILE* m_file = nullptr;
+		size_t m_pointCount = 0;
+		//! Column position and size of each bin
+		std::unordered_map< uint64_t, std::pair<uint64_t, uint64_t> > m_index;
+		std::vector<uint8_t> m_buffer;
+	};
+
+	//! Read-only, memory-mapped visibility matrix (see VisibilityWriter)
+	/** Results are weighted lookups over the matrix: no rendering (nor OpenGL context) is needed.
+	**/
+	class VisibilityMatrix
+	{
+	public:
+		//! Destructor
+		~VisibilityMatrix();
+
+		//! Maps a visibility matrix file
+		/** \return whether the file exists and matches the keys and the number of vertices
+		**/
+		bool open(const QString& filename, uint64_t geometryKey, uint64_t directionsKey, size_t pointCount);
+
+		//! Unmaps the file
+		void close();
+
+		//! Returns the directions (columns) of the matrix
+		const std::vector<CCVector3>& directions() const { return m_directions; }
+
+		//! Adds the weight of each direction to the vertices visible from it
+		/** Columns with a null weight are not even decoded.
+			\param weights weight of each direction
+			\param[in,out] sums per-vertex sums
+			\return success (false if the file is corrupted)
+		**/
+		bool accumulate(const std::vector<double>& weights, std::vector<double>& sums) const;
+
+	private:
+		QFile m_file;
+		const uint8_t* m_data = nullptr;
+		qint64 m_size = 0;
+		size_t m_pointCount = 0;
+		std::vector<CCVector3> m_directions;
+		const uint8_t* m_columns = nullptr;
+		std::vector<uint64_t> m_offsets;
+	};
+};
+
+#endif
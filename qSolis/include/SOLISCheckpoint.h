@@ -0,0 +1,117 @@
+//##########################################################################
+//#                                                                        #
+//#                       CLOUDCOMPARE PLUGIN: qSOLIS                      #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                  COPYRIGHT: David Basler                               #
+//#                                                                        #
+//##########################################################################
+
+#ifndef SOLIS_CHECKPOINT_HEADER
+#define SOLIS_CHECKPOINT_HEADER
+
+//Qt
+#include <QString>
+
+//System
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+//! Periodic snapshots of the accumulators of a SOLIS::Launch loop, to resume an interrupted run
+/** The accumulator buffers are registered once (addBuffer). Every 'interval' seconds, they are copied
+	to a snapshot written by a background thread (to a temporary file, then renamed), so that the render
+	loop only pays for the copy. A snapshot is skipped while the previous one is still being written.
+**/
+class SOLISCheckpoint
+{
+public:
+	//! Default constructor
+	/** \param filename checkpoint file (see Filename)
+		\param geometryKey geometry key (see SOLISCache::GeometryKey)
+		\param raysKey rays and weights key (see SOLISCache::RaysKey)
+		\param interval minimum time between two snapshots (seconds)
+	**/
+	SOLISCheckpoint(const QString& filename, uint64_t geometryKey, uint64_t raysKey, double interval);
+
+	//! Destructor (waits for the pending snapshot)
+	~SOLISCheckpoint();
+
+	//! Returns the checkpoint file of a run
+	/** \param directory checkpoint directory
+		\param geometryKey geometry key (see SOLISCache::GeometryKey)
+		\param raysKey rays and weights key (see SOLISCache::RaysKey)
+	**/
+	static QString Filename(const QString& directory, uint64_t geometryKey, uint64_t raysKey);
+
+	//! Registers an accumulator buffer (must be called before start, in the same order for each run)
+	void addBuffer(void* data, size_t size);
+
+	//! Registers an accumulator buffer (see above)
+	template <class T> void addBuffer(std::vector<T>& buffer)
+	{
+		if (!buffer.empty())
+			addBuffer(buffer.data(), buffer.size() * sizeof(T));
+	}
+
+	//! Starts a run (restoring the last snapshot if it matches)
+	/** \param rayCount number of rays of the run
+		\param options options changing the accumulators (precision, mode, etc.)
+		\param optionsKey key of the data changing the accumulators besides the geometry and the rays (e.g. SOLISHorizon::key)
+		\return index of the first ray to render (0 if there's no matching snapshot)
+	**/
+	size_t start(size_t rayCount, uint32_t options, uint64_t optionsKey = 0);
+
+	//! Snapshots the accumulators if the interval has elapsed (non blocking)
+	/** \param nextRay index of the next ray to render (all the previous ones being accumulated)
+		\return false if the snapshot couldn't be copied (not enough memory)
+	**/
+	bool update(size_t nextRay);
+
+	//! Snapshots the accumulators and waits until the file is written
+	/** \param nextRay index of the next ray to render (all the previous ones being accumulated)
+	**/
+	bool save(size_t nextRay);
+
+	//! Removes the checkpoint (the run is complete)
+	void remove();
+
+private:
+	//! Copies the buffers and writes them in the background
+	bool snapshot(size_t nextRay);
+
+	//! Waits for the pending snapshot
+	bool wait();
+
+	//! Reads a checkpoint file into the buffers
+	size_t load(const std::string& filename);
+
+	std::string m_filename;
+	uint64_t m_geometryKey;
+	uint64_t m_raysKey;
+	std::chrono::steady_clock::duration m_interval;
+	std::chrono::steady_clock::time_point m_lastSnapshot;
+	size_t m_rayCount = 0;
+	uint32_t m_options = 0;
+	uint64_t m_optionsKey = 0;
+
+	std::vector< std::pair<void*, size_t> > m_buffers;
+	std::vector<char> m_snapshot;
+	std::thread m_writer;
+	//! Whether the writer thread is still running (a finished writer is joined by the next snapshot)
+	std::atomic<bool> m_writing{ false };
+	bool m_writeSuccess = true;
+};
+
+#endif
@@ -26,6 +26,11 @@ class ccMainAppInterface;
 //qCC_db
 #include <ccHObject.h>
 
+//Qt
+#include <QStringList>
+
+#include "SOLIS.h"
+
 class SOLISCommand : public ccCommandLineInterface::Command
 {
 public:
@@ -33,6 +38,7 @@ public:
 
 	~SOLISCommand() override = default;
 
+	//! Computes the direct or diffuse irradiance of each candidate entity (see SOLIS::Launch)
 	static bool Process(	const ccHObject::Container& candidates,
 							const std::vector<CCVector3>& rays,
 							const std::vector<double>& irradiance,
@@ -41,7 +47,33 @@ public:
 							bool meshIsClosed,
 							unsigned resolution,
 							ccProgressDialog* progressDlg = nullptr,
-							ccMainAppInterface* app = nullptr);
+							ccMainAppInterface* app = nullptr,
+							SOLIS::AccumulatorPrecision precision = SOLIS::ACCUMULATOR_COMPACT);
+
+	//! Sums the partial results of all the shards of each entity and creates the corresponding fields
+	/** \param shardDirectory directory of the partial result files (see -SHARD)
+		\param[out] error error message (optional)
+		\param[out] runCount number of merged runs (e.g. direct and diffuse), over all the entities (optional)
+	**/
+	static bool MergeShards(	const ccHObject::Container& candidates,
+								const QString& shardDirectory,
+								ccMainAppInterface* app = nullptr,
+								QString* error = nullptr,
+								size_t* runCount = nullptr);
+
+	//! Returns whether all the entities already hold the given scalar fields
+	static bool HasFields(const ccHObject::Container& candidates, const QStringList& fieldNames);
+
+	bool process(ccCommandLineInterface& cmd) override;
+};
+
+//! Merges the partial results of a sharded SOLIS run (see SOLISShard)
+class SOLISMergeCommand : public ccCommandLineInterface::Command
+{
+public:
+	SOLISMergeCommand();
+
+	~SOLISMergeCommand() override = default;
 
 	bool process(ccCommandLineInterface& cmd) override;
 };
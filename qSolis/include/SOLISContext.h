@@ -23,6 +23,8 @@
 #include <GenericMesh.h>
 
 //system
+#include <cstdint>
+#include <functional>
 #include <vector>
 
 class QGLPixelBuffer;
@@ -56,16 +58,62 @@ class SOLISContext
 		//! Set the viewing directions
 		void setViewDirection(const CCVector3& V);
 
+		//! Restricts the visibility tests to a subset of the vertices (all the vertices by default)
+		/** The view is not changed: only the pixels covered by the projected bounding box of the subset are
+			cleared, rendered and read back (scissor test). The pixel grid and the depth range are the ones of the
+			full view, so the visibility of the subset is exactly the same as with a full view.
+			\param receiverMask per-vertex bits (64 vertices per word - must remain valid while in use), or nullptr for all the vertices
+			\return false if the subset is empty
+		**/
+		bool setReceivers(const std::vector<uint64_t>* receiverMask);
+
 		//! Increments the visibility counter for points viewed in the current pass (see setViewDirection)
 		/** \param visibilityCount per-vertex visibility count (same size as the number of vertices)
-			\return number of vertices seen during this pass
+			\return number of vertices seen during this pass (or -1 if an error occurred)
+		**/
+		int64_t GLAccumPixel(std::vector<uint16_t>& visibilityCount);
+		int64_t GLAccumPixel(std::vector<uint32_t>& visibilityCount);
+
+		//! Adds the current irradiance to the points viewed in the current pass (see setViewDirection)
+		/** \param visibilityCount per-vertex accumulated irradiance (same size as the number of vertices)
+			\param irradiance irradiance associated to the current view direction
+			\return number of vertices seen during this pass (or -1 if an error occurred)
+		**/
+		int64_t GLAccumPixelIrradiance(std::vector<double>& visibilityCount, double irradiance);
+
+		//! Same as above with a single precision accumulator (typically the output scalar field itself)
+		/** \param compensation optional per-vertex compensation terms (Kahan summation)
+		**/
+		int64_t GLAccumPixelIrradiance(std::vector<ScalarType>& visibilityCount, std::vector<ScalarType>* compensation, double irradiance);
+
+		//! Calls 'onVisible' with the index of each vertex seen in the current pass (see setViewDirection)
+		/** \param accumulatorSize size of the caller's per-vertex accumulator (must match the number of vertices)
+			\return number of vertices seen during this pass (or -1 if an error occurred)
 		**/
-		int GLAccumPixel(std::vector<int>& visibilityCount);
-		int GLAccumPixelIrradiance(std::vector<double>& visibilityCount, double irradiance);
+		int64_t GLForEachVisiblePoint(size_t accumulatorSize, const std::function<void(size_t)>& onVisible);
+
+		//! Sets the bit of each vertex seen in the current pass (see setViewDirection)
+		/** \param visibilityMask per-vertex visibility bits (64 vertices per word, cleared first)
+			\return number of vertices seen during this pass (or -1 if an error occurred)
+		**/
+		int64_t GLVisibilityMask(std::vector<uint64_t>& visibilityMask);
 
 	protected:
+		//! Renders the entity and calls 'onVisible' with the index of each vertex seen in the current pass
+		/** \param accumulatorSize size of the caller's per-vertex accumulator (must match the number of vertices)
+			\return number of vertices seen during this pass (or -1 if an error occurred)
+		**/
+		template <class VisibleFunc> int64_t GLVisitVisiblePoints(size_t accumulatorSize, VisibleFunc onVisible);
+
 		void glInit();
+		void setProjection(PointCoordinateType depth);
+		void loadViewMatrix();
 		void drawEntity();
+
+		//! Computes the pixels covered by the receivers in the current view (x, y, width, height)
+		/** \return false if no receiver can be seen in the current view
+		**/
+		bool receiversWindow(int window[4]);
 		void associateToEntity(CCCoreLib::GenericCloud* cloud, CCCoreLib::GenericMesh* mesh = nullptr);
 
 		//! Displayed entity (cloud or mesh vertices)
@@ -102,6 +150,12 @@ class SOLISContext
 
 		//! Whether displayed mesh is closed or not
 		bool m_meshIsClosed;
+
+		//! Vertices whose visibility is tested (all if null - see setReceivers)
+		const std::vector<uint64_t>* m_receivers;
+		//! Bounding box of the receivers (see setReceivers)
+		CCVector3 m_receiversMin;
+		CCVector3 m_receiversMax;
 };
 
 #endif
@@ -0,0 +1,163 @@
+//##########################################################################
+//#                                                                        #
+//#                       CLOUDCOMPARE PLUGIN: qSOLIS                      #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                  COPYRIGHT: David Basler                               #
+//#                                                                        #
+//##########################################################################
+
+#ifndef SOLIS_FILE_HEADER
+#define SOLIS_FILE_HEADER
+
+//CCCoreLib
+#include <CCGeom.h>
+#include <PointCloud.h>
+#include <ScalarField.h>
+#include <SimpleMesh.h>
+
+//Qt
+#include <QString>
+
+//System
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+//! Reading and writing of clouds and meshes without CloudCompare (used by the 'solis' command line tool)
+/** Supported formats (by extension):
+	- PLY (*.ply): ASCII, binary little or big endian. The 'x', 'y', 'z' vertex properties and the
+	  'vertex_indices' (or 'vertex_index') face lists are read (polygons are split in triangles),
+	  the other elements and properties are skipped.
+	- ASCII (*.xyz, *.txt, *.asc, *.csv, *.pts): one point per line, the first three numbers (space, tab,
+	  comma or semicolon separated) are the coordinates. Lines that don't start with a number are skipped.
+	- Binary (*.bin): consecutive little endian float32 'x y z' triplets, without header.
+**/
+class SOLISFile
+{
+public:
+	//! Loaded cloud or mesh
+	struct Geometry
+	{
+		std::unique_ptr<CCCoreLib::PointCloud> cloud;	//!< vertices (local coordinates)
+		std::unique_ptr<CCCoreLib::SimpleMesh> mesh;	//!< triangles (null for clouds)
+		CCVector3d shift;								//!< global coordinates = local coordinates + shift
+	};
+
+	//! Loads a cloud or a mesh
+	/** Large coordinates (e.g. projected coordinate systems) are shifted so that they keep their
+		precision in single precision (see Geometry::shift).
+		\param filename input file
+		\param[out] geometry loaded cloud (and mesh)
+		\param[out] error error message (optional)
+		\return success
+	**/
+	static bool Load(const QString& filename, Geometry& geometry, QString* error = nullptr);
+
+	//! Saves a cloud (or a mesh) with per-vertex scalar fields
+	/** PLY files are binary little endian, with double precision global coordinates, one float property per
+		field (named after the field) and the triangles of the mesh. ASCII files have a '//X Y Z <fields>' header
+		line and binary files are float32 'x y z <fields>' records.
+		\param filename output file
+		\param geometry cloud (and mesh)
+		\param fields per-vertex scalar fields
+		\param[out] error error message (optional)
+		\return success
+	**/
+	static bool Save(const QString& filename, const Geometry& geometry, const std::vector<CCCoreLib::ScalarField*>& fields, QString* error = nullptr);
+
+	//! Sequential reader of the points of a file, chunk by chunk (out-of-core processing)
+	/** Same formats as Load. Only the vertices are read (the faces of PLY files are ignored).
+		The shift is defined by the first point read and kept afterwards (including after rewind).
+	**/
+	class Reader
+	{
+	public:
+		Reader();
+		~Reader();
+
+		//! Opens a file (the header of PLY files is read)
+		bool open(const QString& filename, QString* error = nullptr);
+
+		//! Restarts reading from the first point
+		bool rewind(QString* error = nullptr);
+
+		//! Reads the next points
+		/** \param maxCount maximum number of points to read
+			\param[out] chunk points (local coordinates, see shift), empty at the end of the file
+			\param[out] error error message (optional)
+			\return success
+		**/
+		bool read(size_t maxCount, CCCoreLib::PointCloud& chunk, QString* error = nullptr);
+
+		//! Returns the shift (global coordinates = local coordinates + shift)
+		const CCVector3d& shift() const;
+
+		//! Closes the file
+		void close();
+
+	protected:
+		struct State;
+		std::unique_ptr<State> m_state;
+	};
+
+	//! Sequential writer of points with per-vertex scalar fields (see Save)
+	/** The points are written chunk by chunk (the point and triangle counts are declared at opening).
+	**/
+	class Writer
+	{
+	public:
+		~Writer();
+
+		//! Creates a file
+		/** \param filename output file
+			\param pointCount total number of points
+			\param triangleCount total number of triangles (PLY files only)
+			\param shift shift of the points (global coordinates = local coordinates + shift)
+			\param fieldNames names of the per-vertex scalar fields
+			\param[out] error error message (optional)
+			\return success
+		**/
+		bool open(	const QString& filename,
+					size_t pointCount,
+					size_t triangleCount,
+					const CCVector3d& shift,
+					const std::vector<QString>& fieldNames,
+					QString* error = nullptr);
+
+		//! Writes the next points and their scalar values (one field per name given to open)
+		bool write(const CCCoreLib::PointCloud& points, const std::vector<CCCoreLib::ScalarField*>& fields);
+
+		//! Writes the triangles (after all the points)
+		bool writeTriangles(CCCoreLib::GenericIndexedMesh& mesh);
+
+		//! Closes the file
+		/** \return success (false if the file was not complete or if an error occurred)
+		**/
+		bool close(QString* error = nullptr);
+
+	protected:
+		enum Format { PLY, BINARY, ASCII };
+
+		FILE* m_file = nullptr;
+		QString m_filename;
+		Format m_format = PLY;
+		CCVector3d m_shift;
+		size_t m_fieldCount = 0;
+		size_t m_pointCount = 0;
+		size_t m_triangleCount = 0;
+		size_t m_writtenPoints = 0;
+		size_t m_writtenTriangles = 0;
+		bool m_failed = false;
+	};
+};
+
+#endif
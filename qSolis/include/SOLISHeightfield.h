@@ -0,0 +1,134 @@
+//##########################################################################
+//#                                                                        #
+//#                       CLOUDCOMPARE PLUGIN: qSOLIS                      #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                  COPYRIGHT: David Basler                               #
+//#                                                                        #
+//##########################################################################
+
+#ifndef SOLIS_HEIGHTFIELD_HEADER
+#define SOLIS_HEIGHTFIELD_HEADER
+
+//CCCoreLib
+#include <CCGeom.h>
+#include <GenericCloud.h>
+
+//System
+#include <cstdint>
+#include <vector>
+
+//! 2.5D shadowing engine for gridded surface models (DSM), without OpenGL
+/** The vertices are rasterized on a regular grid (highest vertex of each cell). For a light direction,
+	the grid lines perpendicular to the main horizontal axis of the sun are swept away from the sun: the
+	shadow height of each cell is the highest occluder of the previous line (interpolated at the position
+	of the cell shifted toward the sun) minus the drop of the ray over one line. The cost is O(cells) per
+	direction, with a branch-free (vectorizable) inner loop along each line. Each vertex is then lit if it
+	is above the shadow height of its cell. Cells without any vertex and the outside of the grid are at the
+	height of the lowest occluder, so that they don't cancel the shadows of their neighbours.
+**/
+class SOLISHeightfield
+{
+public:
+	//! Per-thread buffers of visibilityMask
+	struct Workspace
+	{
+		std::vector<float> shadow;
+		std::vector<float> occluders;
+	};
+
+	//! Receivers located on the grid (see locate)
+	struct Receivers
+	{
+		std::vector<uint32_t> cells;	//!< cell of each receiver
+		std::vector<float> heights;		//!< height of each receiver
+	};
+
+	//! Rasterizes the vertices (the grid covers their bounding box)
+	/** \param vertices vertices (typically a gridded DSM loaded as a cloud or a mesh)
+		\param cellSize grid cell size (0 = estimated from the vertex density)
+		\return success
+	**/
+	bool init(CCCoreLib::GenericCloud* vertices, double cellSize = 0);
+
+	//! Creates an empty grid (occluders are then added with addOccluders, e.g. chunk by chunk)
+	/** \param bbMin minimum corner of the occluders bounding box
+		\param bbMax maximum corner of the occluders bounding box
+		\param cellSize grid cell size
+		\return success
+	**/
+	bool init(const CCVector3& bbMin, const CCVector3& bbMax, double cellSize);
+
+	//! Creates an empty grid from its origin and size (e.g. a tile aligned on a larger grid)
+	/** \param xMin X coordinate of the center of the first column
+		\param yMin Y coordinate of the center of the first row
+		\param columns number of columns
+		\param rows number of rows
+		\param cellSize grid cell size
+		\return success
+	**/
+	bool init(double xMin, double yMin, unsigned columns, unsigned rows, double cellSize);
+
+	//! Returns the cell size matching a regular grid of vertices (one vertex per grid node)
+	static double EstimateCellSize(const CCVector3& bbMin, const CCVector3& bbMax, size_t vertexCount);
+
+	//! Raises the cells to the height of the vertices they contain
+	void addOccluders(CCCoreLib::GenericCloud* vertices);
+
+	//! Raises a cell to the height of a vertex (ignored outside of the grid)
+	void addOccluder(const CCVector3& P);
+
+	//! Sets the height of the cells without any vertex and of the outside of the grid
+	/** By default, the lowest occluder. A grid covering only a part of the scene (e.g. a tile) must use the
+		lowest height of the whole scene, once its occluders are added, to get the same shadows as a grid of
+		the whole scene.
+	**/
+	void setBaseHeight(float height) { m_baseHeight = height; }
+
+	//! Returns the cell of a position (clamped to the grid)
+	uint32_t cell(const CCVector3& P) const;
+
+	//! Locates receivers on the grid
+	/** \param vertices receivers (inside the grid, the others are clamped to the border cells)
+		\param[out] receivers located receivers
+		\return success
+	**/
+	bool locate(CCCoreLib::GenericCloud* vertices, Receivers& receivers) const;
+
+	//! Returns the number of grid columns (along X)
+	unsigned columns() const { return m_nx; }
+	//! Returns the number of grid rows (along Y)
+	unsigned rows() const { return m_ny; }
+	//! Returns the cell size
+	double cellSize() const { return m_cellSize; }
+
+	//! Flags the receivers lit by a light direction (thread-safe)
+	/** \param ray light direction (pointing downward)
+		\param receivers located receivers
+		\param workspace per-thread buffers
+		\param[out] mask per-receiver visibility bits (64 receivers per word, same layout as SOLISContext::GLVisibilityMask)
+		\return number of lit receivers (or -1 if an error occurred)
+	**/
+	int64_t visibilityMask(const CCVector3& ray, const Receivers& receivers, Workspace& workspace, std::vector<uint64_t>& mask) const;
+
+private:
+	double m_cellSize = 0;
+	double m_xMin = 0;
+	double m_yMin = 0;
+	unsigned m_nx = 0;
+	unsigned m_ny = 0;
+	//! Highest vertex of each cell (row by row, lowest value if empty)
+	std::vector<float> m_heights;
+	//! Height of the empty cells and of the outside of the grid (see setBaseHeight)
+	float m_baseHeight = 0;
+};
+
+#endif
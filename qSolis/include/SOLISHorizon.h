@@ -0,0 +1,113 @@
+//##########################################################################
+//#                                                                        #
+//#                       CLOUDCOMPARE PLUGIN: qSOLIS                      #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                  COPYRIGHT: David Basler                               #
+//#                                                                        #
+//##########################################################################
+
+#ifndef SOLIS_HORIZON_HEADER
+#define SOLIS_HORIZON_HEADER
+
+//CCCoreLib
+#include <CCGeom.h>
+#include <GenericCloud.h>
+
+//Qt
+#include <QString>
+
+//System
+#include <cstdint>
+#include <vector>
+
+//! Far-field horizon of a scene, computed from a coarse elevation model
+/** Distant terrain (e.g. mountains around an alpine site) is not rendered: the horizon elevation seen
+	from each tile of the scene is precomputed by azimuth from a DEM, and light directions below it are
+	rejected by a table lookup. The DEM cells inside the footprint of the scene are ignored (the near
+	field is the rendered geometry).
+**/
+class SOLISHorizon
+{
+public:
+	//! Regular elevation grid
+	struct DEM
+	{
+		unsigned columns = 0;
+		unsigned rows = 0;
+		double xMin = 0;			//!< west edge of the grid
+		double yMax = 0;			//!< north edge of the grid
+		double cellSize = 0;
+		std::vector<float> heights;	//!< row by row, from the north-west corner (NaN = no data)
+
+		//! Returns the bilinearly interpolated height at a position (NaN outside the grid or without data)
+		double height(double x, double y) const;
+	};
+
+	//! Loads an ESRI ASCII grid (*.asc)
+	/** \param filename DEM file
+		\param[out] dem elevation grid
+		\param[out] error error message (optional)
+		\return success
+	**/
+	static bool LoadDEM(const QString& filename, DEM& dem, QString* error = nullptr);
+
+	//! Computes the horizon profile of each tile of a scene (parallel sweep)
+	/** Each profile is the maximum elevation angle of the DEM seen from the tile center along each azimuth,
+		corrected for the earth curvature and the atmospheric refraction. The observer height is the mean
+		height of the tile vertices.
+		\param dem elevation grid (same horizontal units and axes as the scene: X east, Y north)
+		\param vertices scene vertices
+		\param globalShift shift of the vertex coordinates (DEM coordinates = vertex / globalScale - globalShift)
+		\param globalScale scale of the vertex coordinates
+		\param tileSize tile size (same units as the DEM)
+		\param azimuthCount number of azimuths
+		\return success
+	**/
+	bool compute(	const DEM& dem,
+					CCCoreLib::GenericCloud* vertices,
+					const CCVector3d& globalShift,
+					double globalScale,
+					double tileSize,
+					unsigned azimuthCount = 360);
+
+	//! Returns the number of tiles
+	unsigned tileCount() const { return m_nx * m_ny; }
+
+	//! Returns the tile of a vertex
+	unsigned tileIndex(const CCVector3& P) const;
+
+	//! Returns the horizon elevation (degrees) of a tile toward an azimuth (degrees, clockwise from north)
+	double elevation(unsigned tile, double azimuth) const;
+
+	//! Returns whether the far-field horizon hides the sun for a tile
+	/** \param tile tile index
+		\param ray light direction (pointing downward)
+	**/
+	bool hides(unsigned tile, const CCVector3& ray) const;
+
+	//! Returns a key identifying the tiles and their profiles (i.e. the DEM contents seen from the scene and the tile size)
+	/** \return 0 if there's no tile
+	**/
+	uint64_t key() const;
+
+private:
+	CCVector3 m_bbMin;
+	double m_sx = 1.0;
+	double m_sy = 1.0;
+	unsigned m_nx = 0;
+	unsigned m_ny = 0;
+	unsigned m_azimuthCount = 0;
+	//! Horizon elevation (degrees) of each tile ([tile * azimuthCount + azimuth])
+	std::vector<float> m_profiles;
+};
+
+#endif
@@ -0,0 +1,193 @@
+//##########################################################################
+//#                                                                        #
+//#                       CLOUDCOMPARE PLUGIN: qSOLIS                      #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                  COPYRIGHT: David Basler                               #
+//#                                                                        #
+//##########################################################################
+
+#ifndef SOLIS_RUN_HEADER
+#define SOLIS_RUN_HEADER
+
+#include "SOLISHorizon.h"
+#include "SOLISSettings.h"
+
+//CCCoreLib
+#include <GenericMesh.h>
+#include <GenericProgressCallback.h>
+#include <ScalarField.h>
+
+//Qt
+#include <QString>
+#include <QStringList>
+
+//System
+#include <cstdint>
+#include <vector>
+
+constexpr char SOLIS_FIELD_LABEL_NAME_DIRECT[] = "direct_Irradiance";
+constexpr char SOLIS_FIELD_LABEL_NAME_DIFFUSE[] = "diffuse_Irradiance";
+constexpr char SOLIS_FIELD_LABEL_NAME_SUN_HOURS[] = "sun_hours";
+constexpr char SOLIS_FIELD_LABEL_NAME_FIRST_SUN[] = "first_sun";
+constexpr char SOLIS_FIELD_LABEL_NAME_LAST_SUN[] = "last_sun";
+constexpr char SOLIS_FIELD_LABEL_NAME_PEAK[] = "peak_irradiance";
+constexpr char SOLIS_FIELD_LABEL_NAME_SKY_VIEW[] = "sky_view_factor";
+
+//! A SOLIS run (see SOLISSettings), shared by the SOLIS command of CloudCompare and the headless 'solis' tool
+/** The front ends only gather the geometries and store the outputs:
+	- prepare loads the inputs shared by both components (weather files, far-field DEM)
+	- component generates the light directions and outputs of the direct or diffuse component
+	- launch computes a component on each geometry, with the engine selected by the settings
+	- report sums up the engine counters over all the geometries
+**/
+class SOLISRun
+{
+public:
+	//! Light directions of an irradiance component and the weights of its outputs
+	struct Component
+	{
+		bool direct = true;								//!< direct or diffuse component
+		std::vector<CCVector3> rays;					//!< light directions (empty for the sun path loops, see SOLISSettings::sunPathLoop)
+		std::vector< std::vector<double> > weights;		//!< per-output and per-ray weights ([output][ray])
+		QStringList fieldNames;							//!< name of the scalar field of each output
+		std::vector<double> rayDoys;					//!< timestamp of each ray (sun metrics only)
+		std::vector<double> solidAngles;				//!< solid angle of each ray (isotropic skies only, see -SVF_CACHE)
+		bool incremental = false;						//!< whether the previous results are updated (front ends clear it if they have none)
+		QString provenance;								//!< how the outputs are computed (engine and precision)
+
+		//engine data (see SOLISRun::component)
+		uint64_t raysKey = 0;							//!< rays and weights key (checkpoints, caches and shards)
+		std::vector<uint64_t> binKeys;					//!< sun bins of the rays (sun bin cache)
+		std::vector<CCVector3> binDirections;			//!< center of each bin (sun bin cache)
+		std::vector< std::vector<double> > binWeights;	//!< per-output weights of the bins, of the matrix directions or of the sky-view factor
+		std::vector< std::vector<double> > lighting;	//!< lighting coefficients of each output (spherical harmonics)
+		std::vector<double> maxValues;					//!< upper bound of each output (spherical harmonics)
+		double maxError = 0;							//!< maximum snapping angle of the rays (degrees)
+	};
+
+	//! Constructor
+	/** \param settings resolved settings (see SOLISSettings::resolve)
+	**/
+	explicit SOLISRun(const SOLISSettings& settings);
+
+	//! Returns the settings (the location may come from the first weather file, see prepare)
+	const SOLISSettings& settings() const { return m_settings; }
+
+	//! Returns the factor applied to the accumulated values
+	double conversion() const { return m_conversion; }
+
+	//! Loads the weather files and the far-field DEM, and generates the directions shared by both components
+	/** \param[out] messages information about the loaded inputs
+		\param[out] error error message (optional)
+	**/
+	bool prepare(QStringList& messages, QString* error = nullptr);
+
+	//! Returns a description of a component (location and time window)
+	QString description(bool direct) const;
+
+	//! Generates the light directions and the outputs of a component (and resets the counters, see report)
+	/** \param direct direct or diffuse component
+		\param[out] component light directions and outputs
+		\param[out] messages information about the generated directions
+		\param[out] error error message (optional)
+	**/
+	bool component(bool direct, Component& component, QStringList& messages, QString* error = nullptr);
+
+	//! Returns the names of the scalar fields computed by launch (empty for a shard: the partial results are saved in files)
+	QStringList outputNames(const Component& component) const;
+
+	//! Computes a component on a cloud (or a mesh)
+	/** \param component component (see component)
+		\param vertices vertices
+		\param mesh optional mesh structure associated to the vertices
+		\param outputs scalar fields (with as many values as vertices), one per output name (see outputNames)
+		\param globalShift shift of the vertex coordinates (far-field horizon only, see SOLISHorizon::compute)
+		\param globalScale scale of the vertex coordinates (far-field horizon only)
+		\param progressCb progress bar (optional)
+		\param entityName entity name (optional)
+		\param[out] warnings non fatal issues, e.g. a cache that couldn't be saved (optional)
+		\param[out] error error message (optional)
+		\return success
+	**/
+	bool launch(	const Component& component,
+					CCCoreLib::GenericCloud* vertices,
+					CCCoreLib::GenericMesh* mesh,
+					const std::vector<CCCoreLib::ScalarField*>& outputs,
+					const CCVector3d& globalShift,
+					double globalScale,
+					CCCoreLib::GenericProgressCallback* progressCb = nullptr,
+					const QString& entityName = QString(),
+					QStringList* warnings = nullptr,
+					QString* error = nullptr);
+
+	//! Sums up the counters of the engine over all the launches since the last call to component
+	/** \param[out] messages summary (e.g. cache hits or hidden rays)
+	**/
+	void report(const Component& component, QStringList& messages) const;
+
+private:
+	//! Computation engines
+	enum Engine
+	{
+		ENGINE_RENDER = 0,			//!< plain render loop (see SOLIS::Launch)
+		ENGINE_TILED_SUN_PATH,		//!< sun position varying across the scene (see SOLIS::LaunchTiledSunPath)
+		ENGINE_ADAPTIVE_SUN_PATH,	//!< adaptive sun path sampling (see SOLIS::LaunchAdaptiveSunPath)
+		ENGINE_HARMONICS,			//!< cached spherical harmonics visibility (see SOLIS::ProjectVisibility)
+		ENGINE_VISIBILITY_MATRIX,	//!< cached visibility matrix (see SOLISCache::VisibilityMatrix)
+		ENGINE_SUN_CACHE,			//!< extendable per-bin sun visibility (see SOLISCache::SunBinStore)
+		ENGINE_SKY_VIEW,			//!< cached sky-view factor (isotropic skies)
+		ENGINE_INCREMENTAL,			//!< update of previous results (see SOLIS::LaunchIncremental)
+		ENGINE_HEIGHTFIELD,			//!< 2.5D sweep (see SOLIS::LaunchHeightfield)
+		ENGINE_HORIZON,				//!< render loop with a far-field horizon (see SOLISHorizon)
+		ENGINE_SUN_METRICS,			//!< render loop with sunshine statistics (see SOLIS::SunStatistics)
+		ENGINE_SHARD				//!< slice of the render loop saved as partial results (see SOLISShard)
+	};
+
+	//! Returns the engine of a component
+	Engine engine(const Component& component) const;
+
+	//! Engine counters, summed over the launches (see report)
+	struct Counters
+	{
+		size_t launchCount = 0;		//!< number of launches
+		size_t renderCount = 0;		//!< number of renders (adaptive sampling, sun bin cache, shards)
+		size_t cacheHits = 0;		//!< number of geometries loaded from a cache
+		size_t rejectedCount = 0;	//!< number of rays hidden by the far-field horizon of every tile
+		size_t updatedCount = 0;	//!< number of re-evaluated vertices (incremental updates)
+		unsigned tileCount = 0;		//!< number of tiles of the last geometry
+		double haloSize = 0;		//!< halo width of the last geometry (heightfield tiles)
+	};
+
+	//! Settings
+	SOLISSettings m_settings;
+	//! Factor applied to the accumulated values
+	double m_conversion;
+	//! Far-field terrain
+	SOLISHorizon::DEM m_horizonDem;
+	//! Sun bin size (degrees, sun bin cache only)
+	double m_sunBinSize = 0;
+	//! Directions of the visibility matrix or of the harmonics projection
+	std::vector<CCVector3> m_visibilityDirections;
+	//! Solid angle of each visibility direction
+	std::vector<double> m_visibilitySolidAngles;
+	//! Weather-driven sun and sky (one output per weather file)
+	std::vector<CCVector3> m_weatherSunRays;
+	std::vector< std::vector<double> > m_weatherSunWeights;
+	std::vector<CCVector3> m_weatherSkyRays;
+	std::vector< std::vector<double> > m_weatherSkyWeights;
+	QStringList m_weatherDirectNames;
+	QStringList m_weatherDiffuseNames;
+	//! Engine counters
+	Counters m_counters;
+};
+
+#endif
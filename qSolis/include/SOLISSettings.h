@@ -0,0 +1,167 @@
+//##########################################################################
+//#                                                                        #
+//#                       CLOUDCOMPARE PLUGIN: qSOLIS                      #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                  COPYRIGHT: David Basler                               #
+//#                                                                        #
+//##########################################################################
+
+#ifndef SOLIS_SETTINGS_HEADER
+#define SOLIS_SETTINGS_HEADER
+
+#include "SOLIS.h"
+#include "SOLISSky.h"
+
+//CCCoreLib
+#include <CCGeom.h>
+
+//Qt
+#include <QString>
+#include <QStringList>
+
+//System
+#include <limits>
+
+//! Options of a SOLIS run (without the leading '-', case insensitive)
+constexpr char COMMAND_SOLIS_TYPE[] = "TYPE";
+constexpr char COMMAND_SOLIS_LAT[] = "LAT";
+constexpr char COMMAND_SOLIS_LON[] = "LON";
+constexpr char COMMAND_SOLIS_ELV[] = "ELV";
+constexpr char COMMAND_SOLIS_DOY[] = "DOY";
+constexpr char COMMAND_SOLIS_INT[] = "INT";
+constexpr char COMMAND_SOLIS_TS[] = "TS";
+constexpr char COMMAND_SOLIS_N_RAYS[] = "NRAYS";
+constexpr char COMMAND_SOLIS_IS_CLOSED[] = "IS_CLOSED";
+constexpr char COMMAND_SOLIS_RESOLUTION[] = "RESOLUTION";
+constexpr char COMMAND_SOLIS_PRECISION[] = "PRECISION";
+constexpr char COMMAND_SOLIS_SUN_BINNING[] = "SUN_BINNING";
+constexpr char COMMAND_SOLIS_WEATHER[] = "WEATHER";
+constexpr char COMMAND_SOLIS_ADAPTIVE[] = "ADAPTIVE";
+constexpr char COMMAND_SOLIS_ADAPTIVE_THRESHOLD[] = "ADAPTIVE_THRESHOLD";
+constexpr char COMMAND_SOLIS_SKY[] = "SKY";
+constexpr char COMMAND_SOLIS_SKY_MODEL[] = "SKY_MODEL";
+constexpr char COMMAND_SOLIS_DIFFUSE_SAMPLING[] = "DIFFUSE_SAMPLING";
+constexpr char COMMAND_SOLIS_PERIODS[] = "PERIODS";
+constexpr char COMMAND_SOLIS_SUN_METRICS[] = "SUN_METRICS";
+constexpr char COMMAND_SOLIS_TILE_SIZE[] = "TILE_SIZE";
+constexpr char COMMAND_SOLIS_SVF_CACHE[] = "SVF_CACHE";
+constexpr char COMMAND_SOLIS_VIS_MATRIX[] = "VIS_MATRIX";
+constexpr char COMMAND_SOLIS_SH_VISIBILITY[] = "SH_VISIBILITY";
+constexpr char COMMAND_SOLIS_SH_ORDER[] = "SH_ORDER";
+constexpr char COMMAND_SOLIS_INCREMENTAL[] = "INCREMENTAL";
+constexpr char COMMAND_SOLIS_SUN_CACHE[] = "SUN_CACHE";
+constexpr char COMMAND_SOLIS_RESUME[] = "RESUME";
+constexpr char COMMAND_SOLIS_CHECKPOINT_INTERVAL[] = "CHECKPOINT_INTERVAL";
+constexpr char COMMAND_SOLIS_HORIZON_DEM[] = "HORIZON_DEM";
+constexpr char COMMAND_SOLIS_HORIZON_TILE[] = "HORIZON_TILE";
+constexpr char COMMAND_SOLIS_HEIGHTFIELD[] = "HEIGHTFIELD";
+constexpr char COMMAND_SOLIS_HEIGHTFIELD_TILE[] = "HEIGHTFIELD_TILE";
+constexpr char COMMAND_SOLIS_SHARD[] = "SHARD";
+
+//! Settings of a SOLIS run, shared by the SOLIS command of CloudCompare and the headless 'solis' tool
+/** Both front ends fill the settings with parse (same options, values and error messages), then drop the
+	incompatible options with resolve before the run (see SOLISRun). Defaults match SOLIS::Launch.
+**/
+struct SOLISSettings
+{
+	//! Computed irradiance components (see -TYPE)
+	enum Components
+	{
+		COMPONENT_DIRECT = 1,
+		COMPONENT_DIFFUSE = 2,
+		COMPONENT_ALL = COMPONENT_DIRECT | COMPONENT_DIFFUSE
+	};
+
+	unsigned components = COMPONENT_ALL;									//!< computed components
+	double latitude = 45;													//!< latitude (degree N)
+	double longitude = 0;													//!< longitude (degree E)
+	double elevation = 0;													//!< elevation (m)
+	bool locationSet = false;												//!< whether -LAT or -LON was given (the location of the first weather file is used otherwise)
+	double doyFrom = 172.0;													//!< day of year, with fractional time (summer solstice)
+	double integration = 24;												//!< integration time (hours, negative for a single timepoint)
+	double timestep = 1;													//!< timestep of the sun positions (minutes)
+	unsigned rayCount = 256;												//!< number of diffuse directions
+	bool meshIsClosed = false;												//!< the mesh is watertight
+	unsigned resolution = 1024;												//!< OpenGL context resolution
+	SOLIS::AccumulatorPrecision precision = SOLIS::ACCUMULATOR_COMPACT;		//!< per-vertex accumulator precision
+	double binningTolerance = 0;											//!< sun-direction binning tolerance (degrees, 0 = no binning)
+	QStringList weatherFiles;												//!< weather files (one output per file)
+	double adaptiveStep = 0;												//!< coarse step of the adaptive sun path sampling (minutes, 0 = no adaptive sampling)
+	double adaptiveThreshold = 0.001;										//!< refinement threshold of the adaptive sampling
+	SOLISSky::Discretization skyScheme = SOLISSky::SKY_PARTSPHERE;			//!< sky discretization
+	bool skySet = false;													//!< whether -SKY was given
+	bool anisotropicSky = false;											//!< Perez sky instead of an isotropic one
+	SOLIS::DiffuseSampling diffuseSampling = SOLIS::DIFFUSE_UNIFORM;		//!< sampling density of the diffuse directions
+	SOLIS::PeriodBinning periods = SOLIS::PERIODS_NONE;						//!< additional per-period outputs
+	bool sunMetrics = false;												//!< sunshine statistics along with the direct irradiance
+	double tileSize = 0;													//!< size of the tiles with their own sun position (0 = single sun position)
+	QString skyViewCache;													//!< directory of the sky-view factor cache
+	QString visibilityMatrixCache;											//!< directory of the visibility matrices
+	QString harmonicsCache;													//!< directory of the spherical harmonics visibility
+	unsigned harmonicsOrder = 6;											//!< order of the spherical harmonics
+	bool incremental = false;												//!< whether the previous results are updated after a local edit
+	CCVector3 changedMin;													//!< minimum corner of the bounding box of the edit
+	CCVector3 changedMax;													//!< maximum corner of the bounding box of the edit
+	QString sunCache;														//!< directory of the sun bin stores
+	QString checkpointDirectory;											//!< directory of the checkpoints
+	double checkpointInterval = 10;											//!< minimum time between two checkpoints (minutes)
+	QString horizonFile;													//!< far-field DEM
+	double horizonTileSize = 200;											//!< size of the horizon tiles
+	double heightfieldCellSize = -1;										//!< cell size of the heightfield engine (0 = automatic, negative = OpenGL renders)
+	double heightfieldTileSize = -1;										//!< tile size of the heightfield engine (0 = automatic, negative = no tiles)
+	QString shardDirectory;													//!< directory of the partial results (empty = no ray sharding)
+	unsigned shardIndex = 0;												//!< shard index
+	unsigned shardCount = 1;												//!< number of shards
+
+	//! Reads the option at the front of the arguments (and its values)
+	/** \param arguments command line arguments (the option and its values are removed if it's recognized)
+		\param[out] recognized whether the first argument is a SOLIS option (it's left in place otherwise)
+		\param[out] error error message if a value is missing or invalid (optional)
+		\return false if a value is missing or invalid
+	**/
+	bool parse(QStringList& arguments, bool& recognized, QString* error = nullptr);
+
+	//! Applies the single timepoint mode (negative integration time) and drops the incompatible options
+	/** \param[out] warnings one message per dropped (or unused) option
+	**/
+	void resolve(QStringList& warnings);
+
+	//! Returns whether the direct component is computed
+	bool direct() const { return (components & COMPONENT_DIRECT) != 0; }
+
+	//! Returns whether the diffuse component is computed
+	bool diffuse() const { return (components & COMPONENT_DIFFUSE) != 0; }
+
+	//! Returns the end of the integration window (day of year)
+	double doyTo() const { return doyFrom + integration / 24.0; }
+
+	//! Returns whether the visibility is cached (-VIS_MATRIX or -SH_VISIBILITY)
+	bool cachedVisibility() const { return !visibilityMatrixCache.isEmpty() || !harmonicsCache.isEmpty(); }
+
+	//! Returns whether the direct component is computed with its own sun path loop (adaptive sampling, tiled sun positions or sun metrics)
+	bool sunPathLoop() const { return direct() && (adaptiveStep > 0 || tileSize > 0 || sunMetrics); }
+
+	//! Returns whether an argument is the given option ('-' followed by the option name, case insensitive)
+	static bool IsOption(const QString& argument, const char* option);
+
+	//! Reads the value following an option
+	/** \param what description of the expected value (for the error message)
+	**/
+	static bool TakeValue(QStringList& arguments, const char* option, QString& value, QString* error = nullptr, const char* what = "value");
+
+	//! Reads the number following an option
+	/** \param minimum smallest valid value
+	**/
+	static bool TakeNumber(QStringList& arguments, const char* option, double& number, QString* error = nullptr, double minimum = -std::numeric_limits<double>::max());
+};
+
+#endif
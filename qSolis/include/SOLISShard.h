@@ -0,0 +1,148 @@
+//##########################################################################
+//#                                                                        #
+//#                       CLOUDCOMPARE PLUGIN: qSOLIS                      #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                  COPYRIGHT: David Basler                               #
+//#                                                                        #
+//##########################################################################
+
+#ifndef SOLIS_SHARD_HEADER
+#define SOLIS_SHARD_HEADER
+
+//CCCoreLib
+#include <CCTypes.h>
+
+//Qt
+#include <QString>
+#include <QStringList>
+
+//System
+#include <cstdint>
+#include <vector>
+
+//! Partial results of a run split over several processes (ray sharding)
+/** Shard i of N renders the rays with a non-zero weight whose rank (among those rays) is i modulo N, and
+	keeps the raw per-vertex sums of their weights. The sums are 64 bits fixed-point integers (the scale
+	of each output only depends on the sum of its weights over all the rays), so that adding the shards
+	is exact: the merged result doesn't depend on the number of shards nor on the merge order.
+	Partial result files are named after the geometry and the rays (see Filename).
+**/
+class SOLISShard
+{
+public:
+	//! Parses a shard specification ('i/N', with 0 <= i < N)
+	static bool ParseSpec(const QString& spec, unsigned& index, unsigned& count);
+
+	//! Returns the partial result file of a shard
+	/** \param directory shard directory
+		\param geometryKey geometry key (see SOLISCache::GeometryKey, without rendering options)
+		\param raysKey rays and weights key (see SOLISCache::RaysKey)
+		\param index shard index
+		\param count number of shards
+	**/
+	static QString Filename(const QString& directory, uint64_t geometryKey, uint64_t raysKey, unsigned index, unsigned count);
+
+	//! Loads and merges all the partial result files of a geometry found in a directory
+	/** \param directory shard directory
+		\param geometryKey geometry key (see Filename)
+		\param pointCount expected number of vertices
+		\param[out] runs merged results, one per set of rays (e.g. direct and diffuse runs)
+		\param[out] error error message (optional)
+		\return success (false if a shard is missing or inconsistent with the others)
+	**/
+	static bool MergeAll(const QString& directory, uint64_t geometryKey, size_t pointCount, std::vector<SOLISShard>& runs, QString* error = nullptr);
+
+	//! Prepares the accumulators of a shard
+	/** \param index shard index
+		\param count number of shards
+		\param geometryKey geometry key (see Filename)
+		\param renderKey geometry and rendering options key (see SOLISCache::GeometryKey)
+		\param raysKey rays and weights key (see SOLISCache::RaysKey)
+		\param weights per-output and per-ray weights ([output][ray])
+		\param fieldNames name of the scalar field of each output
+		\param conversion factor applied to the merged sums
+		\param pointCount number of vertices
+		\return success
+	**/
+	bool init(	unsigned index,
+				unsigned count,
+				uint64_t geometryKey,
+				uint64_t renderKey,
+				uint64_t raysKey,
+				const std::vector< std::vector<double> >& weights,
+				const QStringList& fieldNames,
+				double conversion,
+				size_t pointCount);
+
+	//! Returns the rays rendered by this shard (see class description)
+	bool selectRays(std::vector<size_t>& rayIndexes) const;
+
+	//! Adds the weights of a ray to a vertex it illuminates
+	inline void add(size_t ray, size_t vertex)
+	{
+		for (size_t k = 0; k < m_sums.size(); ++k)
+			m_sums[k][vertex] += m_weights[k][ray];
+	}
+
+	//! Saves the partial results (of a single shard)
+	bool save(const QString& filename, QString* error = nullptr) const;
+
+	//! Loads partial results (see save)
+	bool load(const QString& filename, QString* error = nullptr);
+
+	//! Adds the partial results of another shard of the same run
+	bool merge(const SOLISShard& other, QString* error = nullptr);
+
+	//! Returns whether all the shards of the run have been merged
+	bool complete() const;
+
+	//! Converts the merged sums of an output (see SOLIS::Launch)
+	/** \param k output index
+		\param[out] values per-vertex values (must already have the number of vertices)
+	**/
+	void convert(size_t k, std::vector<ScalarType>& values) const;
+
+	//! Returns the number of outputs
+	size_t outputCount() const { return m_sums.size(); }
+	//! Returns the scalar field names of the outputs
+	const QStringList& fieldNames() const { return m_fieldNames; }
+	//! Returns the shard index
+	unsigned index() const { return m_index; }
+	//! Returns the number of shards
+	unsigned count() const { return m_count; }
+	//! Returns the number of rays of the run
+	size_t rayCount() const { return m_rayCount; }
+	//! Returns the rays and weights key
+	uint64_t raysKey() const { return m_raysKey; }
+
+private:
+	unsigned m_index = 0;
+	unsigned m_count = 1;
+	uint64_t m_geometryKey = 0;
+	uint64_t m_renderKey = 0;
+	uint64_t m_raysKey = 0;
+	size_t m_rayCount = 0;
+	size_t m_pointCount = 0;
+	double m_conversion = 1.0;
+	QStringList m_fieldNames;
+
+	//! Fixed-point scale of each output (value = sum * 2^-exponent)
+	std::vector<int32_t> m_exponents;
+	//! Fixed-point weights ([output][ray])
+	std::vector< std::vector<int64_t> > m_weights;
+	//! Per-vertex fixed-point sums ([output][vertex])
+	std::vector< std::vector<int64_t> > m_sums;
+	//! Shards already merged (one flag per shard)
+	std::vector<uint8_t> m_merged;
+};
+
+#endif
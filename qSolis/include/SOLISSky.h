@@ -0,0 +1,248 @@
+//##########################################################################
+//#                                                                        #
+//#                       CLOUDCOMPARE PLUGIN: qSOLIS                      #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                  COPYRIGHT: David Basler                               #
+//#                                                                        #
+//##########################################################################
+
+#ifndef SOLIS_SKY_HEADER
+#define SOLIS_SKY_HEADER
+
+#include "SOLISWeather.h"
+
+//CCCoreLib
+#include <CCGeom.h>
+
+//System
+#include <vector>
+
+//! Sky discretization and sky radiance distributions
+/** Light directions point from the sky to the scene (X = east, Y = north, Z = up),
+	as expected by SOLIS::Launch.
+**/
+class SOLISSky
+{
+public:
+	//! Sky discretization schemes
+	enum Discretization
+	{
+		SKY_PARTSPHERE = 0,	//!< Leopardi's equal area partition of the sphere (upper half)
+		SKY_TREGENZA,		//!< Tregenza patches (145)
+		SKY_REINHART,		//!< Reinhart subdivision of the Tregenza patches (144 * MF^2 + 1)
+		SKY_HEALPIX			//!< HEALPix equal area pixels (upper half, 6 * Nside^2 + 2 * Nside)
+	};
+
+	//! Returns the light direction corresponding to a sky position
+	/** \param altitude altitude above the horizon (degrees)
+		\param azimuth azimuth from due south, positive towards west (degrees, same convention as solrad's 'Azimuth')
+	**/
+	static CCVector3 Direction(double altitude, double azimuth);
+
+	//! Solar components of a series of timestamps (structure of arrays)
+	struct SolarSeries
+	{
+		std::vector<double> altitude;	//!< solar altitude (degrees)
+		std::vector<double> azimuth;	//!< solar azimuth (degrees, from due south, positive towards west)
+		std::vector<double> direct;		//!< clear-sky direct radiation on the horizontal plane (W/m2)
+		std::vector<double> diffuse;	//!< clear-sky diffuse radiation on the horizontal plane (W/m2)
+	};
+
+	//! Computes the solar components of a series of timestamps at once (see solrad's SolarComponents)
+	/** Each intermediate value is computed once per timestamp and large series are split across threads.
+		Values are identical to the ones of the scalar solrad functions (local solar time, no daylight saving).
+		\param doys timestamps (day of year)
+		\param lat latitude (degrees N)
+		\param lon longitude (degrees E)
+		\param elevation elevation (m)
+		\param[out] series solar components (same size as 'doys')
+		\param withRadiation whether to compute the direct and diffuse radiation (left empty otherwise)
+		\return success
+	**/
+	static bool ComputeSolarSeries(const std::vector<double>& doys, double lat, double lon, double elevation, SolarSeries& series, bool withRadiation = true);
+
+	//! Tregenza sky subdivision (145 patches)
+	/** 7 bands of 12 degrees (30, 30, 24, 24, 18, 12 and 6 patches) and a zenith cap.
+		\param[out] rays light direction of the center of each patch
+		\param[out] solidAngles solid angle of each patch (sr), they sum to 2*pi
+		\return success
+	**/
+	static bool TregenzaPatches(std::vector<CCVector3>& rays, std::vector<double>& solidAngles);
+
+	//! Returns the resolution of a scheme for a requested number of directions
+	/** \return the number of partition regions on the upper hemisphere (partsphere), the subdivision
+		factor MF (Reinhart) or Nside (HEALPix) giving at least 'count' directions, 1 for Tregenza
+	**/
+	static unsigned SkyResolution(Discretization scheme, unsigned count);
+
+	//! Sky discretization: light directions and solid angle of each direction
+	/** Sets are generated once per (scheme, resolution) and cached (a few sets at most). The solid angles are exact
+		(the area of each patch above the horizon) and sum to 2*pi, so that a diffuse integral is
+		a weighted sum over the directions even when the patches don't have the same size.
+		\param scheme discretization scheme
+		\param count requested number of directions (see SkyResolution, ignored by SKY_TREGENZA)
+		\param[out] rays light directions
+		\param[out] solidAngles solid angle of each direction (sr)
+		\return success
+	**/
+	static bool SkyDirections(Discretization scheme, unsigned count, std::vector<CCVector3>& rays, std::vector<double>& solidAngles);
+
+	//! Unweighted partsphere directions: the regions of Leopardi's partition whose center is above the horizon
+	/** Unlike SkyDirections(SKY_PARTSPHERE, ...), the regions cut by the horizon are not clipped: all the
+		directions have the same solid angle, so that a diffuse integral is their mean (legacy set of
+		SOLIS::GenerateDiffRays). Sets are cached as well.
+		\param count number of partition regions on the upper hemisphere
+		\param[out] rays light directions
+		\return success
+	**/
+	static bool PartsphereDirections(unsigned count, std::vector<CCVector3>& rays);
+
+	//! Number of (equal area) bands of the tabulation grid of sky distributions (see SkyGrid)
+	static const unsigned SKY_GRID_BANDS = 24;
+	//! Number of (equal area) sectors per band of the tabulation grid of sky distributions (see SkyGrid)
+	static const unsigned SKY_GRID_SECTORS = 96;
+
+	//! Tabulation grid of sky distributions
+	/** Cells are bounded by constant sin(altitude) and constant azimuth values, so that they all have the
+		same solid angle. Cell (band, sector) has index band * SKY_GRID_SECTORS + sector, band 0 being at
+		the horizon and sector 0 starting due east (counterclockwise).
+		\param[out] rays light direction of the center of each cell
+		\param[out] solidAngles solid angle of each cell (sr), they sum to 2*pi
+		\return success
+	**/
+	static bool SkyGrid(std::vector<CCVector3>& rays, std::vector<double>& solidAngles);
+
+	//! Draws light directions with a density proportional to a distribution tabulated on the sky grid
+	/** A low discrepancy (spherical Fibonacci) point set is warped by the inverse cumulative distribution of
+		'density', so that the directions remain stratified and each one carries the same share of the
+		distribution. Cells with a null density are never drawn.
+		\param count number of directions
+		\param density non-negative value of each cell of the sky grid (see SkyGrid)
+		\param[out] rays light directions
+		\param[out] cells sky grid cell of each direction
+		\return success
+	**/
+	static bool ImportanceDirections(unsigned count, const std::vector<double>& density, std::vector<CCVector3>& rays, std::vector<size_t>& cells);
+
+	//! Maximum order of the spherical harmonics (see HarmonicsBasis)
+	static const unsigned HARMONICS_MAX_ORDER = 12;
+
+	//! Returns the number of spherical harmonics coefficients up to a given order (see HarmonicsBasis)
+	static unsigned HarmonicsCount(unsigned order);
+
+	//! Evaluates the real spherical harmonics that are symmetric with respect to the horizon
+	/** Sky functions (visibility, radiance) are only defined above the horizon. They are mirrored below
+		it, so that the horizon isn't a discontinuity, and only the harmonics Y(l,m) with l + m even
+		(unchanged by the mirroring) are kept: (order + 1).(order + 2) / 2 coefficients instead of
+		(order + 1)^2. Coefficients are sorted by l, then by m.
+		\param ray light direction (pointing downward)
+		\param order maximum order l (at most HARMONICS_MAX_ORDER)
+		\param[out] values value of each harmonic (HarmonicsCount(order) values)
+	**/
+	static void HarmonicsBasis(const CCVector3& ray, unsigned order, double* values);
+
+	//! Projects weighted light directions on the spherical harmonics (see HarmonicsBasis)
+	/** The irradiance of a receiver whose visibility coefficients are V (see SOLIS::ProjectVisibility)
+		is then the dot product of V and of these coefficients.
+		\param rays light directions
+		\param weights weight (irradiance) of each direction
+		\param order maximum order l
+		\param[out] coefficients lighting coefficients
+		\return success
+	**/
+	static bool LightingHarmonics(const std::vector<CCVector3>& rays, const std::vector<double>& weights, unsigned order, std::vector<double>& coefficients);
+
+	//! Sky luminance distribution parameters (Perez / CIE general sky functional form)
+	/** Relative radiance = (1 + a.exp(b / cos(Z))) * (1 + c.(exp(d.X) - exp(d.pi/2)) + e.cos(X)^2),
+		with Z the zenith angle of the sky element and X its angle to the sun.
+	**/
+	struct SkyType
+	{
+		double a, b, c, d, e;
+	};
+
+	//! Returns one of the 15 CIE standard general skies (1 = overcast ... 12 = CIE clear sky ... 15)
+	static SkyType GeneralSkyType(unsigned type);
+
+	//! Selects a CIE general sky type from the Perez sky clearness of a record
+	/** \param directNormal direct normal irradiance (W/m2)
+		\param diffuseHorizontal diffuse horizontal irradiance (W/m2)
+		\param sunAltitude sun altitude (degrees)
+	**/
+	static unsigned SkyTypeFromClearness(double directNormal, double diffuseHorizontal, double sunAltitude);
+
+	//! Radiance of a sky element relative to the zenith
+	/** \param sky sky parameters
+		\param zenith zenith angle of the sky element (radians)
+		\param sunZenith zenith angle of the sun (radians)
+		\param sunAngle angle between the sky element and the sun (radians)
+	**/
+	static double RelativeRadiance(const SkyType& sky, double zenith, double sunZenith, double sunAngle);
+
+	//! Distributes the diffuse energy of one sky state over the sky directions (anisotropic sky)
+	/** The energy of each direction is proportional to its radiance times its solid angle, so that the
+		whole unobstructed sky still receives 'energy' (as with the isotropic distribution).
+		\param skyRays sky light directions (see SkyDirections)
+		\param solidAngles solid angle of each direction
+		\param sunAltitude sun altitude (degrees)
+		\param sunAzimuth sun azimuth (degrees, same convention as Direction)
+		\param directNormal direct normal irradiance (W/m2, selects the sky type)
+		\param diffuseHorizontal diffuse horizontal irradiance (W/m2, selects the sky type)
+		\param energy diffuse energy to distribute
+		\param[in,out] weights per-direction energy (incremented)
+	**/
+	static void AddSkyRadiance(	const std::vector<CCVector3>& skyRays,
+								const std::vector<double>& solidAngles,
+								double sunAltitude,
+								double sunAzimuth,
+								double directNormal,
+								double diffuseHorizontal,
+								double energy,
+								std::vector<double>& weights);
+
+	//! Builds the weighted light directions of the sky for measured irradiance series
+	/** Each record contributes:
+		- its direct normal irradiance to a sun ray (projected on the horizontal plane, as in the clear-sky mode)
+		- its diffuse horizontal irradiance to the sky patches (isotropic sky weighted by the patch solid angle,
+		  or anisotropic sky - see AddSkyRadiance)
+		Sun rays are shared by all series (one ray per distinct timestamp) and the patches are
+		shared by all records, so the number of renders doesn't depend on the number of series.
+		All the weights are energies (Wh/m2).
+		\param series irradiance series (e.g. several weather years for the same site)
+		\param doyFrom start of the integration period
+		\param doyTo end of the integration period
+		\param lat latitude (degrees N)
+		\param lon longitude (degrees E)
+		\param[out] sunRays sun light directions
+		\param[out] sunWeights direct energy per series and per sun ray ([series][ray])
+		\param[out] skyRays sky patch light directions
+		\param[out] skyWeights diffuse energy per series and per patch ([series][patch])
+		\param skyScheme sky discretization of the diffuse component (optional)
+		\param skyCount requested number of sky directions (optional, see SkyDirections)
+		\param anisotropic whether to use an anisotropic (Perez-type) sky for the diffuse component (optional)
+		\return success
+	**/
+	static bool WeatherSkyMatrix(	const std::vector< std::vector<SOLISWeather::Record> >& series,
+									double doyFrom,
+									double doyTo,
+									double lat,
+									double lon,
+									std::vector<CCVector3>& sunRays,
+									std::vector< std::vector<double> >& sunWeights,
+									std::vector<CCVector3>& skyRays,
+									std::vector< std::vector<double> >& skyWeights,
+									Discretization skyScheme = SKY_TREGENZA,
+									unsigned skyCount = 145,
+									bool anisotropic = false);
+};
+
+#endif
@@ -0,0 +1,67 @@
+//##########################################################################
+//#                                                                        #
+//#                       CLOUDCOMPARE PLUGIN: qSOLIS                      #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                  COPYRIGHT: David Basler                               #
+//#                                                                        #
+//##########################################################################
+
+#ifndef SOLIS_WEATHER_HEADER
+#define SOLIS_WEATHER_HEADER
+
+//Qt
+#include <QString>
+
+//System
+#include <vector>
+
+//! Measured irradiance time series (TMY/EPW weather files or plain CSV files)
+class SOLISWeather
+{
+public:
+	//! Irradiance record
+	struct Record
+	{
+		double doy;					//!< Day of year (with fractional time, local solar time) representative of the record
+		double duration;			//!< Duration of the record (hours)
+		double directNormal;		//!< Direct normal irradiance (W/m2)
+		double diffuseHorizontal;	//!< Diffuse horizontal irradiance (W/m2)
+	};
+
+	//! Site information (read from the EPW 'LOCATION' header)
+	struct Location
+	{
+		bool valid = false;
+		double latitude = 0;	//!< degree N
+		double longitude = 0;	//!< degree E
+		double timeZone = 0;	//!< hours from GMT
+		double elevation = 0;	//!< m
+	};
+
+	//! Loads an irradiance time series
+	/** Two formats are supported:
+		- EnergyPlus weather files (*.epw): hourly records in local standard time, converted to local
+		  solar time with the 'LOCATION' time zone and longitude. Missing values (9999) are set to 0.
+		- CSV files: one record per line with 'doy,dni,dhi' columns (comma, semicolon, tab or space
+		  separated, DOY in local solar time). Each record lasts until the next one. Lines that don't
+		  start with a number are skipped.
+		The file is parsed in a single streaming pass.
+		\param filename weather file
+		\param[out] records irradiance records (sorted by DOY)
+		\param[out] location site information (EPW only, optional)
+		\param[out] error error message (optional)
+		\return success
+	**/
+	static bool Load(const QString& filename, std::vector<Record>& records, Location* location = nullptr, QString* error = nullptr);
+};
+
+#endif
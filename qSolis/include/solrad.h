@@ -14,6 +14,7 @@
 #ifndef SOLRAD_H_
 #define SOLRAD_H_
 
+#include <stddef.h>
 #include <stdio.h>
 #include <math.h>
 
@@ -61,6 +62,9 @@ double OpenRadiation (double doy, double lat, double lon, double slon, double ds
 double DirectRadiation (double doy, double lat, double lon, double slon, double ds, double elevation, double slope, double aspect);
 // Solar Diffuse Radiation on a Surface
 double DiffuseRadiation (double doy, double lat, double lon, double slon, double ds, double elevation, double slope);
+// Solar Components of a series of timestamps (structure of arrays, outputs may be NULL)
+void SolarComponents (const double* doy, size_t n, double lat, double lon, double slon, double ds, double elevation, double slope, double aspect,
+                      double* declination, double* altitude, double* azimuth, double* direct, double* diffuse);
 
 #endif /* SOLRAD_H_ */
 
@@ -19,7 +19,11 @@
 //##########################################################################
 
 #include "SOLIS.h"
+#include "SOLISCache.h"
 #include "SOLISContext.h"
+#include "SOLISFile.h"
+#include "SOLISHeightfield.h"
+#include "SOLISSky.h"
 
 //Qt
 #include <QString>
@@ -31,8 +35,15 @@
 
 //System
 #include <algorithm>
+#include <atomic>
+#include <bitset>
 #include <cassert>
+#include <cstdint>
 #include <cstring>
+#include <limits>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
 
 #include <math.h>
 extern "C" {
@@ -42,223 +53,605 @@ extern "C" {
 
 using namespace CCCoreLib;
 
-static int gcd(int num1, int num2)
+//! Daylight interval of a given day (in day of year, local solar time)
+/** The interval is bounded with the Sunrise/Sunset hour angle, taking the longest day length between
+	the beginning and the end of the day (as the declination changes) and a small margin. The sun is
+	always below the horizon outside of it.
+	\param day day of year (integer part)
+	\param lat latitude
+	\param[out] from start of the interval
+	\param[out] to end of the interval
+**/
+static void DaylightInterval(double day, double lat, double& from, double& to)
 {
-	int remainder = (num2 % num1);
+	static const double c_marginDays = 10.0 / (24 * 60); //10 minutes
+
+	//same expression as solrad's Sunset (with the declination of both ends of the day)
+	double tanLat = tan(M_PI / 180.0 * lat);
+	double x = std::min(-tanLat * tan(M_PI / 180.0 * Declination(day)), -tanLat * tan(M_PI / 180.0 * Declination(day + 1.0)));
+	if (!(x > -1.0)) //polar day (or undefined)
+	{
+		from = day;
+		to = day + 1.0;
+		return;
+	}
+	double halfDay = 180.0 / M_PI * acos(std::min(x, 1.0)) / 15.0 / 24.0;
 
-	return (remainder != 0 ? gcd(remainder, num1) : num1);
+	//solar noon (null hour angle, see solrad's HourAngle with slon = lon)
+	double noon = day + (12 * 60.0 - EOT(day + 0.5)) / (24 * 60);
+
+	from = noon - halfDay - c_marginDays;
+	to = noon + halfDay + c_marginDays;
 }
 
-//! Sample points on the unit sphere
-/** Transcripted from MATLAB's script "partsphere.m" by Paul Leopardi,
-	2003-10-13, for UNSW School of Mathematics.
+//! Ranges [first, last) of the timesteps 'doyFrom + i * stepDays' (i < stepCount) during which the sun may be above the horizon
+static void DaylightSteps(double doyFrom, double stepDays, size_t stepCount, double lat, std::vector< std::pair<size_t, size_t> >& ranges)
+{
+	ranges.clear();
+	if (stepCount == 0 || stepDays <= 0)
+		return;
+
+	double doyTo = doyFrom + (stepCount - 1) * stepDays;
+	for (double day = floor(doyFrom); day <= doyTo; day += 1.0)
+	{
+		double from = 0;
+		double to = 0;
+		DaylightInterval(day, lat, from, to);
+
+		double first = std::max(ceil((from - doyFrom) / stepDays), 0.0);
+		double last = std::min(floor((to - doyFrom) / stepDays) + 1.0, static_cast<double>(stepCount));
+		if (first >= last)
+			continue;
+
+		std::pair<size_t, size_t> range(static_cast<size_t>(first), static_cast<size_t>(last));
+		if (!ranges.empty() && range.first <= ranges.back().second)
+			ranges.back().second = std::max(ranges.back().second, range.second); //overlapping days (polar regions)
+		else
+			ranges.push_back(range);
+	}
+}
 
-	As points are sampled on the unit sphere, they can also
-	be considered as directions.
-	WARNING: returned array is on the user responsibilty!
+//! Adaptive Simpson quadrature (recursive step)
+template <class Func> static double AdaptiveSimpson(const Func& f, double a, double b, double fa, double fm, double fb, double whole, double eps, int depth)
+{
+	double m = (a + b) / 2;
+	double lm = (a + m) / 2;
+	double rm = (m + b) / 2;
+	double flm = f(lm);
+	double frm = f(rm);
+	double left = (m - a) / 6 * (fa + 4 * flm + fm);
+	double right = (b - m) / 6 * (fm + 4 * frm + fb);
+	double delta = left + right - whole;
+	if (depth <= 0 || fabs(delta) <= 15 * eps)
+	{
+		return left + right + delta / 15;
+	}
+	return	AdaptiveSimpson(f, a, m, fa, flm, fm, left, eps / 2, depth - 1)
+		+	AdaptiveSimpson(f, m, b, fm, frm, fb, right, eps / 2, depth - 1);
+}
 
-	\param N number of desired sampled directions
-	\param[out] dirs set of N points
-	\return success
+//! Integrates a smooth function over [a, b] with the adaptive Simpson rule
+/** \param relativeEps tolerance relative to the magnitude of the integral
 **/
-static bool SampleSphere(unsigned N, std::vector<CCVector3>& dirs)
+template <class Func> static double IntegrateAdaptive(const Func& f, double a, double b, double relativeEps)
 {
-	static const double c_eps = 2.2204e-16;
-	static const double c_twist = 4.0;
+	static const int c_panels = 8; //the initial panels must not miss the (narrow) daylight bumps
+	static const int c_maxDepth = 24;
 
-	if (N == 0)
+	if (b <= a)
+		return 0;
+
+	double h = (b - a) / c_panels;
+	double scale = 0;
+	std::vector<double> fx(2 * c_panels + 1);
+	for (int i = 0; i <= 2 * c_panels; ++i)
 	{
-		assert(false);
-		return false;
+		fx[i] = f(a + i * h / 2);
+		scale = std::max(scale, fabs(fx[i]));
 	}
+	double eps = std::max(relativeEps * scale * (b - a), std::numeric_limits<double>::min());
 
-	try
+	double sum = 0;
+	for (int i = 0; i < c_panels; ++i)
 	{
-		dirs.resize(N, CCVector3(0, 0, 1));
+		double pa = a + i * h;
+		double whole = h / 6 * (fx[2 * i] + 4 * fx[2 * i + 1] + fx[2 * i + 2]);
+		sum += AdaptiveSimpson(f, pa, pa + h, fx[2 * i], fx[2 * i + 1], fx[2 * i + 2], whole, eps / c_panels, c_maxDepth);
 	}
-	catch (const std::bad_alloc&)
+	return sum;
+}
+
+//! Integrates the clear-sky diffuse irradiance over [doyFrom, doyTo] (W/m2 x days)
+static double DiffuseIntegral(double doyFrom, double doyTo, double lat, double lon, double elevation)
+{
+	static const double c_relativeEps = 1.0e-7;
+
+	auto diffuse = [&](double doy) { return DiffuseRadiation (doy, lat, lon, lon, 0, elevation, 0); };
+
+	double irad=0;
+	for (double day = floor(doyFrom); day < doyTo; day += 1.0)
 	{
-		//not enough memory
-		return false;
+		double from = 0;
+		double to = 0;
+		DaylightInterval(day, lat, from, to);
+		from = std::max(from, doyFrom);
+		to = std::min(to, doyTo);
+		//the intervals of consecutive days may overlap in polar regions
+		from = std::max(from, day);
+		to = std::min(to, day + 1.0);
+		irad += IntegrateAdaptive(diffuse, from, to, c_relativeEps);
 	}
+	return irad;
+}
+
+// Caluclate Sum of diff irradiance over selected time
+/** The diffuse irradiance is smooth: instead of summing it at every timestep, it is integrated with an
+	adaptive quadrature over the daylight interval of each day. The result is expressed as the equivalent
+	sum over the timesteps (integral / timestep) so that callers can keep using the same conversion factor.
+**/
+double SOLIS::totalDiffIrradiance (double doyFrom,double doyTo,double timestep,double lat,double lon,double elevation){
+	double stepDays = timestep/60/24;
+	if (stepDays <= 0)
+		return 0;
+	size_t count = static_cast<size_t>( floor( (doyTo-doyFrom)/stepDays ) ); // Max number of timepoints
+	double end = doyFrom + count*stepDays;
+
+	return (DiffuseIntegral(doyFrom, end, lat, lon, elevation) / stepDays);
+}
 
-	if (N == 1)
+bool SOLIS::GenerateDiffRays(	unsigned numberOfRays,
+								DiffuseSampling sampling,
+								const std::vector<double>& skyEnergy,
+								std::vector<CCVector3>& rays,
+								std::vector<double>& weights)
+{
+	std::vector<CCVector3> cellRays;
+	std::vector<double> cellSolidAngles;
+	if (numberOfRays == 0 || !SOLISSky::SkyGrid(cellRays, cellSolidAngles) || skyEnergy.size() != cellRays.size())
 	{
-		return true;
+		return false;
 	}
 
+	//sampling density of each grid cell
+	std::vector<double> density;
 	try
 	{
-		double area = (4 * M_PI) / N;
-		double beta = acos(1.0 - 2.0 / N); //return in [0,pi/2] as '1-2/N' goes from 0 to 1 when N --> inf
-		double gamma = M_PI - 2 * beta; //in [0,pi]
-		double fuzz = c_eps * 2 * N;
-
-		int Ltemp = static_cast<int>(ceil(gamma / sqrt(area) - fuzz));
-		int L = 2 + std::max(Ltemp, 1);
-
-		//init mbar
-		std::vector<double> mbar;
-		mbar.resize(L, 0);
-		assert(L >= 3);
+		switch (sampling)
 		{
-			mbar[0] = 1.0;
-			double theta = gamma / (L - 2);
-			for (int i = 1; i < L - 1; ++i)
+		case DIFFUSE_COSINE:
+			density.resize(cellRays.size());
+			for (size_t c = 0; c < cellRays.size(); ++c)
 			{
-				mbar[i] = N * (cos(theta * (i - 1) + beta) - cos(theta * i + beta)) / 2;
+				density[c] = -cellRays[c].z * cellSolidAngles[c];
 			}
-			mbar[L - 1] = 1.0;
+			break;
+		case DIFFUSE_SKY:
+			density = skyEnergy;
+			break;
+		case DIFFUSE_UNIFORM:
+		default:
+			density = cellSolidAngles;
+			break;
 		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		return false;
+	}
 
-		//init m
-		std::vector<int> m;
-		m.resize(L, 0);
-		{
-			m[0] = 1;
-
-			double alpha = 0.0;
-			for (int i = 1; i < L; ++i)
-			{
-				double f = floor(mbar[i] + alpha + fuzz);
-				if ((mbar[i] - f) >= 0.5)
-					f = ceil(mbar[i] + alpha - fuzz);
-				m[i] = static_cast<int>(f);
-
-				alpha += mbar[i] - m[i];
-			}
-		}
+	std::vector<size_t> cells;
+	if (!SOLISSky::ImportanceDirections(numberOfRays, density, rays, cells))
+	{
+		return false;
+	}
 
-		//now we can build the rays
-		{
-			std::vector<double> offset;
-			offset.resize(L - 1, 0);
+	double densitySum = 0;
+	for (double d : density)
+	{
+		densitySum += std::max(d, 0.0);
+	}
 
-			double z = 1.0 - static_cast<double>(2 + m[1]) / N;
+	try
+	{
+		weights.resize(rays.size());
+	}
+	catch (const std::bad_alloc&)
+	{
+		return false;
+	}
+	for (size_t i = 0; i < rays.size(); ++i)
+	{
+		//energy / (probability * count)
+		weights[i] = skyEnergy[cells[i]] * densitySum / (density[cells[i]] * rays.size());
+	}
 
-			unsigned int rayIndex = 1; //the first one is already (0,0,1)
-			for (int i = 1; i < L - 1; ++i)
-			{
-				if (m[i - 1] != 0 && m[i] != 0)
-				{
-					offset[i] = offset[i - 1]
-						+ static_cast<double>(gcd(m[i], m[i - 1])) / (2 * m[i] * m[i - 1])
-						+ std::min<double>(c_twist, floor(m[i - 1] / c_twist)) / m[i - 1];
-				}
-				else
-				{
-					offset[i] = 0.0;
-				}
+	return true;
+}
 
-				double temp = static_cast<double>(m[i]) / N;
+/** The sky distribution changes slowly: it is sampled every 10 minutes (at most) and each sample stands for
+	the skipped timesteps. The weights are finally rescaled to the (accurately integrated) total diffuse irradiance.
+**/
+bool SOLIS::AnisotropicDiffuseWeights(	double doyFrom,
+										double doyTo,
+										double timestep,
+										double lat,
+										double lon,
+										double elevation,
+										const std::vector<CCVector3>& rays,
+										const std::vector<double>& solidAngles,
+										std::vector<double>& weights)
+{
+	static const double c_skyStep = 10.0; //minutes
 
-				double h = cos((acos(z + temp) + acos(z - temp)) / 2);
-				double r = sqrt(1.0 - h*h);
+	if (timestep <= 0 || rays.size() != solidAngles.size())
+		return false;
 
-				for (int j = 0; j < m[i]; ++j)
-				{
-					double theta = 2.0*M_PI * (offset[i] + static_cast<double>(j) / m[i]);
+	double stepDays = timestep/60/24;
+	size_t stepCount = static_cast<size_t>( floor( (doyTo-doyFrom)/stepDays ) );
+	size_t stride = std::max<size_t>(1, static_cast<size_t>(floor(c_skyStep / timestep)));
 
-					dirs[rayIndex++] = CCVector3(static_cast<PointCoordinateType>(r*cos(theta)),
-						static_cast<PointCoordinateType>(r*sin(theta)),
-						static_cast<PointCoordinateType>(h));
-				}
+	std::vector< std::pair<size_t, size_t> > daylight;
+	DaylightSteps(doyFrom, stepDays, stepCount, lat, daylight);
 
-				z -= static_cast<double>(m[i] + m[i + 1]) / N;
+	std::vector<double> doys;
+	std::vector<double> counts; //number of timesteps represented by each sample
+	try
+	{
+		weights.assign(rays.size(), 0.0);
+		for (const std::pair<size_t, size_t>& range : daylight)
+		{
+			for (size_t i = range.first; i < range.second; i += stride)
+			{
+				doys.push_back(doyFrom + i*stepDays);
+				counts.push_back(static_cast<double>(std::min(stride, range.second - i)));
 			}
-
-			assert(rayIndex + 1 == N);
 		}
 	}
 	catch (const std::bad_alloc&)
 	{
-		//not enough memory
 		return false;
 	}
 
-	dirs[N - 1] = CCVector3(0, 0, -1);
+	SOLISSky::SolarSeries sun;
+	if (!SOLISSky::ComputeSolarSeries(doys, lat, lon, elevation, sun))
+	{
+		return false;
+	}
 
-	return true;
-}
+	for (size_t i = 0; i < doys.size(); ++i)
+	{
+		double alt = sun.altitude[i];
+		if (alt <= 0 || sun.diffuse[i] <= 0)
+			continue;
 
-// Caluclate Sum of diff irradiance over selected time
-double SOLIS::totalDiffIrradiance (double doyFrom,double doyTo,double timestep,double lat,double lon,double elevation){
-	double irad=0;
-	unsigned count = (unsigned) floor( (doyTo-doyFrom)/(timestep/24/60) ); // Max number of timepoints
-	for (size_t i = 0; i < count; ++i)
-		{
-			irad += DiffuseRadiation (doyFrom + i*timestep/60/24, lat, lon, lon, 0, elevation, 0);
-		}
-	return (irad);
-}
+		//the direct component is given on the horizontal plane
+		double directNormal = sun.direct[i] / sin(alt * (M_PI / 180.0));
+		SOLISSky::AddSkyRadiance(rays, solidAngles, alt, sun.azimuth[i], directNormal, sun.diffuse[i], sun.diffuse[i] * counts[i], weights);
+	}
 
-// This function is the same as in PCV::GenerateRays and used to estimate diffuse irradiance: We calulate PCV and multiply with daily sum of diffusive radiation
-bool SOLIS::GenerateDiffRays(unsigned numberOfRays, std::vector<CCVector3>& rays)
-{		
-	//generates light directions
-	unsigned rayCount = numberOfRays*2; 
-	if (!SampleSphere(rayCount, rays))
+	double sum = 0;
+	double skyFraction = 0;
+	for (size_t p = 0; p < rays.size(); ++p)
 	{
-		return false;
+		sum += weights[p];
+		skyFraction += solidAngles[p] / (2 * M_PI);
 	}
-	//we keep only the light directions that meets input parameters (non predictible if not in 360 mode!) 
-	unsigned lastIndex = 0;
-	for (size_t i = 0; i < rays.size(); ++i)
+
+	if (sum > 0)
 	{
-		if (rays[i].z < 0)
+		double scale = totalDiffIrradiance(doyFrom, doyTo, timestep, lat, lon, elevation) * skyFraction / sum;
+		for (double& w : weights)
 		{
-			if (lastIndex != i)
-			{
-				rays[lastIndex] = rays[i];
-			}
-			++lastIndex;
+			w *= scale;
 		}
 	}
-	rayCount = lastIndex;
-	rays.resize(rayCount);
+
 	return true;
 }
 
+// This function is the same as in PCV::GenerateRays and used to estimate diffuse irradiance: We calulate PCV and multiply with daily sum of diffusive radiation
+/** The regions of Leopardi's partition whose center is above the horizon are used, all with the same weight
+	(see SOLISSky::PartsphereDirections).
+**/
+bool SOLIS::GenerateDiffRays(unsigned numberOfRays, std::vector<CCVector3>& rays)
+{		
+	return SOLISSky::PartsphereDirections(numberOfRays, rays);
+}
+
 //This function is the same as in PCV and used to DIFFUSE Irradiance: We calulate PCV and multiply with dayly sum of diffusive radiation (REMOVED MODE360)
-bool SOLIS::GenerateSunRays( double doyFrom,double doyTo,double timestep,double lat,double lon,double elevation, std::vector<CCVector3>& rays, std::vector<double>& irradiance)
+bool SOLIS::GenerateSunRays( double doyFrom,double doyTo,double timestep,double lat,double lon,double elevation, std::vector<CCVector3>& rays, std::vector<double>& irradiance, std::vector<double>* rayDoys/*=nullptr*/)
 {		
 	    // SOLIS MODIFICATION: Calculate normals based on sun position, add direct radiation walues in W
-		unsigned rayCount = (unsigned) floor( (doyTo-doyFrom)/(timestep/24/60) ); // Max number of Rays
+		size_t rayCount = static_cast<size_t>( floor( (doyTo-doyFrom)/(timestep/24/60) ) ); // Max number of Rays
+     	//we keep only the light directions BETWEEN SUNRISE AND SUNSET (nights are skipped)
+		std::vector< std::pair<size_t, size_t> > daylight;
+		DaylightSteps(doyFrom, timestep/24/60, rayCount, lat, daylight);
+		std::vector<double> doys;
+		SOLISSky::SolarSeries sun;
 		try
 		{
-			rays.resize(rayCount);
-			irradiance.resize(rayCount);
+			for (const std::pair<size_t, size_t>& range : daylight)
+			{
+				for (size_t i = range.first; i < range.second; ++i)
+				{
+					doys.push_back(doyFrom + i*(timestep/24/60));
+				}
+			}
+			rays.resize(doys.size());
+			irradiance.resize(doys.size());
+		}
+		catch (const std::bad_alloc&)
+		{
+			return false;
 		}
-		catch (std::bad_alloc)
+		//all the sun positions and radiation values are computed at once
+		if (!SOLISSky::ComputeSolarSeries(doys, lat, lon, elevation, sun))
 		{
 			return false;
 		}
 		//we keep only the light directions with positive Altitude
-		unsigned lastIndex=0;
-		double doy,alt,azm,irad;
-     	//we keep only the light directions BETWEEN SUNRISE AND SUNSET
-		for (size_t i = 0; i < rayCount; ++i)
+		size_t lastIndex=0;
+		for (size_t i = 0; i < doys.size(); ++i)
 		{
-			doy = doyFrom + i*(timestep/24/60);
-			alt = Altitude (doy, lat, lon, lon, 0);
-			azm = Azimuth  (doy, lat, lon, lon, 0);
-			irad = DirectRadiation  ( doy, lat, lon, lon, 0, elevation, 0, 0);
-			if (alt > 0)
+			if (sun.altitude[i] > 0)
 			{
 				//Calculate Sun Rays:
-				rays[lastIndex] =  CCVector3(static_cast<PointCoordinateType> (  sin(azm*(M_PI/180.0))),
-						                     static_cast<PointCoordinateType> (  cos(azm*(M_PI/180.0))),
-						                     static_cast<PointCoordinateType> ( - sin(alt*(M_PI/180.0)))
-											 );
-				irradiance[lastIndex] = irad;
+				rays[lastIndex] = SOLISSky::Direction(sun.altitude[i], sun.azimuth[i]);
+				irradiance[lastIndex] = sun.direct[i];
+				if (rayDoys)
+				{
+					doys[lastIndex] = doys[i];
+				}
 				++lastIndex;
 			}
 		}
 		rays.resize(lastIndex);
 		irradiance.resize(lastIndex);
+		if (rayDoys)
+		{
+			doys.resize(lastIndex);
+			rayDoys->swap(doys);
+		}
 		return true;	
 }
 
+unsigned SOLIS::PeriodCount(PeriodBinning binning)
+{
+	switch (binning)
+	{
+	case PERIODS_MONTH:
+		return 12;
+	case PERIODS_HOUR:
+		return 24;
+	case PERIODS_NONE:
+	default:
+		return 0;
+	}
+}
+
+int SOLIS::PeriodIndex(PeriodBinning binning, double doy)
+{
+	//first day of each month (non leap year)
+	static const int c_monthStart[13] = { 1, 32, 60, 91, 121, 152, 182, 213, 244, 274, 305, 335, 366 };
+
+	switch (binning)
+	{
+	case PERIODS_MONTH:
+	{
+		int day = static_cast<int>(floor(fmod(doy - 1.0, 365.0))) + 1;
+		if (day < 1)
+			day += 365;
+		int month = 0;
+		while (month < 11 && day >= c_monthStart[month + 1])
+			++month;
+		return month;
+	}
+	case PERIODS_HOUR:
+	{
+		double dayFraction = doy - floor(doy);
+		return std::min(static_cast<int>(floor(dayFraction * 24)), 23);
+	}
+	case PERIODS_NONE:
+	default:
+		return -1;
+	}
+}
+
+QString SOLIS::PeriodLabel(PeriodBinning binning, unsigned index)
+{
+	switch (binning)
+	{
+	case PERIODS_MONTH:
+		return QString("M%1").arg(index + 1, 2, 10, QChar('0'));
+	case PERIODS_HOUR:
+		return QString("H%1").arg(index, 2, 10, QChar('0'));
+	case PERIODS_NONE:
+	default:
+		return QString();
+	}
+}
+
+bool SOLIS::BinByPeriod(PeriodBinning binning, const std::vector<double>& doys, const std::vector<double>& irradiance, std::vector< std::vector<double> >& weights)
+{
+	unsigned periodCount = PeriodCount(binning);
+	if (periodCount == 0 || doys.size() != irradiance.size())
+		return false;
+
+	try
+	{
+		weights.assign(periodCount, std::vector<double>(irradiance.size(), 0));
+	}
+	catch (const std::bad_alloc&)
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < doys.size(); ++i)
+	{
+		weights[PeriodIndex(binning, doys[i])][i] = irradiance[i];
+	}
+
+	return true;
+}
+
+/** Each day is split at the period boundaries and each piece is integrated separately.
+**/
+bool SOLIS::PeriodDiffIrradiance(PeriodBinning binning, double doyFrom, double doyTo, double timestep, double lat, double lon, double elevation, std::vector<double>& irradiance)
+{
+	unsigned periodCount = PeriodCount(binning);
+	if (periodCount == 0 || timestep <= 0)
+		return false;
+
+	try
+	{
+		irradiance.assign(periodCount, 0);
+	}
+	catch (const std::bad_alloc&)
+	{
+		return false;
+	}
+
+	//same window as totalDiffIrradiance
+	double stepDays = timestep/60/24;
+	size_t count = static_cast<size_t>( floor( (doyTo-doyFrom)/stepDays ) );
+	double end = doyFrom + count*stepDays;
+
+	//pieces of a day belonging to the same period (the whole day for months, one hour otherwise)
+	double pieceDays = (binning == PERIODS_HOUR ? 1.0 / 24 : 1.0);
+	for (double start = floor(doyFrom); start < end; start += pieceDays)
+	{
+		double from = std::max(start, doyFrom);
+		double to = std::min(start + pieceDays, end);
+		if (to <= from)
+			continue;
+		irradiance[PeriodIndex(binning, (from + to) / 2)] += DiffuseIntegral(from, to, lat, lon, elevation) / stepDays;
+	}
+
+	return true;
+}
+
+bool SOLIS::BinSunRays(double tolerance, std::vector<CCVector3>& rays, std::vector<double>& irradiance, double* maxError/*=nullptr*/, double* meanError/*=nullptr*/)
+{
+	std::vector< std::vector<double> > weights(1);
+	weights[0].swap(irradiance);
+	bool success = BinSunRays(tolerance, rays, weights, maxError, meanError);
+	irradiance.swap(weights[0]);
+	return success;
+}
+
+bool SOLIS::BinSunRays(double tolerance, std::vector<CCVector3>& rays, std::vector< std::vector<double> >& weights, double* maxError/*=nullptr*/, double* meanError/*=nullptr*/)
+{
+	if (maxError)
+		*maxError = 0;
+	if (meanError)
+		*meanError = 0;
+
+	for (const std::vector<double>& w : weights)
+	{
+		if (w.size() != rays.size())
+			return false;
+	}
+	if (tolerance <= 0 || rays.empty())
+		return true; //nothing to do
+
+	//the unit sphere is divided into cubic cells small enough so that two directions
+	//falling in the same cell are always less than 'tolerance' apart (cell diagonal <= chord)
+	double chord = 2.0 * sin(std::min(tolerance, 180.0) * (M_PI / 360.0));
+	double cellSize = chord / sqrt(3.0);
+	double maxCellIndex = 1.0 / cellSize + 1.0;
+	if (maxCellIndex >= (1 << 20))
+		return false; //tolerance is too small
+
+	//weighted direction sum of each bin
+	std::vector<CCVector3d> binDirs;
+	std::vector< std::vector<double> > binWeights(weights.size());
+	std::vector<double> rayWeight;
+	std::vector<size_t> rayBin;
+	std::unordered_map<uint64_t, size_t> cellToBin;
+	try
+	{
+		rayBin.resize(rays.size());
+		rayWeight.resize(rays.size(), 0);
+		for (size_t i = 0; i < rays.size(); ++i)
+		{
+			CCVector3d dir(rays[i].x, rays[i].y, rays[i].z);
+			dir.normalize();
+
+			uint64_t key = 0;
+			for (unsigned d = 0; d < 3; ++d)
+			{
+				uint64_t cellIndex = static_cast<uint64_t>(floor(dir.u[d] / cellSize + maxCellIndex));
+				key = (key << 21) | cellIndex;
+			}
+
+			auto it = cellToBin.find(key);
+			size_t binIndex = 0;
+			if (it == cellToBin.end())
+			{
+				binIndex = binDirs.size();
+				cellToBin[key] = binIndex;
+				binDirs.push_back(CCVector3d(0, 0, 0));
+				for (std::vector<double>& w : binWeights)
+					w.push_back(0);
+			}
+			else
+			{
+				binIndex = it->second;
+			}
+
+			for (size_t k = 0; k < weights.size(); ++k)
+			{
+				rayWeight[i] += std::max(weights[k][i], 0.0);
+				binWeights[k][binIndex] += weights[k][i];
+			}
+			//rays without irradiance still contribute a little to the direction (in case all rays of the bin are null)
+			binDirs[binIndex] += dir * (rayWeight[i] + 1.0e-12);
+			rayBin[i] = binIndex;
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return false;
+	}
+
+	for (CCVector3d& dir : binDirs)
+	{
+		dir.normalize();
+	}
+
+	//approximation error
+	double errorMax = 0;
+	double errorSum = 0;
+	double weightSum = 0;
+	for (size_t i = 0; i < rays.size(); ++i)
+	{
+		CCVector3d dir(rays[i].x, rays[i].y, rays[i].z);
+		dir.normalize();
+		double cosAngle = std::max(-1.0, std::min(1.0, dir.dot(binDirs[rayBin[i]])));
+		double angle = acos(cosAngle) * (180.0 / M_PI);
+		errorMax = std::max(errorMax, angle);
+		errorSum += angle * rayWeight[i];
+		weightSum += rayWeight[i];
+	}
+	if (maxError)
+		*maxError = errorMax;
+	if (meanError)
+		*meanError = (weightSum > 0 ? errorSum / weightSum : 0);
+
+	//replace the rays by the bins
+	rays.resize(binDirs.size());
+	for (size_t j = 0; j < binDirs.size(); ++j)
+	{
+		rays[j] = CCVector3(static_cast<PointCoordinateType>(binDirs[j].x),
+							static_cast<PointCoordinateType>(binDirs[j].y),
+							static_cast<PointCoordinateType>(binDirs[j].z));
+	}
+	weights.swap(binWeights);
+
+	return true;
+}
+
 /*
 // IS THIS USED FROM COMMANDLINE? TESTS?
 int SOLIS::Launch(
@@ -295,110 +688,481 @@ int SOLIS::Launch(
 */
 
 
+//! Displays the progress dialog of a SOLIS::Launch call
+static void StartProgress(	CCCoreLib::GenericProgressCallback* progressCb,
+							const QString& entityName,
+							size_t numberOfRays,
+							CCCoreLib::GenericMesh* mesh,
+							size_t numberOfPoints)
+{
+	if (!progressCb)
+		return;
+
+	if (progressCb->textCanBeEdited())
+	{
+		progressCb->setMethodTitle("ShadeVis|SOLIS");
+		QString infoStr;
+		if (!entityName.isEmpty())
+			infoStr = entityName + "\n";
+		infoStr.append(QString("Rays: %1").arg(numberOfRays));
+		if (mesh)
+			infoStr.append(QString("\nFaces: %1").arg(mesh->size()));
+		else
+			infoStr.append(QString("\nVertices: %1").arg(numberOfPoints));
+		progressCb->setInfo(qPrintable(infoStr));
+	}
+	progressCb->update(0);
+	progressCb->start();
+}
+
+//! Updates the progress dialog of a SOLIS::Launch call
+/** Progress is tracked with 64 bits counters (NormalizedProgress is limited to 2^32 steps)
+	\return false if the process has been cancelled
+**/
+static bool UpdateProgress(CCCoreLib::GenericProgressCallback* progressCb, size_t done, size_t total, int& lastPercent)
+{
+	if (!progressCb)
+		return true;
+
+	int percent = static_cast<int>((done * 100) / total);
+	if (percent != lastPercent)
+	{
+		lastPercent = percent;
+		progressCb->update(static_cast<float>(percent));
+	}
+
+	return !progressCb->isCancelRequested();
+}
+
 bool SOLIS::Launch(
                  const std::vector<CCVector3>& rays,
 				 const std::vector<double>& irradiance,
 				 bool modeDirect,
 				 double conversion,
 				 CCCoreLib::GenericCloud* vertices,
+				 CCCoreLib::ScalarField* output,
 				 CCCoreLib::GenericMesh* mesh/*=0*/,
 				 bool meshIsClosed/*=false*/,
 				 unsigned width/*=1024*/,
 				 unsigned height/*=1024*/,
 				 CCCoreLib::GenericProgressCallback* progressCb/*=0*/,
-				 const QString& entityName/*=QString()*/)
+				 const QString& entityName/*=QString()*/,
+				 AccumulatorPrecision precision/*=ACCUMULATOR_COMPACT*/,
+				 const std::vector<double>* rayDoys/*=nullptr*/,
+				 SunStatistics* statistics/*=nullptr*/,
+				 SOLISCheckpoint* checkpoint/*=nullptr*/)
 {
-	if (rays.empty())
+	if (rays.empty() || irradiance.empty())
+		return false;
+
+	if (statistics && (!modeDirect || !rayDoys || rayDoys->size() != rays.size() || irradiance.size() != rays.size()))
 		return false;
 
-	if (!vertices || !vertices->enableScalarField())
+	if (!vertices || !output)
 		return false;
 
 	//vertices/points
-	unsigned numberOfPoints = vertices->size();
+	size_t numberOfPoints = vertices->size();
 	//rays
-	unsigned numberOfRays = static_cast<unsigned>(rays.size());
+	size_t numberOfRays = rays.size();
+
+	if (output->size() != numberOfPoints)
+		return false;
+
+	//the result is accumulated directly in the output scalar field buffer
+	std::vector<ScalarType>& values = *output;
+	std::fill(values.begin(), values.end(), static_cast<ScalarType>(0));
 
 	//for each vertex we keep count of the number of light directions for which it is "illuminated"
+	//(auxiliary buffers, depending on the accumulator precision)
 	std::vector<double> visibilityCountDirect;
-	std::vector<int> visibilityCount;
-	
-	if (modeDirect)	{
-		try
+	std::vector<ScalarType> compensation;
+	std::vector<uint16_t> visibilityCount16;
+	std::vector<uint32_t> visibilityCount32;
+
+	if (!modeDirect)
+	{
+		if (	(precision == ACCUMULATOR_COMPACT && numberOfRays > std::numeric_limits<uint16_t>::max())
+			||	(precision == ACCUMULATOR_FAST && numberOfRays > (static_cast<size_t>(1) << std::numeric_limits<ScalarType>::digits)) )
 		{
-			visibilityCountDirect.resize(numberOfPoints, 0);
+			//16 bits counters would overflow / float counters wouldn't be exact anymore
+			precision = ACCUMULATOR_DOUBLE;
 		}
-		catch (const std::bad_alloc&)
+		if (numberOfRays > std::numeric_limits<uint32_t>::max())
 		{
-			//not enough memory?
+			//not supported
 			return false;
-		}	
+		}
 	}
-	else{	
-		try
+
+	try
+	{
+		switch (precision)
 		{
-			visibilityCount.resize(numberOfPoints, 0);
+		case ACCUMULATOR_COMPACT:
+			if (modeDirect)
+				compensation.resize(numberOfPoints, 0);
+			else
+				visibilityCount16.resize(numberOfPoints, 0);
+			break;
+		case ACCUMULATOR_DOUBLE:
+			if (modeDirect)
+				visibilityCountDirect.resize(numberOfPoints, 0);
+			else
+				visibilityCount32.resize(numberOfPoints, 0);
+			break;
+		case ACCUMULATOR_FAST:
+		default:
+			//nothing to do
+			break;
 		}
-		catch (const std::bad_alloc&)
+
+		if (statistics)
 		{
-			//not enough memory?
-			return false;
-		}	
+			statistics->litCount.assign(numberOfPoints, 0);
+			statistics->firstSun.assign(numberOfPoints, std::numeric_limits<float>::quiet_NaN());
+			statistics->lastSun.assign(numberOfPoints, std::numeric_limits<float>::quiet_NaN());
+			statistics->peakIrradiance.assign(numberOfPoints, 0);
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory?
+		return false;
+	}
+
+	//the accumulators are restored from the last checkpoint (if any)
+	size_t firstRay = 0;
+	if (checkpoint)
+	{
+		checkpoint->addBuffer(values);
+		checkpoint->addBuffer(visibilityCountDirect);
+		checkpoint->addBuffer(compensation);
+		checkpoint->addBuffer(visibilityCount16);
+		checkpoint->addBuffer(visibilityCount32);
+		if (statistics)
+		{
+			checkpoint->addBuffer(statistics->litCount);
+			checkpoint->addBuffer(statistics->firstSun);
+			checkpoint->addBuffer(statistics->lastSun);
+			checkpoint->addBuffer(statistics->peakIrradiance);
+		}
+		uint32_t options = static_cast<uint32_t>(precision) | (modeDirect ? 0x100 : 0) | (statistics ? 0x200 : 0);
+		firstRay = checkpoint->start(numberOfRays, options);
 	}
 	
 	/*** Main illumination loop ***/
-	CCCoreLib::NormalizedProgress nProgress(progressCb, numberOfRays);
-	if (progressCb)
-	{
-		if (progressCb->textCanBeEdited())
-		{
-			progressCb->setMethodTitle("ShadeVis|SOLIS");
-			QString infoStr;
-			if (!entityName.isEmpty())
-				infoStr = entityName + "\n";
-			infoStr.append(QString("Rays: %1").arg(numberOfRays));
-			if (mesh)
-				infoStr.append(QString("\nFaces: %1").arg(mesh->size()));
+	int lastPercent = 0;
+	StartProgress(progressCb, entityName, numberOfRays, mesh, numberOfPoints);
+
+	bool success = true;
+
+	//must be done after progress dialog display!
+	SOLISContext win;
+	if (win.init(width, height, vertices, mesh, meshIsClosed))
+	{
+		for (size_t i = firstRay; i < numberOfRays; ++i)
+		{
+			//set current 'light' direction
+			win.setViewDirection(rays[i]);
+
+			//flag viewed vertices
+			int64_t seen = 0;
+			if (statistics)
+			{
+				//same accumulation as below, the statistics being updated for each lit vertex
+				double weight = irradiance[i];
+				float doy = static_cast<float>((*rayDoys)[i]);
+				float peak = static_cast<float>(weight);
+				seen = win.GLForEachVisiblePoint(numberOfPoints, [&](size_t j)
+				{
+					if (!visibilityCountDirect.empty())
+					{
+						visibilityCountDirect[j] += weight;
+					}
+					else if (!compensation.empty())
+					{
+						//Kahan summation
+						ScalarType y = static_cast<ScalarType>(weight) - compensation[j];
+						ScalarType t = values[j] + y;
+						compensation[j] = (t - values[j]) - y;
+						values[j] = t;
+					}
+					else
+					{
+						values[j] += static_cast<ScalarType>(weight);
+					}
+
+					++statistics->litCount[j];
+					if (!(statistics->firstSun[j] <= doy)) //NaN if never lit
+						statistics->firstSun[j] = doy;
+					if (!(statistics->lastSun[j] >= doy))
+						statistics->lastSun[j] = doy;
+					statistics->peakIrradiance[j] = std::max(statistics->peakIrradiance[j], peak);
+				});
+			}
+			else if (modeDirect) // SOLIS MODIFICATION: accumulate solar radiation
+			{
+				if (!visibilityCountDirect.empty())
+					seen = win.GLAccumPixelIrradiance(visibilityCountDirect, irradiance[i]);
+				else
+					seen = win.GLAccumPixelIrradiance(values, compensation.empty() ? nullptr : &compensation, irradiance[i]);
+			}
+			else
+			{
+				if (!visibilityCount16.empty())
+					seen = win.GLAccumPixel(visibilityCount16);
+				else if (!visibilityCount32.empty())
+					seen = win.GLAccumPixel(visibilityCount32);
+				else
+					seen = win.GLAccumPixelIrradiance(values, nullptr, 1.0); //float counts are exact up to 2^24 rays
+			}
+
+			if (seen < 0)
+			{
+				success = false;
+				break;
+			}
+
+			if (!UpdateProgress(progressCb, i + 1, numberOfRays, lastPercent))
+			{
+				//the run can be resumed from here
+				if (checkpoint)
+					checkpoint->save(i + 1);
+				success = false;
+				break;
+			}
+
+			//a failed snapshot doesn't stop the run (the previous one is kept)
+			if (checkpoint)
+				checkpoint->update(i + 1);
+		}
+		if (success)
+		{
+			if (checkpoint)
+				checkpoint->remove();
+
+			//we convert per-vertex accumulators to an 'intensity' scalar field (in place)
+			//POV * Total Diffuse Irradiance in diffuse mode
+			double scale = (modeDirect ? conversion : irradiance[0] * conversion / numberOfRays);
+			if (!visibilityCountDirect.empty())
+			{
+				for (size_t j = 0; j < numberOfPoints; ++j)
+					values[j] = static_cast<ScalarType>(visibilityCountDirect[j] * scale);
+			}
+			else if (!visibilityCount16.empty())
+			{
+				for (size_t j = 0; j < numberOfPoints; ++j)
+					values[j] = static_cast<ScalarType>(visibilityCount16[j] * scale);
+			}
+			else if (!visibilityCount32.empty())
+			{
+				for (size_t j = 0; j < numberOfPoints; ++j)
+					values[j] = static_cast<ScalarType>(visibilityCount32[j] * scale);
+			}
 			else
-				infoStr.append(QString("\nVertices: %1").arg(numberOfPoints));
-			progressCb->setInfo(qPrintable(infoStr));
+			{
+				for (size_t j = 0; j < numberOfPoints; ++j)
+					values[j] = static_cast<ScalarType>(values[j] * scale);
+			}
+		}
+	}
+	else
+	{
+		success = false;
+	}
+
+	return success;
+}
+
+bool SOLIS::Launch(	const std::vector<CCVector3>& rays,
+					const std::vector< std::vector<double> >& weights,
+					double conversion,
+					CCCoreLib::GenericCloud* vertices,
+					const std::vector<CCCoreLib::ScalarField*>& outputs,
+					CCCoreLib::GenericMesh* mesh/*=nullptr*/,
+					bool meshIsClosed/*=false*/,
+					unsigned width/*=1024*/,
+					unsigned height/*=1024*/,
+					CCCoreLib::GenericProgressCallback* progressCb/*=nullptr*/,
+					const QString& entityName/*=QString()*/,
+					AccumulatorPrecision precision/*=ACCUMULATOR_COMPACT*/,
+					SOLISCheckpoint* checkpoint/*=nullptr*/,
+					const SOLISHorizon* horizon/*=nullptr*/)
+{
+	if (rays.empty() || outputs.empty() || weights.size() != outputs.size())
+		return false;
+
+	if (!vertices)
+		return false;
+
+	size_t numberOfPoints = vertices->size();
+	size_t numberOfRays = rays.size();
+	size_t numberOfOutputs = outputs.size();
+
+	for (size_t k = 0; k < numberOfOutputs; ++k)
+	{
+		if (!outputs[k] || outputs[k]->size() != numberOfPoints || weights[k].size() != numberOfRays)
+			return false;
+		std::fill(outputs[k]->begin(), outputs[k]->end(), static_cast<ScalarType>(0));
+	}
+
+	//auxiliary buffers (see AccumulatorPrecision)
+	std::vector< std::vector<ScalarType> > compensation;
+	std::vector< std::vector<double> > accumulators;
+	//far-field horizon tile of each vertex, and tiles where the current ray is hidden
+	std::vector<unsigned> vertexTiles;
+	std::vector<uint8_t> hiddenTiles;
+	try
+	{
+		if (precision == ACCUMULATOR_COMPACT)
+			compensation.resize(numberOfOutputs, std::vector<ScalarType>(numberOfPoints, 0));
+		else if (precision == ACCUMULATOR_DOUBLE)
+			accumulators.resize(numberOfOutputs, std::vector<double>(numberOfPoints, 0));
+		if (horizon && horizon->tileCount() != 0)
+		{
+			vertexTiles.resize(numberOfPoints);
+			hiddenTiles.resize(horizon->tileCount());
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory?
+		return false;
+	}
+
+	if (!vertexTiles.empty())
+	{
+		vertices->placeIteratorAtBeginning();
+		for (size_t j = 0; j < numberOfPoints; ++j)
+		{
+			vertexTiles[j] = horizon->tileIndex(*vertices->getNextPoint());
+		}
+	}
+
+	//the accumulators are restored from the last checkpoint (if any)
+	size_t firstRay = 0;
+	if (checkpoint)
+	{
+		for (size_t k = 0; k < numberOfOutputs; ++k)
+		{
+			checkpoint->addBuffer(*outputs[k]);
+			if (!compensation.empty())
+				checkpoint->addBuffer(compensation[k]);
+			if (!accumulators.empty())
+				checkpoint->addBuffer(accumulators[k]);
 		}
-		progressCb->update(0);
-		progressCb->start();
+		//the far-field horizon (DEM contents, tile size) changes the accumulated values too
+		firstRay = checkpoint->start(numberOfRays, static_cast<uint32_t>(precision) | 0x400 | (vertexTiles.empty() ? 0 : 0x800), vertexTiles.empty() ? 0 : horizon->key());
 	}
 
+	/*** Main illumination loop ***/
+	int lastPercent = 0;
+	StartProgress(progressCb, entityName, numberOfRays, mesh, numberOfPoints);
+
 	bool success = true;
 
 	//must be done after progress dialog display!
 	SOLISContext win;
 	if (win.init(width, height, vertices, mesh, meshIsClosed))
 	{
-		for (unsigned i = 0; i < numberOfRays; ++i)
+		std::vector<size_t> activeOutputs;
+		activeOutputs.reserve(numberOfOutputs);
+
+		for (size_t i = firstRay; i < numberOfRays; ++i)
 		{
-			//set current 'light' direction
-			win.setViewDirection(rays[i]);
+			//outputs actually lit by this ray
+			activeOutputs.clear();
+			for (size_t k = 0; k < numberOfOutputs; ++k)
+			{
+				if (weights[k][i] != 0)
+					activeOutputs.push_back(k);
+			}
+
+			//rays hidden by the far-field horizon of every tile aren't rendered at all
+			if (!hiddenTiles.empty() && !activeOutputs.empty())
+			{
+				size_t hiddenCount = 0;
+				for (unsigned t = 0; t < hiddenTiles.size(); ++t)
+				{
+					hiddenTiles[t] = horizon->hides(t, rays[i]);
+					hiddenCount += hiddenTiles[t];
+				}
+				if (hiddenCount == hiddenTiles.size())
+					activeOutputs.clear();
+			}
+
+			if (!activeOutputs.empty())
+			{
+				//set current 'light' direction
+				win.setViewDirection(rays[i]);
+
+				//flag viewed vertices
+				int64_t seen = win.GLForEachVisiblePoint(numberOfPoints, [&](size_t j)
+				{
+					if (!vertexTiles.empty() && hiddenTiles[vertexTiles[j]])
+						return;
 
-			//flag viewed vertices 
-			if (modeDirect)	win.GLAccumPixelIrradiance(visibilityCountDirect,irradiance[i]); // SOLIS MODIFICATION: accumulate solar radiation 
-			else win.GLAccumPixel(visibilityCount); // SOLIS MODIFICATION: accumulate solar radiation 
+					for (size_t k : activeOutputs)
+					{
+						if (!accumulators.empty())
+						{
+							accumulators[k][j] += weights[k][i];
+						}
+						else
+						{
+							ScalarType& sum = (*outputs[k])[j];
+							if (!compensation.empty())
+							{
+								//Kahan summation
+								ScalarType& c = compensation[k][j];
+								ScalarType y = static_cast<ScalarType>(weights[k][i]) - c;
+								ScalarType t = sum + y;
+								c = (t - sum) - y;
+								sum = t;
+							}
+							else
+							{
+								sum += static_cast<ScalarType>(weights[k][i]);
+							}
+						}
+					}
+				});
 
-			if (progressCb && !nProgress.oneStep())
+				if (seen < 0)
+				{
+					success = false;
+					break;
+				}
+			}
+
+			if (!UpdateProgress(progressCb, i + 1, numberOfRays, lastPercent))
 			{
+				//the run can be resumed from here
+				if (checkpoint)
+					checkpoint->save(i + 1);
 				success = false;
 				break;
 			}
+
+			//a failed snapshot doesn't stop the run (the previous one is kept)
+			if (checkpoint)
+				checkpoint->update(i + 1);
 		}
+
 		if (success)
 		{
-			//we convert per-vertex accumulators to an 'intensity' scalar field
-			for (unsigned j = 0; j < numberOfPoints; ++j)
+			if (checkpoint)
+				checkpoint->remove();
+
+			//we convert per-vertex accumulators to an 'intensity' scalar field (in place)
+			for (size_t k = 0; k < numberOfOutputs; ++k)
 			{
-				if (modeDirect){
-					ScalarType visValue = static_cast<ScalarType>( visibilityCountDirect[j]*conversion );
-					vertices->setPointScalarValue(j, visValue);
-				} else {
-					ScalarType visValue = static_cast<ScalarType> ( (1.0*visibilityCount[j]) / numberOfRays) * irradiance[0]*conversion; // POV * Total Diffuse Irradiance 
-					vertices->setPointScalarValue(j, visValue);
+				std::vector<ScalarType>& values = *outputs[k];
+				for (size_t j = 0; j < numberOfPoints; ++j)
+				{
+					double sum = (accumulators.empty() ? values[j] : accumulators[k][j]);
+					values[j] = static_cast<ScalarType>(sum * conversion);
 				}
 			}
 		}
@@ -411,6 +1175,1522 @@ bool SOLIS::Launch(
 	return success;
 }
 
+//! Adds 'weight' to the accumulator of every vertex flagged in a visibility mask (see AccumulatorPrecision)
+static void AccumulateMask(	const std::vector<uint64_t>& mask,
+							double weight,
+							std::vector<ScalarType>& values,
+							std::vector<ScalarType>& compensation,
+							std::vector<double>& sums)
+{
+	if (weight == 0)
+		return;
+
+	ScalarType value = static_cast<ScalarType>(weight);
+	for (size_t w = 0; w < mask.size(); ++w)
+	{
+		uint64_t bits = mask[w];
+		for (size_t j = (w << 6); bits != 0; ++j, bits >>= 1)
+		{
+			if ((bits & 1) == 0)
+				continue;
+
+			if (!sums.empty())
+			{
+				sums[j] += weight;
+			}
+			else if (!compensation.empty())
+			{
+				//Kahan summation
+				ScalarType y = value - compensation[j];
+				ScalarType t = values[j] + y;
+				compensation[j] = (t - values[j]) - y;
+				values[j] = t;
+			}
+			else
+			{
+				values[j] += value;
+			}
+		}
+	}
+}
+
+//! Returns the number of vertices whose visibility differs between two masks
+static size_t CountChanges(const std::vector<uint64_t>& maskA, const std::vector<uint64_t>& maskB)
+{
+	size_t count = 0;
+	for (size_t w = 0; w < maskA.size(); ++w)
+	{
+		count += std::bitset<64>(maskA[w] ^ maskB[w]).count();
+	}
+	return count;
+}
+
+bool SOLIS::LaunchAdaptiveSunPath(	double doyFrom,
+									double doyTo,
+									double timestep,
+									unsigned coarseFactor,
+									double threshold,
+									double lat,
+									double lon,
+									double elevation,
+									double conversion,
+									CCCoreLib::GenericCloud* vertices,
+									CCCoreLib::ScalarField* output,
+									CCCoreLib::GenericMesh* mesh/*=nullptr*/,
+									bool meshIsClosed/*=false*/,
+									unsigned width/*=1024*/,
+									unsigned height/*=1024*/,
+									CCCoreLib::GenericProgressCallback* progressCb/*=nullptr*/,
+									const QString& entityName/*=QString()*/,
+									AccumulatorPrecision precision/*=ACCUMULATOR_COMPACT*/,
+									size_t* renderCount/*=nullptr*/)
+{
+	if (renderCount)
+		*renderCount = 0;
+
+	if (!vertices || !output || timestep <= 0)
+		return false;
+
+	size_t numberOfPoints = vertices->size();
+	if (output->size() != numberOfPoints)
+		return false;
+
+	//same timesteps as GenerateSunRays
+	size_t stepCount = static_cast<size_t>( floor( (doyTo-doyFrom)/(timestep/24/60) ) );
+	if (stepCount == 0)
+		return false;
+	size_t lastStep = stepCount - 1;
+	size_t coarseStep = std::max<size_t>(coarseFactor, 1);
+
+	std::vector<ScalarType>& values = *output;
+	std::fill(values.begin(), values.end(), static_cast<ScalarType>(0));
+
+	//direct irradiance of each timestep and number of timesteps with the sun above the horizon before each timestep
+	std::vector<double> irradiance;
+	std::vector<size_t> sunUpBefore;
+	//sun position of each timestep
+	std::vector<double> sunAltitude;
+	std::vector<double> sunAzimuth;
+	//auxiliary buffers (see AccumulatorPrecision)
+	std::vector<ScalarType> compensation;
+	std::vector<double> sums;
+	try
+	{
+		irradiance.resize(stepCount, 0);
+		sunUpBefore.resize(stepCount + 1, 0);
+		sunAltitude.resize(stepCount, -90.0);
+		sunAzimuth.resize(stepCount, 0);
+		if (precision == ACCUMULATOR_COMPACT)
+			compensation.resize(numberOfPoints, 0);
+		else if (precision == ACCUMULATOR_DOUBLE)
+			sums.resize(numberOfPoints, 0);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory?
+		return false;
+	}
+
+	//nights are skipped
+	std::vector< std::pair<size_t, size_t> > daylight;
+	DaylightSteps(doyFrom, timestep/24/60, stepCount, lat, daylight);
+	for (const std::pair<size_t, size_t>& range : daylight)
+	{
+		std::vector<double> doys;
+		SOLISSky::SolarSeries sun;
+		try
+		{
+			doys.resize(range.second - range.first);
+		}
+		catch (const std::bad_alloc&)
+		{
+			//not enough memory?
+			return false;
+		}
+		for (size_t k = range.first; k < range.second; ++k)
+			doys[k - range.first] = doyFrom + k*(timestep/24/60);
+
+		if (!SOLISSky::ComputeSolarSeries(doys, lat, lon, elevation, sun))
+			return false;
+		std::copy(sun.altitude.begin(), sun.altitude.end(), sunAltitude.begin() + range.first);
+		std::copy(sun.azimuth.begin(), sun.azimuth.end(), sunAzimuth.begin() + range.first);
+		std::copy(sun.direct.begin(), sun.direct.end(), irradiance.begin() + range.first);
+	}
+	for (size_t k = 0; k < stepCount; ++k)
+	{
+		bool sunUp = (sunAltitude[k] > 0);
+		if (!sunUp)
+			irradiance[k] = 0;
+		sunUpBefore[k + 1] = sunUpBefore[k] + (sunUp ? 1 : 0);
+	}
+
+	//! Sun path sample
+	struct Sample
+	{
+		size_t step;
+		bool sunUp;
+		std::vector<uint64_t> mask;
+	};
+	size_t maskSize = (numberOfPoints + 63) / 64;
+
+	/*** Main illumination loop ***/
+	int lastPercent = 0;
+	//the number of renders depends on the refinements: progress is tracked in timesteps
+	StartProgress(progressCb, entityName, stepCount, mesh, numberOfPoints);
+
+	//must be done after progress dialog display!
+	SOLISContext win;
+	if (!win.init(width, height, vertices, mesh, meshIsClosed))
+		return false;
+
+	size_t renders = 0;
+	auto takeSample = [&](size_t step, Sample& sample) -> bool
+	{
+		sample.step = step;
+		sample.sunUp = (sunUpBefore[step + 1] != sunUpBefore[step]);
+		sample.mask.resize(maskSize);
+		if (!sample.sunUp)
+		{
+			//nothing is lit at night
+			std::fill(sample.mask.begin(), sample.mask.end(), static_cast<uint64_t>(0));
+			return true;
+		}
+		win.setViewDirection(SOLISSky::Direction(sunAltitude[step], sunAzimuth[step]));
+		++renders;
+		return (win.GLVisibilityMask(sample.mask) >= 0);
+	};
 
+	bool success = true;
+	try
+	{
+		Sample left;
+		std::vector<Sample> pending; //right endpoints of the intervals still to integrate (last = nearest)
+		if (!takeSample(0, left))
+			success = false;
+
+		for (size_t coarseStart = 0; success && coarseStart < lastStep; coarseStart += coarseStep)
+		{
+			pending.resize(1);
+			if (!takeSample(std::min(coarseStart + coarseStep, lastStep), pending.back()))
+			{
+				success = false;
+				break;
+			}
+
+			while (!pending.empty())
+			{
+				Sample& right = pending.back();
+				size_t a = left.step;
+				size_t b = right.step;
+
+				bool refine = false;
+				if (b - a > 1)
+				{
+					//the sun rises or sets in the interval
+					size_t sunUpInside = sunUpBefore[b] - sunUpBefore[a + 1];
+					if (left.sunUp != right.sunUp || sunUpInside != (left.sunUp ? b - a - 1 : 0))
+						refine = true;
+					//or the shadows have moved too much
+					else if (left.sunUp && static_cast<double>(CountChanges(left.mask, right.mask)) > threshold * numberOfPoints)
+						refine = true;
+				}
+
+				if (refine)
+				{
+					Sample middle;
+					if (!takeSample(a + (b - a) / 2, middle))
+					{
+						success = false;
+						break;
+					}
+					pending.push_back(std::move(middle));
+					continue;
+				}
+
+				//the visibility is linearly interpolated between the endpoints and weighted by the irradiance of each timestep
+				double leftWeight = 0;
+				double rightWeight = 0;
+				for (size_t k = a; k < b; ++k)
+				{
+					double lambda = static_cast<double>(k - a) / (b - a);
+					leftWeight += irradiance[k] * (1.0 - lambda);
+					rightWeight += irradiance[k] * lambda;
+				}
+				AccumulateMask(left.mask, leftWeight, values, compensation, sums);
+				AccumulateMask(right.mask, rightWeight, values, compensation, sums);
+
+				left = std::move(right);
+				pending.pop_back();
+
+				if (!UpdateProgress(progressCb, left.step, stepCount, lastPercent))
+				{
+					success = false;
+					break;
+				}
+			}
+		}
+
+		if (success)
+		{
+			//the last timestep only belongs to the last sample
+			AccumulateMask(left.mask, irradiance[lastStep], values, compensation, sums);
+			UpdateProgress(progressCb, stepCount, stepCount, lastPercent);
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory?
+		success = false;
+	}
+
+	if (success)
+	{
+		//we convert per-vertex accumulators to an 'intensity' scalar field (in place)
+		for (size_t j = 0; j < numberOfPoints; ++j)
+		{
+			double sum = (sums.empty() ? values[j] : sums[j]);
+			values[j] = static_cast<ScalarType>(sum * conversion);
+		}
+	}
+
+	if (renderCount)
+		*renderCount = renders;
+
+	return success;
+}
+
+//! Bilinear weight of a tile for a position expressed in tile units (tile centers at integer coordinates)
+static inline double TileWeight(float u, unsigned tileIndex, unsigned tileCount)
+{
+	if (tileCount < 2)
+		return 1.0;
+	//positions beyond the outer tile centers belong to the outer tiles
+	double uc = std::min(std::max(static_cast<double>(u), 0.0), static_cast<double>(tileCount - 1));
+	return std::max(0.0, 1.0 - std::abs(uc - tileIndex));
+}
+
+bool SOLIS::LaunchTiledSunPath(	double doyFrom,
+								double doyTo,
+								double timestep,
+								double lat,
+								double lon,
+								double elevation,
+								double tileSize,
+								double conversion,
+								CCCoreLib::GenericCloud* vertices,
+								CCCoreLib::ScalarField* output,
+								CCCoreLib::GenericMesh* mesh/*=nullptr*/,
+								bool meshIsClosed/*=false*/,
+								unsigned width/*=1024*/,
+								unsigned height/*=1024*/,
+								CCCoreLib::GenericProgressCallback* progressCb/*=nullptr*/,
+								const QString& entityName/*=QString()*/,
+								AccumulatorPrecision precision/*=ACCUMULATOR_COMPACT*/,
+								unsigned* tileCount/*=nullptr*/)
+{
+	//mean Earth radius (m)
+	static const double c_earthRadius = 6371008.8;
+
+	if (tileCount)
+		*tileCount = 0;
+
+	if (!vertices || !output || timestep <= 0 || tileSize <= 0)
+		return false;
+
+	size_t numberOfPoints = vertices->size();
+	if (numberOfPoints == 0 || output->size() != numberOfPoints)
+		return false;
+
+	//tile grid (tiles are slightly shrunk so that they exactly cover the bounding box)
+	CCVector3 bbMin;
+	CCVector3 bbMax;
+	vertices->getBoundingBox(bbMin, bbMax);
+	double dx = static_cast<double>(bbMax.x) - bbMin.x;
+	double dy = static_cast<double>(bbMax.y) - bbMin.y;
+	unsigned nx = std::max(1u, static_cast<unsigned>(ceil(dx / tileSize)));
+	unsigned ny = std::max(1u, static_cast<unsigned>(ceil(dy / tileSize)));
+	double sx = (dx > 0 ? dx / nx : 1.0);
+	double sy = (dy > 0 ? dy / ny : 1.0);
+	unsigned numberOfTiles = nx * ny;
+
+	std::vector<ScalarType>& values = *output;
+	std::fill(values.begin(), values.end(), static_cast<ScalarType>(0));
 
+	//vertex positions in tile units (tile centers at integer coordinates)
+	std::vector<float> tileU;
+	std::vector<float> tileV;
+	//sun rays of each tile
+	std::vector< std::vector<CCVector3> > tileRays;
+	std::vector< std::vector<double> > tileIrradiance;
+	//auxiliary buffers (see AccumulatorPrecision)
+	std::vector<ScalarType> compensation;
+	std::vector<double> sums;
+	//vertices receiving some irradiance of the current tile
+	std::vector<uint64_t> receiverMask;
+	try
+	{
+		tileU.resize(numberOfPoints);
+		tileV.resize(numberOfPoints);
+		receiverMask.resize((numberOfPoints + 63) / 64);
+		tileRays.resize(numberOfTiles);
+		tileIrradiance.resize(numberOfTiles);
+		if (precision == ACCUMULATOR_COMPACT)
+			compensation.resize(numberOfPoints, 0);
+		else if (precision == ACCUMULATOR_DOUBLE)
+			sums.resize(numberOfPoints, 0);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory?
+		return false;
+	}
 
+	vertices->placeIteratorAtBeginning();
+	for (size_t j = 0; j < numberOfPoints; ++j)
+	{
+		const CCVector3* P = vertices->getNextPoint();
+		tileU[j] = static_cast<float>((P->x - bbMin.x) / sx - 0.5);
+		tileV[j] = static_cast<float>((P->y - bbMin.y) / sy - 0.5);
+	}
+
+	//sun rays of each tile, at its own latitude and longitude (the scene center is at 'lat' / 'lon', X pointing east and Y north)
+	//the timestamps are expressed in the local solar time of each tile, so that all the tiles see the same instants
+	size_t totalRays = 0;
+	for (unsigned ty = 0; ty < ny; ++ty)
+	{
+		for (unsigned tx = 0; tx < nx; ++tx)
+		{
+			unsigned t = ty * nx + tx;
+			double offsetX = (tx + 0.5) * sx - dx / 2;
+			double offsetY = (ty + 0.5) * sy - dy / 2;
+			double tileLat = lat + offsetY / c_earthRadius * (180.0 / M_PI);
+			double tileLon = lon + offsetX / (c_earthRadius * cos(lat * (M_PI / 180.0))) * (180.0 / M_PI);
+			double shift = (tileLon - lon) / 360.0;
+
+			if (!GenerateSunRays(doyFrom + shift, doyTo + shift, timestep, tileLat, tileLon, elevation, tileRays[t], tileIrradiance[t]))
+				return false;
+			totalRays += tileRays[t].size();
+		}
+	}
+
+	if (totalRays == 0)
+		return false;
+
+	/*** Main illumination loop ***/
+	int lastPercent = 0;
+	StartProgress(progressCb, entityName, totalRays, mesh, numberOfPoints);
+
+	bool success = true;
+
+	//must be done after progress dialog display!
+	SOLISContext win;
+	if (win.init(width, height, vertices, mesh, meshIsClosed))
+	{
+		//the whole scene is rendered for each tile (shadows may come from the other tiles) but each vertex only
+		//receives the irradiance of the tiles around it, weighted by its bilinear weights (seamless stitching)
+		size_t done = 0;
+		for (unsigned t = 0; t < numberOfTiles && success; ++t)
+		{
+			unsigned tx = t % nx;
+			unsigned ty = t / nx;
+
+			//only the pixels of the vertices around the tile (at most 4 tiles per vertex) are cleared and read back
+			std::fill(receiverMask.begin(), receiverMask.end(), static_cast<uint64_t>(0));
+			for (size_t j = 0; j < numberOfPoints; ++j)
+			{
+				if (TileWeight(tileU[j], tx, nx) * TileWeight(tileV[j], ty, ny) > 0)
+					receiverMask[j >> 6] |= (static_cast<uint64_t>(1) << (j & 63));
+			}
+			if (!win.setReceivers(&receiverMask))
+			{
+				//no vertex around this tile
+				done += tileRays[t].size();
+				if (!UpdateProgress(progressCb, done, totalRays, lastPercent))
+					success = false;
+				continue;
+			}
+
+			for (size_t i = 0; i < tileRays[t].size(); ++i)
+			{
+				double weight = tileIrradiance[t][i];
+				win.setViewDirection(tileRays[t][i]);
+
+				int64_t seen = win.GLForEachVisiblePoint(numberOfPoints, [&](size_t j)
+				{
+					double w = weight * TileWeight(tileU[j], tx, nx) * TileWeight(tileV[j], ty, ny);
+					if (w == 0)
+						return;
+
+					if (!sums.empty())
+					{
+						sums[j] += w;
+					}
+					else if (!compensation.empty())
+					{
+						//Kahan summation
+						ScalarType y = static_cast<ScalarType>(w) - compensation[j];
+						ScalarType s = values[j] + y;
+						compensation[j] = (s - values[j]) - y;
+						values[j] = s;
+					}
+					else
+					{
+						values[j] += static_cast<ScalarType>(w);
+					}
+				});
+
+				if (seen < 0 || !UpdateProgress(progressCb, ++done, totalRays, lastPercent))
+				{
+					success = false;
+					break;
+				}
+			}
+		}
+
+		if (success)
+		{
+			//we convert per-vertex accumulators to an 'intensity' scalar field (in place)
+			for (size_t j = 0; j < numberOfPoints; ++j)
+			{
+				double sum = (sums.empty() ? values[j] : sums[j]);
+				values[j] = static_cast<ScalarType>(sum * conversion);
+			}
+		}
+	}
+	else
+	{
+		success = false;
+	}
+
+	if (tileCount)
+		*tileCount = numberOfTiles;
+
+	return success;
+}
+
+bool SOLIS::ExportVisibilityMatrix(	const QString& filename,
+									const std::vector<CCVector3>& directions,
+									uint64_t geometryKey,
+									uint64_t directionsKey,
+									CCCoreLib::GenericCloud* vertices,
+									CCCoreLib::GenericMesh* mesh/*=nullptr*/,
+									bool meshIsClosed/*=false*/,
+									unsigned width/*=1024*/,
+									unsigned height/*=1024*/,
+									CCCoreLib::GenericProgressCallback* progressCb/*=nullptr*/,
+									const QString& entityName/*=QString()*/)
+{
+	if (!vertices || directions.empty())
+		return false;
+
+	size_t numberOfPoints = vertices->size();
+	if (numberOfPoints == 0)
+		return false;
+
+	std::vector<uint64_t> mask;
+	try
+	{
+		mask.resize((numberOfPoints + 63) / 64);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory?
+		return false;
+	}
+
+	//the file is removed if anything goes wrong before it is complete
+	SOLISCache::VisibilityWriter writer;
+	if (!writer.open(filename, geometryKey, directionsKey, numberOfPoints, directions))
+		return false;
+
+	/*** Main illumination loop ***/
+	int lastPercent = 0;
+	StartProgress(progressCb, entityName, directions.size(), mesh, numberOfPoints);
+
+	//must be done after progress dialog display!
+	SOLISContext win;
+	if (!win.init(width, height, vertices, mesh, meshIsClosed))
+		return false;
+
+	for (size_t i = 0; i < directions.size(); ++i)
+	{
+		//one column per direction
+		win.setViewDirection(directions[i]);
+		if (win.GLVisibilityMask(mask) < 0 || !writer.addColumn(mask))
+			return false;
+
+		if (!UpdateProgress(progressCb, i + 1, directions.size(), lastPercent))
+			return false;
+	}
+
+	return writer.close();
+}
+
+bool SOLIS::ExtendSunBins(	SOLISCache::SunBinStore& store,
+							const std::vector<uint64_t>& binKeys,
+							const std::vector<CCVector3>& directions,
+							CCCoreLib::GenericCloud* vertices,
+							CCCoreLib::GenericMesh* mesh/*=nullptr*/,
+							bool meshIsClosed/*=false*/,
+							unsigned width/*=1024*/,
+							unsigned height/*=1024*/,
+							CCCoreLib::GenericProgressCallback* progressCb/*=nullptr*/,
+							const QString& entityName/*=QString()*/,
+							size_t* renderedCount/*=nullptr*/)
+{
+	if (!vertices || binKeys.size() != directions.size())
+		return false;
+
+	if (renderedCount)
+		*renderedCount = 0;
+
+	size_t numberOfPoints = vertices->size();
+	if (numberOfPoints == 0)
+		return false;
+
+	//only the bins that aren't covered yet
+	std::vector<size_t> missing;
+	std::vector<uint64_t> mask;
+	try
+	{
+		for (size_t i = 0; i < binKeys.size(); ++i)
+		{
+			if (!store.contains(binKeys[i]))
+				missing.push_back(i);
+		}
+		if (missing.empty())
+			return true;
+		mask.resize((numberOfPoints + 63) / 64);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory?
+		return false;
+	}
+
+	/*** Main illumination loop ***/
+	int lastPercent = 0;
+	StartProgress(progressCb, entityName, missing.size(), mesh, numberOfPoints);
+
+	//must be done after progress dialog display!
+	SOLISContext win;
+	if (!win.init(width, height, vertices, mesh, meshIsClosed))
+		return false;
+
+	for (size_t i = 0; i < missing.size(); ++i)
+	{
+		//each column is stored as soon as it is rendered
+		win.setViewDirection(directions[missing[i]]);
+		if (win.GLVisibilityMask(mask) < 0 || !store.addColumn(binKeys[missing[i]], mask))
+			return false;
+
+		if (renderedCount)
+			++(*renderedCount);
+
+		if (!UpdateProgress(progressCb, i + 1, missing.size(), lastPercent))
+			return false;
+	}
+
+	return true;
+}
+
+bool SOLIS::ProjectVisibility(	const std::vector<CCVector3>& rays,
+								const std::vector<double>& solidAngles,
+								unsigned order,
+								CCCoreLib::GenericCloud* vertices,
+								std::vector<float>& coefficients,
+								CCCoreLib::GenericMesh* mesh/*=nullptr*/,
+								bool meshIsClosed/*=false*/,
+								unsigned width/*=1024*/,
+								unsigned height/*=1024*/,
+								CCCoreLib::GenericProgressCallback* progressCb/*=nullptr*/,
+								const QString& entityName/*=QString()*/)
+{
+	if (!vertices || rays.empty() || rays.size() != solidAngles.size() || order > SOLISSky::HARMONICS_MAX_ORDER)
+		return false;
+
+	size_t numberOfPoints = vertices->size();
+	if (numberOfPoints == 0)
+		return false;
+
+	unsigned count = SOLISSky::HarmonicsCount(order);
+	std::vector<double> basis;
+	std::vector<float> weightedBasis;
+	try
+	{
+		coefficients.assign(numberOfPoints * count, 0.0f);
+		basis.resize(count);
+		weightedBasis.resize(count);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory?
+		return false;
+	}
+
+	/*** Main illumination loop ***/
+	int lastPercent = 0;
+	StartProgress(progressCb, entityName, rays.size(), mesh, numberOfPoints);
+
+	//must be done after progress dialog display!
+	SOLISContext win;
+	if (!win.init(width, height, vertices, mesh, meshIsClosed))
+		return false;
+
+	for (size_t i = 0; i < rays.size(); ++i)
+	{
+		//the visibility is mirrored below the horizon: the integral over the sphere is twice the one over the sky
+		SOLISSky::HarmonicsBasis(rays[i], order, basis.data());
+		for (unsigned k = 0; k < count; ++k)
+			weightedBasis[k] = static_cast<float>(2 * solidAngles[i] * basis[k]);
+
+		win.setViewDirection(rays[i]);
+		int64_t seen = win.GLForEachVisiblePoint(numberOfPoints, [&](size_t j)
+		{
+			float* c = coefficients.data() + j * count;
+			for (unsigned k = 0; k < count; ++k)
+				c[k] += weightedBasis[k];
+		});
+
+		if (seen < 0 || !UpdateProgress(progressCb, i + 1, rays.size(), lastPercent))
+			return false;
+	}
+
+	return true;
+}
+
+//! Returns whether the half-line P + t.dir (t >= 0) crosses a bounding box (slab test)
+static bool HalfLineCrossesBox(const CCVector3& P, const CCVector3d& dir, const CCVector3& bbMin, const CCVector3& bbMax)
+{
+	double tNear = 0;
+	double tFar = std::numeric_limits<double>::infinity();
+	for (unsigned a = 0; a < 3; ++a)
+	{
+		double p = P.u[a];
+		if (std::abs(dir.u[a]) < 1.0e-12)
+		{
+			//parallel to the slab
+			if (p < bbMin.u[a] || p > bbMax.u[a])
+				return false;
+			continue;
+		}
+		double t0 = (bbMin.u[a] - p) / dir.u[a];
+		double t1 = (bbMax.u[a] - p) / dir.u[a];
+		if (t0 > t1)
+			std::swap(t0, t1);
+		tNear = std::max(tNear, t0);
+		tFar = std::min(tFar, t1);
+		if (tNear > tFar)
+			return false;
+	}
+	return true;
+}
+
+int64_t SOLIS::AffectedReceivers(	const std::vector<CCVector3>& rays,
+									const std::vector< std::vector<double> >& weights,
+									const CCVector3& changedMin,
+									const CCVector3& changedMax,
+									CCCoreLib::GenericCloud* vertices,
+									const std::vector<CCCoreLib::ScalarField*>& previous,
+									std::vector<uint64_t>& receiverMask)
+{
+	if (!vertices)
+		return -1;
+
+	size_t numberOfPoints = vertices->size();
+	for (const CCCoreLib::ScalarField* sf : previous)
+	{
+		if (!sf || sf->size() != numberOfPoints)
+			return -1;
+	}
+
+	//sky directions of the weighted rays (the opposite of the light directions)
+	std::vector<CCVector3d> skyDirs;
+	double maxCotangent = 0; //horizontal reach per unit of height
+	try
+	{
+		receiverMask.assign((numberOfPoints + 63) / 64, 0);
+		for (size_t i = 0; i < rays.size(); ++i)
+		{
+			bool weighted = false;
+			for (const std::vector<double>& w : weights)
+				weighted = weighted || (i < w.size() && w[i] != 0);
+			if (!weighted)
+				continue;
+
+			CCVector3d dir(-static_cast<double>(rays[i].x), -static_cast<double>(rays[i].y), -static_cast<double>(rays[i].z));
+			dir.normalize();
+			skyDirs.push_back(dir);
+			double horizontal = sqrt(dir.x * dir.x + dir.y * dir.y);
+			maxCotangent = (dir.z > 0 ? std::max(maxCotangent, horizontal / dir.z) : std::numeric_limits<double>::infinity());
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory?
+		return -1;
+	}
+
+	int64_t count = 0;
+	vertices->placeIteratorAtBeginning();
+	for (size_t j = 0; j < numberOfPoints; ++j)
+	{
+		const CCVector3* P = vertices->getNextPoint();
+
+		bool affected = false;
+		for (const CCCoreLib::ScalarField* sf : previous)
+		{
+			if (std::isnan((*sf)[j]))
+			{
+				affected = true;
+				break;
+			}
+		}
+
+		//quick rejection: the box must be within reach of the lowest ray
+		double height = static_cast<double>(changedMax.z) - P->z;
+		if (!affected && height >= 0)
+		{
+			double dx = std::max(0.0, std::max(static_cast<double>(changedMin.x) - P->x, static_cast<double>(P->x) - changedMax.x));
+			double dy = std::max(0.0, std::max(static_cast<double>(changedMin.y) - P->y, static_cast<double>(P->y) - changedMax.y));
+			if (sqrt(dx * dx + dy * dy) <= height * maxCotangent)
+			{
+				for (const CCVector3d& dir : skyDirs)
+				{
+					if (HalfLineCrossesBox(*P, dir, changedMin, changedMax))
+					{
+						affected = true;
+						break;
+					}
+				}
+			}
+		}
+
+		if (affected)
+		{
+			receiverMask[j >> 6] |= (static_cast<uint64_t>(1) << (j & 63));
+			++count;
+		}
+	}
+
+	return count;
+}
+
+bool SOLIS::LaunchIncremental(	const std::vector<CCVector3>& rays,
+								const std::vector< std::vector<double> >& weights,
+								double conversion,
+								const CCVector3& changedMin,
+								const CCVector3& changedMax,
+								CCCoreLib::GenericCloud* vertices,
+								const std::vector<CCCoreLib::ScalarField*>& outputs,
+								CCCoreLib::GenericMesh* mesh/*=nullptr*/,
+								bool meshIsClosed/*=false*/,
+								unsigned width/*=1024*/,
+								unsigned height/*=1024*/,
+								CCCoreLib::GenericProgressCallback* progressCb/*=nullptr*/,
+								const QString& entityName/*=QString()*/,
+								size_t* updatedCount/*=nullptr*/)
+{
+	if (updatedCount)
+		*updatedCount = 0;
+
+	if (rays.empty() || outputs.empty() || weights.size() != outputs.size() || !vertices)
+		return false;
+
+	size_t numberOfPoints = vertices->size();
+	size_t numberOfRays = rays.size();
+	size_t numberOfOutputs = outputs.size();
+	for (size_t k = 0; k < numberOfOutputs; ++k)
+	{
+		if (weights[k].size() != numberOfRays)
+			return false;
+	}
+
+	std::vector<uint64_t> receiverMask;
+	int64_t receiverCount = AffectedReceivers(rays, weights, changedMin, changedMax, vertices, outputs, receiverMask);
+	if (receiverCount < 0)
+		return false;
+	if (receiverCount == 0)
+		return true; //nothing to update
+
+	//accumulator slot of each re-evaluated vertex
+	std::vector<size_t> slots;
+	std::vector<double> sums;
+	try
+	{
+		slots.resize(numberOfPoints, 0);
+		sums.resize(static_cast<size_t>(receiverCount) * numberOfOutputs, 0);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory?
+		return false;
+	}
+	size_t slot = 0;
+	for (size_t j = 0; j < numberOfPoints; ++j)
+	{
+		if ((receiverMask[j >> 6] >> (j & 63)) & 1)
+			slots[j] = slot++;
+	}
+
+	/*** Main illumination loop ***/
+	int lastPercent = 0;
+	StartProgress(progressCb, entityName, numberOfRays, mesh, static_cast<size_t>(receiverCount));
+
+	//must be done after progress dialog display!
+	//(same view and pixels as a full render: only the pixels of the receivers are rendered and read back)
+	SOLISContext win;
+	if (!win.init(width, height, vertices, mesh, meshIsClosed) || !win.setReceivers(&receiverMask))
+		return false;
+
+	std::vector<size_t> activeOutputs;
+	activeOutputs.reserve(numberOfOutputs);
+	for (size_t i = 0; i < numberOfRays; ++i)
+	{
+		//outputs actually lit by this ray
+		activeOutputs.clear();
+		for (size_t k = 0; k < numberOfOutputs; ++k)
+		{
+			if (weights[k][i] != 0)
+				activeOutputs.push_back(k);
+		}
+
+		if (!activeOutputs.empty())
+		{
+			win.setViewDirection(rays[i]);
+			int64_t seen = win.GLForEachVisiblePoint(numberOfPoints, [&](size_t j)
+			{
+				double* s = sums.data() + slots[j] * numberOfOutputs;
+				for (size_t k : activeOutputs)
+					s[k] += weights[k][i];
+			});
+			if (seen < 0)
+				return false;
+		}
+
+		if (!UpdateProgress(progressCb, i + 1, numberOfRays, lastPercent))
+			return false;
+	}
+
+	//only the re-evaluated vertices are updated
+	for (size_t j = 0; j < numberOfPoints; ++j)
+	{
+		if (((receiverMask[j >> 6] >> (j & 63)) & 1) == 0)
+			continue;
+		const double* s = sums.data() + slots[j] * numberOfOutputs;
+		for (size_t k = 0; k < numberOfOutputs; ++k)
+			(*outputs[k])[j] = static_cast<ScalarType>(s[k] * conversion);
+	}
+
+	if (updatedCount)
+		*updatedCount = static_cast<size_t>(receiverCount);
+
+	return true;
+}
+
+//! Accumulates the heightfield visibility of located receivers (see SOLIS::LaunchHeightfield)
+/** Outputs are reset, then converted to an 'intensity' scalar field. Progress is reported as
+	(progressOffset + processed rays) / progressTotal.
+	\return false if an error occurred or if the process has been cancelled
+**/
+static bool AccumulateHeightfield(	const SOLISHeightfield& heightfield,
+									const SOLISHeightfield::Receivers& receivers,
+									const std::vector<CCVector3>& rays,
+									const std::vector< std::vector<double> >& weights,
+									double conversion,
+									const std::vector<CCCoreLib::ScalarField*>& outputs,
+									SOLIS::AccumulatorPrecision precision,
+									CCCoreLib::GenericProgressCallback* progressCb,
+									size_t progressOffset,
+									size_t progressTotal,
+									int& lastPercent)
+{
+	size_t numberOfPoints = receivers.cells.size();
+	size_t numberOfRays = rays.size();
+	size_t numberOfOutputs = outputs.size();
+
+	for (size_t k = 0; k < numberOfOutputs; ++k)
+	{
+		if (!outputs[k] || outputs[k]->size() != numberOfPoints || weights[k].size() != numberOfRays)
+			return false;
+		std::fill(outputs[k]->begin(), outputs[k]->end(), static_cast<ScalarType>(0));
+	}
+
+	//rays actually lit (at least one non-zero weight)
+	std::vector<size_t> activeRays;
+	//auxiliary buffers (see AccumulatorPrecision)
+	std::vector< std::vector<ScalarType> > compensation;
+	std::vector< std::vector<double> > accumulators;
+	std::vector<ScalarType> noCompensation;
+	std::vector<double> noSums;
+	try
+	{
+		for (size_t i = 0; i < numberOfRays; ++i)
+		{
+			for (size_t k = 0; k < numberOfOutputs; ++k)
+			{
+				if (weights[k][i] != 0)
+				{
+					activeRays.push_back(i);
+					break;
+				}
+			}
+		}
+		if (precision == SOLIS::ACCUMULATOR_COMPACT)
+			compensation.resize(numberOfOutputs, std::vector<ScalarType>(numberOfPoints, 0));
+		else if (precision == SOLIS::ACCUMULATOR_DOUBLE)
+			accumulators.resize(numberOfOutputs, std::vector<double>(numberOfPoints, 0));
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory?
+		return false;
+	}
+
+	//the sweep of a direction is sequential (each line depends on the previous one): the directions are swept in parallel
+	size_t threadCount = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), activeRays.size());
+	std::vector<SOLISHeightfield::Workspace> workspaces;
+	std::vector< std::vector<uint64_t> > masks;
+	std::vector<int64_t> litCounts;
+	try
+	{
+		workspaces.resize(threadCount);
+		masks.resize(threadCount);
+		litCounts.resize(threadCount, 0);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory?
+		return false;
+	}
+
+	for (size_t first = 0; first < activeRays.size(); first += threadCount)
+	{
+		size_t batchSize = std::min(threadCount, activeRays.size() - first);
+		auto sweep = [&](size_t slot)
+		{
+			litCounts[slot] = heightfield.visibilityMask(rays[activeRays[first + slot]], receivers, workspaces[slot], masks[slot]);
+		};
+
+		std::vector<std::thread> threads;
+		size_t threadedEnd = 1;
+		try
+		{
+			for (size_t slot = 1; slot < batchSize; ++slot)
+			{
+				threads.emplace_back(sweep, slot);
+				threadedEnd = slot + 1;
+			}
+		}
+		catch (const std::system_error&)
+		{
+			//not enough resources: the remaining directions are swept below
+		}
+		sweep(0);
+		for (size_t slot = threadedEnd; slot < batchSize; ++slot)
+			sweep(slot);
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+
+		//accumulation (sequential)
+		for (size_t slot = 0; slot < batchSize; ++slot)
+		{
+			if (litCounts[slot] < 0)
+				return false;
+
+			size_t i = activeRays[first + slot];
+			for (size_t k = 0; k < numberOfOutputs; ++k)
+			{
+				AccumulateMask(	masks[slot],
+								weights[k][i],
+								*outputs[k],
+								compensation.empty() ? noCompensation : compensation[k],
+								accumulators.empty() ? noSums : accumulators[k]);
+			}
+		}
+
+		size_t done = (first + batchSize < activeRays.size() ? activeRays[first + batchSize] : numberOfRays);
+		if (!UpdateProgress(progressCb, progressOffset + done, progressTotal, lastPercent))
+			return false;
+	}
+
+	//we convert per-vertex accumulators to an 'intensity' scalar field (in place)
+	for (size_t k = 0; k < numberOfOutputs; ++k)
+	{
+		std::vector<ScalarType>& values = *outputs[k];
+		for (size_t j = 0; j < numberOfPoints; ++j)
+		{
+			double sum = (accumulators.empty() ? values[j] : accumulators[k][j]);
+			values[j] = static_cast<ScalarType>(sum * conversion);
+		}
+	}
+
+	return true;
+}
+
+bool SOLIS::LaunchHeightfield(	const std::vector<CCVector3>& rays,
+								const std::vector< std::vector<double> >& weights,
+								double conversion,
+								double cellSize,
+								CCCoreLib::GenericCloud* vertices,
+								const std::vector<CCCoreLib::ScalarField*>& outputs,
+								CCCoreLib::GenericProgressCallback* progressCb/*=nullptr*/,
+								const QString& entityName/*=QString()*/,
+								AccumulatorPrecision precision/*=ACCUMULATOR_COMPACT*/)
+{
+	if (rays.empty() || outputs.empty() || weights.size() != outputs.size())
+		return false;
+
+	if (!vertices)
+		return false;
+
+	SOLISHeightfield heightfield;
+	if (!heightfield.init(vertices, cellSize))
+		return false;
+
+	SOLISHeightfield::Receivers receivers;
+	if (!heightfield.locate(vertices, receivers))
+		return false;
+
+	/*** Main illumination loop ***/
+	int lastPercent = 0;
+	StartProgress(progressCb, entityName, rays.size(), nullptr, vertices->size());
+
+	return AccumulateHeightfield(heightfield, receivers, rays, weights, conversion, outputs, precision, progressCb, 0, rays.size(), lastPercent);
+}
+
+//! Extra halo cells (rasterization and interpolation of the occluders)
+static const unsigned c_haloPadding = 2;
+//! Minimum number of tiles per thread (load balancing) with an automatic tile size
+static const unsigned c_tilesPerThread = 4;
+
+bool SOLIS::LaunchHeightfieldTiled(	const std::vector<CCVector3>& rays,
+									const std::vector< std::vector<double> >& weights,
+									double conversion,
+									double cellSize,
+									double tileSize,
+									CCCoreLib::GenericCloud* vertices,
+									const std::vector<CCCoreLib::ScalarField*>& outputs,
+									CCCoreLib::GenericProgressCallback* progressCb/*=nullptr*/,
+									const QString& entityName/*=QString()*/,
+									AccumulatorPrecision precision/*=ACCUMULATOR_COMPACT*/,
+									unsigned* tileCount/*=nullptr*/,
+									double* haloSize/*=nullptr*/)
+{
+	if (rays.empty() || outputs.empty() || weights.size() != outputs.size())
+		return false;
+
+	if (!vertices || vertices->size() == 0)
+		return false;
+
+	size_t numberOfPoints = vertices->size();
+	size_t numberOfRays = rays.size();
+	size_t numberOfOutputs = outputs.size();
+
+	for (size_t k = 0; k < numberOfOutputs; ++k)
+	{
+		if (!outputs[k] || outputs[k]->size() != numberOfPoints || weights[k].size() != numberOfRays)
+			return false;
+		std::fill(outputs[k]->begin(), outputs[k]->end(), static_cast<ScalarType>(0));
+	}
+
+	//global grid (the tile grids are aligned on it)
+	CCVector3 bbMin;
+	CCVector3 bbMax;
+	vertices->getBoundingBox(bbMin, bbMax);
+	if (cellSize <= 0)
+		cellSize = SOLISHeightfield::EstimateCellSize(bbMin, bbMax, numberOfPoints);
+	double gridColumns = floor((static_cast<double>(bbMax.x) - bbMin.x) / cellSize + 0.5) + 1;
+	double gridRows = floor((static_cast<double>(bbMax.y) - bbMin.y) / cellSize + 0.5) + 1;
+	if (gridColumns * gridRows >= 4294967295.0)
+		return false;
+	unsigned nx = static_cast<unsigned>(gridColumns);
+	unsigned ny = static_cast<unsigned>(gridRows);
+
+	//rays actually lit (at least one non-zero weight, sun above the horizon) and lowest sun elevation
+	std::vector<size_t> activeRays;
+	double minTangent = std::numeric_limits<double>::infinity();
+	//vertices and their tile
+	std::vector<CCVector3> points;
+	std::vector< std::vector<size_t> > tileVertices;
+	try
+	{
+		for (size_t i = 0; i < numberOfRays; ++i)
+		{
+			double horizontal = sqrt(static_cast<double>(rays[i].x) * rays[i].x + static_cast<double>(rays[i].y) * rays[i].y);
+			if (rays[i].z >= 0)
+				continue;
+			for (size_t k = 0; k < numberOfOutputs; ++k)
+			{
+				if (weights[k][i] != 0)
+				{
+					activeRays.push_back(i);
+					if (horizontal > 0)
+						minTangent = std::min(minTangent, -rays[i].z / horizontal);
+					break;
+				}
+			}
+		}
+
+		//shadows can't be longer than the height range of the scene divided by the tangent of the lowest sun elevation
+		double halo = (std::isinf(minTangent) ? 0 : (static_cast<double>(bbMax.z) - bbMin.z) / minTangent);
+		unsigned haloCells = static_cast<unsigned>(std::min(ceil(halo / cellSize), static_cast<double>(std::max(nx, ny)))) + c_haloPadding;
+		if (haloSize)
+			*haloSize = haloCells * cellSize;
+
+		if (tileSize <= 0)
+		{
+			//a few tiles per thread (load balancing), but not much smaller than the halo (overhead)
+			double threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+			tileSize = std::max(4 * haloCells * cellSize, sqrt(nx * cellSize * ny * cellSize / (c_tilesPerThread * threadCount)));
+		}
+		unsigned tileCells = static_cast<unsigned>(std::max(floor(tileSize / cellSize + 0.5), 1.0));
+		unsigned tileColumns = (nx + tileCells - 1) / tileCells;
+		unsigned tileRows = (ny + tileCells - 1) / tileCells;
+
+		points.resize(numberOfPoints);
+		tileVertices.resize(static_cast<size_t>(tileColumns) * tileRows);
+		SOLISHeightfield grid;
+		if (!grid.init(bbMin.x, bbMin.y, nx, ny, cellSize))
+			return false;
+		vertices->placeIteratorAtBeginning();
+		for (size_t j = 0; j < numberOfPoints; ++j)
+		{
+			points[j] = *vertices->getNextPoint();
+			uint32_t cell = grid.cell(points[j]);
+			unsigned tile = (cell / nx / tileCells) * tileColumns + (cell % nx) / tileCells;
+			tileVertices[tile].push_back(j);
+		}
+
+		if (tileCount)
+			*tileCount = tileColumns * tileRows;
+
+		/*** Main illumination loop ***/
+		int lastPercent = 0;
+		StartProgress(progressCb, entityName, numberOfRays, nullptr, numberOfPoints);
+
+		std::atomic<size_t> nextTile(0);
+		std::atomic<size_t> doneTiles(0);
+		std::atomic<bool> stop(false);
+
+		auto processTile = [&](size_t tile) -> bool
+		{
+			const std::vector<size_t>& receiverIndexes = tileVertices[tile];
+			if (receiverIndexes.empty() || activeRays.empty())
+				return true;
+
+			//tile and halo cells
+			unsigned tx = static_cast<unsigned>(tile % tileColumns);
+			unsigned ty = static_cast<unsigned>(tile / tileColumns);
+			unsigned c0 = tx * tileCells - std::min(tx * tileCells, haloCells);
+			unsigned c1 = std::min((tx + 1) * tileCells + haloCells, nx);
+			unsigned r0 = ty * tileCells - std::min(ty * tileCells, haloCells);
+			unsigned r1 = std::min((ty + 1) * tileCells + haloCells, ny);
+
+			SOLISHeightfield heightfield;
+			if (!heightfield.init(bbMin.x + c0 * cellSize, bbMin.y + r0 * cellSize, c1 - c0, r1 - r0, cellSize))
+				return false;
+			for (unsigned y = r0 / tileCells; y <= (r1 - 1) / tileCells; ++y)
+			{
+				for (unsigned x = c0 / tileCells; x <= (c1 - 1) / tileCells; ++x)
+				{
+					for (size_t j : tileVertices[static_cast<size_t>(y) * tileColumns + x])
+						heightfield.addOccluder(points[j]);
+				}
+			}
+			//same base height as a grid of the whole entity
+			heightfield.setBaseHeight(bbMin.z);
+
+			size_t receiverCount = receiverIndexes.size();
+			SOLISHeightfield::Receivers receivers;
+			receivers.cells.resize(receiverCount);
+			receivers.heights.resize(receiverCount);
+			for (size_t j = 0; j < receiverCount; ++j)
+			{
+				receivers.cells[j] = heightfield.cell(points[receiverIndexes[j]]);
+				receivers.heights[j] = points[receiverIndexes[j]].z;
+			}
+
+			//per-tile accumulators (see AccumulatorPrecision)
+			std::vector< std::vector<ScalarType> > values(numberOfOutputs, std::vector<ScalarType>(receiverCount, 0));
+			std::vector< std::vector<ScalarType> > compensation;
+			std::vector< std::vector<double> > accumulators;
+			std::vector<ScalarType> noCompensation;
+			std::vector<double> noSums;
+			if (precision == ACCUMULATOR_COMPACT)
+				compensation.resize(numberOfOutputs, std::vector<ScalarType>(receiverCount, 0));
+			else if (precision == ACCUMULATOR_DOUBLE)
+				accumulators.resize(numberOfOutputs, std::vector<double>(receiverCount, 0));
+
+			SOLISHeightfield::Workspace workspace;
+			std::vector<uint64_t> mask;
+			for (size_t i : activeRays)
+			{
+				if (stop)
+					return true;
+				if (heightfield.visibilityMask(rays[i], receivers, workspace, mask) < 0)
+					return false;
+				for (size_t k = 0; k < numberOfOutputs; ++k)
+				{
+					AccumulateMask(	mask,
+									weights[k][i],
+									values[k],
+									compensation.empty() ? noCompensation : compensation[k],
+									accumulators.empty() ? noSums : accumulators[k]);
+				}
+			}
+
+			//each vertex belongs to a single tile
+			for (size_t k = 0; k < numberOfOutputs; ++k)
+			{
+				std::vector<ScalarType>& output = *outputs[k];
+				for (size_t j = 0; j < receiverCount; ++j)
+				{
+					double sum = (accumulators.empty() ? values[k][j] : accumulators[k][j]);
+					output[receiverIndexes[j]] = static_cast<ScalarType>(sum * conversion);
+				}
+			}
+			return true;
+		};
+
+		auto worker = [&](bool mainThread)
+		{
+			while (!stop)
+			{
+				size_t tile = nextTile++;
+				if (tile >= tileVertices.size())
+					break;
+
+				bool success = false;
+				try
+				{
+					success = processTile(tile);
+				}
+				catch (const std::bad_alloc&)
+				{
+					//not enough memory?
+				}
+				if (!success)
+					stop = true;
+				++doneTiles;
+
+				//the progress bar is only updated by the main thread
+				if (mainThread && !UpdateProgress(progressCb, doneTiles, tileVertices.size(), lastPercent))
+					stop = true;
+			}
+		};
+
+		//tiles are processed in parallel (one tile at a time per thread)
+		size_t threadCount = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), tileVertices.size());
+		std::vector<std::thread> threads;
+		try
+		{
+			for (size_t t = 1; t < threadCount; ++t)
+			{
+				threads.emplace_back(worker, false);
+			}
+		}
+		catch (const std::system_error&)
+		{
+			//not enough resources: the remaining tiles are processed by the other threads
+		}
+		worker(true);
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+
+		return !stop;
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory?
+		return false;
+	}
+}
+
+bool SOLIS::LaunchStreamed(	const std::vector<CCVector3>& rays,
+							const std::vector< std::vector<double> >& weights,
+							double conversion,
+							double cellSize,
+							const QString& inputFilename,
+							const QString& outputFilename,
+							const std::vector<QString>& fieldNames,
+							size_t chunkSize,
+							CCCoreLib::GenericProgressCallback* progressCb/*=nullptr*/,
+							AccumulatorPrecision precision/*=ACCUMULATOR_COMPACT*/,
+							QString* error/*=nullptr*/)
+{
+	if (weights.empty() || weights.size() != fieldNames.size() || chunkSize == 0)
+		return false;
+
+	SOLISFile::Reader reader;
+	if (!reader.open(inputFilename, error))
+		return false;
+
+	CCCoreLib::PointCloud chunk;
+
+	//first pass: extent of the vertices
+	size_t numberOfPoints = 0;
+	CCVector3 bbMin;
+	CCVector3 bbMax;
+	while (true)
+	{
+		if (!reader.read(chunkSize, chunk, error))
+			return false;
+		if (chunk.size() == 0)
+			break;
+
+		CCVector3 chunkMin;
+		CCVector3 chunkMax;
+		chunk.getBoundingBox(chunkMin, chunkMax);
+		for (unsigned d = 0; d < 3; ++d)
+		{
+			bbMin.u[d] = (numberOfPoints == 0 ? chunkMin.u[d] : std::min(bbMin.u[d], chunkMin.u[d]));
+			bbMax.u[d] = (numberOfPoints == 0 ? chunkMax.u[d] : std::max(bbMax.u[d], chunkMax.u[d]));
+		}
+		numberOfPoints += chunk.size();
+	}
+	if (numberOfPoints == 0)
+	{
+		if (error)
+			*error = QString("%1: No point found").arg(inputFilename);
+		return false;
+	}
+
+	//second pass: occluders
+	SOLISHeightfield heightfield;
+	if (cellSize <= 0)
+		cellSize = SOLISHeightfield::EstimateCellSize(bbMin, bbMax, numberOfPoints);
+	if (!heightfield.init(bbMin, bbMax, cellSize))
+	{
+		if (error)
+			*error = "Not enough memory";
+		return false;
+	}
+
+	if (!reader.rewind(error))
+		return false;
+	while (true)
+	{
+		if (!reader.read(chunkSize, chunk, error))
+			return false;
+		if (chunk.size() == 0)
+			break;
+		heightfield.addOccluders(&chunk);
+	}
+
+	//third pass: receivers, chunk by chunk
+	SOLISFile::Writer writer;
+	if (!writer.open(outputFilename, numberOfPoints, 0, reader.shift(), fieldNames, error))
+		return false;
+
+	std::vector<CCCoreLib::ScalarField*> outputs;
+	for (const QString& name : fieldNames)
+	{
+		outputs.push_back(new CCCoreLib::ScalarField(qPrintable(name)));
+		outputs.back()->link();
+	}
+
+	size_t chunkCount = (numberOfPoints + chunkSize - 1) / chunkSize;
+	int lastPercent = 0;
+	StartProgress(progressCb, inputFilename, rays.size(), nullptr, numberOfPoints);
+
+	bool success = reader.rewind(error);
+	SOLISHeightfield::Receivers receivers;
+	for (size_t c = 0; success; ++c)
+	{
+		success = reader.read(chunkSize, chunk, error);
+		if (!success || chunk.size() == 0)
+			break;
+
+		for (CCCoreLib::ScalarField* output : outputs)
+		{
+			if (!output->resizeSafe(chunk.size()))
+			{
+				success = false;
+				break;
+			}
+		}
+
+		success = success
+			&& heightfield.locate(&chunk, receivers)
+			&& AccumulateHeightfield(heightfield, receivers, rays, weights, conversion, outputs, precision, progressCb, c * rays.size(), chunkCount * rays.size(), lastPercent)
+			&& writer.write(chunk, outputs);
+	}
+	for (CCCoreLib::ScalarField* output : outputs)
+		output->release();
+
+	if (!success)
+	{
+		writer.close();
+		if (error && error->isEmpty())
+			*error = QString("Failed to process '%1'").arg(inputFilename);
+		return false;
+	}
+
+	return writer.close(error);
+}
+
+bool SOLIS::LaunchShard(	const std::vector<CCVector3>& rays,
+							CCCoreLib::GenericCloud* vertices,
+							SOLISShard& shard,
+							CCCoreLib::GenericMesh* mesh/*=nullptr*/,
+							bool meshIsClosed/*=false*/,
+							unsigned width/*=1024*/,
+							unsigned height/*=1024*/,
+							CCCoreLib::GenericProgressCallback* progressCb/*=nullptr*/,
+							const QString& entityName/*=QString()*/,
+							size_t* renderedCount/*=nullptr*/)
+{
+	if (!vertices || rays.size() != shard.rayCount())
+		return false;
+
+	//slice of the rays rendered by this shard
+	std::vector<size_t> rayIndexes;
+	if (!shard.selectRays(rayIndexes))
+		return false;
+
+	if (renderedCount)
+		*renderedCount = rayIndexes.size();
+	if (rayIndexes.empty())
+	{
+		//nothing to render (more shards than rays): null partial results
+		return true;
+	}
+
+	size_t numberOfPoints = vertices->size();
+
+	/*** Main illumination loop ***/
+	int lastPercent = 0;
+	StartProgress(progressCb, entityName, rayIndexes.size(), mesh, numberOfPoints);
+
+	//must be done after progress dialog display!
+	SOLISContext win;
+	if (!win.init(width, height, vertices, mesh, meshIsClosed))
+		return false;
+
+	for (size_t r = 0; r < rayIndexes.size(); ++r)
+	{
+		size_t i = rayIndexes[r];
+
+		//set current 'light' direction
+		win.setViewDirection(rays[i]);
+
+		//flag viewed vertices
+		int64_t seen = win.GLForEachVisiblePoint(numberOfPoints, [&](size_t j)
+		{
+			shard.add(i, j);
+		});
+
+		if (seen < 0)
+			return false;
+
+		if (!UpdateProgress(progressCb, r + 1, rayIndexes.size(), lastPercent))
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,916 @@
+//##########################################################################
+//#                                                                        #
+//#                       CLOUDCOMPARE PLUGIN: qSOLIS                      #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                  COPYRIGHT: David Basler                               #
+//#                                                                        #
+//##########################################################################
+
+#include "SOLISCache.h"
+#include "SOLISSky.h"
+
+//CCCoreLib
+#include <GenericTriangle.h>
+
+//Qt
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+//System
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+//! Sky-view factor file signature
+static const char c_skyViewMagic[8] = { 'S', 'O', 'L', 'I', 'S', 'S', 'V', 'F' };
+//! Sky-view factor file version
+static const uint32_t c_skyViewVersion = 1;
+
+//! Spherical harmonics visibility file signature
+static const char c_harmonicsMagic[8] = { 'S', 'O', 'L', 'I', 'S', 'S', 'H', 'V' };
+//! Spherical harmonics visibility file version
+static const uint32_t c_harmonicsVersion = 1;
+
+//! Visibility matrix file signature
+static const char c_visibilityMagic[8] = { 'S', 'O', 'L', 'I', 'S', 'V', 'I', 'S' };
+//! Visibility matrix file version
+static const uint32_t c_visibilityVersion = 1;
+
+//! Sun bin store file signature
+static const char c_sunBinMagic[8] = { 'S', 'O', 'L', 'I', 'S', 'S', 'U', 'N' };
+//! Sun bin store file version
+static const uint32_t c_sunBinVersion = 1;
+
+//! 64 bits FNV-1a hash
+class Hash64
+{
+public:
+	void add(const void* data, size_t size)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; ++i)
+		{
+			m_value ^= bytes[i];
+			m_value *= 1099511628211ULL;
+		}
+	}
+
+	template <class T> void add(const T& value)
+	{
+		add(&value, sizeof(T));
+	}
+
+	uint64_t value() const { return m_value; }
+
+private:
+	uint64_t m_value = 14695981039346656037ULL;
+};
+
+//! Sky-view factor file header
+struct SkyViewHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+	uint64_t geometryKey;
+	uint64_t raysKey;
+	uint64_t count;
+};
+
+//! Spherical harmonics visibility file header (followed by the coefficients, as 32 bits floats)
+struct HarmonicsHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t order;
+	uint64_t geometryKey;
+	uint64_t raysKey;
+	uint64_t pointCount;
+};
+
+//! Visibility matrix file header
+/** Followed by the directions (3 x 32 bits floats each), the column offsets (directionCount + 1 x 64 bits,
+	relative to the first column) and the columns.
+**/
+struct VisibilityHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+	uint64_t geometryKey;
+	uint64_t directionsKey;
+	uint64_t pointCount;
+	uint64_t directionCount;
+};
+
+//! Sun bin store file header (followed by the columns, see SunBinRecord)
+struct SunBinHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+	uint64_t geometryKey;
+	uint64_t pointCount;
+	double binSize;
+};
+
+//! Sun bin store column header (followed by the encoded column)
+struct SunBinRecord
+{
+	uint64_t binKey;
+	uint64_t size;
+};
+
+//! Returns the position in a file (64 bits)
+static int64_t Tell(FILE* fp)
+{
+#ifdef _WIN32
+	return _ftelli64(fp);
+#else
+	return static_cast<int64_t>(ftello(fp));
+#endif
+}
+
+//! Sets the position in a file (64 bits)
+static bool Seek(FILE* fp, int64_t offset, int origin)
+{
+#ifdef _WIN32
+	return (_fseeki64(fp, offset, origin) == 0);
+#else
+	return (fseeko(fp, static_cast<off_t>(offset), origin) == 0);
+#endif
+}
+
+//! Returns the index of the lowest set bit (the value must not be null)
+static inline unsigned LowestBit(uint64_t value)
+{
+#ifdef _MSC_VER
+	unsigned long index = 0;
+	_BitScanForward64(&index, value);
+	return static_cast<unsigned>(index);
+#else
+	return static_cast<unsigned>(__builtin_ctzll(value));
+#endif
+}
+
+//! Returns the index of the first vertex at or after 'start' whose visibility bit is 'visible' ('count' if none)
+static size_t NextVertex(const std::vector<uint64_t>& mask, size_t start, bool visible, size_t count)
+{
+	size_t wordIndex = start >> 6;
+	if (wordIndex >= mask.size())
+		return count;
+
+	uint64_t word = (visible ? mask[wordIndex] : ~mask[wordIndex]) & (~0ULL << (start & 63));
+	while (word == 0)
+	{
+		if (++wordIndex >= mask.size())
+			return count;
+		word = (visible ? mask[wordIndex] : ~mask[wordIndex]);
+	}
+	return std::min((wordIndex << 6) + LowestBit(word), count);
+}
+
+//! Appends a LEB128 variable length integer
+static inline void WriteVarint(uint64_t value, std::vector<uint8_t>& buffer)
+{
+	while (value >= 0x80)
+	{
+		buffer.push_back(static_cast<uint8_t>(value | 0x80));
+		value >>= 7;
+	}
+	buffer.push_back(static_cast<uint8_t>(value));
+}
+
+//! Reads a LEB128 variable length integer
+/** \return false if the end of the buffer is reached first
+**/
+static inline bool ReadVarint(const uint8_t*& data, const uint8_t* end, uint64_t& value)
+{
+	value = 0;
+	for (unsigned shift = 0; data < end && shift < 64; shift += 7)
+	{
+		uint8_t byte = *data++;
+		value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0)
+			return true;
+	}
+	return false;
+}
+
+//! Encodes a visibility column as alternated runs of hidden and visible vertices (starting with hidden ones)
+static bool EncodeColumn(const std::vector<uint64_t>& visibilityMask, size_t pointCount, std::vector<uint8_t>& buffer)
+{
+	if (visibilityMask.size() < (pointCount + 63) / 64)
+		return false;
+
+	buffer.clear();
+	try
+	{
+		bool visible = false;
+		for (size_t start = 0; start < pointCount; )
+		{
+			size_t end = NextVertex(visibilityMask, start, !visible, pointCount);
+			WriteVarint(end - start, buffer);
+			start = end;
+			visible = !visible;
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		return false;
+	}
+	return true;
+}
+
+//! Adds a weight to the vertices visible in an encoded column (see EncodeColumn)
+/** \return false if the column is corrupted
+**/
+static bool AccumulateColumn(const uint8_t* data, const uint8_t* end, double weight, std::vector<double>& sums)
+{
+	size_t index = 0;
+	bool visible = false;
+	while (data < end)
+	{
+		uint64_t run = 0;
+		if (!ReadVarint(data, end, run) || run > sums.size() - index)
+			return false;
+		if (visible)
+		{
+			for (size_t j = index; j < index + run; ++j)
+				sums[j] += weight;
+		}
+		index += run;
+		visible = !visible;
+	}
+	return true;
+}
+
+uint64_t SOLISCache::GeometryKey(CCCoreLib::GenericCloud* vertices, CCCoreLib::GenericMesh* mesh, bool meshIsClosed, unsigned resolution)
+{
+	Hash64 hash;
+	hash.add(static_cast<uint8_t>(meshIsClosed));
+	hash.add(resolution);
+
+	if (vertices)
+	{
+		hash.add(vertices->size());
+		vertices->placeIteratorAtBeginning();
+		for (unsigned i = 0; i < vertices->size(); ++i)
+		{
+			const CCVector3* P = vertices->getNextPoint();
+			hash.add(P->u, sizeof(PointCoordinateType) * 3);
+		}
+	}
+
+	if (mesh)
+	{
+		hash.add(mesh->size());
+		mesh->placeIteratorAtBeginning();
+		for (unsigned i = 0; i < mesh->size(); ++i)
+		{
+			CCCoreLib::GenericTriangle* triangle = mesh->_getNextTriangle();
+			hash.add(triangle->_getA()->u, sizeof(PointCoordinateType) * 3);
+			hash.add(triangle->_getB()->u, sizeof(PointCoordinateType) * 3);
+			hash.add(triangle->_getC()->u, sizeof(PointCoordinateType) * 3);
+		}
+	}
+
+	return hash.value();
+}
+
+uint64_t SOLISCache::RaysKey(const std::vector<CCVector3>& rays, const std::vector<double>& weights)
+{
+	Hash64 hash;
+	hash.add(static_cast<uint64_t>(rays.size()));
+	for (const CCVector3& ray : rays)
+	{
+		hash.add(ray.u, sizeof(PointCoordinateType) * 3);
+	}
+	hash.add(static_cast<uint64_t>(weights.size()));
+	if (!weights.empty())
+	{
+		hash.add(weights.data(), weights.size() * sizeof(double));
+	}
+	return hash.value();
+}
+
+uint64_t SOLISCache::RaysKey(const std::vector<CCVector3>& rays, const std::vector< std::vector<double> >& weights)
+{
+	Hash64 hash;
+	hash.add(RaysKey(rays, std::vector<double>()));
+	hash.add(static_cast<uint64_t>(weights.size()));
+	for (const std::vector<double>& w : weights)
+	{
+		hash.add(RaysKey(std::vector<CCVector3>(), w));
+	}
+	return hash.value();
+}
+
+QString SOLISCache::SkyViewFilename(const QString& directory, uint64_t geometryKey, uint64_t raysKey)
+{
+	return QDir(directory).absoluteFilePath(QString("%1_%2.svf").arg(geometryKey, 16, 16, QChar('0')).arg(raysKey, 16, 16, QChar('0')));
+}
+
+bool SOLISCache::LoadSkyView(const QString& filename, uint64_t geometryKey, uint64_t raysKey, std::vector<ScalarType>& values)
+{
+	FILE* fp = fopen(qPrintable(filename), "rb");
+	if (!fp)
+		return false;
+
+	SkyViewHeader header;
+	bool valid = (	fread(&header, sizeof(SkyViewHeader), 1, fp) == 1
+				&&	memcmp(header.magic, c_skyViewMagic, sizeof(c_skyViewMagic)) == 0
+				&&	header.version == c_skyViewVersion
+				&&	header.geometryKey == geometryKey
+				&&	header.raysKey == raysKey
+				&&	header.count == values.size() );
+
+	if (valid && !values.empty())
+	{
+		//values are stored as 32 bits floats
+		std::vector<float> buffer;
+		try
+		{
+			buffer.resize(values.size());
+		}
+		catch (const std::bad_alloc&)
+		{
+			fclose(fp);
+			return false;
+		}
+		valid = (fread(buffer.data(), sizeof(float), buffer.size(), fp) == buffer.size());
+		if (valid)
+		{
+			for (size_t i = 0; i < values.size(); ++i)
+				values[i] = static_cast<ScalarType>(buffer[i]);
+		}
+	}
+
+	fclose(fp);
+	return valid;
+}
+
+bool SOLISCache::SaveSkyView(const QString& filename, uint64_t geometryKey, uint64_t raysKey, const std::vector<ScalarType>& values)
+{
+	QDir().mkpath(QFileInfo(filename).absolutePath());
+
+	FILE* fp = fopen(qPrintable(filename), "wb");
+	if (!fp)
+		return false;
+
+	SkyViewHeader header;
+	memcpy(header.magic, c_skyViewMagic, sizeof(c_skyViewMagic));
+	header.version = c_skyViewVersion;
+	header.reserved = 0;
+	header.geometryKey = geometryKey;
+	header.raysKey = raysKey;
+	header.count = values.size();
+
+	bool success = (fwrite(&header, sizeof(SkyViewHeader), 1, fp) == 1);
+	for (size_t i = 0; success && i < values.size(); ++i)
+	{
+		float value = static_cast<float>(values[i]);
+		success = (fwrite(&value, sizeof(float), 1, fp) == 1);
+	}
+
+	fclose(fp);
+	if (!success)
+	{
+		//don't leave a truncated file behind
+		remove(qPrintable(filename));
+	}
+	return success;
+}
+
+QString SOLISCache::HarmonicsFilename(const QString& directory, uint64_t geometryKey, uint64_t raysKey)
+{
+	return QDir(directory).absoluteFilePath(QString("%1_%2.shv").arg(geometryKey, 16, 16, QChar('0')).arg(raysKey, 16, 16, QChar('0')));
+}
+
+bool SOLISCache::LoadHarmonics(const QString& filename, uint64_t geometryKey, uint64_t raysKey, unsigned order, size_t pointCount, std::vector<float>& coefficients)
+{
+	FILE* fp = fopen(qPrintable(filename), "rb");
+	if (!fp)
+		return false;
+
+	HarmonicsHeader header;
+	bool valid = (	fread(&header, sizeof(HarmonicsHeader), 1, fp) == 1
+				&&	memcmp(header.magic, c_harmonicsMagic, sizeof(c_harmonicsMagic)) == 0
+				&&	header.version == c_harmonicsVersion
+				&&	header.order == order
+				&&	header.geometryKey == geometryKey
+				&&	header.raysKey == raysKey
+				&&	header.pointCount == pointCount );
+
+	if (valid)
+	{
+		try
+		{
+			coefficients.resize(pointCount * SOLISSky::HarmonicsCount(order));
+		}
+		catch (const std::bad_alloc&)
+		{
+			fclose(fp);
+			return false;
+		}
+		valid = (fread(coefficients.data(), sizeof(float), coefficients.size(), fp) == coefficients.size());
+	}
+
+	fclose(fp);
+	return valid;
+}
+
+bool SOLISCache::SaveHarmonics(const QString& filename, uint64_t geometryKey, uint64_t raysKey, unsigned order, const std::vector<float>& coefficients)
+{
+	size_t count = SOLISSky::HarmonicsCount(order);
+	if (coefficients.size() % count != 0)
+		return false;
+
+	QDir().mkpath(QFileInfo(filename).absolutePath());
+
+	FILE* fp = fopen(qPrintable(filename), "wb");
+	if (!fp)
+		return false;
+
+	HarmonicsHeader header;
+	memcpy(header.magic, c_harmonicsMagic, sizeof(c_harmonicsMagic));
+	header.version = c_harmonicsVersion;
+	header.order = order;
+	header.geometryKey = geometryKey;
+	header.raysKey = raysKey;
+	header.pointCount = coefficients.size() / count;
+
+	bool success = (	fwrite(&header, sizeof(HarmonicsHeader), 1, fp) == 1
+					&&	fwrite(coefficients.data(), sizeof(float), coefficients.size(), fp) == coefficients.size() );
+
+	fclose(fp);
+	if (!success)
+	{
+		//don't leave a truncated file behind
+		remove(qPrintable(filename));
+	}
+	return success;
+}
+
+QString SOLISCache::VisibilityMatrixFilename(const QString& directory, uint64_t geometryKey, uint64_t directionsKey)
+{
+	return QDir(directory).absoluteFilePath(QString("%1_%2.vis").arg(geometryKey, 16, 16, QChar('0')).arg(directionsKey, 16, 16, QChar('0')));
+}
+
+bool SOLISCache::MapToDirections(	const std::vector<CCVector3>& directions,
+									const std::vector<CCVector3>& rays,
+									const std::vector< std::vector<double> >& weights,
+									std::vector< std::vector<double> >& directionWeights,
+									double* maxError/*=nullptr*/)
+{
+	if (directions.empty())
+		return false;
+
+	try
+	{
+		directionWeights.assign(weights.size(), std::vector<double>(directions.size(), 0));
+	}
+	catch (const std::bad_alloc&)
+	{
+		return false;
+	}
+
+	double minCos = 1.0;
+	for (size_t i = 0; i < rays.size(); ++i)
+	{
+		//nearest direction (largest dot product)
+		size_t nearest = 0;
+		double bestCos = -2.0;
+		for (size_t d = 0; d < directions.size(); ++d)
+		{
+			double c = static_cast<double>(rays[i].x) * directions[d].x + static_cast<double>(rays[i].y) * directions[d].y + static_cast<double>(rays[i].z) * directions[d].z;
+			if (c > bestCos)
+			{
+				bestCos = c;
+				nearest = d;
+			}
+		}
+		minCos = std::min(minCos, bestCos);
+
+		for (size_t k = 0; k < weights.size(); ++k)
+		{
+			if (weights[k].size() != rays.size())
+				return false;
+			directionWeights[k][nearest] += weights[k][i];
+		}
+	}
+
+	if (maxError)
+		*maxError = acos(std::max(-1.0, std::min(1.0, minCos))) * (180.0 / M_PI);
+
+	return true;
+}
+
+SOLISCache::VisibilityWriter::~VisibilityWriter()
+{
+	if (m_file)
+	{
+		//unfinished file
+		fclose(m_file);
+		remove(qPrintable(m_filename));
+	}
+}
+
+bool SOLISCache::VisibilityWriter::open(const QString& filename, uint64_t geometryKey, uint64_t directionsKey, size_t pointCount, const std::vector<CCVector3>& directions)
+{
+	if (m_file)
+		return false;
+
+	QDir().mkpath(QFileInfo(filename).absolutePath());
+
+	m_file = fopen(qPrintable(filename), "wb");
+	if (!m_file)
+		return false;
+
+	m_filename = filename;
+	m_pointCount = pointCount;
+	m_directionCount = directions.size();
+	try
+	{
+		m_offsets.clear();
+		m_offsets.reserve(m_directionCount + 1);
+		m_offsets.push_back(0);
+	}
+	catch (const std::bad_alloc&)
+	{
+		return false;
+	}
+
+	VisibilityHeader header;
+	memcpy(header.magic, c_visibilityMagic, sizeof(c_visibilityMagic));
+	header.version = c_visibilityVersion;
+	header.reserved = 0;
+	header.geometryKey = geometryKey;
+	header.directionsKey = directionsKey;
+	header.pointCount = pointCount;
+	header.directionCount = m_directionCount;
+	if (fwrite(&header, sizeof(VisibilityHeader), 1, m_file) != 1)
+		return false;
+
+	for (const CCVector3& d : directions)
+	{
+		float xyz[3] = { static_cast<float>(d.x), static_cast<float>(d.y), static_cast<float>(d.z) };
+		if (fwrite(xyz, sizeof(float), 3, m_file) != 3)
+			return false;
+	}
+
+	//the offset table is written once all the columns are known
+	std::vector<uint64_t> placeholder(m_directionCount + 1, 0);
+	return (fwrite(placeholder.data(), sizeof(uint64_t), placeholder.size(), m_file) == placeholder.size());
+}
+
+bool SOLISCache::VisibilityWriter::addColumn(const std::vector<uint64_t>& visibilityMask)
+{
+	if (!m_file || m_offsets.size() > m_directionCount || !EncodeColumn(visibilityMask, m_pointCount, m_buffer))
+		return false;
+
+	if (!m_buffer.empty() && fwrite(m_buffer.data(), 1, m_buffer.size(), m_file) != m_buffer.size())
+		return false;
+
+	m_offsets.push_back(m_offsets.back() + m_buffer.size());
+	return true;
+}
+
+bool SOLISCache::VisibilityWriter::close()
+{
+	if (!m_file || m_offsets.size() != m_directionCount + 1)
+		return false;
+
+	int64_t offsetsPos = static_cast<int64_t>(sizeof(VisibilityHeader) + m_directionCount * 3 * sizeof(float));
+	bool success = (	Seek(m_file, offsetsPos, SEEK_SET)
+					&&	fwrite(m_offsets.data(), sizeof(uint64_t), m_offsets.size(), m_file) == m_offsets.size() );
+	success = (fclose(m_file) == 0) && success;
+	m_file = nullptr;
+
+	if (!success)
+		remove(qPrintable(m_filename));
+	return success;
+}
+
+SOLISCache::VisibilityMatrix::~VisibilityMatrix()
+{
+	close();
+}
+
+void SOLISCache::VisibilityMatrix::close()
+{
+	if (m_data)
+	{
+		m_file.unmap(const_cast<uchar*>(reinterpret_cast<const uchar*>(m_data)));
+		m_data = nullptr;
+	}
+	if (m_file.isOpen())
+	{
+		m_file.close();
+	}
+	m_size = 0;
+	m_columns = nullptr;
+	m_directions.clear();
+	m_offsets.clear();
+}
+
+bool SOLISCache::VisibilityMatrix::open(const QString& filename, uint64_t geometryKey, uint64_t directionsKey, size_t pointCount)
+{
+	close();
+
+	m_file.setFileName(filename);
+	if (!m_file.open(QIODevice::ReadOnly))
+		return false;
+
+	m_size = m_file.size();
+	if (m_size < static_cast<qint64>(sizeof(VisibilityHeader)))
+	{
+		close();
+		return false;
+	}
+
+	m_data = reinterpret_cast<const uint8_t*>(m_file.map(0, m_size));
+	if (!m_data)
+	{
+		close();
+		return false;
+	}
+
+	VisibilityHeader header;
+	memcpy(&header, m_data, sizeof(VisibilityHeader));
+	uint64_t tableSize = header.directionCount * 3 * sizeof(float) + (header.directionCount + 1) * sizeof(uint64_t);
+	if (	memcmp(header.magic, c_visibilityMagic, sizeof(c_visibilityMagic)) != 0
+		||	header.version != c_visibilityVersion
+		||	header.geometryKey != geometryKey
+		||	header.directionsKey != directionsKey
+		||	header.pointCount != pointCount
+		||	header.directionCount == 0
+		||	sizeof(VisibilityHeader) + tableSize > static_cast<uint64_t>(m_size) )
+	{
+		close();
+		return false;
+	}
+
+	m_pointCount = pointCount;
+	try
+	{
+		m_directions.resize(header.directionCount);
+		m_offsets.resize(header.directionCount + 1);
+	}
+	catch (const std::bad_alloc&)
+	{
+		close();
+		return false;
+	}
+
+	const uint8_t* current = m_data + sizeof(VisibilityHeader);
+	for (CCVector3& d : m_directions)
+	{
+		float xyz[3];
+		memcpy(xyz, current, sizeof(xyz));
+		current += sizeof(xyz);
+		d = CCVector3(static_cast<PointCoordinateType>(xyz[0]), static_cast<PointCoordinateType>(xyz[1]), static_cast<PointCoordinateType>(xyz[2]));
+	}
+	memcpy(m_offsets.data(), current, m_offsets.size() * sizeof(uint64_t));
+	m_columns = current + m_offsets.size() * sizeof(uint64_t);
+
+	//the columns must fit in the file
+	uint64_t columnsSize = static_cast<uint64_t>(m_size) - (m_columns - m_data);
+	if (m_offsets.front() != 0 || m_offsets.back() > columnsSize || !std::is_sorted(m_offsets.begin(), m_offsets.end()))
+	{
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+bool SOLISCache::VisibilityMatrix::accumulate(const std::vector<double>& weights, std::vector<double>& sums) const
+{
+	if (!m_data || weights.size() != m_directions.size() || sums.size() != m_pointCount)
+		return false;
+
+	for (size_t d = 0; d < m_directions.size(); ++d)
+	{
+		double weight = weights[d];
+		if (weight == 0)
+			continue;
+
+		if (!AccumulateColumn(m_columns + m_offsets[d], m_columns + m_offsets[d + 1], weight, sums))
+			return false;
+	}
+
+	return true;
+}
+
+uint64_t SOLISCache::SunBin(const CCVector3& ray, double binSize, CCVector3& center)
+{
+	double z = std::max(-1.0, std::min(1.0, -static_cast<double>(ray.z)));
+	double altitude = asin(z) * (180.0 / M_PI);
+	double azimuth = atan2(static_cast<double>(ray.x), static_cast<double>(ray.y)) * (180.0 / M_PI);
+	if (azimuth < 0)
+		azimuth += 360.0;
+
+	//altitude bands (from the horizon) split in sectors (clockwise from the north)
+	int band = static_cast<int>(floor(altitude / binSize));
+	double bandAltitude = (band + 0.5) * binSize;
+	unsigned sectors = std::max(1u, static_cast<unsigned>(ceil(360.0 * cos(bandAltitude * (M_PI / 180.0)) / binSize)));
+	unsigned sector = std::min(sectors - 1, static_cast<unsigned>(azimuth / (360.0 / sectors)));
+
+	center = SOLISSky::Direction(bandAltitude, (sector + 0.5) * (360.0 / sectors));
+	return (static_cast<uint64_t>(static_cast<uint32_t>(band)) << 32) | sector;
+}
+
+QString SOLISCache::SunBinFilename(const QString& directory, uint64_t geometryKey, double binSize)
+{
+	//the bin size is part of the name (millidegrees)
+	return QDir(directory).absoluteFilePath(QString("%1_%2.sun").arg(geometryKey, 16, 16, QChar('0')).arg(static_cast<qint64>(std::round(binSize * 1000))));
+}
+
+SOLISCache::SunBinStore::~SunBinStore()
+{
+	close();
+}
+
+void SOLISCache::SunBinStore::close()
+{
+	if (m_file)
+	{
+		fclose(m_file);
+		m_file = nullptr;
+	}
+	m_index.clear();
+}
+
+bool SOLISCache::SunBinStore::open(const QString& filename, uint64_t geometryKey, size_t pointCount, double binSize, bool* mismatch/*=nullptr*/)
+{
+	close();
+	if (mismatch)
+		*mismatch = false;
+
+	m_pointCount = pointCount;
+	if (QFile::exists(filename))
+	{
+		m_file = fopen(qPrintable(filename), "r+b");
+		if (!m_file)
+			return false;
+	}
+	else
+	{
+		//new store
+		QDir().mkpath(QFileInfo(filename).absolutePath());
+		m_file = fopen(qPrintable(filename), "w+b");
+		if (!m_file)
+			return false;
+
+		SunBinHeader header;
+		memcpy(header.magic, c_sunBinMagic, sizeof(c_sunBinMagic));
+		header.version = c_sunBinVersion;
+		header.reserved = 0;
+		header.geometryKey = geometryKey;
+		header.pointCount = pointCount;
+		header.binSize = binSize;
+		if (fwrite(&header, sizeof(SunBinHeader), 1, m_file) != 1 || fflush(m_file) != 0)
+		{
+			close();
+			remove(qPrintable(filename));
+			return false;
+		}
+		return true;
+	}
+
+	SunBinHeader header;
+	if (	fread(&header, sizeof(SunBinHeader), 1, m_file) != 1
+		||	memcmp(header.magic, c_sunBinMagic, sizeof(c_sunBinMagic)) != 0
+		||	header.version != c_sunBinVersion
+		||	header.geometryKey != geometryKey
+		||	header.pointCount != pointCount
+		||	header.binSize != binSize )
+	{
+		close();
+		if (mismatch)
+			*mismatch = true;
+		return false;
+	}
+
+	//index of the complete columns
+	int64_t end = (Seek(m_file, 0, SEEK_END) ? Tell(m_file) : -1);
+	uint64_t position = sizeof(SunBinHeader);
+	if (end < 0 || !Seek(m_file, static_cast<int64_t>(position), SEEK_SET))
+	{
+		close();
+		return false;
+	}
+	uint64_t fileSize = static_cast<uint64_t>(end);
+	try
+	{
+		SunBinRecord record;
+		while (	position + sizeof(SunBinRecord) <= fileSize
+			&&	fread(&record, sizeof(SunBinRecord), 1, m_file) == 1
+			&&	position + sizeof(SunBinRecord) + record.size <= fileSize )
+		{
+			position += sizeof(SunBinRecord);
+			m_index[record.binKey] = std::make_pair(position, record.size);
+			position += record.size;
+			if (!Seek(m_file, static_cast<int64_t>(position), SEEK_SET))
+			{
+				close();
+				return false;
+			}
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		close();
+		return false;
+	}
+
+	if (position != fileSize)
+	{
+		//truncated column (interrupted run): it will be overwritten
+		fclose(m_file);
+		m_file = nullptr;
+		if (!QFile::resize(filename, static_cast<qint64>(position)))
+		{
+			m_index.clear();
+			return false;
+		}
+		m_file = fopen(qPrintable(filename), "r+b");
+		if (!m_file)
+		{
+			m_index.clear();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool SOLISCache::SunBinStore::addColumn(uint64_t binKey, const std::vector<uint64_t>& visibilityMask)
+{
+	if (!m_file || !EncodeColumn(visibilityMask, m_pointCount, m_buffer))
+		return false;
+
+	int64_t end = (Seek(m_file, 0, SEEK_END) ? Tell(m_file) : -1);
+	if (end < 0)
+		return false;
+	uint64_t position = static_cast<uint64_t>(end) + sizeof(SunBinRecord);
+
+	SunBinRecord record;
+	record.binKey = binKey;
+	record.size = m_buffer.size();
+	if (	fwrite(&record, sizeof(SunBinRecord), 1, m_file) != 1
+		||	(!m_buffer.empty() && fwrite(m_buffer.data(), 1, m_buffer.size(), m_file) != m_buffer.size())
+		||	fflush(m_file) != 0 )
+	{
+		return false;
+	}
+
+	try
+	{
+		m_index[binKey] = std::make_pair(position, record.size);
+	}
+	catch (const std::bad_alloc&)
+	{
+		return false;
+	}
+	return true;
+}
+
+bool SOLISCache::SunBinStore::accumulate(uint64_t binKey, double weight, std::vector<double>& sums)
+{
+	auto it = m_index.find(binKey);
+	if (!m_file || it == m_index.end() || sums.size() != m_pointCount)
+		return false;
+
+	try
+	{
+		m_buffer.resize(it->second.second);
+	}
+	catch (const std::bad_alloc&)
+	{
+		return false;
+	}
+	if (	!Seek(m_file, static_cast<int64_t>(it->second.first), SEEK_SET)
+		||	(!m_buffer.empty() && fread(m_buffer.data(), 1, m_buffer.size(), m_file) != m_buffer.size()) )
+	{
+		return false;
+	}
+
+	return AccumulateColumn(m_buffer.data(), m_buffer.data() + m_buffer.size(), weight, sums);
+}
@@ -0,0 +1,261 @@
+//##########################################################################
+//#                                                                        #
+//#                       CLOUDCOMPARE PLUGIN: qSOLIS                      #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                  COPYRIGHT: David Basler                               #
+//#                                                                        #
+//##########################################################################
+
+#include "SOLISCheckpoint.h"
+
+//Qt
+#include <QDir>
+#include <QFileInfo>
+
+//System
+#include <cstdio>
+#include <cstring>
+
+//! Checkpoint file signature
+static const char c_checkpointMagic[8] = { 'S', 'O', 'L', 'I', 'S', 'C', 'K', 'P' };
+//! Checkpoint file version
+static const uint32_t c_checkpointVersion = 2;
+
+//! Checkpoint file header (followed by the size of each buffer, then by the buffers)
+struct CheckpointHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t options;
+	uint64_t geometryKey;
+	uint64_t raysKey;
+	uint64_t optionsKey;
+	uint64_t rayCount;
+	uint64_t nextRay;
+	uint64_t bufferCount;
+};
+
+//! Returns the position in a file (64 bits)
+static int64_t Tell(FILE* fp)
+{
+#ifdef _WIN32
+	return _ftelli64(fp);
+#else
+	return static_cast<int64_t>(ftello(fp));
+#endif
+}
+
+//! Sets the position in a file (64 bits)
+static bool Seek(FILE* fp, int64_t offset, int origin)
+{
+#ifdef _WIN32
+	return (_fseeki64(fp, offset, origin) == 0);
+#else
+	return (fseeko(fp, static_cast<off_t>(offset), origin) == 0);
+#endif
+}
+
+SOLISCheckpoint::SOLISCheckpoint(const QString& filename, uint64_t geometryKey, uint64_t raysKey, double interval)
+	: m_filename(qPrintable(filename))
+	, m_geometryKey(geometryKey)
+	, m_raysKey(raysKey)
+	, m_interval(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(interval)))
+{
+	QDir().mkpath(QFileInfo(filename).absolutePath());
+}
+
+SOLISCheckpoint::~SOLISCheckpoint()
+{
+	wait();
+}
+
+QString SOLISCheckpoint::Filename(const QString& directory, uint64_t geometryKey, uint64_t raysKey)
+{
+	return QDir(directory).absoluteFilePath(QString("%1_%2.ckp").arg(geometryKey, 16, 16, QChar('0')).arg(raysKey, 16, 16, QChar('0')));
+}
+
+void SOLISCheckpoint::addBuffer(void* data, size_t size)
+{
+	m_buffers.emplace_back(data, size);
+}
+
+size_t SOLISCheckpoint::start(size_t rayCount, uint32_t options, uint64_t optionsKey/*=0*/)
+{
+	m_rayCount = rayCount;
+	m_options = options;
+	m_optionsKey = optionsKey;
+	m_lastSnapshot = std::chrono::steady_clock::now();
+
+	//the temporary file is only complete if the process stopped between the removal and the renaming of the checkpoint
+	size_t nextRay = load(m_filename);
+	if (nextRay == 0)
+		nextRay = load(m_filename + ".tmp");
+	return nextRay;
+}
+
+size_t SOLISCheckpoint::load(const std::string& filename)
+{
+	FILE* fp = fopen(filename.c_str(), "rb");
+	if (!fp)
+		return 0;
+
+	CheckpointHeader header;
+	bool valid = (	fread(&header, sizeof(CheckpointHeader), 1, fp) == 1
+				&&	memcmp(header.magic, c_checkpointMagic, sizeof(c_checkpointMagic)) == 0
+				&&	header.version == c_checkpointVersion
+				&&	header.options == m_options
+				&&	header.geometryKey == m_geometryKey
+				&&	header.raysKey == m_raysKey
+			&&	header.optionsKey == m_optionsKey
+				&&	header.rayCount == m_rayCount
+				&&	header.nextRay <= m_rayCount
+				&&	header.bufferCount == m_buffers.size() );
+
+	for (size_t i = 0; valid && i < m_buffers.size(); ++i)
+	{
+		uint64_t size = 0;
+		valid = (fread(&size, sizeof(uint64_t), 1, fp) == 1 && size == m_buffers[i].second);
+	}
+
+	//the buffers are only overwritten once the whole file is known to be valid
+	if (valid)
+	{
+		int64_t dataStart = Tell(fp);
+		uint64_t dataSize = 0;
+		for (const auto& buffer : m_buffers)
+			dataSize += buffer.second;
+		valid = (	dataStart >= 0
+				&&	Seek(fp, 0, SEEK_END)
+				&&	static_cast<uint64_t>(Tell(fp) - dataStart) == dataSize
+				&&	Seek(fp, dataStart, SEEK_SET) );
+	}
+	for (size_t i = 0; valid && i < m_buffers.size(); ++i)
+	{
+		valid = (fread(m_buffers[i].first, 1, m_buffers[i].second, fp) == m_buffers[i].second);
+	}
+
+	fclose(fp);
+	return (valid ? static_cast<size_t>(header.nextRay) : 0);
+}
+
+bool SOLISCheckpoint::update(size_t nextRay)
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (now - m_lastSnapshot < m_interval)
+		return true;
+
+	//the previous snapshot is still being written: we'll try again later
+	if (m_writing)
+		return true;
+
+	m_lastSnapshot = now;
+	return snapshot(nextRay);
+}
+
+bool SOLISCheckpoint::save(size_t nextRay)
+{
+	m_lastSnapshot = std::chrono::steady_clock::now();
+	return snapshot(nextRay) && wait();
+}
+
+void SOLISCheckpoint::remove()
+{
+	wait();
+	std::remove(m_filename.c_str());
+	std::remove((m_filename + ".tmp").c_str());
+}
+
+bool SOLISCheckpoint::wait()
+{
+	if (m_writer.joinable())
+		m_writer.join();
+	return m_writeSuccess;
+}
+
+bool SOLISCheckpoint::snapshot(size_t nextRay)
+{
+	//a finished writer still has to be joined
+	wait();
+
+	size_t size = sizeof(CheckpointHeader) + m_buffers.size() * sizeof(uint64_t);
+	for (const auto& buffer : m_buffers)
+		size += buffer.second;
+
+	try
+	{
+		m_snapshot.resize(size);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory?
+		return false;
+	}
+
+	//header, sizes, then data (in a single contiguous block)
+	CheckpointHeader header;
+	memcpy(header.magic, c_checkpointMagic, sizeof(c_checkpointMagic));
+	header.version = c_checkpointVersion;
+	header.options = m_options;
+	header.geometryKey = m_geometryKey;
+	header.raysKey = m_raysKey;
+	header.optionsKey = m_optionsKey;
+	header.rayCount = m_rayCount;
+	header.nextRay = nextRay;
+	header.bufferCount = m_buffers.size();
+
+	char* out = m_snapshot.data();
+	memcpy(out, &header, sizeof(CheckpointHeader));
+	out += sizeof(CheckpointHeader);
+	for (const auto& buffer : m_buffers)
+	{
+		uint64_t bufferSize = buffer.second;
+		memcpy(out, &bufferSize, sizeof(uint64_t));
+		out += sizeof(uint64_t);
+	}
+	for (const auto& buffer : m_buffers)
+	{
+		memcpy(out, buffer.first, buffer.second);
+		out += buffer.second;
+	}
+
+	//the file is only replaced once the new snapshot is completely written
+	m_writeSuccess = true;
+	m_writing = true;
+	m_writer = std::thread([this]()
+	{
+		std::string tempFilename = m_filename + ".tmp";
+		FILE* fp = fopen(tempFilename.c_str(), "wb");
+		if (!fp)
+		{
+			m_writeSuccess = false;
+		}
+		else
+		{
+			bool written = (fwrite(m_snapshot.data(), 1, m_snapshot.size(), fp) == m_snapshot.size());
+			written = (fclose(fp) == 0) && written;
+			if (!written)
+			{
+				//the previous checkpoint is kept
+				std::remove(tempFilename.c_str());
+				m_writeSuccess = false;
+			}
+			else
+			{
+				std::remove(m_filename.c_str());
+				m_writeSuccess = (std::rename(tempFilename.c_str(), m_filename.c_str()) == 0);
+			}
+		}
+		m_writing = false;
+	});
+
+	return true;
+}
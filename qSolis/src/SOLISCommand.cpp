@@ -2,6 +2,9 @@
 
 #include "SOLISCommand.h"
 #include "SOLIS.h"
+#include "SOLISCache.h"
+#include "SOLISRun.h"
+#include "SOLISShard.h"
 #include "qSOLIS.h"
 
 //qCC_db
@@ -12,65 +15,109 @@
 #include <ccProgressDialog.h>
 #include <ccScalarField.h>
 
-constexpr char CC_SOLIS_FIELD_LABEL_NAME_DIRECT[]  = "direct_Irradiance";
-constexpr char CC_SOLIS_FIELD_LABEL_NAME_DIFFUSE[] = "diffuse_Irradiance";
+//System
+#include <algorithm>
+#include <functional>
+
+//! Computes the SOLIS outputs of a cloud (or mesh vertices)
+using SOLISEntityLauncher = std::function<bool(ccPointCloud* cloud, ccGenericMesh* mesh, const std::vector<CCCoreLib::ScalarField*>& outputs, const QString& progressName)>;
 
 constexpr char COMMAND_SOLIS[]        = "SOLIS";
-constexpr char COMMAND_SOLIS_TYPE[]   = "TYPE";
+constexpr char COMMAND_SOLIS_MERGE[] = "SOLIS_MERGE";
+
+SOLISCommand::SOLISCommand()
+	: Command("SOLIS", COMMAND_SOLIS)
+{
+}
 
-constexpr char COMMAND_SOLIS_LAT[]    = "LAT";
-constexpr char COMMAND_SOLIS_LON[]    = "LON";
-constexpr char COMMAND_SOLIS_ELV[]    = "ELV";
+SOLISMergeCommand::SOLISMergeCommand()
+	: Command("SOLIS merge", COMMAND_SOLIS_MERGE)
+{
+}
 
-constexpr char COMMAND_SOLIS_DOY[]    = "DOY";
-constexpr char COMMAND_SOLIS_INT[]    = "INT";
-constexpr char COMMAND_SOLIS_TS[]     = "TS";
+//! Returns the cloud (and the mesh if any) of a candidate entity
+static ccPointCloud* GetEntityCloud(ccHObject* obj, ccGenericMesh*& mesh, QString& objName)
+{
+	ccPointCloud* cloud = nullptr;
+	mesh = nullptr;
+	objName = "unknown";
 
-constexpr char COMMAND_SOLIS_N_RAYS[] = "NRAYS";
-constexpr char COMMAND_SOLIS_IS_CLOSED[] = "IS_CLOSED";
-constexpr char COMMAND_SOLIS_RESOLUTION[] = "RESOLUTION";
+	assert(obj);
+	if (obj->isA(CC_TYPES::POINT_CLOUD))
+	{
+		//we need a real point cloud
+		cloud = ccHObjectCaster::ToPointCloud(obj);
+		objName = cloud->getName();
+	}
+	else if (obj->isKindOf(CC_TYPES::MESH))
+	{
+		mesh = ccHObjectCaster::ToGenericMesh(obj);
+		cloud = ccHObjectCaster::ToPointCloud(mesh->getAssociatedCloud());
+		objName = mesh->getName();
+	}
 
-#define SOLIS_DIRECT 0
-#define SOLIS_DIFFUSE 1
-#define SOLIS_BOTH 2
+	return cloud;
+}
 
-SOLISCommand::SOLISCommand()
-	: Command("SOLIS", COMMAND_SOLIS)
+//! Returns the index of a SOLIS scalar field (created if necessary)
+static int GetOrCreateField(ccPointCloud* cloud, const QString& fieldName)
 {
+	//we get the SOLIS field if it already exists
+	int sfIdx = cloud->getScalarFieldIndexByName(qPrintable(fieldName));
+	//otherwise we create it
+	if (sfIdx < 0)
+	{
+		sfIdx = cloud->addScalarField(qPrintable(fieldName));
+	}
+	return sfIdx;
 }
 
-bool SOLISCommand::Process(	const ccHObject::Container& candidates,
-							const std::vector<CCVector3>& rays,
-							const std::vector<double>& irradiance,
-							bool modeDirect,
-							double conversion,
-							bool meshIsClosed,
-							unsigned resolution,
-							ccProgressDialog* progressDlg/*=nullptr*/,
-							ccMainAppInterface* app/*=nullptr*/)
+//! Displays a SOLIS scalar field once computed
+static void ShowField(ccHObject* obj, ccPointCloud* cloud, int sfIdx, const QString& objName, ccMainAppInterface* app)
+{
+	ccScalarField* sf = static_cast<ccScalarField*>(cloud->getScalarField(sfIdx));
+	if (sf)
+	{
+		sf->computeMinAndMax();
+		cloud->setCurrentDisplayedScalarField(sfIdx);
+		sf->setColorScale(ccColorScalesManager::GetDefaultScale(ccColorScalesManager::GREY));
+		if (obj->hasNormals() && obj->normalsShown())
+		{
+			if (app)
+				app->dispToConsole(QObject::tr("Entity '%1' normals have been automatically disabled").arg(objName), ccMainAppInterface::WRN_CONSOLE_MESSAGE);
+		}
+		obj->showNormals(false);
+		obj->showSF(true);
+		if (obj != cloud)
+		{
+			cloud->showSF(true);
+		}
+		obj->prepareDisplayForRefresh_recursive();
+	}
+	else
+	{
+		assert(false);
+	}
+}
+
+//! Launches a SOLIS computation on each candidate entity
+/** \param fieldNames name of the scalar field of each output (none if the launcher saves its results elsewhere, e.g. a shard)
+	\param launch computes the outputs of a cloud (or mesh) - see SOLIS::Launch
+**/
+static bool ProcessEntities(const ccHObject::Container& candidates,
+							const QStringList& fieldNames,
+							ccProgressDialog* progressDlg,
+							ccMainAppInterface* app,
+							const SOLISEntityLauncher& launch)
 {
 	size_t count = 0;
 	size_t errorCount = 0;
 
 	for (ccHObject* obj : candidates)
 	{
-		ccPointCloud* cloud = nullptr;
 		ccGenericMesh* mesh = nullptr;
-		QString objName("unknown");
-
-		assert(obj);
-		if (obj->isA(CC_TYPES::POINT_CLOUD))
-		{
-			//we need a real point cloud
-			cloud = ccHObjectCaster::ToPointCloud(obj);
-			objName = cloud->getName();
-		}
-		else if (obj->isKindOf(CC_TYPES::MESH))
-		{
-			mesh = ccHObjectCaster::ToGenericMesh(obj);
-			cloud = ccHObjectCaster::ToPointCloud(mesh->getAssociatedCloud());
-			objName = mesh->getName();
-		}
+		QString objName;
+		ccPointCloud* cloud = GetEntityCloud(obj, mesh, objName);
 
 		if (cloud == nullptr)
 		{
@@ -80,33 +127,29 @@ bool SOLISCommand::Process(	const ccHObject::Container& candidates,
 			++errorCount;
 			continue;
 		}
-		
-		int sfIdx;
-		if (modeDirect){
-			//we get the SOLIS field if it already exists
-			sfIdx = cloud->getScalarFieldIndexByName(CC_SOLIS_FIELD_LABEL_NAME_DIRECT);
-			//otherwise we create it
-			if (sfIdx < 0)
-			{
-				sfIdx = cloud->addScalarField(CC_SOLIS_FIELD_LABEL_NAME_DIRECT);
-			}
-		} else {
-			//we get the SOLIS field if it already exists
-			sfIdx = cloud->getScalarFieldIndexByName(CC_SOLIS_FIELD_LABEL_NAME_DIFFUSE);
-			//otherwise we create it
+
+		std::vector<int> sfIdxs;
+		std::vector<CCCoreLib::ScalarField*> outputSFs;
+		for (const QString& fieldName : fieldNames)
+		{
+			int sfIdx = GetOrCreateField(cloud, fieldName);
 			if (sfIdx < 0)
 			{
-				sfIdx = cloud->addScalarField(CC_SOLIS_FIELD_LABEL_NAME_DIFFUSE);
+				if (app)
+					app->dispToConsole("Couldn't allocate a new scalar field for computing SOLIS field! Try to free some memory...", ccMainAppInterface::ERR_CONSOLE_MESSAGE);
+				return false;
 			}
+			sfIdxs.push_back(sfIdx);
 		}
-		
-		if (sfIdx < 0)
+		for (int sfIdx : sfIdxs)
 		{
-			if (app)
-				app->dispToConsole("Couldn't allocate a new scalar field for computing SOLIS field! Try to free some memory...", ccMainAppInterface::ERR_CONSOLE_MESSAGE);
-			return false;
+			//indexes are only valid once all the fields have been created
+			outputSFs.push_back(cloud->getScalarField(sfIdx));
+		}
+		if (!sfIdxs.empty())
+		{
+			cloud->setCurrentScalarField(sfIdxs.front());
 		}
-		cloud->setCurrentScalarField(sfIdx);
 
 		QString objNameForPorgressDialog = objName;
 		if (candidates.size() > 1)
@@ -118,44 +161,26 @@ bool SOLISCommand::Process(	const ccHObject::Container& candidates,
 		bool wasVisible = obj->isVisible();
 		obj->setEnabled(true);
 		obj->setVisible(true);
-		
-		bool success = SOLIS::Launch(rays,irradiance, modeDirect ,conversion ,cloud, mesh, meshIsClosed, resolution, resolution, progressDlg, objNameForPorgressDialog);
+
+		bool success = launch(cloud, mesh, outputSFs, objNameForPorgressDialog);
 
 		obj->setEnabled(wasEnabled);
 		obj->setVisible(wasVisible);
 
 		if (!success)
 		{
-			cloud->deleteScalarField(sfIdx);
+			//delete the fields in reverse order (indexes are shifted otherwise)
+			std::sort(sfIdxs.begin(), sfIdxs.end());
+			for (auto it = sfIdxs.rbegin(); it != sfIdxs.rend(); ++it)
+				cloud->deleteScalarField(*it);
 			if (app)
 				app->dispToConsole(QObject::tr("An error occurred during entity '%1' illumination!").arg(objName), ccMainAppInterface::ERR_CONSOLE_MESSAGE);
 			++errorCount;
 		}
 		else
 		{
-			ccScalarField* sf = static_cast<ccScalarField*>(cloud->getScalarField(sfIdx));
-			if (sf)
-			{
-				sf->computeMinAndMax();
-				cloud->setCurrentDisplayedScalarField(sfIdx);
-				sf->setColorScale(ccColorScalesManager::GetDefaultScale(ccColorScalesManager::GREY));
-				if (obj->hasNormals() && obj->normalsShown())
-				{
-					if (app)
-						app->dispToConsole(QObject::tr("Entity '%1' normals have been automatically disabled").arg(objName), ccMainAppInterface::WRN_CONSOLE_MESSAGE);
-				}
-				obj->showNormals(false);
-				obj->showSF(true);
-				if (obj != cloud)
-				{
-					cloud->showSF(true);
-				}
-				obj->prepareDisplayForRefresh_recursive();
-			}
-			else
-			{
-				assert(false);
-			}
+			for (int sfIdx : sfIdxs)
+				ShowField(obj, cloud, sfIdx, objName, app);
 		}
 
 		if (progressDlg && progressDlg->wasCanceled())
@@ -169,301 +194,384 @@ bool SOLISCommand::Process(	const ccHObject::Container& candidates,
 
 	return (errorCount == 0);
 }
-// COMMANDLINE COMMANDS
-bool SOLISCommand::process(ccCommandLineInterface& cmd)
+bool SOLISCommand::Process(	const ccHObject::Container& candidates,
+							const std::vector<CCVector3>& rays,
+							const std::vector<double>& irradiance,
+							bool modeDirect,
+							double conversion,
+							bool meshIsClosed,
+							unsigned resolution,
+							ccProgressDialog* progressDlg/*=nullptr*/,
+							ccMainAppInterface* app/*=nullptr*/,
+							SOLIS::AccumulatorPrecision precision/*=SOLIS::ACCUMULATOR_COMPACT*/)
 {
-	cmd.print("[SOLIS]");
+	QStringList fieldNames;
+	fieldNames.append(modeDirect ? SOLIS_FIELD_LABEL_NAME_DIRECT : SOLIS_FIELD_LABEL_NAME_DIFFUSE);
 
-	if (cmd.meshes().empty() && cmd.clouds().empty())
+	return ProcessEntities(candidates, fieldNames, progressDlg, app, [&](ccPointCloud* cloud, ccGenericMesh* mesh, const std::vector<CCCoreLib::ScalarField*>& outputSFs, const QString& name)
 	{
-		return cmd.error(qSOLIS::tr("No entity is loaded."));
-	}
+		return SOLIS::Launch(rays, irradiance, modeDirect, conversion, cloud, outputSFs.front(), mesh, meshIsClosed, resolution, resolution, progressDlg, name, precision);
+	});
+}
 
-	// Initialize to match SOLIS::Launch defaults
-	double latitude=45;
-	double longitude=0;
-	int elevation=0;
-	
-	double doyFrom = 172.0; //Summer equinox
-	double timestep=1;
-	double integration=24;
-		
-	unsigned rayCount = 256;
-	bool meshIsClosed = false;
-	unsigned resolution = 1024;
-	
-	unsigned mode=SOLIS_BOTH;
-	double conversion;
-	bool modeDirect;
-	char buf[100];
-	
-	while (!cmd.arguments().empty())
+bool SOLISCommand::MergeShards(	const ccHObject::Container& candidates,
+								const QString& shardDirectory,
+								ccMainAppInterface* app/*=nullptr*/,
+								QString* error/*=nullptr*/,
+								size_t* runCount/*=nullptr*/)
+{
+	if (runCount)
+		*runCount = 0;
+
+	for (ccHObject* obj : candidates)
 	{
-		const QString& arg = cmd.arguments().front();
-		
-		if (ccCommandLineInterface::IsCommand(arg, COMMAND_SOLIS_IS_CLOSED))
+		ccGenericMesh* mesh = nullptr;
+		QString objName;
+		ccPointCloud* cloud = GetEntityCloud(obj, mesh, objName);
+		if (!cloud)
 		{
-			cmd.arguments().pop_front();
-			meshIsClosed = true;
+			assert(false);
+			if (error)
+				*error = QObject::tr("Invalid object type");
+			return false;
 		}
-		
-		else if (ccCommandLineInterface::IsCommand(arg, COMMAND_SOLIS_TYPE))
+
+		std::vector<SOLISShard> runs;
+		QString errorStr;
+		if (!SOLISShard::MergeAll(shardDirectory, SOLISCache::GeometryKey(cloud, mesh, false, 0), cloud->size(), runs, &errorStr))
 		{
-			cmd.arguments().pop_front();
-			QString rtype = cmd.arguments().takeFirst().toUpper();
-			if (!QString::compare(rtype,"DIRECT"))  mode = SOLIS_DIRECT;
-			else if (!QString::compare(rtype,"DIFFUSE"))  mode = SOLIS_DIFFUSE;
-			else if (!QString::compare(rtype,"ALL")) mode = SOLIS_BOTH;
-			else {
-				return cmd.error(QObject::tr("Invalid parameter: value after \"-%1\"").arg(COMMAND_SOLIS_TYPE));
-			}
+			if (error)
+				*error = QObject::tr("Entity '%1': %2").arg(objName, errorStr);
+			return false;
 		}
-		
-		else if (ccCommandLineInterface::IsCommand(arg, COMMAND_SOLIS_DOY))
+
+		for (const SOLISShard& run : runs)
 		{
-			cmd.arguments().pop_front();
-			bool conversionOk = false;
-			doyFrom = cmd.arguments().takeFirst().toDouble(&conversionOk);
-			if (!conversionOk)
+			for (size_t k = 0; k < run.outputCount(); ++k)
 			{
-				return cmd.error(QObject::tr("Invalid parameter: value after \"-%1\"").arg(COMMAND_SOLIS_DOY));
+				int sfIdx = GetOrCreateField(cloud, run.fieldNames()[static_cast<int>(k)]);
+				if (sfIdx < 0)
+				{
+					if (error)
+						*error = QObject::tr("Couldn't allocate a new scalar field for computing SOLIS field! Try to free some memory...");
+					return false;
+				}
+				run.convert(k, *cloud->getScalarField(sfIdx));
+				ShowField(obj, cloud, sfIdx, objName, app);
 			}
 		}
-		
-		else if (ccCommandLineInterface::IsCommand(arg, COMMAND_SOLIS_TS))
+
+		if (runCount)
+			*runCount += runs.size();
+	}
+
+	return true;
+}
+
+bool SOLISCommand::HasFields(const ccHObject::Container& candidates, const QStringList& fieldNames)
+{
+	for (ccHObject* obj : candidates)
+	{
+		ccGenericMesh* mesh = nullptr;
+		QString objName;
+		ccPointCloud* cloud = GetEntityCloud(obj, mesh, objName);
+		if (!cloud)
+			return false;
+
+		for (const QString& fieldName : fieldNames)
 		{
-			cmd.arguments().pop_front();
-			bool conversionOk = false;
-			timestep = cmd.arguments().takeFirst().toDouble(&conversionOk);
-			if (!conversionOk)
-			{
-				return cmd.error(QObject::tr("Invalid parameter: value after \"-%1\"").arg(COMMAND_SOLIS_TS));
-			}
+			if (cloud->getScalarFieldIndexByName(qPrintable(fieldName)) < 0)
+				return false;
 		}
+	}
+	return true;
+}
 
-		else if (ccCommandLineInterface::IsCommand(arg, COMMAND_SOLIS_INT))
+//! Prefix of the metadata holding the provenance of a SOLIS field (followed by the field name)
+static const char SOLIS_PROVENANCE_KEY[] = "SOLIS provenance ";
+
+//! Records how the fields of the candidates have been computed (engine and precision, see CheckProvenance)
+static void SetProvenance(const ccHObject::Container& candidates, const QStringList& fieldNames, const QString& provenance)
+{
+	for (ccHObject* obj : candidates)
+	{
+		ccGenericMesh* mesh = nullptr;
+		QString objName;
+		ccPointCloud* cloud = GetEntityCloud(obj, mesh, objName);
+		if (!cloud)
+			continue;
+
+		for (const QString& fieldName : fieldNames)
+			cloud->setMetaData(QString(SOLIS_PROVENANCE_KEY) + fieldName, provenance);
+	}
+}
+
+//! Checks that the previous fields have been computed the way an incremental update would compute them
+/** Fields without provenance (e.g. saved in a format without metadata) are assumed to match, with a warning.
+	\return false if a field has another provenance (full computation)
+**/
+static bool CheckProvenance(ccCommandLineInterface& cmd, const ccHObject::Container& candidates, const QStringList& fieldNames, const QString& provenance)
+{
+	size_t unknownCount = 0;
+	for (ccHObject* obj : candidates)
+	{
+		ccGenericMesh* mesh = nullptr;
+		QString objName;
+		ccPointCloud* cloud = GetEntityCloud(obj, mesh, objName);
+		if (!cloud)
+			return false;
+
+		for (const QString& fieldName : fieldNames)
 		{
-			cmd.arguments().pop_front();
-			bool conversionOk = false;
-			integration = cmd.arguments().takeFirst().toDouble(&conversionOk);
-			if (!conversionOk)
+			QString key = QString(SOLIS_PROVENANCE_KEY) + fieldName;
+			if (!cloud->hasMetaData(key))
 			{
-				return cmd.error(QObject::tr("Invalid parameter: value after \"-%1\"").arg(COMMAND_SOLIS_INT));
+				++unknownCount;
+				continue;
 			}
-		}
-		
-		else if (ccCommandLineInterface::IsCommand(arg, COMMAND_SOLIS_LAT))
-		{
-			cmd.arguments().pop_front();
-			bool conversionOk = false;
-			latitude = cmd.arguments().takeFirst().toDouble(&conversionOk);
-			if (!conversionOk)
+			QString previous = cloud->getMetaData(key).toString();
+			if (previous != provenance)
 			{
-				return cmd.error(QObject::tr("Invalid parameter: value after \"-%1\"").arg(COMMAND_SOLIS_LAT));
+				cmd.warning(QObject::tr("Field '%1' of entity '%2' was computed with %3, an incremental update would use %4: full computation").arg(fieldName).arg(objName).arg(previous).arg(provenance));
+				return false;
 			}
 		}
+	}
 
-		else if (ccCommandLineInterface::IsCommand(arg, COMMAND_SOLIS_LON))
-		{
-			cmd.arguments().pop_front();
-			bool conversionOk = false;
-			longitude = cmd.arguments().takeFirst().toDouble(&conversionOk);
-			if (!conversionOk)
-			{
-				return cmd.error(QObject::tr("Invalid parameter: value after \"-%1\"").arg(COMMAND_SOLIS_LON));
-			}
-		}
-		
-		else if (ccCommandLineInterface::IsCommand(arg, COMMAND_SOLIS_ELV))
+	if (unknownCount != 0)
+	{
+		cmd.warning(QObject::tr("%1 previous fields have no SOLIS provenance: they are assumed to be computed with %2").arg(unknownCount).arg(provenance));
+	}
+	return true;
+}
+
+//! Gathers the clouds and meshes loaded in the command line
+static bool GetCandidates(ccCommandLineInterface& cmd, ccHObject::Container& candidates)
+{
+	try
+	{
+		candidates.reserve(cmd.clouds().size() + cmd.meshes().size());
+	}
+	catch (const std::bad_alloc&)
+	{
+		return false;
+	}
+
+	for (CLCloudDesc& desc : cmd.clouds())
+		candidates.push_back(desc.pc);
+	for (CLMeshDesc& desc : cmd.meshes())
+		candidates.push_back(desc.mesh);
+
+	return true;
+}
+
+//! Appends a suffix to the clouds and meshes loaded in the command line and saves them (in auto-save mode)
+/** \return error message (empty on success)
+**/
+static QString SaveEntities(ccCommandLineInterface& cmd, const QString& suffix)
+{
+	for (CLCloudDesc& desc : cmd.clouds())
+	{
+		desc.basename += suffix;
+		//save output
+		if (cmd.autoSaveMode())
 		{
-			cmd.arguments().pop_front();
-			bool conversionOk = false;
-			elevation = cmd.arguments().takeFirst().toInt(&conversionOk);
-			if (!conversionOk)
+			QString errorStr = cmd.exportEntity(desc);
+			if (!errorStr.isEmpty())
 			{
-				return cmd.error(QObject::tr("Invalid parameter: value after \"-%1\"").arg(COMMAND_SOLIS_ELV));
+				return errorStr;
 			}
 		}
-		
-		else if (ccCommandLineInterface::IsCommand(arg, COMMAND_SOLIS_N_RAYS))
+	}
+
+	for (CLMeshDesc& desc : cmd.meshes())
+	{
+		desc.basename += suffix;
+		//save output
+		if (cmd.autoSaveMode())
 		{
-			cmd.arguments().pop_front();
-			bool conversionOk = false;
-			rayCount = cmd.arguments().takeFirst().toUInt(&conversionOk);
-			if (!conversionOk)
+			QString errorStr = cmd.exportEntity(desc);
+			if (!errorStr.isEmpty())
 			{
-				return cmd.error(QObject::tr("Invalid parameter: value after \"-%1\"").arg(COMMAND_SOLIS_N_RAYS));
+				return errorStr;
 			}
 		}
-		
-		else if (ccCommandLineInterface::IsCommand(arg, COMMAND_SOLIS_RESOLUTION))
+	}
+
+	return QString();
+}
+
+// COMMANDLINE COMMANDS
+//! Computes a component of a SOLIS run on the entities loaded in the command line, then saves them
+/** \param suffix suffix appended to the entity names
+**/
+static bool ProcessComponent(ccCommandLineInterface& cmd, SOLISRun& run, bool direct, const QString& suffix)
+{
+	cmd.warning(run.description(direct));
+
+	SOLISRun::Component component;
+	QStringList messages;
+	QString errorStr;
+	bool success = run.component(direct, component, messages, &errorStr);
+	for (const QString& message : messages)
+	{
+		cmd.print(message);
+	}
+	if (!success)
+	{
+		return cmd.error(errorStr);
+	}
+
+	ccHObject::Container candidates;
+	if (!GetCandidates(cmd, candidates))
+	{
+		return cmd.error(QObject::tr("Not enough memory"));
+	}
+
+	if (component.incremental)
+	{
+		//the previous results are updated in place
+		if (!SOLISCommand::HasFields(candidates, component.fieldNames))
 		{
-			cmd.arguments().pop_front();
-			bool conversionOk = false;
-			resolution = cmd.arguments().takeFirst().toUInt(&conversionOk);
-			if (!conversionOk)
-			{
-				return cmd.error(QObject::tr("Invalid parameter: value after \"-%1\"").arg(COMMAND_SOLIS_RESOLUTION));
-			}
+			cmd.warning(direct ? QObject::tr("No previous direct result: full computation") : QObject::tr("No previous diffuse result: full computation"));
+			component.incremental = false;
 		}
 		else
 		{
-			cmd.warning(arg);
-			break;
+			component.incremental = CheckProvenance(cmd, candidates, component.fieldNames, component.provenance);
 		}
 	}
 
-	if (integration<0) { // Single direct ray
-		integration=0.02;
-		timestep=1.0;
-	}
-	
-	conversion = timestep/60/integration;
-	
-	//generates light directions
-	std::vector<CCVector3> rays;
-	std::vector<double> irradiance;
+	ccProgressDialog pcvProgressCb(true);
+	pcvProgressCb.setAutoClose(false);
 
-	
+	QStringList warnings;
+	errorStr.clear();
+	success = ProcessEntities(candidates, run.outputNames(component), &pcvProgressCb, nullptr, [&](ccPointCloud* cloud, ccGenericMesh* mesh, const std::vector<CCCoreLib::ScalarField*>& outputSFs, const QString& name)
+	{
+		return run.launch(component, cloud, mesh, outputSFs, cloud->getGlobalShift(), cloud->getGlobalScale(), &pcvProgressCb, name, &warnings, &errorStr);
+	});
+	pcvProgressCb.close();
 
+	for (const QString& warning : warnings)
+	{
+		cmd.warning(warning);
+	}
+	if (!success)
+	{
+		return cmd.error(errorStr.isEmpty() ? QObject::tr("Process failed") : errorStr);
+	}
 
-	if (mode==SOLIS_DIRECT || mode ==SOLIS_BOTH)
+	messages.clear();
+	run.report(component, messages);
+	for (const QString& message : messages)
 	{
-		sprintf(buf, "Direct irradiance: LAT %0.3f LON %0.3f ELV %i DOY %0.3f INT %0.3f TS %0.3f",latitude,longitude,elevation,doyFrom, integration, timestep);
-		cmd.warning(buf);
-		// Generate direct sunrays & irradiance
-		if (!SOLIS::GenerateSunRays(doyFrom,doyFrom+integration/24.0,timestep,latitude,longitude,elevation, rays, irradiance))
-		{
-			return cmd.error(QObject::tr("Failed to generate the set of rays"));
-		}
-		if (rays.empty())
-		{
-			return cmd.error(QObject::tr("No ray was generated. Sun always below horizon in selected timerange"));
-		}
+		cmd.print(message);
+	}
 
-		ccHObject::Container candidates;
-		try
-		{
-			candidates.reserve(cmd.clouds().size() + cmd.meshes().size());
-		}
-		catch (const std::bad_alloc)
+	// Save output (shards only write their partial results, see -SOLIS_MERGE)
+	if (run.settings().shardDirectory.isEmpty())
+	{
+		SetProvenance(candidates, component.fieldNames, component.provenance);
+		errorStr = SaveEntities(cmd, suffix);
+		if (!errorStr.isEmpty())
 		{
-			return cmd.error(QObject::tr("Not enough memory"));
+			return cmd.error(errorStr);
 		}
+	}
+	return true;
+}
+
+bool SOLISCommand::process(ccCommandLineInterface& cmd)
+{
+	cmd.print("[SOLIS]");
+
+	if (cmd.meshes().empty() && cmd.clouds().empty())
+	{
+		return cmd.error(qSOLIS::tr("No entity is loaded."));
+	}
 
-		for (CLCloudDesc& desc : cmd.clouds())
-			candidates.push_back(desc.pc);
-		for (CLMeshDesc& desc : cmd.meshes())
-			candidates.push_back(desc.mesh);
-		
-		modeDirect=true;
-		ccProgressDialog pcvProgressCb(true);
-		pcvProgressCb.setAutoClose(false);
-		if (!SOLISCommand::Process(candidates, rays,  irradiance, modeDirect, conversion, meshIsClosed, resolution, &pcvProgressCb, nullptr))
+	//same options as the headless 'solis' tool
+	SOLISSettings settings;
+	QString errorStr;
+	while (!cmd.arguments().empty())
+	{
+		bool recognized = false;
+		if (!settings.parse(cmd.arguments(), recognized, &errorStr))
 		{
-			return cmd.error(QObject::tr("Process failed"));
+			return cmd.error(errorStr);
 		}
-		pcvProgressCb.close();
-		// Save output
-		for (CLCloudDesc& desc : cmd.clouds())
+		if (!recognized)
 		{
-			desc.basename += QString("_SOLISDIR");
-			//save output
-			if (cmd.autoSaveMode())
-			{
-				QString errorStr = cmd.exportEntity(desc);
-				if (!errorStr.isEmpty())
-				{
-					return cmd.error(errorStr);
-				}
-			}
+			cmd.warning(cmd.arguments().front());
+			break;
 		}
+	}
 
-		for (CLMeshDesc& desc : cmd.meshes())
-		{
-			desc.basename += QString("_SOLISDIR");
-			//save output
-			if (cmd.autoSaveMode())
-			{
-				QString errorStr = cmd.exportEntity(desc);
-				if (!errorStr.isEmpty())
-				{
-					return cmd.error(errorStr);
-				}
-			}
-		}		
+	QStringList messages;
+	settings.resolve(messages);
+	for (const QString& message : messages)
+	{
+		cmd.warning(message);
 	}
-    // END DIRECT
 
-	if (mode==SOLIS_DIFFUSE || mode == SOLIS_BOTH)
+	SOLISRun run(settings);
+	messages.clear();
+	bool success = run.prepare(messages, &errorStr);
+	for (const QString& message : messages)
+	{
+		cmd.print(message);
+	}
+	if (!success)
 	{
-		sprintf(buf, "Diffuse irradiance: LAT %0.3f LON %0.3f ELV %i DOY %0.3f INT %0.3f TS %0.3f",latitude,longitude,elevation,doyFrom, integration, timestep);
-		cmd.warning(buf);
+		return cmd.error(errorStr);
+	}
 
-		if (!SOLIS::GenerateDiffRays(rayCount, rays))
-		{
-			return cmd.error(QObject::tr("Failed to generate the set of rays"));
-		}
-		irradiance.resize(1);
-		irradiance[0] = SOLIS::totalDiffIrradiance (doyFrom,doyFrom+integration/24.0,timestep,latitude,longitude,elevation);
-		modeDirect=false;
-		
-		
-		if (rays.empty())
-		{
-			return cmd.error(QObject::tr("No ray was generated. Sun always below horizon in selected timerange"));
-		}
-		
-		ccHObject::Container candidates;
-		try
-		{
-			candidates.reserve(cmd.clouds().size() + cmd.meshes().size());
-		}
-		catch (const std::bad_alloc)
-		{
-			return cmd.error(QObject::tr("Not enough memory"));
-		}
+	if (settings.direct() && !ProcessComponent(cmd, run, true, "_SOLISDIR"))
+	{
+		return false;
+	}
+	if (settings.diffuse() && !ProcessComponent(cmd, run, false, "_SOLISDIF"))
+	{
+		return false;
+	}
+	return true;
+}
 
-		for (CLCloudDesc& desc : cmd.clouds())
-			candidates.push_back(desc.pc);
-		for (CLMeshDesc& desc : cmd.meshes())
-			candidates.push_back(desc.mesh);
+bool SOLISMergeCommand::process(ccCommandLineInterface& cmd)
+{
+	cmd.print("[SOLIS MERGE]");
 
-		ccProgressDialog pcvProgressCb(true);
-		pcvProgressCb.setAutoClose(false);
-		if (!SOLISCommand::Process(candidates, rays,  irradiance, modeDirect, conversion, meshIsClosed, resolution, &pcvProgressCb, nullptr))
-		{
-			return cmd.error(QObject::tr("Process failed"));
-		}
+	if (cmd.meshes().empty() && cmd.clouds().empty())
+	{
+		return cmd.error(qSOLIS::tr("No entity is loaded."));
+	}
 
-		for (CLCloudDesc& desc : cmd.clouds())
-		{
-			desc.basename += QString("_SOLISDIF");
-			//save output
-			if (cmd.autoSaveMode())
-			{
-				QString errorStr = cmd.exportEntity(desc);
-				if (!errorStr.isEmpty())
-				{
-					return cmd.error(errorStr);
-				}
-			}
-		}
+	if (cmd.arguments().empty())
+	{
+		return cmd.error(QObject::tr("Missing parameter: directory after \"-%1\"").arg(COMMAND_SOLIS_MERGE));
+	}
+	QString shardDirectory = cmd.arguments().takeFirst();
 
-		for (CLMeshDesc& desc : cmd.meshes())
-		{
-			desc.basename += QString("_SOLISDIF");
-			//save output
-			if (cmd.autoSaveMode())
-			{
-				QString errorStr = cmd.exportEntity(desc);
-				if (!errorStr.isEmpty())
-				{
-					return cmd.error(errorStr);
-				}
-			}
-		}
-		pcvProgressCb.close();
+	ccHObject::Container candidates;
+	if (!GetCandidates(cmd, candidates))
+	{
+		return cmd.error(QObject::tr("Not enough memory"));
+	}
+
+	QString errorStr;
+	size_t runCount = 0;
+	if (!SOLISCommand::MergeShards(candidates, shardDirectory, nullptr, &errorStr, &runCount))
+	{
+		return cmd.error(errorStr);
+	}
+	cmd.print(QObject::tr("Merged shards: %1 runs over %2 entities").arg(runCount).arg(candidates.size()));
+
+	// Save output
+	errorStr = SaveEntities(cmd, "_SOLIS");
+	if (!errorStr.isEmpty())
+	{
+		return cmd.error(errorStr);
 	}
 	return true;
 }
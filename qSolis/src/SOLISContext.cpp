@@ -36,7 +36,10 @@
 #endif
 
 //system
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <new>
 
 //type-less glVertex3Xv call (X=f,d)
 static inline void glVertex3v(const float* v) { glVertex3fv(v); }
@@ -66,6 +69,7 @@ SOLISContext::SOLISContext()
 	, m_snapZ(nullptr)
 	, m_snapC(nullptr)
 	, m_meshIsClosed(false)
+	, m_receivers(nullptr)
 {
 	memset(m_viewMat, 0, sizeof(float)*OPENGL_MATRIX_SIZE);
 }
@@ -92,8 +96,9 @@ bool SOLISContext::init(unsigned W,
 	if (!m_pixBuffer || !m_pixBuffer->isValid())
 		return false;
 
-	unsigned size = W*H;
-	m_snapZ = new float[size];
+	//64 bits pixel count (W*H may exceed 2^31 for large contexts)
+	size_t size = static_cast<size_t>(W) * H;
+	m_snapZ = new (std::nothrow) float[size];
 	if (!m_snapZ)
 	{
 		delete m_pixBuffer;
@@ -104,8 +109,8 @@ bool SOLISContext::init(unsigned W,
 	m_meshIsClosed = (closedMesh || !mesh);
 	if (!m_meshIsClosed)
 	{
-		//buffer for color
-		m_snapC = new unsigned char[4*size];
+		//buffer for color (+ one row and one pixel of padding for the neighbour lookup in GLVisitVisiblePoints)
+		m_snapC = new (std::nothrow) unsigned char[4 * (size + W + 1)];
 		if (!m_snapC)
 		{
 			delete m_pixBuffer;
@@ -114,6 +119,8 @@ bool SOLISContext::init(unsigned W,
 			m_snapZ = nullptr;
 			return false;
 		}
+		//the padding isn't written by the snapshots: it must not light anything
+		memset(m_snapC, 0, 4 * (size + W + 1));
 	}
 
 	m_width = W;
@@ -173,13 +180,52 @@ void SOLISContext::glInit()
 	glPushMatrix();
 
 	//projection matrix initialization
+	setProjection(static_cast<PointCoordinateType>(std::max(m_width, m_height)));
+	glPushMatrix();
+}
+
+void SOLISContext::setProjection(PointCoordinateType depth)
+{
 	glMatrixMode(GL_PROJECTION);
 	glLoadIdentity();
 	float w2 = 0.5f * m_width;
 	float h2 = 0.5f * m_height;
-	float maxD = static_cast<float>(std::max(m_width, m_height));
-	glOrtho(-w2, w2, -h2, h2, -maxD, maxD);
-	glPushMatrix();
+	glOrtho(-w2, w2, -h2, h2, -depth, depth);
+}
+
+bool SOLISContext::setReceivers(const std::vector<uint64_t>* receiverMask)
+{
+	m_receivers = nullptr;
+	if (!receiverMask)
+		return true;
+	if (!m_vertices || receiverMask->size() != (m_vertices->size() + 63) / 64)
+		return false;
+
+	//bounding box of the subset (the view itself is not changed)
+	size_t count = 0;
+	size_t nVert = m_vertices->size();
+	m_vertices->placeIteratorAtBeginning();
+	for (size_t i = 0; i < nVert; ++i)
+	{
+		const CCVector3* P = m_vertices->getNextPoint();
+		if (((*receiverMask)[i >> 6] >> (i & 63)) & 1)
+		{
+			if (count++ == 0)
+			{
+				m_receiversMin = m_receiversMax = *P;
+			}
+			else
+			{
+				m_receiversMin = CCVector3(std::min(m_receiversMin.x, P->x), std::min(m_receiversMin.y, P->y), std::min(m_receiversMin.z, P->z));
+				m_receiversMax = CCVector3(std::max(m_receiversMax.x, P->x), std::max(m_receiversMax.y, P->y), std::max(m_receiversMax.z, P->z));
+			}
+		}
+	}
+	if (count == 0)
+		return false;
+
+	m_receivers = receiverMask;
+	return true;
 }
 
 void SOLISContext::setViewDirection(const CCVector3& V)
@@ -205,24 +251,29 @@ void SOLISContext::setViewDirection(const CCVector3& V)
 	glPopMatrix();
 }
 
-void SOLISContext::drawEntity()
+void SOLISContext::loadViewMatrix()
 {
-	assert(m_vertices);
-
 	glMatrixMode(GL_MODELVIEW);
 	glLoadMatrixf(m_viewMat);
 	glScale(m_zoom, m_zoom, m_zoom);
 	glTranslate(-m_viewCenter.x, -m_viewCenter.y, -m_viewCenter.z);
+}
+
+void SOLISContext::drawEntity()
+{
+	assert(m_vertices);
+
+	loadViewMatrix();
 
 	glColor3ub(255, 255, 0); //yellow by default
 
 	if (m_mesh)
 	{
-		unsigned nTri = m_mesh->size();
+		size_t nTri = m_mesh->size();
 		m_mesh->placeIteratorAtBeginning();
 
 		glBegin(GL_TRIANGLES);
-		for (unsigned i = 0; i < nTri; ++i)
+		for (size_t i = 0; i < nTri; ++i)
 		{
 			const GenericTriangle* t = m_mesh->_getNextTriangle();
 			glVertex3v(t->_getA()->u);
@@ -233,75 +284,27 @@ void SOLISContext::drawEntity()
 	}
 	else
 	{
-		unsigned nPts = m_vertices->size();
+		size_t nPts = m_vertices->size();
 		m_vertices->placeIteratorAtBeginning();
 
 		glBegin(GL_POINTS);
-		for (unsigned i = 0; i < nPts; ++i)
+		for (size_t i = 0; i < nPts; ++i)
 			glVertex3v(m_vertices->getNextPoint()->u);
 		glEnd();
 	}
 }
 
-void openGLSnapshot(GLenum format, GLenum type, void* buffer)
+void openGLSnapshot(const int window[4], GLenum format, GLenum type, void* buffer)
 {
 	assert(buffer);
 
-	int vp[4];
-	glGetIntegerv(GL_VIEWPORT, vp);
-
-	glReadPixels(vp[0], vp[1], vp[2], vp[3], format, type, buffer);
+	glReadPixels(window[0], window[1], window[2], window[3], format, type, buffer);
 }
 
-//The method below is inspired from ShadeVis' "GLAccumPixel" (Cignoni et al.)
-/****************************************************************************
-* VCGLib                                                            o o     *
-* Visual and Computer Graphics Library                            o     o   *
-*                                                                _   O  _   *
-* Copyright(C) 2004                                                \/)\/    *
-* Visual Computing Lab                                            /\/|      *
-* ISTI - Italian National Research Council                           |      *
-*****************************************************************************/
-int SOLISContext::GLAccumPixel(std::vector<int>& visibilityCount)
+bool SOLISContext::receiversWindow(int window[4])
 {
-	if (!m_pixBuffer || !m_pixBuffer->isValid())
-		return -1;
-	if (!m_vertices)
-		return -1;
-	if (m_vertices->size() != visibilityCount.size())
-		return -1;
-
-	assert(m_snapZ);
-
-	m_pixBuffer->makeCurrent();
-
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glDepthRange(2.0f*ZTWIST, 1.0f);
-
-	if (m_meshIsClosed)
-		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-	else
-		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-
-	//display 3D entity (front)
-	glCullFace(GL_BACK);
-	drawEntity();
-
-	if (!m_meshIsClosed)
-	{
-		//display it again (back)
-		glCullFace(GL_FRONT);
-		drawEntity();
-
-		assert(m_snapC);
-		openGLSnapshot(GL_RGBA, GL_UNSIGNED_BYTE, m_snapC);
-	}
-	openGLSnapshot(GL_DEPTH_COMPONENT, GL_FLOAT, m_snapZ);
-
-	if (m_meshIsClosed)
-		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-
-	glDepthRange(0, 1.0f - 2.0f*ZTWIST);
+	//the receivers are projected with the same matrices as the vertices (see GLVisitVisiblePoints)
+	loadViewMatrix();
 	double MM[OPENGL_MATRIX_SIZE];
 	glGetDoublev(GL_MODELVIEW_MATRIX, MM);
 	double MP[OPENGL_MATRIX_SIZE];
@@ -309,56 +312,42 @@ int SOLISContext::GLAccumPixel(std::vector<int>& visibilityCount)
 	int VP[4];
 	glGetIntegerv(GL_VIEWPORT, VP);
 
-	int count = 0;
-	int sx4 = (m_width << 2);
-
-	unsigned nVert = m_vertices->size();
-	m_vertices->placeIteratorAtBeginning();
-	for (unsigned i = 0; i < nVert; ++i)
+	//orthographic projection: the projected bounding box of the subset contains all the receivers
+	double xMin = 0.0;
+	double xMax = 0.0;
+	double yMin = 0.0;
+	double yMax = 0.0;
+	for (int c = 0; c < 8; ++c)
 	{
-		const CCVector3* P = m_vertices->getNextPoint();
-
+		CCVector3 P(	(c & 1) ? m_receiversMax.x : m_receiversMin.x,
+						(c & 2) ? m_receiversMax.y : m_receiversMin.y,
+						(c & 4) ? m_receiversMax.z : m_receiversMin.z);
 		double tx = 0.0;
 		double ty = 0.0;
 		double tz = 0.0;
-		gluProject(P->x, P->y, P->z, MM, MP, VP, &tx, &ty, &tz);
-
-		int txi = static_cast<int>(floor(tx));
-		int tyi = static_cast<int>(floor(ty));
-		if (txi >= 0 && txi < static_cast<int>(m_width)
-			&& tyi >= 0 && tyi < static_cast<int>(m_height))
-		{
-			int dec = txi + tyi*static_cast<int>(m_width);
-			int col = 1;
-
-			if (!m_meshIsClosed)
-			{
-				//int c1 = std::max(m_snapC[dec],m_snapC[dec<<2+4]);
-				//int c2 = std::max(m_snapC[dec<<2+sx4],m_snapC[dec<<2+sx4+4]);
-				const unsigned char* pix = m_snapC + (dec << 2);
-				int c1 = std::max(pix[0], pix[4]);
-				pix += sx4;
-				int c2 = std::max(pix[0], pix[4]);
-				col = std::max(c1, c2);
-			}
-
-			if (col != 0)
-			{
-				if (tz < static_cast<double>(m_snapZ[dec]))
-				{
-					assert(i < visibilityCount.size());
-					++visibilityCount[i]; // SOLIS Here increment with current radiation
-					++count;
-				}
-			}
-		}
+		gluProject(P.x, P.y, P.z, MM, MP, VP, &tx, &ty, &tz);
+		xMin = (c == 0 ? tx : std::min(xMin, tx));
+		xMax = (c == 0 ? tx : std::max(xMax, tx));
+		yMin = (c == 0 ? ty : std::min(yMin, ty));
+		yMax = (c == 0 ? ty : std::max(yMax, ty));
 	}
 
-	return count;
+	//one pixel of margin (rounding), plus the next column and row (neighbour lookup of non-closed meshes)
+	double x0 = std::max(0.0, floor(xMin) - 1.0);
+	double y0 = std::max(0.0, floor(yMin) - 1.0);
+	double x1 = std::min(static_cast<double>(m_width), floor(xMax) + 3.0);
+	double y1 = std::min(static_cast<double>(m_height), floor(yMax) + 3.0);
+	if (x1 <= x0 || y1 <= y0)
+		return false;
+
+	window[0] = static_cast<int>(x0);
+	window[1] = static_cast<int>(y0);
+	window[2] = static_cast<int>(x1) - window[0];
+	window[3] = static_cast<int>(y1) - window[1];
+	return true;
 }
 
 //The method below is inspired from ShadeVis' "GLAccumPixel" (Cignoni et al.)
-// Modified to acclumulate irradiance values
 /****************************************************************************
 * VCGLib                                                            o o     *
 * Visual and Computer Graphics Library                            o     o   *
@@ -367,19 +356,29 @@ int SOLISContext::GLAccumPixel(std::vector<int>& visibilityCount)
 * Visual Computing Lab                                            /\/|      *
 * ISTI - Italian National Research Council                           |      *
 *****************************************************************************/
-int SOLISContext::GLAccumPixelIrradiance(std::vector<double>& visibilityCount, double irradiance)
+template <class VisibleFunc> int64_t SOLISContext::GLVisitVisiblePoints(size_t accumulatorSize, VisibleFunc onVisible)
 {
 	if (!m_pixBuffer || !m_pixBuffer->isValid())
 		return -1;
 	if (!m_vertices)
 		return -1;
-	if (m_vertices->size() != visibilityCount.size())
+	if (m_vertices->size() != accumulatorSize)
 		return -1;
 
 	assert(m_snapZ);
 
 	m_pixBuffer->makeCurrent();
 
+	//pixels read back: the whole view, or only the ones covering the receivers (same pixels as the whole view)
+	int window[4] = { 0, 0, static_cast<int>(m_width), static_cast<int>(m_height) };
+	if (m_receivers)
+	{
+		if (!receiversWindow(window))
+			return 0; //no receiver in the view
+		glScissor(window[0], window[1], window[2], window[3]);
+		glEnable(GL_SCISSOR_TEST);
+	}
+
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glDepthRange(2.0f*ZTWIST, 1.0f);
 
@@ -399,9 +398,14 @@ int SOLISContext::GLAccumPixelIrradiance(std::vector<double>& visibilityCount, d
 		drawEntity();
 
 		assert(m_snapC);
-		openGLSnapshot(GL_RGBA, GL_UNSIGNED_BYTE, m_snapC);
+		openGLSnapshot(window, GL_RGBA, GL_UNSIGNED_BYTE, m_snapC);
+		//the row after a receivers window may hold a previous (larger) snapshot: clear it as the padding
+		memset(m_snapC + 4 * static_cast<size_t>(window[2]) * window[3], 0, 4 * (static_cast<size_t>(window[2]) + 1));
 	}
-	openGLSnapshot(GL_DEPTH_COMPONENT, GL_FLOAT, m_snapZ);
+	openGLSnapshot(window, GL_DEPTH_COMPONENT, GL_FLOAT, m_snapZ);
+
+	if (m_receivers)
+		glDisable(GL_SCISSOR_TEST);
 
 	if (m_meshIsClosed)
 		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
@@ -414,26 +418,35 @@ int SOLISContext::GLAccumPixelIrradiance(std::vector<double>& visibilityCount, d
 	int VP[4];
 	glGetIntegerv(GL_VIEWPORT, VP);
 
-	int count = 0;
-	int sx4 = (m_width << 2);
+	int64_t count = 0;
+	size_t windowWidth = static_cast<size_t>(window[2]);
+	size_t sx4 = (windowWidth << 2);
 
-	unsigned nVert = m_vertices->size();
+	size_t nVert = m_vertices->size();
 	m_vertices->placeIteratorAtBeginning();
-	for (unsigned i = 0; i < nVert; ++i)
+	for (size_t i = 0; i < nVert; ++i)
 	{
 		const CCVector3* P = m_vertices->getNextPoint();
+		if (m_receivers && (((*m_receivers)[i >> 6] >> (i & 63)) & 1) == 0)
+			continue;
 
 		double tx = 0.0;
 		double ty = 0.0;
 		double tz = 0.0;
 		gluProject(P->x, P->y, P->z, MM, MP, VP, &tx, &ty, &tz);
 
-		int txi = static_cast<int>(floor(tx));
-		int tyi = static_cast<int>(floor(ty));
-		if (txi >= 0 && txi < static_cast<int>(m_width)
-			&& tyi >= 0 && tyi < static_cast<int>(m_height))
+		//test the bounds before casting (projected coordinates may be far outside of the int range)
+		if (tx >= 0.0 && tx < static_cast<double>(m_width)
+			&& ty >= 0.0 && ty < static_cast<double>(m_height))
 		{
-			int dec = txi + tyi*static_cast<int>(m_width);
+			size_t txi = static_cast<size_t>(tx);
+			size_t tyi = static_cast<size_t>(ty);
+			if (txi < static_cast<size_t>(window[0]) || txi >= static_cast<size_t>(window[0] + window[2])
+				|| tyi < static_cast<size_t>(window[1]) || tyi >= static_cast<size_t>(window[1] + window[3]))
+			{
+				continue; //can't happen (see receiversWindow)
+			}
+			size_t dec = (txi - window[0]) + (tyi - window[1]) * windowWidth;
 			int col = 1;
 
 			if (!m_meshIsClosed)
@@ -451,8 +464,7 @@ int SOLISContext::GLAccumPixelIrradiance(std::vector<double>& visibilityCount, d
 			{
 				if (tz < static_cast<double>(m_snapZ[dec]))
 				{
-					assert(i < visibilityCount.size());
-					visibilityCount[i]+=irradiance; // SOLIS Here increment with current radiation
+					onVisible(i); // SOLIS Here increment with current radiation
 					++count;
 				}
 			}
@@ -461,3 +473,55 @@ int SOLISContext::GLAccumPixelIrradiance(std::vector<double>& visibilityCount, d
 
 	return count;
 }
+
+int64_t SOLISContext::GLForEachVisiblePoint(size_t accumulatorSize, const std::function<void(size_t)>& onVisible)
+{
+	return GLVisitVisiblePoints(accumulatorSize, onVisible);
+}
+
+int64_t SOLISContext::GLVisibilityMask(std::vector<uint64_t>& visibilityMask)
+{
+	if (!m_vertices || visibilityMask.size() != (m_vertices->size() + 63) / 64)
+		return -1;
+
+	std::fill(visibilityMask.begin(), visibilityMask.end(), static_cast<uint64_t>(0));
+	return GLVisitVisiblePoints(m_vertices->size(), [&](size_t i) { visibilityMask[i >> 6] |= (static_cast<uint64_t>(1) << (i & 63)); });
+}
+
+int64_t SOLISContext::GLAccumPixel(std::vector<uint16_t>& visibilityCount)
+{
+	return GLVisitVisiblePoints(visibilityCount.size(), [&](size_t i) { ++visibilityCount[i]; });
+}
+
+int64_t SOLISContext::GLAccumPixel(std::vector<uint32_t>& visibilityCount)
+{
+	return GLVisitVisiblePoints(visibilityCount.size(), [&](size_t i) { ++visibilityCount[i]; });
+}
+
+int64_t SOLISContext::GLAccumPixelIrradiance(std::vector<double>& visibilityCount, double irradiance)
+{
+	return GLVisitVisiblePoints(visibilityCount.size(), [&](size_t i) { visibilityCount[i] += irradiance; });
+}
+
+int64_t SOLISContext::GLAccumPixelIrradiance(std::vector<ScalarType>& visibilityCount, std::vector<ScalarType>* compensation, double irradiance)
+{
+	ScalarType value = static_cast<ScalarType>(irradiance);
+
+	if (!compensation)
+	{
+		return GLVisitVisiblePoints(visibilityCount.size(), [&](size_t i) { visibilityCount[i] += value; });
+	}
+
+	if (compensation->size() != visibilityCount.size())
+		return -1;
+
+	//Kahan summation: 'compensation' keeps the low-order bits lost by each addition
+	std::vector<ScalarType>& c = *compensation;
+	return GLVisitVisiblePoints(visibilityCount.size(), [&](size_t i)
+	{
+		ScalarType y = value - c[i];
+		ScalarType t = visibilityCount[i] + y;
+		c[i] = (t - visibilityCount[i]) - y;
+		visibilityCount[i] = t;
+	});
+}
@@ -0,0 +1,1050 @@
+//##########################################################################
+//#                                                                        #
+//#                       CLOUDCOMPARE PLUGIN: qSOLIS                      #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                  COPYRIGHT: David Basler                               #
+//#                                                                        #
+//##########################################################################
+
+#include "SOLISFile.h"
+
+//System
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+
+//! PLY value types
+enum PlyType { PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64, PLY_INVALID };
+
+//! PLY storage formats
+enum PlyFormat { PLY_ASCII, PLY_BINARY_LE, PLY_BINARY_BE };
+
+//! PLY property
+struct PlyProperty
+{
+	std::string name;
+	PlyType type = PLY_INVALID;
+	PlyType countType = PLY_INVALID;	//!< type of the item count (lists only)
+};
+
+//! PLY element
+struct PlyElement
+{
+	std::string name;
+	size_t count = 0;
+	std::vector<PlyProperty> properties;
+};
+
+//! Coordinates beyond this value are shifted (see SOLISFile::Geometry::shift)
+static const double c_maxLocalCoordinate = 1.0e5;
+//! Number of points read or written at once (binary files)
+static const size_t c_chunkSize = 65536;
+
+static PlyType ParsePlyType(const char* name)
+{
+	static const struct { const char* name; PlyType type; } s_types[] = {
+		{ "char", PLY_INT8 }, { "int8", PLY_INT8 }, { "uchar", PLY_UINT8 }, { "uint8", PLY_UINT8 },
+		{ "short", PLY_INT16 }, { "int16", PLY_INT16 }, { "ushort", PLY_UINT16 }, { "uint16", PLY_UINT16 },
+		{ "int", PLY_INT32 }, { "int32", PLY_INT32 }, { "uint", PLY_UINT32 }, { "uint32", PLY_UINT32 },
+		{ "float", PLY_FLOAT32 }, { "float32", PLY_FLOAT32 }, { "double", PLY_FLOAT64 }, { "float64", PLY_FLOAT64 } };
+
+	for (const auto& t : s_types)
+	{
+		if (strcmp(name, t.name) == 0)
+			return t.type;
+	}
+	return PLY_INVALID;
+}
+
+static size_t PlyTypeSize(PlyType type)
+{
+	switch (type)
+	{
+	case PLY_INT8:
+	case PLY_UINT8:
+		return 1;
+	case PLY_INT16:
+	case PLY_UINT16:
+		return 2;
+	case PLY_INT32:
+	case PLY_UINT32:
+	case PLY_FLOAT32:
+		return 4;
+	case PLY_FLOAT64:
+		return 8;
+	default:
+		return 0;
+	}
+}
+
+static bool IsLittleEndianHost()
+{
+	uint16_t value = 1;
+	uint8_t firstByte = 0;
+	memcpy(&firstByte, &value, 1);
+	return firstByte == 1;
+}
+
+//! Decodes a binary PLY value
+static double DecodePlyValue(const unsigned char* data, PlyType type, bool swap)
+{
+	unsigned char bytes[8];
+	size_t size = PlyTypeSize(type);
+	for (size_t i = 0; i < size; ++i)
+		bytes[i] = data[swap ? size - 1 - i : i];
+
+	switch (type)
+	{
+	case PLY_INT8:		{ int8_t v;   memcpy(&v, bytes, 1); return v; }
+	case PLY_UINT8:		{ uint8_t v;  memcpy(&v, bytes, 1); return v; }
+	case PLY_INT16:		{ int16_t v;  memcpy(&v, bytes, 2); return v; }
+	case PLY_UINT16:	{ uint16_t v; memcpy(&v, bytes, 2); return v; }
+	case PLY_INT32:		{ int32_t v;  memcpy(&v, bytes, 4); return v; }
+	case PLY_UINT32:	{ uint32_t v; memcpy(&v, bytes, 4); return v; }
+	case PLY_FLOAT32:	{ float v;    memcpy(&v, bytes, 4); return v; }
+	case PLY_FLOAT64:	{ double v;   memcpy(&v, bytes, 8); return v; }
+	default:
+		return 0;
+	}
+}
+
+//! Reads a single PLY value
+static bool ReadPlyValue(FILE* fp, PlyFormat format, PlyType type, double& value)
+{
+	if (format == PLY_ASCII)
+		return (fscanf(fp, "%lf", &value) == 1);
+
+	unsigned char bytes[8];
+	size_t size = PlyTypeSize(type);
+	if (fread(bytes, 1, size, fp) != size)
+		return false;
+	value = DecodePlyValue(bytes, type, (format == PLY_BINARY_LE) != IsLittleEndianHost());
+	return true;
+}
+
+//! Reads the header of a PLY file (the file is then positioned at the first element)
+static bool ReadPlyHeader(FILE* fp, PlyFormat& format, std::vector<PlyElement>& elements, QString& error)
+{
+	char line[1024];
+	if (!fgets(line, sizeof(line), fp) || strncmp(line, "ply", 3) != 0)
+	{
+		error = "Not a PLY file";
+		return false;
+	}
+
+	bool formatFound = false;
+	while (fgets(line, sizeof(line), fp))
+	{
+		char keyword[64] = { 0 };
+		char a[256] = { 0 };
+		char b[256] = { 0 };
+		char c[256] = { 0 };
+		char d[256] = { 0 };
+		if (sscanf(line, "%63s %255s %255s %255s %255s", keyword, a, b, c, d) <= 0)
+			continue;
+
+		if (strcmp(keyword, "end_header") == 0)
+		{
+			if (!formatFound)
+				error = "Missing PLY format";
+			return formatFound;
+		}
+		else if (strcmp(keyword, "format") == 0)
+		{
+			if (strcmp(a, "ascii") == 0)
+				format = PLY_ASCII;
+			else if (strcmp(a, "binary_little_endian") == 0)
+				format = PLY_BINARY_LE;
+			else if (strcmp(a, "binary_big_endian") == 0)
+				format = PLY_BINARY_BE;
+			else
+			{
+				error = QString("Unknown PLY format '%1'").arg(a);
+				return false;
+			}
+			formatFound = true;
+		}
+		else if (strcmp(keyword, "element") == 0)
+		{
+			PlyElement element;
+			element.name = a;
+			element.count = static_cast<size_t>(strtoull(b, nullptr, 10));
+			elements.push_back(element);
+		}
+		else if (strcmp(keyword, "property") == 0)
+		{
+			if (elements.empty())
+			{
+				error = "PLY property without element";
+				return false;
+			}
+			PlyProperty property;
+			if (strcmp(a, "list") == 0)
+			{
+				property.countType = ParsePlyType(b);
+				property.type = ParsePlyType(c);
+				property.name = d;
+				if (property.countType == PLY_INVALID || property.countType == PLY_FLOAT32 || property.countType == PLY_FLOAT64)
+					property.type = PLY_INVALID;
+			}
+			else
+			{
+				property.type = ParsePlyType(a);
+				property.name = b;
+			}
+			if (property.type == PLY_INVALID)
+			{
+				error = QString("Unsupported PLY property '%1'").arg(QString(line).trimmed());
+				return false;
+			}
+			elements.back().properties.push_back(property);
+		}
+		//comments and other keywords are ignored
+	}
+
+	error = "Truncated PLY header";
+	return false;
+}
+
+//! Layout of the records of a PLY element
+struct PlyLayout
+{
+	int coordIndexes[3] = { -1, -1, -1 };	//!< 'x', 'y', 'z' properties (vertices)
+	int indicesIndex = -1;					//!< 'vertex_indices' list (faces)
+	std::vector<size_t> offsets;			//!< offset of the properties (fixed size records)
+	bool fixedSize = false;					//!< binary records without lists (read at once)
+	size_t recordSize = 0;
+};
+
+static PlyLayout AnalyzePlyElement(const PlyElement& element, PlyFormat format)
+{
+	bool isVertex = (element.name == "vertex");
+	bool isFace = (element.name == "face");
+
+	PlyLayout layout;
+	layout.fixedSize = (format != PLY_ASCII);
+	for (size_t k = 0; k < element.properties.size(); ++k)
+	{
+		const PlyProperty& property = element.properties[k];
+		bool isList = (property.countType != PLY_INVALID);
+		if (isVertex && !isList && property.name.size() == 1 && property.name[0] >= 'x' && property.name[0] <= 'z')
+			layout.coordIndexes[property.name[0] - 'x'] = static_cast<int>(k);
+		if (isFace && isList && (property.name == "vertex_indices" || property.name == "vertex_index"))
+			layout.indicesIndex = static_cast<int>(k);
+		layout.offsets.push_back(layout.recordSize);
+		if (isList)
+			layout.fixedSize = false;
+		else
+			layout.recordSize += PlyTypeSize(property.type);
+	}
+	return layout;
+}
+
+//! Reads a PLY record
+/** \param values scalar values (only the coordinates are decoded for fixed size records)
+	\param polygon vertex indices of faces (optional)
+	\return false if the file is truncated
+**/
+static bool ReadPlyRecord(	FILE* fp,
+							PlyFormat format,
+							const PlyElement& element,
+							const PlyLayout& layout,
+							std::vector<unsigned char>& record,
+							std::vector<double>& values,
+							std::vector<unsigned>* polygon)
+{
+	bool swap = ((format == PLY_BINARY_LE) != IsLittleEndianHost());
+	if (layout.fixedSize)
+	{
+		if (fread(record.data(), 1, layout.recordSize, fp) != layout.recordSize)
+			return false;
+		for (int k : layout.coordIndexes)
+		{
+			if (k >= 0)
+				values[k] = DecodePlyValue(record.data() + layout.offsets[k], element.properties[k].type, swap);
+		}
+		return true;
+	}
+
+	if (polygon)
+		polygon->clear();
+	for (size_t k = 0; k < element.properties.size(); ++k)
+	{
+		const PlyProperty& property = element.properties[k];
+		if (property.countType == PLY_INVALID)
+		{
+			if (!ReadPlyValue(fp, format, property.type, values[k]))
+				return false;
+			continue;
+		}
+
+		double count = 0;
+		if (!ReadPlyValue(fp, format, property.countType, count) || count < 0)
+			return false;
+		bool isIndices = (polygon && static_cast<int>(k) == layout.indicesIndex);
+		for (size_t i = 0; i < static_cast<size_t>(count); ++i)
+		{
+			double index = 0;
+			if (!ReadPlyValue(fp, format, property.type, index))
+				return false;
+			if (isIndices)
+				polygon->push_back(static_cast<unsigned>(index));
+		}
+	}
+	return true;
+}
+
+//! Returns the shift keeping the coordinates of a point small enough for single precision
+static CCVector3d SuggestedShift(const CCVector3d& P)
+{
+	CCVector3d shift(0, 0, 0);
+	for (unsigned d = 0; d < 3; ++d)
+	{
+		if (std::abs(P.u[d]) >= c_maxLocalCoordinate)
+			shift.u[d] = floor(P.u[d] / 100.0 + 0.5) * 100.0;
+	}
+	return shift;
+}
+
+//! Adds a point (in global coordinates) to a cloud
+/** The shift is defined by the first point (if not already defined).
+**/
+static void AddPoint(CCCoreLib::PointCloud& cloud, CCVector3d& shift, bool& shiftDefined, const CCVector3d& P)
+{
+	if (!shiftDefined)
+	{
+		shift = SuggestedShift(P);
+		shiftDefined = true;
+	}
+
+	cloud.addPoint(CCVector3(	static_cast<PointCoordinateType>(P.x - shift.x),
+								static_cast<PointCoordinateType>(P.y - shift.y),
+								static_cast<PointCoordinateType>(P.z - shift.z)));
+}
+
+static bool LoadPLY(FILE* fp, SOLISFile::Geometry& geometry, std::vector<unsigned>& triangles, QString& error)
+{
+	PlyFormat format = PLY_ASCII;
+	std::vector<PlyElement> elements;
+	if (!ReadPlyHeader(fp, format, elements, error))
+		return false;
+
+	bool shiftDefined = false;
+	size_t vertexCount = 0;
+	std::vector<double> values;
+	std::vector<unsigned> polygon;
+	std::vector<unsigned char> record;
+
+	for (const PlyElement& element : elements)
+	{
+		bool isVertex = (element.name == "vertex");
+		bool isFace = (element.name == "face");
+		PlyLayout layout = AnalyzePlyElement(element, format);
+
+		if (isVertex)
+		{
+			if (layout.coordIndexes[0] < 0 || layout.coordIndexes[1] < 0 || layout.coordIndexes[2] < 0)
+			{
+				error = "Missing PLY vertex coordinates";
+				return false;
+			}
+			if (!geometry.cloud->reserve(static_cast<unsigned>(vertexCount + element.count)))
+			{
+				error = "Not enough memory";
+				return false;
+			}
+		}
+
+		try
+		{
+			values.resize(element.properties.size());
+			record.resize(layout.recordSize);
+		}
+		catch (const std::bad_alloc&)
+		{
+			//not enough memory?
+			error = "Not enough memory";
+			return false;
+		}
+
+		for (size_t r = 0; r < element.count; ++r)
+		{
+			if (!ReadPlyRecord(fp, format, element, layout, record, values, isFace ? &polygon : nullptr))
+			{
+				error = "Truncated PLY file";
+				return false;
+			}
+
+			if (isVertex)
+			{
+				AddPoint(	*geometry.cloud,
+							geometry.shift,
+							shiftDefined,
+							CCVector3d(values[layout.coordIndexes[0]], values[layout.coordIndexes[1]], values[layout.coordIndexes[2]]));
+			}
+			else if (isFace && layout.indicesIndex >= 0)
+			{
+				for (unsigned index : polygon)
+				{
+					if (index >= vertexCount)
+					{
+						error = "Invalid PLY face (vertex index out of range)";
+						return false;
+					}
+				}
+				//polygons are split in triangles (fan)
+				for (size_t i = 1; i + 1 < polygon.size(); ++i)
+				{
+					triangles.push_back(polygon[0]);
+					triangles.push_back(polygon[i]);
+					triangles.push_back(polygon[i + 1]);
+				}
+			}
+		}
+
+		if (isVertex)
+			vertexCount = geometry.cloud->size();
+	}
+
+	return true;
+}
+
+//! Returns the position in a file (64 bits)
+static int64_t Tell(FILE* fp)
+{
+#ifdef _WIN32
+	return _ftelli64(fp);
+#else
+	return static_cast<int64_t>(ftello(fp));
+#endif
+}
+
+//! Sets the position in a file (64 bits)
+static bool Seek(FILE* fp, int64_t offset, int origin)
+{
+#ifdef _WIN32
+	return (_fseeki64(fp, offset, origin) == 0);
+#else
+	return (fseeko(fp, static_cast<off_t>(offset), origin) == 0);
+#endif
+}
+
+//! Reads the points of an ASCII file (up to maxCount points)
+static void ReadASCIIPoints(FILE* fp, size_t maxCount, CCCoreLib::PointCloud& cloud, CCVector3d& shift, bool& shiftDefined)
+{
+	char line[4096];
+	size_t count = 0;
+	while (count < maxCount && fgets(line, sizeof(line), fp))
+	{
+		size_t length = strlen(line);
+		if (length + 1 == sizeof(line) && line[length - 1] != '\n')
+		{
+			//the end of a (too) long line is skipped
+			int ch = 0;
+			while ((ch = fgetc(fp)) != EOF && ch != '\n') {}
+		}
+
+		double values[3];
+		char* current = line;
+		int valueCount = 0;
+		for (; valueCount < 3; ++valueCount)
+		{
+			while (*current == ' ' || *current == '\t' || *current == ',' || *current == ';')
+				++current;
+			char* end = nullptr;
+			values[valueCount] = strtod(current, &end);
+			if (end == current)
+				break;
+			current = end;
+		}
+		if (valueCount < 3)
+			continue;
+
+		AddPoint(cloud, shift, shiftDefined, CCVector3d(values[0], values[1], values[2]));
+		++count;
+	}
+}
+
+//! Returns the number of points of a binary file (or -1 if the file size is invalid)
+static int64_t BinaryPointCount(FILE* fp, QString& error)
+{
+	Seek(fp, 0, SEEK_END);
+	int64_t fileSize = Tell(fp);
+	Seek(fp, 0, SEEK_SET);
+	if (fileSize <= 0 || fileSize % (3 * sizeof(float)) != 0)
+	{
+		error = "Invalid binary file size (float32 'x y z' triplets expected)";
+		return -1;
+	}
+	return fileSize / static_cast<int64_t>(3 * sizeof(float));
+}
+
+//! Reads the points of a binary file
+static bool ReadBinaryPoints(FILE* fp, size_t pointCount, CCCoreLib::PointCloud& cloud, CCVector3d& shift, bool& shiftDefined, QString& error)
+{
+	bool swap = !IsLittleEndianHost();
+	std::vector<unsigned char> buffer(std::min(c_chunkSize, pointCount) * 3 * sizeof(float));
+	for (size_t first = 0; first < pointCount; first += c_chunkSize)
+	{
+		size_t count = std::min(c_chunkSize, pointCount - first);
+		if (fread(buffer.data(), 3 * sizeof(float), count, fp) != count)
+		{
+			error = "Truncated binary file";
+			return false;
+		}
+		for (size_t j = 0; j < count; ++j)
+		{
+			const unsigned char* data = buffer.data() + j * 3 * sizeof(float);
+			AddPoint(cloud, shift, shiftDefined, CCVector3d(DecodePlyValue(data, PLY_FLOAT32, swap),
+															DecodePlyValue(data + 4, PLY_FLOAT32, swap),
+															DecodePlyValue(data + 8, PLY_FLOAT32, swap)));
+		}
+	}
+	return true;
+}
+
+static bool LoadASCII(FILE* fp, SOLISFile::Geometry& geometry, QString& error)
+{
+	bool shiftDefined = false;
+	ReadASCIIPoints(fp, std::numeric_limits<size_t>::max(), *geometry.cloud, geometry.shift, shiftDefined);
+
+	if (geometry.cloud->size() == 0)
+	{
+		error = "No point found";
+		return false;
+	}
+	return true;
+}
+
+static bool LoadBinary(FILE* fp, SOLISFile::Geometry& geometry, QString& error)
+{
+	int64_t pointCount = BinaryPointCount(fp, error);
+	if (pointCount < 0)
+		return false;
+
+	if (!geometry.cloud->reserve(static_cast<unsigned>(pointCount)))
+	{
+		error = "Not enough memory";
+		return false;
+	}
+
+	bool shiftDefined = false;
+	return ReadBinaryPoints(fp, static_cast<size_t>(pointCount), *geometry.cloud, geometry.shift, shiftDefined, error);
+}
+
+//! Supported file formats
+enum FileFormat { FILE_PLY, FILE_BINARY, FILE_ASCII, FILE_UNKNOWN };
+
+//! Returns the format of a file (from its extension)
+static FileFormat GetFileFormat(const QString& filename)
+{
+	QString extension = filename.section('.', -1).toUpper();
+	if (extension == "PLY")
+		return FILE_PLY;
+	if (extension == "BIN")
+		return FILE_BINARY;
+	if (extension == "XYZ" || extension == "TXT" || extension == "ASC" || extension == "CSV" || extension == "PTS")
+		return FILE_ASCII;
+	return FILE_UNKNOWN;
+}
+
+bool SOLISFile::Load(const QString& filename, Geometry& geometry, QString* error/*=nullptr*/)
+{
+	FileFormat fileFormat = GetFileFormat(filename);
+	if (fileFormat == FILE_UNKNOWN)
+	{
+		if (error)
+			*error = QString("Unsupported file format '%1'").arg(filename);
+		return false;
+	}
+
+	FILE* fp = fopen(qPrintable(filename), "rb");
+	if (!fp)
+	{
+		if (error)
+			*error = QString("Failed to open file '%1'").arg(filename);
+		return false;
+	}
+
+	geometry.mesh.reset();
+	geometry.cloud.reset(new CCCoreLib::PointCloud);
+	geometry.shift = CCVector3d(0, 0, 0);
+
+	std::vector<unsigned> triangles;
+	QString errorStr;
+	bool success = false;
+	try
+	{
+		if (fileFormat == FILE_PLY)
+			success = LoadPLY(fp, geometry, triangles, errorStr);
+		else if (fileFormat == FILE_BINARY)
+			success = LoadBinary(fp, geometry, errorStr);
+		else
+			success = LoadASCII(fp, geometry, errorStr);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory?
+		errorStr = "Not enough memory";
+		success = false;
+	}
+	fclose(fp);
+
+	if (success && !triangles.empty())
+	{
+		geometry.mesh.reset(new CCCoreLib::SimpleMesh(geometry.cloud.get()));
+		if (!geometry.mesh->reserve(static_cast<unsigned>(triangles.size() / 3)))
+		{
+			errorStr = "Not enough memory";
+			success = false;
+		}
+		else
+		{
+			for (size_t i = 0; i < triangles.size(); i += 3)
+				geometry.mesh->addTriangle(triangles[i], triangles[i + 1], triangles[i + 2]);
+		}
+	}
+
+	if (!success)
+	{
+		geometry.mesh.reset();
+		geometry.cloud.reset();
+		if (error)
+			*error = QString("%1: %2").arg(filename, errorStr);
+	}
+	return success;
+}
+
+bool SOLISFile::Save(const QString& filename, const Geometry& geometry, const std::vector<CCCoreLib::ScalarField*>& fields, QString* error/*=nullptr*/)
+{
+	if (!geometry.cloud)
+		return false;
+
+	std::vector<QString> fieldNames;
+	for (CCCoreLib::ScalarField* field : fields)
+	{
+		if (!field || field->size() != geometry.cloud->size())
+			return false;
+		fieldNames.push_back(field->getName());
+	}
+
+	Writer writer;
+	if (!writer.open(filename, geometry.cloud->size(), geometry.mesh ? geometry.mesh->size() : 0, geometry.shift, fieldNames, error))
+		return false;
+
+	writer.write(*geometry.cloud, fields);
+	if (geometry.mesh)
+		writer.writeTriangles(*geometry.mesh);
+
+	return writer.close(error);
+}
+
+/*** Reader ***/
+
+struct SOLISFile::Reader::State
+{
+	FILE* fp = nullptr;
+	QString filename;
+	FileFormat fileFormat = FILE_UNKNOWN;
+	//PLY
+	PlyFormat plyFormat = PLY_ASCII;
+	std::vector<PlyElement> skippedElements;	//!< elements stored before the vertices
+	PlyElement vertexElement;
+	PlyLayout vertexLayout;
+	std::vector<unsigned char> record;
+	std::vector<double> values;
+	//position of the first point (PLY: first element)
+	int64_t dataStart = 0;
+	size_t pointCount = 0;
+	size_t remaining = 0;
+	CCVector3d shift = CCVector3d(0, 0, 0);
+	bool shiftDefined = false;
+};
+
+SOLISFile::Reader::Reader()
+	: m_state(new State)
+{
+}
+
+SOLISFile::Reader::~Reader()
+{
+	close();
+}
+
+bool SOLISFile::Reader::open(const QString& filename, QString* error/*=nullptr*/)
+{
+	close();
+	m_state.reset(new State);
+	m_state->filename = filename;
+	m_state->fileFormat = GetFileFormat(filename);
+	if (m_state->fileFormat == FILE_UNKNOWN)
+	{
+		if (error)
+			*error = QString("Unsupported file format '%1'").arg(filename);
+		return false;
+	}
+
+	m_state->fp = fopen(qPrintable(filename), "rb");
+	if (!m_state->fp)
+	{
+		if (error)
+			*error = QString("Failed to open file '%1'").arg(filename);
+		return false;
+	}
+
+	QString errorStr;
+	bool success = true;
+	if (m_state->fileFormat == FILE_PLY)
+	{
+		std::vector<PlyElement> elements;
+		success = ReadPlyHeader(m_state->fp, m_state->plyFormat, elements, errorStr);
+		bool vertexFound = false;
+		for (size_t i = 0; success && i < elements.size() && !vertexFound; ++i)
+		{
+			if (elements[i].name == "vertex")
+			{
+				m_state->vertexElement = elements[i];
+				m_state->vertexLayout = AnalyzePlyElement(elements[i], m_state->plyFormat);
+				vertexFound = true;
+			}
+			else
+			{
+				m_state->skippedElements.push_back(elements[i]);
+			}
+		}
+
+		const PlyLayout& layout = m_state->vertexLayout;
+		if (success && (!vertexFound || layout.coordIndexes[0] < 0 || layout.coordIndexes[1] < 0 || layout.coordIndexes[2] < 0))
+		{
+			errorStr = "Missing PLY vertex coordinates";
+			success = false;
+		}
+		m_state->dataStart = Tell(m_state->fp);
+		m_state->pointCount = m_state->vertexElement.count;
+	}
+	else if (m_state->fileFormat == FILE_BINARY)
+	{
+		int64_t pointCount = BinaryPointCount(m_state->fp, errorStr);
+		success = (pointCount >= 0);
+		m_state->pointCount = static_cast<size_t>(std::max<int64_t>(pointCount, 0));
+	}
+	else
+	{
+		m_state->pointCount = std::numeric_limits<size_t>::max();
+	}
+
+	if (!success)
+	{
+		close();
+		if (error)
+			*error = QString("%1: %2").arg(filename, errorStr);
+		return false;
+	}
+
+	return rewind(error);
+}
+
+bool SOLISFile::Reader::rewind(QString* error/*=nullptr*/)
+{
+	if (!m_state->fp)
+		return false;
+
+	bool success = Seek(m_state->fp, m_state->dataStart, SEEK_SET);
+
+	//the elements stored before the vertices are skipped
+	for (size_t i = 0; success && i < m_state->skippedElements.size(); ++i)
+	{
+		const PlyElement& element = m_state->skippedElements[i];
+		PlyLayout layout = AnalyzePlyElement(element, m_state->plyFormat);
+		if (layout.fixedSize)
+		{
+			success = Seek(m_state->fp, static_cast<int64_t>(layout.recordSize * element.count), SEEK_CUR);
+			continue;
+		}
+
+		try
+		{
+			m_state->values.resize(element.properties.size());
+		}
+		catch (const std::bad_alloc&)
+		{
+			//not enough memory?
+			success = false;
+			break;
+		}
+		for (size_t r = 0; success && r < element.count; ++r)
+			success = ReadPlyRecord(m_state->fp, m_state->plyFormat, element, layout, m_state->record, m_state->values, nullptr);
+	}
+
+	if (!success)
+	{
+		if (error)
+			*error = QString("%1: Truncated PLY file").arg(m_state->filename);
+		return false;
+	}
+
+	m_state->remaining = m_state->pointCount;
+	return true;
+}
+
+bool SOLISFile::Reader::read(size_t maxCount, CCCoreLib::PointCloud& chunk, QString* error/*=nullptr*/)
+{
+	chunk.reset();
+	if (!m_state->fp)
+		return false;
+
+	size_t count = std::min(maxCount, m_state->remaining);
+	if (count == 0)
+		return true;
+
+	QString errorStr;
+	bool success = true;
+	try
+	{
+		if (m_state->fileFormat == FILE_ASCII)
+		{
+			ReadASCIIPoints(m_state->fp, count, chunk, m_state->shift, m_state->shiftDefined);
+			if (chunk.size() < count)
+				m_state->remaining = 0;
+		}
+		else if (!chunk.reserve(static_cast<unsigned>(count)))
+		{
+			errorStr = "Not enough memory";
+			success = false;
+		}
+		else if (m_state->fileFormat == FILE_BINARY)
+		{
+			success = ReadBinaryPoints(m_state->fp, count, chunk, m_state->shift, m_state->shiftDefined, errorStr);
+			m_state->remaining -= count;
+		}
+		else
+		{
+			const PlyElement& element = m_state->vertexElement;
+			const PlyLayout& layout = m_state->vertexLayout;
+			m_state->values.resize(element.properties.size());
+			m_state->record.resize(layout.recordSize);
+			for (size_t r = 0; success && r < count; ++r)
+			{
+				success = ReadPlyRecord(m_state->fp, m_state->plyFormat, element, layout, m_state->record, m_state->values, nullptr);
+				if (success)
+				{
+					const std::vector<double>& values = m_state->values;
+					AddPoint(	chunk,
+								m_state->shift,
+								m_state->shiftDefined,
+								CCVector3d(values[layout.coordIndexes[0]], values[layout.coordIndexes[1]], values[layout.coordIndexes[2]]));
+				}
+			}
+			if (!success)
+				errorStr = "Truncated PLY file";
+			m_state->remaining -= count;
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory?
+		errorStr = "Not enough memory";
+		success = false;
+	}
+
+	if (!success)
+	{
+		chunk.reset();
+		if (error)
+			*error = QString("%1: %2").arg(m_state->filename, errorStr);
+	}
+	return success;
+}
+
+const CCVector3d& SOLISFile::Reader::shift() const
+{
+	return m_state->shift;
+}
+
+void SOLISFile::Reader::close()
+{
+	if (m_state && m_state->fp)
+	{
+		fclose(m_state->fp);
+		m_state->fp = nullptr;
+	}
+}
+
+/*** Writer ***/
+
+SOLISFile::Writer::~Writer()
+{
+	if (m_file)
+		fclose(m_file);
+}
+
+bool SOLISFile::Writer::open(	const QString& filename,
+								size_t pointCount,
+								size_t triangleCount,
+								const CCVector3d& shift,
+								const std::vector<QString>& fieldNames,
+								QString* error/*=nullptr*/)
+{
+	if (m_file)
+		fclose(m_file);
+
+	FileFormat fileFormat = GetFileFormat(filename);
+	m_format = (fileFormat == FILE_PLY ? PLY : fileFormat == FILE_BINARY ? BINARY : ASCII);
+	m_filename = filename;
+	m_shift = shift;
+	m_fieldCount = fieldNames.size();
+	m_pointCount = pointCount;
+	m_triangleCount = (m_format == PLY ? triangleCount : 0);
+	m_writtenPoints = 0;
+	m_writtenTriangles = 0;
+	m_failed = false;
+
+	m_file = fopen(qPrintable(filename), m_format == ASCII ? "w" : "wb");
+	if (!m_file)
+	{
+		if (error)
+			*error = QString("Failed to create file '%1'").arg(filename);
+		return false;
+	}
+
+	if (m_format == PLY)
+	{
+		fprintf(m_file, "ply\nformat %s 1.0\ncomment SOLIS\n", IsLittleEndianHost() ? "binary_little_endian" : "binary_big_endian");
+		fprintf(m_file, "element vertex %zu\nproperty double x\nproperty double y\nproperty double z\n", pointCount);
+		for (const QString& name : fieldNames)
+			fprintf(m_file, "property float %s\n", qPrintable(QString(name).replace(' ', '_')));
+		if (m_triangleCount != 0)
+			fprintf(m_file, "element face %zu\nproperty list uchar int vertex_indices\n", m_triangleCount);
+		m_failed = (fprintf(m_file, "end_header\n") < 0);
+	}
+	else if (m_format == ASCII)
+	{
+		fprintf(m_file, "//X Y Z");
+		for (const QString& name : fieldNames)
+			fprintf(m_file, " %s", qPrintable(QString(name).replace(' ', '_')));
+		m_failed = (fprintf(m_file, "\n") < 0);
+	}
+
+	return !m_failed;
+}
+
+bool SOLISFile::Writer::write(const CCCoreLib::PointCloud& points, const std::vector<CCCoreLib::ScalarField*>& fields)
+{
+	unsigned pointCount = points.size();
+	if (!m_file || m_failed || fields.size() != m_fieldCount || m_writtenPoints + pointCount > m_pointCount)
+	{
+		m_failed = true;
+		return false;
+	}
+	for (CCCoreLib::ScalarField* field : fields)
+	{
+		if (!field || field->size() != pointCount)
+		{
+			m_failed = true;
+			return false;
+		}
+	}
+
+	if (m_format == PLY)
+	{
+		std::vector<unsigned char> record(3 * sizeof(double) + fields.size() * sizeof(float));
+		for (unsigned j = 0; !m_failed && j < pointCount; ++j)
+		{
+			const CCVector3* P = points.getPoint(j);
+			unsigned char* out = record.data();
+			for (unsigned d = 0; d < 3; ++d, out += sizeof(double))
+			{
+				double value = P->u[d] + m_shift.u[d];
+				memcpy(out, &value, sizeof(double));
+			}
+			for (CCCoreLib::ScalarField* field : fields)
+			{
+				float value = static_cast<float>((*field)[j]);
+				memcpy(out, &value, sizeof(float));
+				out += sizeof(float);
+			}
+			m_failed = (fwrite(record.data(), 1, record.size(), m_file) != record.size());
+		}
+	}
+	else if (m_format == BINARY)
+	{
+		std::vector<float> record(3 + fields.size());
+		for (unsigned j = 0; !m_failed && j < pointCount; ++j)
+		{
+			const CCVector3* P = points.getPoint(j);
+			for (unsigned d = 0; d < 3; ++d)
+				record[d] = static_cast<float>(P->u[d] + m_shift.u[d]);
+			for (size_t k = 0; k < fields.size(); ++k)
+				record[3 + k] = static_cast<float>((*fields[k])[j]);
+			m_failed = (fwrite(record.data(), sizeof(float), record.size(), m_file) != record.size());
+		}
+	}
+	else
+	{
+		for (unsigned j = 0; !m_failed && j < pointCount; ++j)
+		{
+			const CCVector3* P = points.getPoint(j);
+			fprintf(m_file, "%.12g %.12g %.12g", P->x + m_shift.x, P->y + m_shift.y, P->z + m_shift.z);
+			for (CCCoreLib::ScalarField* field : fields)
+				fprintf(m_file, " %.7g", static_cast<double>((*field)[j]));
+			m_failed = (fprintf(m_file, "\n") < 0);
+		}
+	}
+
+	m_writtenPoints += pointCount;
+	return !m_failed;
+}
+
+bool SOLISFile::Writer::writeTriangles(CCCoreLib::GenericIndexedMesh& mesh)
+{
+	if (!m_file || m_failed || m_format != PLY)
+		return (m_file && !m_failed);
+
+	unsigned triangleCount = mesh.size();
+	if (m_writtenPoints != m_pointCount || m_writtenTriangles + triangleCount > m_triangleCount)
+	{
+		m_failed = true;
+		return false;
+	}
+
+	for (unsigned i = 0; !m_failed && i < triangleCount; ++i)
+	{
+		const CCCoreLib::VerticesIndexes* tri = mesh.getTriangleVertIndexes(i);
+		unsigned char face[1 + 3 * sizeof(int32_t)];
+		face[0] = 3;
+		int32_t indexes[3] = { static_cast<int32_t>(tri->i1), static_cast<int32_t>(tri->i2), static_cast<int32_t>(tri->i3) };
+		memcpy(face + 1, indexes, sizeof(indexes));
+		m_failed = (fwrite(face, 1, sizeof(face), m_file) != sizeof(face));
+	}
+
+	m_writtenTriangles += triangleCount;
+	return !m_failed;
+}
+
+bool SOLISFile::Writer::close(QString* error/*=nullptr*/)
+{
+	if (!m_file)
+		return false;
+
+	bool success = !m_failed && m_writtenPoints == m_pointCount && m_writtenTriangles == m_triangleCount;
+	success = (fclose(m_file) == 0) && success;
+	m_file = nullptr;
+
+	if (!success && error)
+		*error = QString("Failed to write file '%1'").arg(m_filename);
+	return success;
+}
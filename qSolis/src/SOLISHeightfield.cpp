@@ -0,0 +1,274 @@
+//##########################################################################
+//#                                                                        #
+//#                       CLOUDCOMPARE PLUGIN: qSOLIS                      #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                  COPYRIGHT: David Basler                               #
+//#                                                                        #
+//##########################################################################
+
+#include "SOLISHeightfield.h"
+
+//System
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+//! Height of the cells without any vertex (no occluder)
+static const float c_noHeight = -1.0e30f;
+//! Padding of the occluder lines (the cell shifted toward the sun is at most one position away)
+static const size_t c_linePadding = 2;
+
+double SOLISHeightfield::EstimateCellSize(const CCVector3& bbMin, const CCVector3& bbMax, size_t vertexCount)
+{
+	//one vertex per grid node: (dx / cellSize + 1) * (dy / cellSize + 1) = vertexCount
+	double dx = std::max(static_cast<double>(bbMax.x) - bbMin.x, 1.0e-6);
+	double dy = std::max(static_cast<double>(bbMax.y) - bbMin.y, 1.0e-6);
+	double n = std::max<double>(static_cast<double>(vertexCount), 2.0) - 1.0;
+	return ((dx + dy) + sqrt((dx + dy) * (dx + dy) + 4 * n * dx * dy)) / (2 * n);
+}
+
+bool SOLISHeightfield::init(const CCVector3& bbMin, const CCVector3& bbMax, double cellSize)
+{
+	if (cellSize <= 0)
+		return false;
+
+	//cells are centered on the grid nodes
+	double nx = floor((static_cast<double>(bbMax.x) - bbMin.x) / cellSize + 0.5) + 1;
+	double ny = floor((static_cast<double>(bbMax.y) - bbMin.y) / cellSize + 0.5) + 1;
+	if (nx * ny >= 4294967295.0)
+		return false;
+
+	return init(bbMin.x, bbMin.y, static_cast<unsigned>(nx), static_cast<unsigned>(ny), cellSize);
+}
+
+bool SOLISHeightfield::init(double xMin, double yMin, unsigned columns, unsigned rows, double cellSize)
+{
+	m_nx = m_ny = 0;
+	m_heights.clear();
+
+	if (cellSize <= 0 || columns == 0 || rows == 0 || static_cast<double>(columns) * rows >= 4294967295.0)
+		return false;
+
+	try
+	{
+		m_heights.resize(static_cast<size_t>(columns) * rows, c_noHeight);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory?
+		return false;
+	}
+
+	m_cellSize = cellSize;
+	m_xMin = xMin;
+	m_yMin = yMin;
+	m_nx = columns;
+	m_ny = rows;
+	m_baseHeight = std::numeric_limits<float>::infinity();
+
+	return true;
+}
+
+bool SOLISHeightfield::init(CCCoreLib::GenericCloud* vertices, double cellSize/*=0*/)
+{
+	if (!vertices || vertices->size() == 0)
+		return false;
+
+	CCVector3 bbMin;
+	CCVector3 bbMax;
+	vertices->getBoundingBox(bbMin, bbMax);
+	if (cellSize <= 0)
+		cellSize = EstimateCellSize(bbMin, bbMax, vertices->size());
+
+	if (!init(bbMin, bbMax, cellSize))
+		return false;
+
+	addOccluders(vertices);
+	return true;
+}
+
+uint32_t SOLISHeightfield::cell(const CCVector3& P) const
+{
+	double u = std::max((P.x - m_xMin) / m_cellSize + 0.5, 0.0);
+	double v = std::max((P.y - m_yMin) / m_cellSize + 0.5, 0.0);
+	unsigned cx = std::min(static_cast<unsigned>(std::min(u, 4294967295.0)), m_nx - 1);
+	unsigned cy = std::min(static_cast<unsigned>(std::min(v, 4294967295.0)), m_ny - 1);
+	return cy * m_nx + cx;
+}
+
+void SOLISHeightfield::addOccluder(const CCVector3& P)
+{
+	double u = floor((P.x - m_xMin) / m_cellSize + 0.5);
+	double v = floor((P.y - m_yMin) / m_cellSize + 0.5);
+	if (u < 0 || v < 0 || u >= m_nx || v >= m_ny)
+		return;
+
+	float& height = m_heights[static_cast<size_t>(v) * m_nx + static_cast<size_t>(u)];
+	height = std::max(height, static_cast<float>(P.z));
+	m_baseHeight = std::min(m_baseHeight, static_cast<float>(P.z));
+}
+
+void SOLISHeightfield::addOccluders(CCCoreLib::GenericCloud* vertices)
+{
+	if (!vertices || m_heights.empty())
+		return;
+
+	//highest vertex of each cell
+	size_t numberOfPoints = vertices->size();
+	vertices->placeIteratorAtBeginning();
+	for (size_t j = 0; j < numberOfPoints; ++j)
+	{
+		addOccluder(*vertices->getNextPoint());
+	}
+}
+
+bool SOLISHeightfield::locate(CCCoreLib::GenericCloud* vertices, Receivers& receivers) const
+{
+	if (!vertices || m_heights.empty())
+		return false;
+
+	size_t numberOfPoints = vertices->size();
+	try
+	{
+		receivers.cells.resize(numberOfPoints);
+		receivers.heights.resize(numberOfPoints);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory?
+		return false;
+	}
+
+	vertices->placeIteratorAtBeginning();
+	for (size_t j = 0; j < numberOfPoints; ++j)
+	{
+		const CCVector3* P = vertices->getNextPoint();
+		receivers.cells[j] = cell(*P);
+		receivers.heights[j] = P->z;
+	}
+
+	return true;
+}
+
+int64_t SOLISHeightfield::visibilityMask(const CCVector3& ray, const Receivers& receivers, Workspace& workspace, std::vector<uint64_t>& mask) const
+{
+	size_t numberOfPoints = receivers.cells.size();
+	if (m_heights.empty() || receivers.heights.size() != numberOfPoints)
+		return -1;
+
+	try
+	{
+		mask.resize((numberOfPoints + 63) / 64);
+		workspace.shadow.resize(m_heights.size());
+		workspace.occluders.resize(2 * (std::max(m_nx, m_ny) + 2 * c_linePadding));
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory?
+		return -1;
+	}
+	std::fill(mask.begin(), mask.end(), 0);
+
+	//direction toward the sun
+	double tx = -static_cast<double>(ray.x);
+	double ty = -static_cast<double>(ray.y);
+	double tz = -static_cast<double>(ray.z);
+	double horizontal = sqrt(tx * tx + ty * ty);
+	if (tz <= 0)
+	{
+		//sun below the horizon
+		return 0;
+	}
+
+	int64_t litCount = 0;
+	if (horizontal <= 1.0e-9 * tz)
+	{
+		//no shadow at the zenith
+		for (size_t j = 0; j < numberOfPoints; ++j)
+			mask[j >> 6] |= (static_cast<uint64_t>(1) << (j & 63));
+		return static_cast<int64_t>(numberOfPoints);
+	}
+
+	//lines are perpendicular to the main horizontal axis of the sun
+	bool xMajor = (std::abs(tx) >= std::abs(ty));
+	double major = (xMajor ? tx : ty);
+	double minor = (xMajor ? ty : tx);
+	unsigned lineCount = (xMajor ? m_nx : m_ny);
+	unsigned lineLength = (xMajor ? m_ny : m_nx);
+
+	//position shift (within [-1, 1]) and drop of the ray from one line to the next
+	double delta = minor / std::abs(major);
+	int shift = static_cast<int>(floor(delta));
+	float f = static_cast<float>(delta - shift);
+	float drop = static_cast<float>(sqrt(1.0 + delta * delta) * m_cellSize * tz / horizontal);
+
+	//the sweep starts on the sun side
+	int lineStep = (major > 0 ? -1 : 1);
+	unsigned line = (major > 0 ? lineCount - 1 : 0);
+
+	//empty cells and the outside of the grid are at the base height: they don't cast any shadow, but their
+	//neighbours do (they are interpolated with a finite height, as next to the lowest ground)
+	float base = (m_baseHeight <= std::numeric_limits<float>::max() ? m_baseHeight : 0.0f);
+
+	//shadow heights are stored line by line
+	float* shadow = workspace.shadow.data();
+	size_t stride = lineLength + 2 * c_linePadding;
+	float* previous = workspace.occluders.data();
+	float* current = previous + stride;
+	std::fill(workspace.occluders.begin(), workspace.occluders.end(), base);
+
+	for (unsigned l = 0; l < lineCount; ++l, line += lineStep)
+	{
+		float* lineShadow = shadow + static_cast<size_t>(line) * lineLength;
+		const float* heights = m_heights.data() + (xMajor ? line : static_cast<size_t>(line) * m_nx);
+		size_t heightStride = (xMajor ? m_nx : 1);
+
+		if (l == 0)
+		{
+			std::fill(lineShadow, lineShadow + lineLength, base);
+		}
+		else
+		{
+			//highest occluder of the previous line, at the position shifted toward the sun
+			const float* p0 = previous + c_linePadding + shift;
+			const float* p1 = p0 + 1;
+			for (unsigned p = 0; p < lineLength; ++p)
+			{
+				lineShadow[p] = p0[p] * (1.0f - f) + p1[p] * f - drop;
+			}
+		}
+
+		float* occluders = current + c_linePadding;
+		for (unsigned p = 0; p < lineLength; ++p)
+		{
+			occluders[p] = std::max(std::max(heights[p * heightStride], lineShadow[p]), base);
+		}
+		std::swap(previous, current);
+	}
+
+	//receivers above the shadow height of their cell
+	float tolerance = static_cast<float>(m_cellSize * 1.0e-4);
+	for (size_t j = 0; j < numberOfPoints; ++j)
+	{
+		uint32_t cell = receivers.cells[j];
+		unsigned cx = cell % m_nx;
+		unsigned cy = cell / m_nx;
+		size_t index = (xMajor ? static_cast<size_t>(cx) * m_ny + cy : static_cast<size_t>(cy) * m_nx + cx);
+		if (receivers.heights[j] + tolerance >= shadow[index])
+		{
+			mask[j >> 6] |= (static_cast<uint64_t>(1) << (j & 63));
+			++litCount;
+		}
+	}
+
+	return litCount;
+}
@@ -0,0 +1,367 @@
+//##########################################################################
+//#                                                                        #
+//#                       CLOUDCOMPARE PLUGIN: qSOLIS                      #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                  COPYRIGHT: David Basler                               #
+//#                                                                        #
+//##########################################################################
+
+#include "SOLISHorizon.h"
+
+//System
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <system_error>
+#include <thread>
+
+//! Mean Earth radius (m)
+static const double c_earthRadius = 6371008.8;
+//! Atmospheric refraction coefficient (standard atmosphere)
+static const double c_refraction = 0.13;
+
+double SOLISHorizon::DEM::height(double x, double y) const
+{
+	//cell centers at integer coordinates
+	double u = (x - xMin) / cellSize - 0.5;
+	double v = (yMax - y) / cellSize - 0.5;
+	if (!(u >= 0 && v >= 0 && u <= columns - 1.0 && v <= rows - 1.0))
+		return std::numeric_limits<double>::quiet_NaN();
+
+	unsigned c0 = static_cast<unsigned>(u);
+	unsigned r0 = static_cast<unsigned>(v);
+	unsigned c1 = std::min(c0 + 1, columns - 1);
+	unsigned r1 = std::min(r0 + 1, rows - 1);
+	double fu = u - c0;
+	double fv = v - r0;
+
+	//no data values are propagated (NaN)
+	double h00 = heights[static_cast<size_t>(r0) * columns + c0];
+	double h01 = heights[static_cast<size_t>(r0) * columns + c1];
+	double h10 = heights[static_cast<size_t>(r1) * columns + c0];
+	double h11 = heights[static_cast<size_t>(r1) * columns + c1];
+	return (h00 * (1 - fu) + h01 * fu) * (1 - fv) + (h10 * (1 - fu) + h11 * fu) * fv;
+}
+
+bool SOLISHorizon::LoadDEM(const QString& filename, DEM& dem, QString* error/*=nullptr*/)
+{
+	dem = DEM();
+
+	FILE* fp = fopen(qPrintable(filename), "rb");
+	if (!fp)
+	{
+		if (error)
+			*error = QString("Failed to open DEM file '%1'").arg(filename);
+		return false;
+	}
+
+	std::vector<char> buffer;
+	try
+	{
+		fseek(fp, 0, SEEK_END);
+		long size = ftell(fp);
+		fseek(fp, 0, SEEK_SET);
+		buffer.resize(static_cast<size_t>(std::max(size, 0L)) + 1);
+		buffer.resize(fread(buffer.data(), 1, buffer.size() - 1, fp) + 1);
+		buffer.back() = '\0';
+	}
+	catch (const std::bad_alloc&)
+	{
+		fclose(fp);
+		if (error)
+			*error = "Not enough memory";
+		return false;
+	}
+	fclose(fp);
+
+	//header: 'key value' lines until the first number
+	double xll = 0;
+	double yll = 0;
+	bool xCenter = false;
+	bool yCenter = false;
+	double noData = -9999.0;
+	char* current = buffer.data();
+	while (true)
+	{
+		while (isspace(static_cast<unsigned char>(*current)))
+			++current;
+		if (!isalpha(static_cast<unsigned char>(*current)))
+			break;
+
+		char key[32] = { 0 };
+		size_t length = 0;
+		while (isalpha(static_cast<unsigned char>(*current)) || *current == '_')
+		{
+			if (length + 1 < sizeof(key))
+				key[length++] = static_cast<char>(tolower(static_cast<unsigned char>(*current)));
+			++current;
+		}
+		double value = strtod(current, &current);
+
+		if (!strcmp(key, "ncols"))				dem.columns = static_cast<unsigned>(std::max(value, 0.0));
+		else if (!strcmp(key, "nrows"))			dem.rows = static_cast<unsigned>(std::max(value, 0.0));
+		else if (!strcmp(key, "xllcorner"))		xll = value;
+		else if (!strcmp(key, "xllcenter"))		{ xll = value; xCenter = true; }
+		else if (!strcmp(key, "yllcorner"))		yll = value;
+		else if (!strcmp(key, "yllcenter"))		{ yll = value; yCenter = true; }
+		else if (!strcmp(key, "cellsize"))		dem.cellSize = value;
+		else if (!strcmp(key, "nodata_value"))	noData = value;
+	}
+
+	if (dem.columns < 2 || dem.rows < 2 || !(dem.cellSize > 0))
+	{
+		if (error)
+			*error = QString("Invalid DEM header in '%1' (ESRI ASCII grid expected)").arg(filename);
+		return false;
+	}
+	dem.xMin = xll - (xCenter ? dem.cellSize / 2 : 0);
+	dem.yMax = yll - (yCenter ? dem.cellSize / 2 : 0) + dem.rows * dem.cellSize;
+
+	size_t count = static_cast<size_t>(dem.columns) * dem.rows;
+	try
+	{
+		dem.heights.resize(count);
+	}
+	catch (const std::bad_alloc&)
+	{
+		if (error)
+			*error = "Not enough memory";
+		return false;
+	}
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		char* end = nullptr;
+		double value = strtod(current, &end);
+		if (end == current)
+		{
+			if (error)
+				*error = QString("DEM file '%1' is truncated (%2 of %3 values)").arg(filename).arg(i).arg(count);
+			dem = DEM();
+			return false;
+		}
+		current = end;
+		dem.heights[i] = (value == noData ? std::numeric_limits<float>::quiet_NaN() : static_cast<float>(value));
+	}
+
+	return true;
+}
+
+bool SOLISHorizon::compute(	const DEM& dem,
+							CCCoreLib::GenericCloud* vertices,
+							const CCVector3d& globalShift,
+							double globalScale,
+							double tileSize,
+							unsigned azimuthCount/*=360*/)
+{
+	//minimum number of profiles per thread
+	static const size_t c_minChunkSize = 64;
+
+	m_profiles.clear();
+	m_nx = m_ny = 0;
+
+	if (!vertices || vertices->size() == 0 || dem.heights.empty() || tileSize <= 0 || azimuthCount == 0 || globalScale <= 0)
+		return false;
+
+	//tile grid (same as SOLIS::LaunchTiledSunPath)
+	CCVector3 bbMax;
+	vertices->getBoundingBox(m_bbMin, bbMax);
+	double dx = static_cast<double>(bbMax.x) - m_bbMin.x;
+	double dy = static_cast<double>(bbMax.y) - m_bbMin.y;
+	m_nx = std::max(1u, static_cast<unsigned>(ceil(dx / tileSize)));
+	m_ny = std::max(1u, static_cast<unsigned>(ceil(dy / tileSize)));
+	m_sx = (dx > 0 ? dx / m_nx : 1.0);
+	m_sy = (dy > 0 ? dy / m_ny : 1.0);
+	m_azimuthCount = azimuthCount;
+	unsigned numberOfTiles = tileCount();
+
+	//observer height of each tile
+	std::vector<double> tileHeights;
+	std::vector<size_t> tileCounts;
+	try
+	{
+		tileHeights.resize(numberOfTiles, 0);
+		tileCounts.resize(numberOfTiles, 0);
+		m_profiles.resize(static_cast<size_t>(numberOfTiles) * azimuthCount);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory?
+		m_nx = m_ny = 0;
+		return false;
+	}
+
+	double meanHeight = 0;
+	vertices->placeIteratorAtBeginning();
+	for (unsigned i = 0; i < vertices->size(); ++i)
+	{
+		const CCVector3* P = vertices->getNextPoint();
+		unsigned t = tileIndex(*P);
+		tileHeights[t] += P->z;
+		++tileCounts[t];
+		meanHeight += P->z;
+	}
+	meanHeight /= vertices->size();
+
+	//footprint of the scene (DEM coordinates)
+	double footprintMinX = m_bbMin.x / globalScale - globalShift.x;
+	double footprintMinY = m_bbMin.y / globalScale - globalShift.y;
+	double footprintMaxX = bbMax.x / globalScale - globalShift.x;
+	double footprintMaxY = bbMax.y / globalScale - globalShift.y;
+	double demMaxX = dem.xMin + dem.columns * dem.cellSize;
+	double demMinY = dem.yMax - dem.rows * dem.cellSize;
+
+	auto computeChunk = [&](size_t first, size_t last)
+	{
+		for (size_t p = first; p < last; ++p)
+		{
+			unsigned t = static_cast<unsigned>(p / azimuthCount);
+			unsigned a = static_cast<unsigned>(p % azimuthCount);
+
+			double x0 = (m_bbMin.x + ((t % m_nx) + 0.5) * m_sx) / globalScale - globalShift.x;
+			double y0 = (m_bbMin.y + ((t / m_nx) + 0.5) * m_sy) / globalScale - globalShift.y;
+			double h0 = (tileCounts[t] ? tileHeights[t] / tileCounts[t] : meanHeight) / globalScale - globalShift.z;
+
+			double azimuth = (360.0 * a) / azimuthCount * (M_PI / 180.0);
+			double ux = sin(azimuth);
+			double uy = cos(azimuth);
+
+			//the near field (inside the footprint) is the rendered geometry
+			double d = std::numeric_limits<double>::max();
+			if (ux != 0)
+				d = std::min(d, ((ux > 0 ? footprintMaxX : footprintMinX) - x0) / ux);
+			if (uy != 0)
+				d = std::min(d, ((uy > 0 ? footprintMaxY : footprintMinY) - y0) / uy);
+			d = std::max(d, 0.0) + dem.cellSize / 2;
+
+			double maxAngle = -90.0;
+			while (true)
+			{
+				double x = x0 + ux * d;
+				double y = y0 + uy * d;
+				if (x < dem.xMin || x > demMaxX || y < demMinY || y > dem.yMax)
+					break;
+
+				double h = dem.height(x, y);
+				if (!std::isnan(h))
+				{
+					//the earth curvature (minus the refraction) lowers distant terrain
+					double drop = d * d * (1.0 - c_refraction) / (2.0 * c_earthRadius);
+					double angle = atan2(h - drop - h0, d) * (180.0 / M_PI);
+					maxAngle = std::max(maxAngle, angle);
+				}
+
+				//the angular resolution only needs to be constant
+				d += std::max(dem.cellSize / 2, d * 1.0e-3);
+			}
+			m_profiles[p] = static_cast<float>(maxAngle);
+		}
+	};
+
+	size_t count = m_profiles.size();
+	size_t threadCount = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), (count + c_minChunkSize - 1) / c_minChunkSize);
+	if (threadCount <= 1)
+	{
+		computeChunk(0, count);
+		return true;
+	}
+
+	//each chunk only writes its own profiles
+	size_t chunkSize = (count + threadCount - 1) / threadCount;
+	std::vector<std::thread> threads;
+	try
+	{
+		for (size_t first = chunkSize; first < count; first += chunkSize)
+		{
+			threads.emplace_back(computeChunk, first, std::min(first + chunkSize, count));
+		}
+	}
+	catch (const std::system_error&)
+	{
+		//not enough resources: the remaining chunks are computed below
+	}
+	size_t threadedEnd = std::min(chunkSize * (threads.size() + 1), count);
+	computeChunk(0, chunkSize);
+	if (threadedEnd < count)
+		computeChunk(threadedEnd, count);
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	return true;
+}
+
+unsigned SOLISHorizon::tileIndex(const CCVector3& P) const
+{
+	int tx = static_cast<int>((P.x - m_bbMin.x) / m_sx);
+	int ty = static_cast<int>((P.y - m_bbMin.y) / m_sy);
+	tx = std::max(0, std::min(tx, static_cast<int>(m_nx) - 1));
+	ty = std::max(0, std::min(ty, static_cast<int>(m_ny) - 1));
+	return static_cast<unsigned>(ty) * m_nx + static_cast<unsigned>(tx);
+}
+
+double SOLISHorizon::elevation(unsigned tile, double azimuth) const
+{
+	if (m_profiles.empty())
+		return -90.0;
+
+	//linear interpolation between the profile azimuths
+	double position = azimuth / 360.0 * m_azimuthCount;
+	position -= floor(position / m_azimuthCount) * m_azimuthCount;
+	unsigned a0 = std::min(static_cast<unsigned>(position), m_azimuthCount - 1);
+	unsigned a1 = (a0 + 1) % m_azimuthCount;
+	double f = position - a0;
+
+	const float* profile = m_profiles.data() + static_cast<size_t>(tile) * m_azimuthCount;
+	return profile[a0] * (1.0 - f) + profile[a1] * f;
+}
+
+bool SOLISHorizon::hides(unsigned tile, const CCVector3& ray) const
+{
+	//the sun is opposite to the light direction
+	double altitude = asin(std::max(-1.0, std::min(1.0, -static_cast<double>(ray.z)))) * (180.0 / M_PI);
+	double azimuth = atan2(-static_cast<double>(ray.x), -static_cast<double>(ray.y)) * (180.0 / M_PI);
+	return altitude < elevation(tile, azimuth);
+}
+
+uint64_t SOLISHorizon::key() const
+{
+	if (tileCount() == 0)
+		return 0;
+
+	//64 bits FNV-1a hash of the tile grid and of the profiles
+	uint64_t value = 14695981039346656037ULL;
+	auto add = [&value](const void* data, size_t size)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; ++i)
+		{
+			value ^= bytes[i];
+			value *= 1099511628211ULL;
+		}
+	};
+	add(m_bbMin.u, sizeof(PointCoordinateType) * 3);
+	add(&m_sx, sizeof(double));
+	add(&m_sy, sizeof(double));
+	add(&m_nx, sizeof(unsigned));
+	add(&m_ny, sizeof(unsigned));
+	add(&m_azimuthCount, sizeof(unsigned));
+	add(m_profiles.data(), m_profiles.size() * sizeof(float));
+
+	return value;
+}
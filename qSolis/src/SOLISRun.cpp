@@ -0,0 +1,897 @@
+//##########################################################################
+//#                                                                        #
+//#                       CLOUDCOMPARE PLUGIN: qSOLIS                      #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                  COPYRIGHT: David Basler                               #
+//#                                                                        #
+//##########################################################################
+
+#include "SOLISRun.h"
+#include "SOLIS.h"
+#include "SOLISCache.h"
+#include "SOLISCheckpoint.h"
+#include "SOLISShard.h"
+#include "SOLISSky.h"
+#include "SOLISWeather.h"
+
+//Qt
+#include <QFile>
+#include <QFileInfo>
+
+//System
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <memory>
+#include <unordered_map>
+
+//! Name of an accumulator precision (as given after -PRECISION)
+static QString PrecisionName(SOLIS::AccumulatorPrecision precision)
+{
+	switch (precision)
+	{
+	case SOLIS::ACCUMULATOR_FAST:
+		return "FAST";
+	case SOLIS::ACCUMULATOR_DOUBLE:
+		return "DOUBLE";
+	default:
+		return "COMPACT";
+	}
+}
+
+//! Returns whether a component has the single output of the sun rays (dedicated accumulators of SOLIS::Launch)
+static bool SingleDirectOutput(const SOLISSettings& settings, const SOLISRun::Component& component)
+{
+	return component.direct && settings.weatherFiles.empty() && settings.periods == SOLIS::PERIODS_NONE;
+}
+
+//! Reports an error
+static bool Failure(QString* error, const QString& message)
+{
+	if (error)
+		*error = message;
+	return false;
+}
+
+//! Returns the checkpoint of a run on a geometry (nullptr if checkpoints are disabled)
+static std::unique_ptr<SOLISCheckpoint> CreateCheckpoint(	const SOLISSettings& settings,
+															CCCoreLib::GenericCloud* vertices,
+															CCCoreLib::GenericMesh* mesh,
+															uint64_t raysKey)
+{
+	if (settings.checkpointDirectory.isEmpty())
+		return nullptr;
+
+	uint64_t geometryKey = SOLISCache::GeometryKey(vertices, mesh, settings.meshIsClosed, settings.resolution);
+	QString filename = SOLISCheckpoint::Filename(settings.checkpointDirectory, geometryKey, raysKey);
+	return std::unique_ptr<SOLISCheckpoint>(new SOLISCheckpoint(filename, geometryKey, raysKey, settings.checkpointInterval * 60));
+}
+
+SOLISRun::SOLISRun(const SOLISSettings& settings)
+	: m_settings(settings)
+	, m_conversion(settings.timestep / 60 / settings.integration)
+{
+}
+
+bool SOLISRun::prepare(QStringList& messages, QString* error/*=nullptr*/)
+{
+	//far-field terrain
+	if (!m_settings.horizonFile.isEmpty())
+	{
+		if (!SOLISHorizon::LoadDEM(m_settings.horizonFile, m_horizonDem, error))
+		{
+			return false;
+		}
+		messages.append(QString("Far-field DEM '%1': %2 x %3 cells of %4").arg(m_settings.horizonFile).arg(m_horizonDem.columns).arg(m_horizonDem.rows).arg(m_horizonDem.cellSize));
+	}
+
+	//the sun binning tolerance is the size of the cached bins
+	if (!m_settings.sunCache.isEmpty())
+	{
+		m_sunBinSize = (m_settings.binningTolerance > 0 ? m_settings.binningTolerance : 0.5);
+		if (m_settings.binningTolerance <= 0)
+		{
+			messages.append(QString("Sun bin cache: default bin size of %1 deg (see -%2)").arg(m_sunBinSize).arg(COMMAND_SOLIS_SUN_BINNING));
+		}
+		m_settings.binningTolerance = 0;
+	}
+
+	//directions of the visibility matrix or of the harmonics projection (same as the diffuse directions, so that the diffuse component of the matrix is exact)
+	if (m_settings.cachedVisibility())
+	{
+		SOLISSky::Discretization scheme = (!m_settings.weatherFiles.empty() && !m_settings.skySet ? SOLISSky::SKY_TREGENZA : m_settings.skyScheme);
+		if (!SOLISSky::SkyDirections(scheme, m_settings.rayCount, m_visibilityDirections, m_visibilitySolidAngles))
+		{
+			return Failure(error, "Not enough memory");
+		}
+	}
+
+	//weather-driven sky (one output per weather file)
+	if (!m_settings.weatherFiles.empty())
+	{
+		const QStringList& weatherFiles = m_settings.weatherFiles;
+		std::vector< std::vector<SOLISWeather::Record> > series(weatherFiles.size());
+		for (int k = 0; k < weatherFiles.size(); ++k)
+		{
+			SOLISWeather::Location location;
+			if (!SOLISWeather::Load(weatherFiles[k], series[k], &location, error))
+			{
+				return false;
+			}
+			if (k == 0 && location.valid && !m_settings.locationSet)
+			{
+				m_settings.latitude = location.latitude;
+				m_settings.longitude = location.longitude;
+				m_settings.elevation = location.elevation;
+			}
+			messages.append(QString("Weather file '%1': %2 records").arg(weatherFiles[k]).arg(series[k].size()));
+
+			QString suffix = (weatherFiles.size() > 1 ? QString("_") + QFileInfo(weatherFiles[k]).completeBaseName() : QString());
+			m_weatherDirectNames.append(QString(SOLIS_FIELD_LABEL_NAME_DIRECT) + suffix);
+			m_weatherDiffuseNames.append(QString(SOLIS_FIELD_LABEL_NAME_DIFFUSE) + suffix);
+		}
+
+		//Tregenza patches by default
+		SOLISSky::Discretization weatherSky = (m_settings.skySet ? m_settings.skyScheme : SOLISSky::SKY_TREGENZA);
+		if (!SOLISSky::WeatherSkyMatrix(series, m_settings.doyFrom, m_settings.doyTo(), m_settings.latitude, m_settings.longitude, m_weatherSunRays, m_weatherSunWeights, m_weatherSkyRays, m_weatherSkyWeights, weatherSky, m_settings.rayCount, m_settings.anisotropicSky))
+		{
+			return Failure(error, "Failed to build the sky matrix");
+		}
+
+		//weights are energies (Wh/m2)
+		m_conversion = 1.0 / m_settings.integration;
+	}
+
+	return true;
+}
+
+QString SOLISRun::description(bool direct) const
+{
+	return QString("%1 irradiance: LAT %2 LON %3 ELV %4 DOY %5 INT %6 TS %7")
+			.arg(direct ? "Direct" : "Diffuse")
+			.arg(m_settings.latitude, 0, 'f', 3)
+			.arg(m_settings.longitude, 0, 'f', 3)
+			.arg(m_settings.elevation, 0, 'f', 0)
+			.arg(m_settings.doyFrom, 0, 'f', 3)
+			.arg(m_settings.integration, 0, 'f', 3)
+			.arg(m_settings.timestep, 0, 'f', 3);
+}
+
+SOLISRun::Engine SOLISRun::engine(const Component& component) const
+{
+	const SOLISSettings& s = m_settings;
+	if (!s.shardDirectory.isEmpty())
+		return ENGINE_SHARD;
+	if (component.direct && s.tileSize > 0)
+		return ENGINE_TILED_SUN_PATH;
+	if (component.direct && s.adaptiveStep > 0)
+		return ENGINE_ADAPTIVE_SUN_PATH;
+	if (!s.harmonicsCache.isEmpty())
+		return ENGINE_HARMONICS;
+	if (!s.visibilityMatrixCache.isEmpty())
+		return ENGINE_VISIBILITY_MATRIX;
+	if (component.direct && !s.sunCache.isEmpty())
+		return ENGINE_SUN_CACHE;
+	if (!component.direct && !s.skyViewCache.isEmpty() && !component.solidAngles.empty())
+		return ENGINE_SKY_VIEW;
+	if (component.incremental)
+		return ENGINE_INCREMENTAL;
+	if (s.heightfieldCellSize >= 0)
+		return ENGINE_HEIGHTFIELD;
+	if (!m_horizonDem.heights.empty())
+		return ENGINE_HORIZON;
+	if (component.direct && s.sunMetrics)
+		return ENGINE_SUN_METRICS;
+	return ENGINE_RENDER;
+}
+
+bool SOLISRun::component(bool direct, Component& component, QStringList& messages, QString* error/*=nullptr*/)
+{
+	const SOLISSettings& s = m_settings;
+	double doyTo = s.doyTo();
+
+	component = Component();
+	component.direct = direct;
+	m_counters = Counters();
+
+	//how the results are computed (an incremental update is a plain render, see Component::provenance)
+	QString engineName = (s.heightfieldCellSize >= 0 ? "HEIGHTFIELD" : !s.horizonFile.isEmpty() ? "HORIZON_DEM" : !s.visibilityMatrixCache.isEmpty() ? "VIS_MATRIX" : !s.harmonicsCache.isEmpty() ? "SH_VISIBILITY" : "OPENGL");
+
+	if (direct)
+	{
+		component.provenance = QString("%1 PRECISION=%2").arg(!s.sunCache.isEmpty() ? "SUN_CACHE" : s.adaptiveStep > 0 ? "ADAPTIVE" : s.tileSize > 0 ? "TILE_SIZE" : engineName).arg(PrecisionName(s.precision));
+
+		if (s.tileSize > 0 || s.adaptiveStep > 0)
+		{
+			//the sun path loops generate their own rays
+			component.fieldNames.append(SOLIS_FIELD_LABEL_NAME_DIRECT);
+			return true;
+		}
+
+		std::vector<double> irradiance;
+		if (!s.weatherFiles.empty())
+		{
+			component.rays = m_weatherSunRays;
+			component.weights = m_weatherSunWeights;
+			component.fieldNames = m_weatherDirectNames;
+		}
+		else if (!SOLIS::GenerateSunRays(s.doyFrom, doyTo, s.timestep, s.latitude, s.longitude, s.elevation, component.rays, irradiance, s.periods != SOLIS::PERIODS_NONE || s.sunMetrics ? &component.rayDoys : nullptr))
+		{
+			return Failure(error, "Failed to generate the set of rays");
+		}
+		if (component.rays.empty())
+		{
+			return Failure(error, "No ray was generated. Sun always below horizon in selected timerange");
+		}
+
+		if (s.weatherFiles.empty())
+		{
+			if (s.periods != SOLIS::PERIODS_NONE)
+			{
+				//one output for the whole window, then one per period (rendered in the same sweep)
+				if (!SOLIS::BinByPeriod(s.periods, component.rayDoys, irradiance, component.weights))
+				{
+					return Failure(error, "Not enough memory");
+				}
+				for (unsigned p = 0; p < SOLIS::PeriodCount(s.periods); ++p)
+				{
+					component.fieldNames.append(QString(SOLIS_FIELD_LABEL_NAME_DIRECT) + "_" + SOLIS::PeriodLabel(s.periods, p));
+				}
+			}
+			component.weights.insert(component.weights.begin(), irradiance);
+			component.fieldNames.insert(0, SOLIS_FIELD_LABEL_NAME_DIRECT);
+		}
+
+		if (s.binningTolerance > 0)
+		{
+			size_t timestepCount = component.rays.size();
+			double maxError = 0;
+			double meanError = 0;
+			if (!SOLIS::BinSunRays(s.binningTolerance, component.rays, component.weights, &maxError, &meanError))
+			{
+				return Failure(error, "Failed to bin the sun rays");
+			}
+			messages.append(QString("Sun binning: %1 timesteps merged into %2 directions (max. error %3 deg, mean error %4 deg)").arg(timestepCount).arg(component.rays.size()).arg(maxError, 0, 'f', 3).arg(meanError, 0, 'f', 3));
+		}
+	}
+	else
+	{
+		component.provenance = QString("%1 PRECISION=%2").arg(engineName).arg(PrecisionName(s.precision));
+
+		if (!s.weatherFiles.empty())
+		{
+			//sky patches
+			component.rays = m_weatherSkyRays;
+			component.weights = m_weatherSkyWeights;
+			component.fieldNames = m_weatherDiffuseNames;
+			if (!s.skyViewCache.isEmpty() && !s.anisotropicSky)
+			{
+				//same (cached) set as WeatherSkyMatrix
+				std::vector<CCVector3> patchRays;
+				if (!SOLISSky::SkyDirections(s.skySet ? s.skyScheme : SOLISSky::SKY_TREGENZA, s.rayCount, patchRays, component.solidAngles))
+				{
+					return Failure(error, "Not enough memory");
+				}
+			}
+		}
+		else if (s.diffuseSampling != SOLIS::DIFFUSE_UNIFORM)
+		{
+			//sky energy tabulated on the sky grid, then sampled
+			std::vector<CCVector3> cellRays;
+			std::vector<double> cellSolidAngles;
+			std::vector<double> cellEnergy;
+			if (!SOLISSky::SkyGrid(cellRays, cellSolidAngles))
+			{
+				return Failure(error, "Not enough memory");
+			}
+			if (s.anisotropicSky)
+			{
+				if (!SOLIS::AnisotropicDiffuseWeights(s.doyFrom, doyTo, s.timestep, s.latitude, s.longitude, s.elevation, cellRays, cellSolidAngles, cellEnergy))
+				{
+					return Failure(error, "Not enough memory");
+				}
+			}
+			else
+			{
+				double totalIrradiance = SOLIS::totalDiffIrradiance(s.doyFrom, doyTo, s.timestep, s.latitude, s.longitude, s.elevation);
+				cellEnergy.resize(cellRays.size());
+				for (size_t i = 0; i < cellRays.size(); ++i)
+				{
+					cellEnergy[i] = totalIrradiance * cellSolidAngles[i] / (2 * M_PI);
+				}
+			}
+
+			component.weights.resize(1);
+			if (!SOLIS::GenerateDiffRays(s.rayCount, s.diffuseSampling, cellEnergy, component.rays, component.weights[0]))
+			{
+				return Failure(error, "Failed to generate the set of rays");
+			}
+			component.fieldNames.append(SOLIS_FIELD_LABEL_NAME_DIFFUSE);
+		}
+		else
+		{
+			std::vector<double> solidAngles;
+			if (!SOLISSky::SkyDirections(s.skyScheme, s.rayCount, component.rays, solidAngles))
+			{
+				return Failure(error, "Failed to generate the set of rays");
+			}
+			component.weights.assign(1, std::vector<double>(component.rays.size()));
+			if (s.anisotropicSky)
+			{
+				//the sky radiance follows the sun (same rays, only the weights change)
+				if (!SOLIS::AnisotropicDiffuseWeights(s.doyFrom, doyTo, s.timestep, s.latitude, s.longitude, s.elevation, component.rays, solidAngles, component.weights[0]))
+				{
+					return Failure(error, "Not enough memory");
+				}
+			}
+			else
+			{
+				//isotropic sky: each direction gets the share of its solid angle
+				double totalIrradiance = SOLIS::totalDiffIrradiance(s.doyFrom, doyTo, s.timestep, s.latitude, s.longitude, s.elevation);
+				for (size_t i = 0; i < component.rays.size(); ++i)
+				{
+					component.weights[0][i] = totalIrradiance * solidAngles[i] / (2 * M_PI);
+				}
+				component.solidAngles = solidAngles;
+			}
+			component.fieldNames.append(SOLIS_FIELD_LABEL_NAME_DIFFUSE);
+		}
+
+		if (s.periods != SOLIS::PERIODS_NONE)
+		{
+			//the sky distribution of the whole window is scaled by the diffuse energy of each period
+			std::vector<double> periodIrradiance;
+			if (!SOLIS::PeriodDiffIrradiance(s.periods, s.doyFrom, doyTo, s.timestep, s.latitude, s.longitude, s.elevation, periodIrradiance))
+			{
+				return Failure(error, "Not enough memory");
+			}
+			double totalIrradiance = 0;
+			for (double e : periodIrradiance)
+			{
+				totalIrradiance += e;
+			}
+			for (unsigned p = 0; p < periodIrradiance.size(); ++p)
+			{
+				double share = (totalIrradiance > 0 ? periodIrradiance[p] / totalIrradiance : 0);
+				component.weights.push_back(component.weights.front());
+				for (double& w : component.weights.back())
+				{
+					w *= share;
+				}
+				component.fieldNames.append(QString(SOLIS_FIELD_LABEL_NAME_DIFFUSE) + "_" + SOLIS::PeriodLabel(s.periods, p));
+			}
+		}
+
+		if (component.rays.empty())
+		{
+			return Failure(error, "No ray was generated. Sun always below horizon in selected timerange");
+		}
+
+		if (!s.skyViewCache.isEmpty())
+		{
+			if (component.solidAngles.empty())
+				messages.append("The sky-view factor cache only applies to isotropic skies (ignored)");
+			else
+				component.provenance = QString("SVF_CACHE PRECISION=%1").arg(PrecisionName(s.precision));
+		}
+	}
+
+	component.incremental = s.incremental;
+
+	//engine data
+	try
+	{
+		switch (engine(component))
+		{
+		case ENGINE_INCREMENTAL:
+			//without previous results, the front ends fall back to the plain render loop (see below)
+		case ENGINE_RENDER:
+		case ENGINE_HORIZON:
+			if (!s.checkpointDirectory.isEmpty())
+			{
+				component.raysKey = (SingleDirectOutput(s, component) && engine(component) == ENGINE_RENDER
+										? SOLISCache::RaysKey(component.rays, component.weights.front())
+										: SOLISCache::RaysKey(component.rays, component.weights));
+			}
+			break;
+
+		case ENGINE_SUN_METRICS:
+			if (!s.checkpointDirectory.isEmpty())
+			{
+				//the timestamps change the statistics, not the irradiance
+				std::vector< std::vector<double> > keyWeights{ component.weights.front(), component.rayDoys };
+				component.raysKey = SOLISCache::RaysKey(component.rays, keyWeights);
+			}
+			break;
+
+		case ENGINE_SHARD:
+			component.raysKey = SOLISCache::RaysKey(component.rays, component.weights);
+			break;
+
+		case ENGINE_SKY_VIEW:
+		{
+			//sky-view factor weights
+			component.binWeights.assign(1, std::vector<double>(component.rays.size()));
+			for (size_t i = 0; i < component.rays.size(); ++i)
+			{
+				component.binWeights[0][i] = component.solidAngles[i] / (2 * M_PI);
+			}
+			component.raysKey = SOLISCache::RaysKey(component.rays, component.binWeights[0]);
+		}
+		break;
+
+		case ENGINE_VISIBILITY_MATRIX:
+			//the rays are snapped to the matrix directions
+			if (!SOLISCache::MapToDirections(m_visibilityDirections, component.rays, component.weights, component.binWeights, &component.maxError))
+			{
+				return Failure(error, "Not enough memory");
+			}
+			component.raysKey = SOLISCache::RaysKey(m_visibilityDirections, std::vector<double>());
+			break;
+
+		case ENGINE_HARMONICS:
+			//lighting coefficients of each output
+			component.lighting.resize(component.weights.size());
+			component.maxValues.assign(component.weights.size(), 0);
+			for (size_t k = 0; k < component.weights.size(); ++k)
+			{
+				if (!SOLISSky::LightingHarmonics(component.rays, component.weights[k], s.harmonicsOrder, component.lighting[k]))
+				{
+					return Failure(error, "Not enough memory");
+				}
+				for (double w : component.weights[k])
+				{
+					component.maxValues[k] += std::max(w, 0.0);
+				}
+			}
+			component.raysKey = SOLISCache::RaysKey(m_visibilityDirections, m_visibilitySolidAngles);
+			break;
+
+		case ENGINE_SUN_CACHE:
+		{
+			//the rays are merged in their (window independent) bins
+			component.binWeights.resize(component.weights.size());
+			std::unordered_map<uint64_t, size_t> binIndexes;
+			for (size_t i = 0; i < component.rays.size(); ++i)
+			{
+				CCVector3 center;
+				uint64_t key = SOLISCache::SunBin(component.rays[i], m_sunBinSize, center);
+				auto it = binIndexes.find(key);
+				if (it == binIndexes.end())
+				{
+					it = binIndexes.emplace(key, component.binKeys.size()).first;
+					component.binKeys.push_back(key);
+					component.binDirections.push_back(center);
+					for (std::vector<double>& w : component.binWeights)
+						w.push_back(0);
+				}
+				for (size_t k = 0; k < component.weights.size(); ++k)
+					component.binWeights[k][it->second] += component.weights[k][i];
+
+				double dot = std::max(-1.0, std::min(1.0, static_cast<double>(component.rays[i].dot(center))));
+				component.maxError = std::max(component.maxError, acos(dot) * (180.0 / M_PI));
+			}
+		}
+		break;
+
+		default:
+			//nothing to prepare
+			break;
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory?
+		return Failure(error, "Not enough memory");
+	}
+
+	return true;
+}
+
+QStringList SOLISRun::outputNames(const Component& component) const
+{
+	QStringList names;
+	switch (engine(component))
+	{
+	case ENGINE_SHARD:
+		//partial results only
+		break;
+	case ENGINE_SKY_VIEW:
+		names.append(SOLIS_FIELD_LABEL_NAME_SKY_VIEW);
+		names.append(component.fieldNames);
+		break;
+	case ENGINE_SUN_METRICS:
+		names = component.fieldNames;
+		names.append(SOLIS_FIELD_LABEL_NAME_SUN_HOURS);
+		names.append(SOLIS_FIELD_LABEL_NAME_FIRST_SUN);
+		names.append(SOLIS_FIELD_LABEL_NAME_LAST_SUN);
+		names.append(SOLIS_FIELD_LABEL_NAME_PEAK);
+		break;
+	default:
+		names = component.fieldNames;
+		break;
+	}
+	return names;
+}
+
+bool SOLISRun::launch(	const Component& component,
+						CCCoreLib::GenericCloud* vertices,
+						CCCoreLib::GenericMesh* mesh,
+						const std::vector<CCCoreLib::ScalarField*>& outputs,
+						const CCVector3d& globalShift,
+						double globalScale,
+						CCCoreLib::GenericProgressCallback* progressCb/*=nullptr*/,
+						const QString& entityName/*=QString()*/,
+						QStringList* warnings/*=nullptr*/,
+						QString* error/*=nullptr*/)
+{
+	const SOLISSettings& s = m_settings;
+	Engine e = engine(component);
+	if (!vertices || outputs.size() != static_cast<size_t>(outputNames(component).size()))
+	{
+		assert(false);
+		return false;
+	}
+	++m_counters.launchCount;
+
+	const std::vector<CCVector3>& rays = component.rays;
+	const std::vector< std::vector<double> >& weights = component.weights;
+	size_t numberOfPoints = vertices->size();
+	unsigned resolution = s.resolution;
+
+	switch (e)
+	{
+	case ENGINE_TILED_SUN_PATH:
+	{
+		//each tile has its own sun position (regional scenes)
+		return SOLIS::LaunchTiledSunPath(s.doyFrom, s.doyTo(), s.timestep, s.latitude, s.longitude, s.elevation, s.tileSize, m_conversion, vertices, outputs.front(), mesh, s.meshIsClosed, resolution, resolution, progressCb, entityName, s.precision, &m_counters.tileCount);
+	}
+
+	case ENGINE_ADAPTIVE_SUN_PATH:
+	{
+		//the sun path is rendered at the coarse step first, then refined down to the timestep where shadows move
+		unsigned coarseFactor = static_cast<unsigned>(std::max(1.0, std::round(s.adaptiveStep / s.timestep)));
+		size_t renders = 0;
+		bool success = SOLIS::LaunchAdaptiveSunPath(s.doyFrom, s.doyTo(), s.timestep, coarseFactor, s.adaptiveThreshold, s.latitude, s.longitude, s.elevation, m_conversion, vertices, outputs.front(), mesh, s.meshIsClosed, resolution, resolution, progressCb, entityName, s.precision, &renders);
+		m_counters.renderCount += renders;
+		return success;
+	}
+
+	case ENGINE_HARMONICS:
+	{
+		uint64_t geometryKey = SOLISCache::GeometryKey(vertices, mesh, s.meshIsClosed, resolution);
+		QString filename = SOLISCache::HarmonicsFilename(s.harmonicsCache, geometryKey, component.raysKey);
+
+		std::vector<float> coefficients;
+		if (SOLISCache::LoadHarmonics(filename, geometryKey, component.raysKey, s.harmonicsOrder, numberOfPoints, coefficients))
+		{
+			++m_counters.cacheHits;
+		}
+		else
+		{
+			if (!SOLIS::ProjectVisibility(m_visibilityDirections, m_visibilitySolidAngles, s.harmonicsOrder, vertices, coefficients, mesh, s.meshIsClosed, resolution, resolution, progressCb, entityName))
+			{
+				return false;
+			}
+			if (!SOLISCache::SaveHarmonics(filename, geometryKey, component.raysKey, s.harmonicsOrder, coefficients) && warnings)
+			{
+				warnings->append(QString("Failed to save the visibility coefficients to '%1'").arg(filename));
+			}
+		}
+
+		//the outputs don't need any rendering
+		unsigned count = SOLISSky::HarmonicsCount(s.harmonicsOrder);
+		for (size_t k = 0; k < component.lighting.size(); ++k)
+		{
+			std::vector<ScalarType>& values = *outputs[k];
+			const double* l = component.lighting[k].data();
+			for (size_t j = 0; j < numberOfPoints; ++j)
+			{
+				const float* c = coefficients.data() + j * count;
+				double value = 0;
+				for (unsigned i = 0; i < count; ++i)
+					value += c[i] * l[i];
+				//ringing of the truncated expansion
+				value = std::max(0.0, std::min(value, component.maxValues[k]));
+				values[j] = static_cast<ScalarType>(value * m_conversion);
+			}
+		}
+		return true;
+	}
+
+	case ENGINE_VISIBILITY_MATRIX:
+	{
+		uint64_t geometryKey = SOLISCache::GeometryKey(vertices, mesh, s.meshIsClosed, resolution);
+		QString filename = SOLISCache::VisibilityMatrixFilename(s.visibilityMatrixCache, geometryKey, component.raysKey);
+
+		SOLISCache::VisibilityMatrix matrix;
+		if (matrix.open(filename, geometryKey, component.raysKey, numberOfPoints))
+		{
+			++m_counters.cacheHits;
+		}
+		else if (	!SOLIS::ExportVisibilityMatrix(filename, m_visibilityDirections, geometryKey, component.raysKey, vertices, mesh, s.meshIsClosed, resolution, resolution, progressCb, entityName)
+				||	!matrix.open(filename, geometryKey, component.raysKey, numberOfPoints) )
+		{
+			return false;
+		}
+
+		std::vector<double> sums;
+		try
+		{
+			sums.resize(numberOfPoints);
+		}
+		catch (const std::bad_alloc&)
+		{
+			//not enough memory?
+			return false;
+		}
+
+		//the outputs don't need any rendering
+		for (size_t k = 0; k < component.binWeights.size(); ++k)
+		{
+			std::fill(sums.begin(), sums.end(), 0.0);
+			if (!matrix.accumulate(component.binWeights[k], sums))
+			{
+				return false;
+			}
+			std::vector<ScalarType>& values = *outputs[k];
+			for (size_t j = 0; j < numberOfPoints; ++j)
+			{
+				values[j] = static_cast<ScalarType>(sums[j] * m_conversion);
+			}
+		}
+		return true;
+	}
+
+	case ENGINE_SUN_CACHE:
+	{
+		uint64_t geometryKey = SOLISCache::GeometryKey(vertices, mesh, s.meshIsClosed, resolution);
+		QString filename = SOLISCache::SunBinFilename(s.sunCache, geometryKey, m_sunBinSize);
+
+		SOLISCache::SunBinStore store;
+		bool mismatch = false;
+		if (!store.open(filename, geometryKey, numberOfPoints, m_sunBinSize, &mismatch))
+		{
+			//only a store of another version or geometry (e.g. a key collision) is started over
+			if (!mismatch || !QFile::remove(filename) || !store.open(filename, geometryKey, numberOfPoints, m_sunBinSize))
+			{
+				return Failure(error, QString("Failed to open the sun bin store '%1'").arg(filename));
+			}
+			if (warnings)
+				warnings->append(QString("Sun bin store '%1' doesn't match the entity (replaced)").arg(filename));
+		}
+
+		size_t rendered = 0;
+		if (!SOLIS::ExtendSunBins(store, component.binKeys, component.binDirections, vertices, mesh, s.meshIsClosed, resolution, resolution, progressCb, entityName, &rendered))
+		{
+			return false;
+		}
+		m_counters.renderCount += rendered;
+
+		std::vector<double> sums;
+		try
+		{
+			sums.resize(numberOfPoints);
+		}
+		catch (const std::bad_alloc&)
+		{
+			//not enough memory?
+			return false;
+		}
+
+		//the outputs are combined from the stored columns
+		for (size_t k = 0; k < component.binWeights.size(); ++k)
+		{
+			std::fill(sums.begin(), sums.end(), 0.0);
+			for (size_t i = 0; i < component.binKeys.size(); ++i)
+			{
+				if (component.binWeights[k][i] != 0 && !store.accumulate(component.binKeys[i], component.binWeights[k][i], sums))
+				{
+					return false;
+				}
+			}
+			std::vector<ScalarType>& values = *outputs[k];
+			for (size_t j = 0; j < numberOfPoints; ++j)
+			{
+				values[j] = static_cast<ScalarType>(sums[j] * m_conversion);
+			}
+		}
+		return true;
+	}
+
+	case ENGINE_SKY_VIEW:
+	{
+		uint64_t geometryKey = SOLISCache::GeometryKey(vertices, mesh, s.meshIsClosed, resolution);
+		QString filename = SOLISCache::SkyViewFilename(s.skyViewCache, geometryKey, component.raysKey);
+
+		std::vector<ScalarType>& skyView = *outputs.front();
+		if (SOLISCache::LoadSkyView(filename, geometryKey, component.raysKey, skyView))
+		{
+			++m_counters.cacheHits;
+		}
+		else
+		{
+			std::vector<CCCoreLib::ScalarField*> skyViewSF(1, outputs.front());
+			if (!SOLIS::Launch(rays, component.binWeights, 1.0, vertices, skyViewSF, mesh, s.meshIsClosed, resolution, resolution, progressCb, entityName, s.precision))
+			{
+				return false;
+			}
+			if (!SOLISCache::SaveSkyView(filename, geometryKey, component.raysKey, skyView) && warnings)
+			{
+				warnings->append(QString("Failed to save the sky-view factor to '%1'").arg(filename));
+			}
+		}
+
+		//isotropic sky: the weights of each output are proportional to the solid angles, the outputs don't need any rendering
+		for (size_t k = 0; k < weights.size(); ++k)
+		{
+			double energy = 0;
+			for (double w : weights[k])
+				energy += w;
+
+			std::vector<ScalarType>& values = *outputs[k + 1];
+			double scale = energy * m_conversion;
+			for (size_t j = 0; j < skyView.size(); ++j)
+			{
+				values[j] = static_cast<ScalarType>(skyView[j] * scale);
+			}
+		}
+		return true;
+	}
+
+	case ENGINE_INCREMENTAL:
+	{
+		size_t count = 0;
+		if (!SOLIS::LaunchIncremental(rays, weights, m_conversion, s.changedMin, s.changedMax, vertices, outputs, mesh, s.meshIsClosed, resolution, resolution, progressCb, entityName, &count))
+		{
+			return false;
+		}
+		m_counters.updatedCount += count;
+		return true;
+	}
+
+	case ENGINE_HEIGHTFIELD:
+	{
+		//only the vertices are used (the grid is the surface)
+		if (s.heightfieldTileSize >= 0)
+			return SOLIS::LaunchHeightfieldTiled(rays, weights, m_conversion, s.heightfieldCellSize, s.heightfieldTileSize, vertices, outputs, progressCb, entityName, s.precision, &m_counters.tileCount, &m_counters.haloSize);
+		return SOLIS::LaunchHeightfield(rays, weights, m_conversion, s.heightfieldCellSize, vertices, outputs, progressCb, entityName, s.precision);
+	}
+
+	case ENGINE_HORIZON:
+	{
+		//the horizon depends on the footprint of each entity
+		SOLISHorizon horizon;
+		if (!horizon.compute(m_horizonDem, vertices, globalShift, globalScale, s.horizonTileSize))
+		{
+			return false;
+		}
+
+		for (const CCVector3& ray : rays)
+		{
+			unsigned t = 0;
+			while (t < horizon.tileCount() && horizon.hides(t, ray))
+				++t;
+			if (t == horizon.tileCount())
+				++m_counters.rejectedCount;
+		}
+
+		std::unique_ptr<SOLISCheckpoint> checkpoint = CreateCheckpoint(s, vertices, mesh, component.raysKey);
+		return SOLIS::Launch(rays, weights, m_conversion, vertices, outputs, mesh, s.meshIsClosed, resolution, resolution, progressCb, entityName, s.precision, checkpoint.get(), &horizon);
+	}
+
+	case ENGINE_SHARD:
+	{
+		//the files are named after the geometry only, the rendering options are checked at merge time
+		uint64_t geometryKey = SOLISCache::GeometryKey(vertices, mesh, false, 0);
+		uint64_t renderKey = SOLISCache::GeometryKey(vertices, mesh, s.meshIsClosed, resolution);
+
+		SOLISShard shard;
+		if (!shard.init(s.shardIndex, s.shardCount, geometryKey, renderKey, component.raysKey, weights, component.fieldNames, m_conversion, numberOfPoints))
+		{
+			return Failure(error, "Not enough memory");
+		}
+
+		size_t rendered = 0;
+		if (!SOLIS::LaunchShard(rays, vertices, shard, mesh, s.meshIsClosed, resolution, resolution, progressCb, entityName, &rendered))
+		{
+			return false;
+		}
+		if (!shard.save(SOLISShard::Filename(s.shardDirectory, geometryKey, component.raysKey, s.shardIndex, s.shardCount), error))
+		{
+			return false;
+		}
+		m_counters.renderCount += rendered;
+		return true;
+	}
+
+	case ENGINE_SUN_METRICS:
+	{
+		SOLIS::SunStatistics statistics;
+		std::unique_ptr<SOLISCheckpoint> checkpoint = CreateCheckpoint(s, vertices, mesh, component.raysKey);
+		if (!SOLIS::Launch(rays, weights.front(), true, m_conversion, vertices, outputs[0], mesh, s.meshIsClosed, resolution, resolution, progressCb, entityName, s.precision, &component.rayDoys, &statistics, checkpoint.get()))
+		{
+			return false;
+		}
+
+		//duration represented by each ray (hours)
+		double rayHours = s.timestep / 60;
+		for (size_t j = 0; j < statistics.litCount.size(); ++j)
+		{
+			(*outputs[1])[j] = static_cast<ScalarType>(statistics.litCount[j] * rayHours);
+			(*outputs[2])[j] = static_cast<ScalarType>(statistics.firstSun[j]);
+			(*outputs[3])[j] = static_cast<ScalarType>(statistics.lastSun[j]);
+			(*outputs[4])[j] = static_cast<ScalarType>(statistics.peakIrradiance[j]);
+		}
+		return true;
+	}
+
+	case ENGINE_RENDER:
+	default:
+	{
+		std::unique_ptr<SOLISCheckpoint> checkpoint = CreateCheckpoint(s, vertices, mesh, component.raysKey);
+		if (SingleDirectOutput(s, component))
+		{
+			//single direct output (dedicated accumulators)
+			return SOLIS::Launch(rays, weights.front(), true, m_conversion, vertices, outputs.front(), mesh, s.meshIsClosed, resolution, resolution, progressCb, entityName, s.precision, nullptr, nullptr, checkpoint.get());
+		}
+		return SOLIS::Launch(rays, weights, m_conversion, vertices, outputs, mesh, s.meshIsClosed, resolution, resolution, progressCb, entityName, s.precision, checkpoint.get());
+	}
+	}
+}
+
+void SOLISRun::report(const Component& component, QStringList& messages) const
+{
+	const char* rayType = (component.direct ? "sun positions" : "sky directions");
+	size_t rayCount = component.rays.size() * m_counters.launchCount;
+
+	switch (engine(component))
+	{
+	case ENGINE_TILED_SUN_PATH:
+		messages.append(QString("Tiled sun positions: %1 tiles").arg(m_counters.tileCount));
+		break;
+	case ENGINE_ADAPTIVE_SUN_PATH:
+		messages.append(QString("Adaptive sampling: %1 renders").arg(m_counters.renderCount));
+		break;
+	case ENGINE_HARMONICS:
+		messages.append(QString("Spherical harmonics visibility: %1 of %2 entities loaded from the cache").arg(m_counters.cacheHits).arg(m_counters.launchCount));
+		break;
+	case ENGINE_VISIBILITY_MATRIX:
+		if (component.direct)
+			messages.append(QString("Visibility matrix: %1 of %2 entities loaded from the cache, %3 sun positions snapped to %4 directions (max. error %5 deg)").arg(m_counters.cacheHits).arg(m_counters.launchCount).arg(component.rays.size()).arg(m_visibilityDirections.size()).arg(component.maxError, 0, 'f', 3));
+		else
+			messages.append(QString("Visibility matrix: %1 of %2 entities loaded from the cache").arg(m_counters.cacheHits).arg(m_counters.launchCount));
+		break;
+	case ENGINE_SUN_CACHE:
+		messages.append(QString("Sun bin cache: %1 sun positions in %2 bins of %3 deg, %4 renders (max. snapping error %5 deg)").arg(component.rays.size()).arg(component.binKeys.size()).arg(m_sunBinSize).arg(m_counters.renderCount).arg(component.maxError, 0, 'f', 3));
+		break;
+	case ENGINE_SKY_VIEW:
+		messages.append(QString("Sky-view factor: %1 of %2 entities loaded from the cache").arg(m_counters.cacheHits).arg(m_counters.launchCount));
+		break;
+	case ENGINE_INCREMENTAL:
+		messages.append(QString("Incremental update: %1 points re-evaluated").arg(m_counters.updatedCount));
+		break;
+	case ENGINE_HEIGHTFIELD:
+		if (m_settings.heightfieldTileSize >= 0)
+			messages.append(QString("Heightfield tiles: %1 tiles, halo %2").arg(m_counters.tileCount).arg(m_counters.haloSize));
+		break;
+	case ENGINE_HORIZON:
+		messages.append(QString("Far-field horizon: %1 of %2 %3 hidden (not rendered)").arg(m_counters.rejectedCount).arg(rayCount).arg(rayType));
+		break;
+	case ENGINE_SHARD:
+		messages.append(QString("Shard %1/%2: %3 of %4 %5 rendered, partial results saved in '%6'").arg(m_settings.shardIndex).arg(m_settings.shardCount).arg(m_counters.renderCount).arg(rayCount).arg(rayType).arg(m_settings.shardDirectory));
+		break;
+	default:
+		//nothing to report
+		break;
+	}
+}
@@ -0,0 +1,511 @@
+//##########################################################################
+//#                                                                        #
+//#                       CLOUDCOMPARE PLUGIN: qSOLIS                      #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                  COPYRIGHT: David Basler                               #
+//#                                                                        #
+//##########################################################################
+
+#include "SOLISSettings.h"
+#include "SOLISShard.h"
+
+//System
+#include <algorithm>
+#include <initializer_list>
+
+//! Reports an invalid option value
+static bool InvalidValue(const char* option, QString* error, const QString& details = QString())
+{
+	if (error)
+		*error = QString("Invalid parameter: value after \"-%1\"%2").arg(option).arg(details);
+	return false;
+}
+
+//! Reads the keyword following an option
+/** \param[out] index index of the keyword in 'keywords'
+**/
+static bool TakeKeyword(QStringList& arguments, const char* option, std::initializer_list<const char*> keywords, int& index, QString* error)
+{
+	QString value;
+	if (!SOLISSettings::TakeValue(arguments, option, value, error))
+		return false;
+
+	value = value.toUpper();
+	index = 0;
+	for (const char* keyword : keywords)
+	{
+		if (value == keyword)
+			return true;
+		++index;
+	}
+	return InvalidValue(option, error);
+}
+
+//! Reads the positive integer following an option
+static bool TakeUnsigned(QStringList& arguments, const char* option, unsigned& number, QString* error, unsigned minimum = 0, unsigned maximum = std::numeric_limits<unsigned>::max())
+{
+	QString value;
+	if (!SOLISSettings::TakeValue(arguments, option, value, error))
+		return false;
+
+	bool conversionOk = false;
+	number = value.toUInt(&conversionOk);
+	if (!conversionOk || number < minimum || number > maximum)
+		return InvalidValue(option, error);
+	return true;
+}
+
+bool SOLISSettings::IsOption(const QString& argument, const char* option)
+{
+	return argument.startsWith("-") && argument.mid(1).toUpper() == option;
+}
+
+bool SOLISSettings::TakeValue(QStringList& arguments, const char* option, QString& value, QString* error/*=nullptr*/, const char* what/*="value"*/)
+{
+	if (arguments.empty())
+	{
+		if (error)
+			*error = QString("Missing parameter: %1 after \"-%2\"").arg(what).arg(option);
+		return false;
+	}
+	value = arguments.takeFirst();
+	return true;
+}
+
+bool SOLISSettings::TakeNumber(QStringList& arguments, const char* option, double& number, QString* error/*=nullptr*/, double minimum/*=-max*/)
+{
+	QString value;
+	if (!TakeValue(arguments, option, value, error))
+		return false;
+
+	bool conversionOk = false;
+	number = value.toDouble(&conversionOk);
+	if (!conversionOk || number < minimum)
+		return InvalidValue(option, error);
+	return true;
+}
+
+bool SOLISSettings::parse(QStringList& arguments, bool& recognized, QString* error/*=nullptr*/)
+{
+	recognized = false;
+	if (arguments.empty())
+		return true;
+
+	const QString arg = arguments.front();
+	recognized = true;
+	int index = 0;
+
+	if (IsOption(arg, COMMAND_SOLIS_IS_CLOSED))
+	{
+		arguments.pop_front();
+		meshIsClosed = true;
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_SUN_METRICS))
+	{
+		arguments.pop_front();
+		sunMetrics = true;
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_TYPE))
+	{
+		arguments.pop_front();
+		if (!TakeKeyword(arguments, COMMAND_SOLIS_TYPE, { "DIRECT", "DIFFUSE", "ALL" }, index, error))
+			return false;
+		static const Components c_components[] = { COMPONENT_DIRECT, COMPONENT_DIFFUSE, COMPONENT_ALL };
+		components = c_components[index];
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_DOY))
+	{
+		arguments.pop_front();
+		return TakeNumber(arguments, COMMAND_SOLIS_DOY, doyFrom, error);
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_TS))
+	{
+		arguments.pop_front();
+		if (!TakeNumber(arguments, COMMAND_SOLIS_TS, timestep, error))
+			return false;
+		if (timestep <= 0)
+			return InvalidValue(COMMAND_SOLIS_TS, error);
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_INT))
+	{
+		arguments.pop_front();
+		return TakeNumber(arguments, COMMAND_SOLIS_INT, integration, error);
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_LAT))
+	{
+		arguments.pop_front();
+		locationSet = true;
+		return TakeNumber(arguments, COMMAND_SOLIS_LAT, latitude, error);
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_LON))
+	{
+		arguments.pop_front();
+		locationSet = true;
+		return TakeNumber(arguments, COMMAND_SOLIS_LON, longitude, error);
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_ELV))
+	{
+		arguments.pop_front();
+		return TakeNumber(arguments, COMMAND_SOLIS_ELV, elevation, error);
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_N_RAYS))
+	{
+		arguments.pop_front();
+		return TakeUnsigned(arguments, COMMAND_SOLIS_N_RAYS, rayCount, error, 1);
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_RESOLUTION))
+	{
+		arguments.pop_front();
+		return TakeUnsigned(arguments, COMMAND_SOLIS_RESOLUTION, resolution, error, 1);
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_PRECISION))
+	{
+		arguments.pop_front();
+		if (!TakeKeyword(arguments, COMMAND_SOLIS_PRECISION, { "COMPACT", "FAST", "DOUBLE" }, index, error))
+			return false;
+		static const SOLIS::AccumulatorPrecision c_precisions[] = { SOLIS::ACCUMULATOR_COMPACT, SOLIS::ACCUMULATOR_FAST, SOLIS::ACCUMULATOR_DOUBLE };
+		precision = c_precisions[index];
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_SUN_BINNING))
+	{
+		arguments.pop_front();
+		return TakeNumber(arguments, COMMAND_SOLIS_SUN_BINNING, binningTolerance, error, 0);
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_WEATHER))
+	{
+		arguments.pop_front();
+		QString filename;
+		if (!TakeValue(arguments, COMMAND_SOLIS_WEATHER, filename, error, "filename"))
+			return false;
+		weatherFiles.append(filename);
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_ADAPTIVE))
+	{
+		arguments.pop_front();
+		return TakeNumber(arguments, COMMAND_SOLIS_ADAPTIVE, adaptiveStep, error, 0);
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_ADAPTIVE_THRESHOLD))
+	{
+		arguments.pop_front();
+		return TakeNumber(arguments, COMMAND_SOLIS_ADAPTIVE_THRESHOLD, adaptiveThreshold, error, 0);
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_SVF_CACHE))
+	{
+		arguments.pop_front();
+		return TakeValue(arguments, COMMAND_SOLIS_SVF_CACHE, skyViewCache, error, "directory");
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_VIS_MATRIX))
+	{
+		arguments.pop_front();
+		return TakeValue(arguments, COMMAND_SOLIS_VIS_MATRIX, visibilityMatrixCache, error, "directory");
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_SUN_CACHE))
+	{
+		arguments.pop_front();
+		return TakeValue(arguments, COMMAND_SOLIS_SUN_CACHE, sunCache, error, "directory");
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_RESUME))
+	{
+		arguments.pop_front();
+		return TakeValue(arguments, COMMAND_SOLIS_RESUME, checkpointDirectory, error, "directory");
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_CHECKPOINT_INTERVAL))
+	{
+		arguments.pop_front();
+		return TakeNumber(arguments, COMMAND_SOLIS_CHECKPOINT_INTERVAL, checkpointInterval, error, 0);
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_HORIZON_DEM))
+	{
+		arguments.pop_front();
+		return TakeValue(arguments, COMMAND_SOLIS_HORIZON_DEM, horizonFile, error, "filename");
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_HORIZON_TILE))
+	{
+		arguments.pop_front();
+		if (!TakeNumber(arguments, COMMAND_SOLIS_HORIZON_TILE, horizonTileSize, error))
+			return false;
+		if (horizonTileSize <= 0)
+			return InvalidValue(COMMAND_SOLIS_HORIZON_TILE, error);
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_HEIGHTFIELD))
+	{
+		arguments.pop_front();
+		return TakeNumber(arguments, COMMAND_SOLIS_HEIGHTFIELD, heightfieldCellSize, error, 0);
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_HEIGHTFIELD_TILE))
+	{
+		arguments.pop_front();
+		return TakeNumber(arguments, COMMAND_SOLIS_HEIGHTFIELD_TILE, heightfieldTileSize, error, 0);
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_SHARD))
+	{
+		arguments.pop_front();
+		QString spec;
+		if (!TakeValue(arguments, COMMAND_SOLIS_SHARD, spec, error, "shard ('i/N') and directory"))
+			return false;
+		if (!SOLISShard::ParseSpec(spec, shardIndex, shardCount))
+			return InvalidValue(COMMAND_SOLIS_SHARD, error, " (i/N with 0 <= i < N expected)");
+		return TakeValue(arguments, COMMAND_SOLIS_SHARD, shardDirectory, error, "directory");
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_SH_VISIBILITY))
+	{
+		arguments.pop_front();
+		return TakeValue(arguments, COMMAND_SOLIS_SH_VISIBILITY, harmonicsCache, error, "directory");
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_SH_ORDER))
+	{
+		arguments.pop_front();
+		return TakeUnsigned(arguments, COMMAND_SOLIS_SH_ORDER, harmonicsOrder, error, 0, SOLISSky::HARMONICS_MAX_ORDER);
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_INCREMENTAL))
+	{
+		arguments.pop_front();
+		//bounding box of the edit: xmin ymin zmin xmax ymax zmax
+		double bounds[6];
+		for (unsigned b = 0; b < 6; ++b)
+		{
+			if (!TakeNumber(arguments, COMMAND_SOLIS_INCREMENTAL, bounds[b], error))
+				return false;
+		}
+		changedMin = CCVector3(	static_cast<PointCoordinateType>(std::min(bounds[0], bounds[3])),
+								static_cast<PointCoordinateType>(std::min(bounds[1], bounds[4])),
+								static_cast<PointCoordinateType>(std::min(bounds[2], bounds[5])) );
+		changedMax = CCVector3(	static_cast<PointCoordinateType>(std::max(bounds[0], bounds[3])),
+								static_cast<PointCoordinateType>(std::max(bounds[1], bounds[4])),
+								static_cast<PointCoordinateType>(std::max(bounds[2], bounds[5])) );
+		incremental = true;
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_TILE_SIZE))
+	{
+		arguments.pop_front();
+		return TakeNumber(arguments, COMMAND_SOLIS_TILE_SIZE, tileSize, error, 0);
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_PERIODS))
+	{
+		arguments.pop_front();
+		if (!TakeKeyword(arguments, COMMAND_SOLIS_PERIODS, { "NONE", "MONTH", "HOUR" }, index, error))
+			return false;
+		static const SOLIS::PeriodBinning c_periods[] = { SOLIS::PERIODS_NONE, SOLIS::PERIODS_MONTH, SOLIS::PERIODS_HOUR };
+		periods = c_periods[index];
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_DIFFUSE_SAMPLING))
+	{
+		arguments.pop_front();
+		if (!TakeKeyword(arguments, COMMAND_SOLIS_DIFFUSE_SAMPLING, { "UNIFORM", "COSINE", "SKY" }, index, error))
+			return false;
+		static const SOLIS::DiffuseSampling c_samplings[] = { SOLIS::DIFFUSE_UNIFORM, SOLIS::DIFFUSE_COSINE, SOLIS::DIFFUSE_SKY };
+		diffuseSampling = c_samplings[index];
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_SKY_MODEL))
+	{
+		arguments.pop_front();
+		if (!TakeKeyword(arguments, COMMAND_SOLIS_SKY_MODEL, { "ISOTROPIC", "PEREZ" }, index, error))
+			return false;
+		anisotropicSky = (index == 1);
+	}
+	else if (IsOption(arg, COMMAND_SOLIS_SKY))
+	{
+		arguments.pop_front();
+		if (!TakeKeyword(arguments, COMMAND_SOLIS_SKY, { "PARTSPHERE", "TREGENZA", "REINHART", "HEALPIX" }, index, error))
+			return false;
+		static const SOLISSky::Discretization c_schemes[] = { SOLISSky::SKY_PARTSPHERE, SOLISSky::SKY_TREGENZA, SOLISSky::SKY_REINHART, SOLISSky::SKY_HEALPIX };
+		skyScheme = c_schemes[index];
+		skySet = true;
+	}
+	else
+	{
+		recognized = false;
+	}
+
+	return true;
+}
+
+void SOLISSettings::resolve(QStringList& warnings)
+{
+	if (integration < 0) { // Single direct ray
+		integration = 0.02;
+		timestep = 1.0;
+	}
+
+	if (!shardDirectory.isEmpty())
+	{
+		//the shards only hold the raw sums of the plain render loop
+		if (sunPathLoop())
+		{
+			warnings.append("Adaptive sampling, tiled sun positions and sun metrics are not available with ray sharding (ignored)");
+			adaptiveStep = 0;
+			tileSize = 0;
+			sunMetrics = false;
+		}
+		if (cachedVisibility() || !skyViewCache.isEmpty() || !sunCache.isEmpty() || incremental)
+		{
+			warnings.append("Cached visibility, the sky-view factor cache, the sun bin cache and incremental updates are not available with ray sharding (ignored)");
+			visibilityMatrixCache.clear();
+			harmonicsCache.clear();
+			skyViewCache.clear();
+			sunCache.clear();
+			incremental = false;
+		}
+		if (!horizonFile.isEmpty() || heightfieldCellSize >= 0)
+		{
+			warnings.append("The far-field horizon and the heightfield engine are not available with ray sharding (ignored)");
+			horizonFile.clear();
+			heightfieldCellSize = -1;
+		}
+		if (!checkpointDirectory.isEmpty())
+		{
+			//a shard is already a fraction of the run
+			warnings.append("Checkpoints are not used with ray sharding (ignored)");
+			checkpointDirectory.clear();
+		}
+	}
+
+	if (adaptiveStep > 0 && !weatherFiles.empty())
+	{
+		warnings.append("Adaptive sampling is not available with weather files (ignored)");
+		adaptiveStep = 0;
+	}
+	if (adaptiveStep > 0 && binningTolerance > 0)
+	{
+		warnings.append("Sun binning is not available with adaptive sampling (ignored)");
+		binningTolerance = 0;
+	}
+	if (diffuseSampling != SOLIS::DIFFUSE_UNIFORM && !weatherFiles.empty())
+	{
+		warnings.append("Importance sampling of the diffuse directions is not available with weather files (ignored)");
+		diffuseSampling = SOLIS::DIFFUSE_UNIFORM;
+	}
+	if (periods != SOLIS::PERIODS_NONE && !weatherFiles.empty())
+	{
+		warnings.append("Period maps are not available with weather files (ignored)");
+		periods = SOLIS::PERIODS_NONE;
+	}
+	if (periods != SOLIS::PERIODS_NONE && adaptiveStep > 0 && direct())
+	{
+		warnings.append("Period maps are not available with adaptive sampling (ignored)");
+		periods = SOLIS::PERIODS_NONE;
+	}
+	if (tileSize > 0 && (!weatherFiles.empty() || adaptiveStep > 0 || binningTolerance > 0 || periods != SOLIS::PERIODS_NONE || sunMetrics))
+	{
+		warnings.append("Tiled sun positions are not available with weather files, adaptive sampling, sun binning, period maps or sun metrics (ignored)");
+		tileSize = 0;
+	}
+	if (sunMetrics && (!weatherFiles.empty() || adaptiveStep > 0 || binningTolerance > 0 || periods != SOLIS::PERIODS_NONE))
+	{
+		//statistics need one ray per timestep
+		warnings.append("Sun metrics are not available with weather files, adaptive sampling, sun binning or period maps (ignored)");
+		sunMetrics = false;
+	}
+	if (diffuseSampling != SOLIS::DIFFUSE_UNIFORM && skySet)
+	{
+		warnings.append("Sky discretization is not used with importance sampling (ignored)");
+	}
+	if (!visibilityMatrixCache.isEmpty() && !harmonicsCache.isEmpty())
+	{
+		warnings.append("Spherical harmonics visibility is superseded by the visibility matrix (ignored)");
+		harmonicsCache.clear();
+	}
+	if (incremental && (cachedVisibility() || !skyViewCache.isEmpty()))
+	{
+		//lookups are already cheaper than any render
+		warnings.append("Incremental updates are not available with cached visibility (ignored)");
+		incremental = false;
+	}
+	if (incremental && sunPathLoop())
+	{
+		warnings.append("Incremental updates are not available with adaptive sampling, tiled sun positions or sun metrics (ignored)");
+		incremental = false;
+	}
+	if (cachedVisibility() && sunPathLoop())
+	{
+		warnings.append("Cached visibility is not available with adaptive sampling, tiled sun positions or sun metrics (ignored)");
+		adaptiveStep = 0;
+		tileSize = 0;
+		sunMetrics = false;
+	}
+	if (cachedVisibility() && binningTolerance > 0)
+	{
+		//the number of sun rays doesn't change the cost of a lookup
+		warnings.append("Sun binning is superseded by cached visibility (ignored)");
+		binningTolerance = 0;
+	}
+	if (cachedVisibility() && !skyViewCache.isEmpty())
+	{
+		warnings.append("The sky-view factor cache is superseded by cached visibility (ignored)");
+		skyViewCache.clear();
+	}
+	if (!sunCache.isEmpty() && (cachedVisibility() || incremental))
+	{
+		warnings.append("The sun bin cache is not available with cached visibility or incremental updates (ignored)");
+		sunCache.clear();
+	}
+	if (!sunCache.isEmpty() && sunPathLoop())
+	{
+		warnings.append("The sun bin cache is not available with adaptive sampling, tiled sun positions or sun metrics (ignored)");
+		sunCache.clear();
+	}
+	if (!checkpointDirectory.isEmpty() && direct() && (adaptiveStep > 0 || tileSize > 0))
+	{
+		//the renders of these loops depend on the previous ones
+		warnings.append("Checkpoints are not available with adaptive sampling or tiled sun positions (ignored for the direct component)");
+	}
+
+	if (incremental && (!horizonFile.isEmpty() || heightfieldCellSize >= 0))
+	{
+		//the previous results would be updated with plain renders
+		warnings.append("Incremental updates are not available with the far-field horizon or the heightfield engine (full computation)");
+		incremental = false;
+	}
+	if (!horizonFile.isEmpty() && (cachedVisibility() || !sunCache.isEmpty()))
+	{
+		warnings.append("The far-field horizon is not available with cached visibility or the sun bin cache (ignored)");
+		horizonFile.clear();
+	}
+	if (!horizonFile.isEmpty() && sunPathLoop())
+	{
+		warnings.append("The far-field horizon is not available with adaptive sampling, tiled sun positions or sun metrics (ignored)");
+		horizonFile.clear();
+	}
+	if (!horizonFile.isEmpty() && !skyViewCache.isEmpty())
+	{
+		//the sky-view factor doesn't depend on the horizon
+		warnings.append("The sky-view factor cache is not available with the far-field horizon (ignored)");
+		skyViewCache.clear();
+	}
+
+	if (heightfieldCellSize >= 0 && (cachedVisibility() || !sunCache.isEmpty() || !horizonFile.isEmpty()))
+	{
+		warnings.append("The heightfield engine is not available with cached visibility, the sun bin cache or the far-field horizon (ignored)");
+		heightfieldCellSize = -1;
+	}
+	if (heightfieldCellSize >= 0 && sunPathLoop())
+	{
+		warnings.append("The heightfield engine is not available with adaptive sampling, tiled sun positions or sun metrics (ignored)");
+		heightfieldCellSize = -1;
+	}
+	if (heightfieldCellSize >= 0 && !skyViewCache.isEmpty())
+	{
+		//the sweep is cheaper than the cache
+		warnings.append("The sky-view factor cache is not available with the heightfield engine (ignored)");
+		skyViewCache.clear();
+	}
+	if (heightfieldCellSize >= 0 && !checkpointDirectory.isEmpty())
+	{
+		warnings.append("Checkpoints are not used by the heightfield engine (ignored)");
+		checkpointDirectory.clear();
+	}
+	if (heightfieldCellSize < 0 && heightfieldTileSize >= 0)
+	{
+		warnings.append("Heightfield tiles are only used by the heightfield engine (ignored)");
+		heightfieldTileSize = -1;
+	}
+}
@@ -0,0 +1,439 @@
+//##########################################################################
+//#                                                                        #
+//#                       CLOUDCOMPARE PLUGIN: qSOLIS                      #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                  COPYRIGHT: David Basler                               #
+//#                                                                        #
+//##########################################################################
+
+#include "SOLISShard.h"
+
+//Qt
+#include <QByteArray>
+#include <QDir>
+#include <QFileInfo>
+
+//System
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+//! Partial result file signature
+static const char c_shardMagic[8] = { 'S', 'O', 'L', 'I', 'S', 'S', 'H', 'D' };
+//! Partial result file version
+static const uint32_t c_shardVersion = 1;
+
+//! Partial result file header
+/** Followed by the outputs (see ShardOutputRecord, each followed by the UTF-8 field name), then by the
+	per-vertex sums of each output (pointCount x 64 bits integers per output).
+**/
+struct ShardHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t outputCount;
+	uint64_t geometryKey;
+	uint64_t renderKey;
+	uint64_t raysKey;
+	uint32_t index;
+	uint32_t count;
+	uint64_t rayCount;
+	uint64_t pointCount;
+	double conversion;
+};
+
+//! Partial result file output record
+struct ShardOutputRecord
+{
+	int32_t exponent;
+	uint32_t nameSize;
+};
+
+bool SOLISShard::ParseSpec(const QString& spec, unsigned& index, unsigned& count)
+{
+	QStringList tokens = spec.split('/');
+	if (tokens.size() != 2)
+		return false;
+
+	bool indexOk = false;
+	bool countOk = false;
+	index = tokens[0].toUInt(&indexOk);
+	count = tokens[1].toUInt(&countOk);
+	return (indexOk && countOk && count != 0 && index < count);
+}
+
+QString SOLISShard::Filename(const QString& directory, uint64_t geometryKey, uint64_t raysKey, unsigned index, unsigned count)
+{
+	return QDir(directory).absoluteFilePath(QString("%1_%2_%3of%4.shard").arg(geometryKey, 16, 16, QChar('0')).arg(raysKey, 16, 16, QChar('0')).arg(index).arg(count));
+}
+
+bool SOLISShard::MergeAll(const QString& directory, uint64_t geometryKey, size_t pointCount, std::vector<SOLISShard>& runs, QString* error/*=nullptr*/)
+{
+	runs.clear();
+
+	QDir dir(directory);
+	QStringList filenames = dir.entryList(QStringList(QString("%1_*.shard").arg(geometryKey, 16, 16, QChar('0'))), QDir::Files, QDir::Name);
+	if (filenames.isEmpty())
+	{
+		if (error)
+			*error = QString("No partial result found in '%1'").arg(directory);
+		return false;
+	}
+
+	for (const QString& filename : filenames)
+	{
+		SOLISShard shard;
+		if (!shard.load(dir.absoluteFilePath(filename), error))
+			return false;
+
+		if (shard.m_pointCount != pointCount)
+		{
+			if (error)
+				*error = QString("%1: The number of points doesn't match the entity").arg(filename);
+			return false;
+		}
+
+		//shards of the same run share the rays key
+		bool merged = false;
+		for (SOLISShard& run : runs)
+		{
+			if (run.m_raysKey == shard.m_raysKey)
+			{
+				if (!run.merge(shard, error))
+					return false;
+				merged = true;
+				break;
+			}
+		}
+
+		if (!merged)
+		{
+			try
+			{
+				runs.push_back(std::move(shard));
+			}
+			catch (const std::bad_alloc&)
+			{
+				if (error)
+					*error = "Not enough memory";
+				return false;
+			}
+		}
+	}
+
+	for (const SOLISShard& run : runs)
+	{
+		if (!run.complete())
+		{
+			size_t mergedCount = 0;
+			for (uint8_t flag : run.m_merged)
+				mergedCount += flag;
+			if (error)
+				*error = QString("Incomplete run in '%1': %2 of %3 shards found").arg(directory).arg(mergedCount).arg(run.m_count);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool SOLISShard::init(	unsigned index,
+						unsigned count,
+						uint64_t geometryKey,
+						uint64_t renderKey,
+						uint64_t raysKey,
+						const std::vector< std::vector<double> >& weights,
+						const QStringList& fieldNames,
+						double conversion,
+						size_t pointCount)
+{
+	if (count == 0 || index >= count || weights.empty() || fieldNames.size() != static_cast<int>(weights.size()))
+		return false;
+
+	size_t outputCount = weights.size();
+	size_t rayCount = weights.front().size();
+	for (const std::vector<double>& outputWeights : weights)
+	{
+		if (outputWeights.size() != rayCount)
+			return false;
+	}
+
+	try
+	{
+		m_exponents.resize(outputCount);
+		m_weights.assign(outputCount, std::vector<int64_t>(rayCount));
+		m_sums.assign(outputCount, std::vector<int64_t>(pointCount, 0));
+		m_merged.assign(count, 0);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory?
+		return false;
+	}
+
+	m_index = index;
+	m_count = count;
+	m_geometryKey = geometryKey;
+	m_renderKey = renderKey;
+	m_raysKey = raysKey;
+	m_rayCount = rayCount;
+	m_pointCount = pointCount;
+	m_conversion = conversion;
+	m_fieldNames = fieldNames;
+	m_merged[index] = 1;
+
+	for (size_t k = 0; k < outputCount; ++k)
+	{
+		//the sum of all the weights fits in 62 bits (+ 1/2 per ray of rounding), whatever the visibility
+		double total = 0;
+		for (double w : weights[k])
+			total += std::abs(w);
+
+		int exponent = 0;
+		if (total > 0)
+		{
+			frexp(total, &exponent);
+			exponent = 62 - exponent;
+		}
+		m_exponents[k] = exponent;
+
+		for (size_t i = 0; i < rayCount; ++i)
+		{
+			m_weights[k][i] = static_cast<int64_t>(llround(ldexp(weights[k][i], exponent)));
+		}
+	}
+
+	return true;
+}
+
+bool SOLISShard::selectRays(std::vector<size_t>& rayIndexes) const
+{
+	rayIndexes.clear();
+
+	size_t rank = 0;
+	for (size_t i = 0; i < m_rayCount; ++i)
+	{
+		bool active = false;
+		for (const std::vector<int64_t>& outputWeights : m_weights)
+		{
+			if (outputWeights[i] != 0)
+			{
+				active = true;
+				break;
+			}
+		}
+		if (!active)
+			continue;
+
+		if (rank % m_count == m_index)
+		{
+			try
+			{
+				rayIndexes.push_back(i);
+			}
+			catch (const std::bad_alloc&)
+			{
+				//not enough memory?
+				return false;
+			}
+		}
+		++rank;
+	}
+
+	return true;
+}
+
+bool SOLISShard::save(const QString& filename, QString* error/*=nullptr*/) const
+{
+	QDir().mkpath(QFileInfo(filename).absolutePath());
+
+	FILE* fp = fopen(qPrintable(filename), "wb");
+	if (!fp)
+	{
+		if (error)
+			*error = QString("Failed to create file '%1'").arg(filename);
+		return false;
+	}
+
+	ShardHeader header;
+	memcpy(header.magic, c_shardMagic, sizeof(c_shardMagic));
+	header.version = c_shardVersion;
+	header.outputCount = static_cast<uint32_t>(m_sums.size());
+	header.geometryKey = m_geometryKey;
+	header.renderKey = m_renderKey;
+	header.raysKey = m_raysKey;
+	header.index = m_index;
+	header.count = m_count;
+	header.rayCount = m_rayCount;
+	header.pointCount = m_pointCount;
+	header.conversion = m_conversion;
+
+	bool success = (fwrite(&header, sizeof(ShardHeader), 1, fp) == 1);
+	for (size_t k = 0; success && k < m_sums.size(); ++k)
+	{
+		QByteArray name = m_fieldNames[static_cast<int>(k)].toUtf8();
+		ShardOutputRecord record;
+		record.exponent = m_exponents[k];
+		record.nameSize = static_cast<uint32_t>(name.size());
+		success = (	fwrite(&record, sizeof(ShardOutputRecord), 1, fp) == 1
+				&&	(name.isEmpty() || fwrite(name.constData(), 1, name.size(), fp) == static_cast<size_t>(name.size())) );
+	}
+	for (size_t k = 0; success && k < m_sums.size(); ++k)
+	{
+		success = (m_pointCount == 0 || fwrite(m_sums[k].data(), sizeof(int64_t), m_pointCount, fp) == m_pointCount);
+	}
+
+	fclose(fp);
+	if (!success)
+	{
+		//don't leave a truncated file behind
+		remove(qPrintable(filename));
+		if (error)
+			*error = QString("Failed to write file '%1'").arg(filename);
+	}
+	return success;
+}
+
+bool SOLISShard::load(const QString& filename, QString* error/*=nullptr*/)
+{
+	FILE* fp = fopen(qPrintable(filename), "rb");
+	if (!fp)
+	{
+		if (error)
+			*error = QString("Failed to open file '%1'").arg(filename);
+		return false;
+	}
+
+	ShardHeader header;
+	bool valid = (	fread(&header, sizeof(ShardHeader), 1, fp) == 1
+				&&	memcmp(header.magic, c_shardMagic, sizeof(c_shardMagic)) == 0
+				&&	header.version == c_shardVersion
+				&&	header.count != 0
+				&&	header.index < header.count );
+
+	if (valid)
+	{
+		m_index = header.index;
+		m_count = header.count;
+		m_geometryKey = header.geometryKey;
+		m_renderKey = header.renderKey;
+		m_raysKey = header.raysKey;
+		m_rayCount = static_cast<size_t>(header.rayCount);
+		m_pointCount = static_cast<size_t>(header.pointCount);
+		m_conversion = header.conversion;
+		m_fieldNames.clear();
+		m_weights.clear();
+
+		try
+		{
+			m_exponents.resize(header.outputCount);
+			m_sums.assign(header.outputCount, std::vector<int64_t>(m_pointCount));
+			m_merged.assign(m_count, 0);
+
+			for (uint32_t k = 0; valid && k < header.outputCount; ++k)
+			{
+				ShardOutputRecord record;
+				valid = (fread(&record, sizeof(ShardOutputRecord), 1, fp) == 1 && record.nameSize < 65536);
+				if (valid)
+				{
+					QByteArray name(static_cast<int>(record.nameSize), '\0');
+					valid = (record.nameSize == 0 || fread(name.data(), 1, record.nameSize, fp) == record.nameSize);
+					m_exponents[k] = record.exponent;
+					m_fieldNames.append(QString::fromUtf8(name));
+				}
+			}
+		}
+		catch (const std::bad_alloc&)
+		{
+			fclose(fp);
+			if (error)
+				*error = "Not enough memory";
+			return false;
+		}
+
+		for (size_t k = 0; valid && k < m_sums.size(); ++k)
+		{
+			valid = (m_pointCount == 0 || fread(m_sums[k].data(), sizeof(int64_t), m_pointCount, fp) == m_pointCount);
+		}
+		if (valid)
+		{
+			m_merged[m_index] = 1;
+		}
+	}
+
+	fclose(fp);
+	if (!valid && error)
+		*error = QString("%1: Invalid or truncated partial result file").arg(filename);
+	return valid;
+}
+
+bool SOLISShard::merge(const SOLISShard& other, QString* error/*=nullptr*/)
+{
+	if (	other.m_count != m_count
+		||	other.m_geometryKey != m_geometryKey
+		||	other.m_renderKey != m_renderKey
+		||	other.m_raysKey != m_raysKey
+		||	other.m_rayCount != m_rayCount
+		||	other.m_pointCount != m_pointCount
+		||	other.m_conversion != m_conversion
+		||	other.m_fieldNames != m_fieldNames
+		||	other.m_exponents != m_exponents )
+	{
+		if (error)
+			*error = QString("Shard %1/%2 doesn't belong to the same run (different rendering options?)").arg(other.m_index).arg(other.m_count);
+		return false;
+	}
+
+	for (unsigned s = 0; s < m_count; ++s)
+	{
+		if (m_merged[s] && other.m_merged[s])
+		{
+			if (error)
+				*error = QString("Shard %1/%2 found twice").arg(s).arg(m_count);
+			return false;
+		}
+	}
+
+	//integer sums: exact, whatever the order
+	for (size_t k = 0; k < m_sums.size(); ++k)
+	{
+		for (size_t j = 0; j < m_pointCount; ++j)
+			m_sums[k][j] += other.m_sums[k][j];
+	}
+	for (unsigned s = 0; s < m_count; ++s)
+	{
+		m_merged[s] |= other.m_merged[s];
+	}
+
+	return true;
+}
+
+bool SOLISShard::complete() const
+{
+	for (uint8_t flag : m_merged)
+	{
+		if (!flag)
+			return false;
+	}
+	return !m_merged.empty();
+}
+
+void SOLISShard::convert(size_t k, std::vector<ScalarType>& values) const
+{
+	double scale = ldexp(1.0, -m_exponents[k]) * m_conversion;
+	size_t count = std::min(values.size(), m_sums[k].size());
+	for (size_t j = 0; j < count; ++j)
+	{
+		values[j] = static_cast<ScalarType>(static_cast<double>(m_sums[k][j]) * scale);
+	}
+}
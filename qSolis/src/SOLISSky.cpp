@@ -0,0 +1,907 @@
+//##########################################################################
+//#                                                                        #
+//#                       CLOUDCOMPARE PLUGIN: qSOLIS                      #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                  COPYRIGHT: David Basler                               #
+//#                                                                        #
+//##########################################################################
+
+#include "SOLISSky.h"
+
+//System
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cassert>
+#include <map>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+extern "C" {
+	#include <solrad.h>
+}
+
+static int gcd(int num1, int num2)
+{
+	int remainder = (num2 % num1);
+
+	return (remainder != 0 ? gcd(remainder, num1) : num1);
+}
+
+//! Sample points on the unit sphere
+/** Transcripted from MATLAB's script "partsphere.m" by Paul Leopardi,
+	2003-10-13, for UNSW School of Mathematics.
+
+	As points are sampled on the unit sphere, they can also
+	be considered as directions.
+	WARNING: returned array is on the user responsibilty!
+
+	The partition is made of equal area regions (4*pi/N): two polar caps and
+	collars of regions, each region spanning the whole height of its collar.
+
+	\param N number of desired sampled directions
+	\param[out] dirs set of N points
+	\param[out] zMin lower bound (along Z) of the region of each point (optional)
+	\param[out] zMax upper bound (along Z) of the region of each point (optional)
+	\return success
+**/
+static bool SampleSphere(size_t N, std::vector<CCVector3>& dirs, std::vector<double>* zMin = nullptr, std::vector<double>* zMax = nullptr)
+{
+	static const double c_eps = 2.2204e-16;
+	static const double c_twist = 4.0;
+
+	if (N == 0)
+	{
+		assert(false);
+		return false;
+	}
+
+	try
+	{
+		dirs.resize(N, CCVector3(0, 0, 1));
+		if (zMin)
+			zMin->resize(N, -1.0);
+		if (zMax)
+			zMax->resize(N, 1.0);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return false;
+	}
+
+	if (N == 1)
+	{
+		return true;
+	}
+
+	try
+	{
+		double area = (4 * M_PI) / N;
+		double beta = acos(1.0 - 2.0 / N); //return in [0,pi/2] as '1-2/N' goes from 0 to 1 when N --> inf
+		double gamma = M_PI - 2 * beta; //in [0,pi]
+		double fuzz = c_eps * 2 * N;
+
+		int Ltemp = static_cast<int>(ceil(gamma / sqrt(area) - fuzz));
+		int L = 2 + std::max(Ltemp, 1);
+
+		//init mbar
+		std::vector<double> mbar;
+		mbar.resize(L, 0);
+		assert(L >= 3);
+		{
+			mbar[0] = 1.0;
+			double theta = gamma / (L - 2);
+			for (int i = 1; i < L - 1; ++i)
+			{
+				mbar[i] = N * (cos(theta * (i - 1) + beta) - cos(theta * i + beta)) / 2;
+			}
+			mbar[L - 1] = 1.0;
+		}
+
+		//init m
+		std::vector<int> m;
+		m.resize(L, 0);
+		{
+			m[0] = 1;
+
+			double alpha = 0.0;
+			for (int i = 1; i < L; ++i)
+			{
+				double f = floor(mbar[i] + alpha + fuzz);
+				if ((mbar[i] - f) >= 0.5)
+					f = ceil(mbar[i] + alpha - fuzz);
+				m[i] = static_cast<int>(f);
+
+				alpha += mbar[i] - m[i];
+			}
+		}
+
+		//now we can build the rays
+		{
+			std::vector<double> offset;
+			offset.resize(L - 1, 0);
+
+			double z = 1.0 - static_cast<double>(2 + m[1]) / N;
+
+			size_t rayIndex = 1; //the first one is already (0,0,1)
+			if (zMin)
+				(*zMin)[0] = 1.0 - 2.0 / N;
+			for (int i = 1; i < L - 1; ++i)
+			{
+				if (m[i - 1] != 0 && m[i] != 0)
+				{
+					offset[i] = offset[i - 1]
+						+ static_cast<double>(gcd(m[i], m[i - 1])) / (2 * m[i] * m[i - 1])
+						+ std::min<double>(c_twist, floor(m[i - 1] / c_twist)) / m[i - 1];
+				}
+				else
+				{
+					offset[i] = 0.0;
+				}
+
+				double temp = static_cast<double>(m[i]) / N;
+
+				double h = cos((acos(z + temp) + acos(z - temp)) / 2);
+				double r = sqrt(1.0 - h*h);
+
+				for (int j = 0; j < m[i]; ++j)
+				{
+					double theta = 2.0*M_PI * (offset[i] + static_cast<double>(j) / m[i]);
+
+					if (zMin)
+						(*zMin)[rayIndex] = z - temp;
+					if (zMax)
+						(*zMax)[rayIndex] = z + temp;
+					dirs[rayIndex++] = CCVector3(static_cast<PointCoordinateType>(r*cos(theta)),
+						static_cast<PointCoordinateType>(r*sin(theta)),
+						static_cast<PointCoordinateType>(h));
+				}
+
+				z -= static_cast<double>(m[i] + m[i + 1]) / N;
+			}
+
+			assert(rayIndex + 1 == N);
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return false;
+	}
+
+	dirs[N - 1] = CCVector3(0, 0, -1);
+	if (zMax)
+		(*zMax)[N - 1] = -1.0 + 2.0 / N;
+
+	return true;
+}
+
+//! Reinhart sky subdivision (Tregenza patches subdivided 'mf' times in altitude and azimuth, single zenith cap)
+static void ReinhartPatches(unsigned mf, std::vector<CCVector3>& rays, std::vector<double>& solidAngles)
+{
+	static const int c_bandCount = 7;
+	static const int c_patchesPerBand[c_bandCount] = { 30, 30, 24, 24, 18, 12, 6 };
+	static const double c_bandHeight = 12.0;
+
+	double rowHeight = c_bandHeight / mf;
+	for (int b = 0; b < c_bandCount; ++b)
+	{
+		for (unsigned r = 0; r < mf; ++r)
+		{
+			double altMin = b * c_bandHeight + r * rowHeight;
+			double altMax = altMin + rowHeight;
+			double rowSolidAngle = 2 * M_PI * (sin(altMax * (M_PI / 180.0)) - sin(altMin * (M_PI / 180.0)));
+			unsigned n = c_patchesPerBand[b] * mf;
+			for (unsigned p = 0; p < n; ++p)
+			{
+				rays.push_back(SOLISSky::Direction(altMin + rowHeight / 2, (360.0 * p) / n));
+				solidAngles.push_back(rowSolidAngle / n);
+			}
+		}
+	}
+
+	//zenith cap
+	double altCap = c_bandCount * c_bandHeight;
+	rays.push_back(SOLISSky::Direction(90.0, 0.0));
+	solidAngles.push_back(2 * M_PI * (1.0 - sin(altCap * (M_PI / 180.0))));
+}
+
+//! HEALPix pixels of the upper hemisphere (ring scheme)
+/** All the pixels have the same area (4*pi / (12 * nside^2)). The pixels of the equator ring are cut by
+	the horizon: only their upper half is kept (with half the solid angle).
+**/
+static void HEALPixPatches(unsigned nside, std::vector<CCVector3>& rays, std::vector<double>& solidAngles)
+{
+	double n = static_cast<double>(nside);
+	double pixelSolidAngle = M_PI / (3 * n * n);
+
+	for (unsigned i = 1; i <= 2 * nside; ++i)
+	{
+		double z = 0;
+		unsigned pixelCount = 0;
+		double phaseShift = 0.5;
+		if (i < nside)
+		{
+			//polar cap
+			z = 1.0 - (static_cast<double>(i) * i) / (3 * n * n);
+			pixelCount = 4 * i;
+		}
+		else
+		{
+			//equatorial belt
+			z = 4.0 / 3 - (2.0 * i) / (3 * n);
+			pixelCount = 4 * nside;
+			phaseShift = ((i - nside + 1) % 2) / 2.0;
+		}
+
+		double solidAngle = pixelSolidAngle;
+		if (i == 2 * nside)
+		{
+			//equator: centroid of the upper half of the pixels
+			z = 2.0 / (9 * n);
+			solidAngle /= 2;
+		}
+
+		double altitude = asin(z) * (180.0 / M_PI);
+		for (unsigned j = 1; j <= pixelCount; ++j)
+		{
+			rays.push_back(SOLISSky::Direction(altitude, (360.0 / pixelCount) * (j - phaseShift)));
+			solidAngles.push_back(solidAngle);
+		}
+	}
+}
+
+//! Leopardi's partition of the sphere restricted to the upper hemisphere (see SampleSphere)
+/** The sphere is partitioned into 2 * count regions and the regions (or parts of regions) above the
+	horizon are kept. The solid angle of each direction is the exact area of its region above the horizon.
+**/
+static bool PartspherePatches(unsigned count, std::vector<CCVector3>& rays, std::vector<double>& solidAngles)
+{
+	size_t N = static_cast<size_t>(count) * 2;
+	std::vector<CCVector3> dirs;
+	std::vector<double> zMin;
+	std::vector<double> zMax;
+	if (!SampleSphere(N, dirs, &zMin, &zMax))
+		return false;
+
+	double regionSolidAngle = 4 * M_PI / N;
+	for (size_t i = 0; i < N; ++i)
+	{
+		//light directions point downwards (the sky is where z < 0)
+		if (zMin[i] >= 0)
+			continue;
+
+		double zTop = std::min(zMax[i], 0.0);
+		CCVector3 dir = dirs[i];
+		if (dir.z >= 0)
+		{
+			//region cut by the horizon: the direction is moved to the middle of its part above the horizon
+			double z = (zMin[i] + zTop) / 2;
+			double r = sqrt(std::max(0.0, 1.0 - z * z));
+			double xy = sqrt(static_cast<double>(dir.x) * dir.x + static_cast<double>(dir.y) * dir.y);
+			double scale = (xy > 0 ? r / xy : 0);
+			dir = CCVector3(static_cast<PointCoordinateType>(dir.x * scale),
+							static_cast<PointCoordinateType>(dir.y * scale),
+							static_cast<PointCoordinateType>(z));
+		}
+		rays.push_back(dir);
+		solidAngles.push_back(regionSolidAngle * (zTop - zMin[i]) / (zMax[i] - zMin[i]));
+	}
+
+	return true;
+}
+
+//! Leopardi's partition of the sphere: regions whose center is above the horizon (see SOLISSky::PartsphereDirections)
+/** The directions are not moved and the regions cut by the horizon are either fully kept or dropped, so that
+	all the directions have the same solid angle.
+**/
+static bool PartsphereCenters(unsigned count, std::vector<CCVector3>& rays, std::vector<double>& solidAngles)
+{
+	size_t N = static_cast<size_t>(count) * 2;
+	std::vector<CCVector3> dirs;
+	if (!SampleSphere(N, dirs))
+		return false;
+
+	double regionSolidAngle = 4 * M_PI / N;
+	for (const CCVector3& dir : dirs)
+	{
+		//light directions point downwards (the sky is where z < 0)
+		if (dir.z < 0)
+		{
+			rays.push_back(dir);
+			solidAngles.push_back(regionSolidAngle);
+		}
+	}
+
+	return true;
+}
+
+//! Cache key of the PartsphereCenters sets (not a SOLISSky::Discretization value)
+static const int c_partsphereCentersKey = -1;
+//! Maximum number of cached direction sets
+/** A run only uses a few (scheme, resolution) pairs: the cache is cleared when it is full, so that a
+	long-lived process trying many resolutions doesn't keep all of them.
+**/
+static const size_t c_maxCachedSkySets = 16;
+
+//! Returns a direction set, generated once per (scheme, resolution) and cached
+static bool CachedSkySet(int scheme, unsigned resolution, std::vector<CCVector3>& rays, std::vector<double>& solidAngles)
+{
+	//! Generated set
+	struct SkySet
+	{
+		std::vector<CCVector3> rays;
+		std::vector<double> solidAngles;
+	};
+	static std::map< std::pair<int, unsigned>, SkySet > s_cache;
+	static std::mutex s_cacheMutex;
+
+	std::pair<int, unsigned> key(scheme, resolution);
+
+	std::lock_guard<std::mutex> lock(s_cacheMutex);
+	try
+	{
+		auto it = s_cache.find(key);
+		if (it == s_cache.end())
+		{
+			SkySet set;
+			switch (scheme)
+			{
+			case c_partsphereCentersKey:
+				if (!PartsphereCenters(resolution, set.rays, set.solidAngles))
+					return false;
+				break;
+			case SOLISSky::SKY_PARTSPHERE:
+				if (!PartspherePatches(resolution, set.rays, set.solidAngles))
+					return false;
+				break;
+			case SOLISSky::SKY_REINHART:
+				ReinhartPatches(resolution, set.rays, set.solidAngles);
+				break;
+			case SOLISSky::SKY_HEALPIX:
+				HEALPixPatches(resolution, set.rays, set.solidAngles);
+				break;
+			case SOLISSky::SKY_TREGENZA:
+			default:
+				ReinhartPatches(1, set.rays, set.solidAngles);
+				break;
+			}
+			if (s_cache.size() >= c_maxCachedSkySets)
+				s_cache.clear();
+			it = s_cache.emplace(key, std::move(set)).first;
+		}
+
+		rays = it->second.rays;
+		solidAngles = it->second.solidAngles;
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return false;
+	}
+
+	return true;
+}
+
+CCVector3 SOLISSky::Direction(double altitude, double azimuth)
+{
+	double cosAlt = cos(altitude * (M_PI / 180.0));
+	return CCVector3(	static_cast<PointCoordinateType>(cosAlt * sin(azimuth * (M_PI / 180.0))),
+						static_cast<PointCoordinateType>(cosAlt * cos(azimuth * (M_PI / 180.0))),
+						static_cast<PointCoordinateType>(-sin(altitude * (M_PI / 180.0))) );
+}
+
+bool SOLISSky::ComputeSolarSeries(const std::vector<double>& doys, double lat, double lon, double elevation, SolarSeries& series, bool withRadiation/*=true*/)
+{
+	//minimum number of timestamps per thread
+	static const size_t c_minChunkSize = 16384;
+
+	size_t count = doys.size();
+	try
+	{
+		series.altitude.resize(count);
+		series.azimuth.resize(count);
+		series.direct.resize(withRadiation ? count : 0);
+		series.diffuse.resize(withRadiation ? count : 0);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return false;
+	}
+	if (count == 0)
+		return true;
+
+	auto computeChunk = [&](size_t first, size_t last)
+	{
+		SolarComponents(doys.data() + first, last - first, lat, lon, lon, 0, elevation, 0, 0,
+						nullptr,
+						series.altitude.data() + first,
+						series.azimuth.data() + first,
+						withRadiation ? series.direct.data() + first : nullptr,
+						withRadiation ? series.diffuse.data() + first : nullptr);
+	};
+
+	size_t threadCount = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), (count + c_minChunkSize - 1) / c_minChunkSize);
+	if (threadCount <= 1)
+	{
+		computeChunk(0, count);
+		return true;
+	}
+
+	//SolarComponents only writes to its own range of the outputs
+	size_t chunkSize = (count + threadCount - 1) / threadCount;
+	std::vector<std::thread> threads;
+	try
+	{
+		for (size_t first = chunkSize; first < count; first += chunkSize)
+		{
+			threads.emplace_back(computeChunk, first, std::min(first + chunkSize, count));
+		}
+	}
+	catch (const std::system_error&)
+	{
+		//not enough resources: the remaining chunks are computed below
+	}
+	size_t threadedEnd = std::min(chunkSize * (threads.size() + 1), count);
+	computeChunk(0, chunkSize);
+	if (threadedEnd < count)
+		computeChunk(threadedEnd, count);
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	return true;
+}
+
+bool SOLISSky::SkyGrid(std::vector<CCVector3>& rays, std::vector<double>& solidAngles)
+{
+	try
+	{
+		rays.resize(SKY_GRID_BANDS * SKY_GRID_SECTORS);
+		solidAngles.assign(rays.size(), 2 * M_PI / rays.size());
+	}
+	catch (const std::bad_alloc&)
+	{
+		return false;
+	}
+
+	for (unsigned b = 0; b < SKY_GRID_BANDS; ++b)
+	{
+		double z = (b + 0.5) / SKY_GRID_BANDS;
+		double r = sqrt(1.0 - z * z);
+		for (unsigned s = 0; s < SKY_GRID_SECTORS; ++s)
+		{
+			double phi = 2 * M_PI * (s + 0.5) / SKY_GRID_SECTORS;
+			rays[b * SKY_GRID_SECTORS + s] = CCVector3(	static_cast<PointCoordinateType>(-r * cos(phi)),
+														static_cast<PointCoordinateType>(-r * sin(phi)),
+														static_cast<PointCoordinateType>(-z));
+		}
+	}
+
+	return true;
+}
+
+bool SOLISSky::ImportanceDirections(unsigned count, const std::vector<double>& density, std::vector<CCVector3>& rays, std::vector<size_t>& cells)
+{
+	static const double c_goldenRatio = (1.0 + sqrt(5.0)) / 2;
+
+	if (density.size() != SKY_GRID_BANDS * SKY_GRID_SECTORS)
+		return false;
+
+	//cumulative distributions (marginal over the bands, conditional over the sectors of each band)
+	std::vector<double> bandCdf;
+	std::vector<double> sectorCdf;
+	try
+	{
+		bandCdf.resize(SKY_GRID_BANDS + 1, 0);
+		sectorCdf.resize(SKY_GRID_BANDS * (SKY_GRID_SECTORS + 1), 0);
+		rays.resize(count);
+		cells.resize(count);
+	}
+	catch (const std::bad_alloc&)
+	{
+		return false;
+	}
+
+	for (unsigned b = 0; b < SKY_GRID_BANDS; ++b)
+	{
+		double* cdf = sectorCdf.data() + b * (SKY_GRID_SECTORS + 1);
+		for (unsigned s = 0; s < SKY_GRID_SECTORS; ++s)
+		{
+			cdf[s + 1] = cdf[s] + std::max(density[b * SKY_GRID_SECTORS + s], 0.0);
+		}
+		bandCdf[b + 1] = bandCdf[b] + cdf[SKY_GRID_SECTORS];
+	}
+
+	double total = bandCdf[SKY_GRID_BANDS];
+	if (total <= 0)
+		return false;
+
+	//inverse of a piecewise constant cumulative distribution: returns the cell and the position inside it
+	auto invert = [](const double* cdf, unsigned n, double u, double& t)
+	{
+		double value = u * cdf[n];
+		unsigned i = static_cast<unsigned>(std::upper_bound(cdf + 1, cdf + n + 1, value) - (cdf + 1));
+		i = std::min(i, n - 1);
+		while (i > 0 && cdf[i + 1] <= cdf[i]) //empty cells (only reached with u = 1)
+			--i;
+		double width = cdf[i + 1] - cdf[i];
+		t = (width > 0 ? std::min(std::max((value - cdf[i]) / width, 0.0), 1.0) : 0.5);
+		return i;
+	};
+
+	for (unsigned i = 0; i < count; ++i)
+	{
+		//spherical Fibonacci point set (mapped to the unit square)
+		double u1 = (i + 0.5) / count;
+		double u2 = fmod(i / c_goldenRatio, 1.0);
+
+		double tb = 0;
+		unsigned b = invert(bandCdf.data(), SKY_GRID_BANDS, u1, tb);
+		double ts = 0;
+		unsigned s = invert(sectorCdf.data() + b * (SKY_GRID_SECTORS + 1), SKY_GRID_SECTORS, u2, ts);
+
+		//uniform (in solid angle) position inside the cell
+		double z = (b + tb) / SKY_GRID_BANDS;
+		double r = sqrt(std::max(1.0 - z * z, 0.0));
+		double phi = 2 * M_PI * (s + ts) / SKY_GRID_SECTORS;
+		rays[i] = CCVector3(static_cast<PointCoordinateType>(-r * cos(phi)),
+							static_cast<PointCoordinateType>(-r * sin(phi)),
+							static_cast<PointCoordinateType>(-z));
+		cells[i] = b * SKY_GRID_SECTORS + s;
+	}
+
+	return true;
+}
+
+unsigned SOLISSky::HarmonicsCount(unsigned order)
+{
+	return (order + 1) * (order + 2) / 2;
+}
+
+void SOLISSky::HarmonicsBasis(const CCVector3& ray, unsigned order, double* values)
+{
+	assert(order <= HARMONICS_MAX_ORDER);
+	order = std::min(order, HARMONICS_MAX_ORDER);
+
+	//sky point (the opposite of the light direction)
+	double x = -static_cast<double>(ray.x);
+	double y = -static_cast<double>(ray.y);
+	double z = -static_cast<double>(ray.z);
+	double norm = sqrt(x * x + y * y + z * z);
+	double cosTheta = (norm > 0 ? z / norm : 1.0);
+	double sinTheta = sqrt(std::max(0.0, 1.0 - cosTheta * cosTheta));
+	double phi = atan2(y, x);
+
+	//associated Legendre polynomials P(l,m)(cos(theta)) (standard recurrences)
+	double legendre[HARMONICS_MAX_ORDER + 1][HARMONICS_MAX_ORDER + 1];
+	double pmm = 1.0;
+	for (unsigned m = 0; m <= order; ++m)
+	{
+		legendre[m][m] = pmm;
+		if (m < order)
+			legendre[m + 1][m] = cosTheta * (2 * m + 1) * pmm;
+		for (unsigned l = m + 2; l <= order; ++l)
+			legendre[l][m] = (cosTheta * (2 * l - 1) * legendre[l - 1][m] - (l + m - 1) * legendre[l - 2][m]) / (l - m);
+		pmm *= -static_cast<double>(2 * m + 1) * sinTheta;
+	}
+
+	size_t k = 0;
+	for (unsigned l = 0; l <= order; ++l)
+	{
+		//m from -l to l, with l + m even
+		for (int m = -static_cast<int>(l); m <= static_cast<int>(l); m += 2)
+		{
+			unsigned am = static_cast<unsigned>(std::abs(m));
+			//normalization: sqrt((2l + 1) / 4pi * (l - |m|)! / (l + |m|)!)
+			double factorialRatio = 1.0;
+			for (unsigned f = l - am + 1; f <= l + am; ++f)
+				factorialRatio /= f;
+			double scale = sqrt((2 * l + 1) / (4 * M_PI) * factorialRatio);
+
+			if (m == 0)
+				values[k++] = scale * legendre[l][0];
+			else if (m > 0)
+				values[k++] = sqrt(2.0) * scale * cos(m * phi) * legendre[l][am];
+			else
+				values[k++] = sqrt(2.0) * scale * sin(am * phi) * legendre[l][am];
+		}
+	}
+}
+
+bool SOLISSky::LightingHarmonics(const std::vector<CCVector3>& rays, const std::vector<double>& weights, unsigned order, std::vector<double>& coefficients)
+{
+	if (order > HARMONICS_MAX_ORDER || rays.size() != weights.size())
+		return false;
+
+	unsigned count = HarmonicsCount(order);
+	std::vector<double> basis;
+	try
+	{
+		coefficients.assign(count, 0);
+		basis.resize(count);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return false;
+	}
+
+	for (size_t i = 0; i < rays.size(); ++i)
+	{
+		if (weights[i] == 0)
+			continue;
+		HarmonicsBasis(rays[i], order, basis.data());
+		for (unsigned k = 0; k < count; ++k)
+			coefficients[k] += weights[i] * basis[k];
+	}
+
+	return true;
+}
+
+SOLISSky::SkyType SOLISSky::GeneralSkyType(unsigned type)
+{
+	//CIE standard general sky (ISO 15469): gradation (a, b) and indicatrix (c, d, e) parameters
+	static const SkyType c_types[15] = {
+		{  4.0, -0.70,  0.0, -1.0, 0.00 },	//1: overcast, steep gradation, azimuthal uniformity
+		{  4.0, -0.70,  2.0, -1.5, 0.15 },	//2
+		{  1.1, -0.80,  0.0, -1.0, 0.00 },	//3
+		{  1.1, -0.80,  2.0, -1.5, 0.15 },	//4
+		{  0.0, -1.00,  0.0, -1.0, 0.00 },	//5: uniform sky
+		{  0.0, -1.00,  2.0, -1.5, 0.15 },	//6
+		{  0.0, -1.00,  5.0, -2.5, 0.30 },	//7
+		{  0.0, -1.00, 10.0, -3.0, 0.45 },	//8
+		{ -1.0, -0.55,  2.0, -1.5, 0.15 },	//9
+		{ -1.0, -0.55,  5.0, -2.5, 0.30 },	//10
+		{ -1.0, -0.55, 10.0, -3.0, 0.45 },	//11
+		{ -1.0, -0.32, 10.0, -3.0, 0.45 },	//12: CIE standard clear sky
+		{ -1.0, -0.32, 16.0, -3.0, 0.30 },	//13: clear, polluted atmosphere
+		{ -1.0, -0.15, 16.0, -3.0, 0.30 },	//14
+		{ -1.0, -0.15, 24.0, -2.8, 0.15 }	//15
+	};
+
+	return c_types[std::min(std::max(type, 1u), 15u) - 1];
+}
+
+unsigned SOLISSky::SkyTypeFromClearness(double directNormal, double diffuseHorizontal, double sunAltitude)
+{
+	//Perez sky clearness bins
+	static const double c_clearnessBins[7] = { 1.065, 1.23, 1.5, 1.95, 2.8, 4.5, 6.2 };
+	static const unsigned c_binTypes[8] = { 1, 3, 6, 7, 10, 11, 12, 13 };
+
+	if (diffuseHorizontal <= 0)
+		return 12;
+
+	double z = (90.0 - sunAltitude) * (M_PI / 180.0);
+	double kz3 = 1.041 * z * z * z;
+	double clearness = ((diffuseHorizontal + std::max(directNormal, 0.0)) / diffuseHorizontal + kz3) / (1.0 + kz3);
+
+	unsigned bin = 0;
+	while (bin < 7 && clearness >= c_clearnessBins[bin])
+		++bin;
+	return c_binTypes[bin];
+}
+
+double SOLISSky::RelativeRadiance(const SkyType& sky, double zenith, double sunZenith, double sunAngle)
+{
+	//gradation
+	double cosZenith = cos(zenith);
+	double gradation = 1.0 + (cosZenith > 1.0e-6 ? sky.a * exp(sky.b / cosZenith) : 0.0);
+	//scattering indicatrix
+	double cosAngle = cos(sunAngle);
+	double indicatrix = 1.0 + sky.c * (exp(sky.d * sunAngle) - exp(sky.d * M_PI / 2)) + sky.e * cosAngle * cosAngle;
+
+	//relative to the zenith
+	double cosSunZenith = cos(sunZenith);
+	double zenithIndicatrix = 1.0 + sky.c * (exp(sky.d * sunZenith) - exp(sky.d * M_PI / 2)) + sky.e * cosSunZenith * cosSunZenith;
+	double zenithGradation = 1.0 + sky.a * exp(sky.b);
+
+	double denominator = zenithIndicatrix * zenithGradation;
+	return (denominator > 0 ? std::max(0.0, indicatrix * gradation / denominator) : 1.0);
+}
+
+void SOLISSky::AddSkyRadiance(	const std::vector<CCVector3>& skyRays,
+								const std::vector<double>& solidAngles,
+								double sunAltitude,
+								double sunAzimuth,
+								double directNormal,
+								double diffuseHorizontal,
+								double energy,
+								std::vector<double>& weights)
+{
+	if (energy == 0 || skyRays.empty())
+		return;
+
+	SkyType sky = GeneralSkyType(SkyTypeFromClearness(directNormal, diffuseHorizontal, sunAltitude));
+
+	//light directions point from the sky to the scene: the sky positions are their opposite
+	CCVector3 sunRay = Direction(sunAltitude, sunAzimuth);
+	double sunZenith = (90.0 - sunAltitude) * (M_PI / 180.0);
+
+	//radiance of each patch (stored in 'weights' increments after normalization)
+	double sum = 0;
+	std::vector<double> radiance(skyRays.size());
+	for (size_t p = 0; p < skyRays.size(); ++p)
+	{
+		const CCVector3& ray = skyRays[p];
+		double zenith = acos(std::max(-1.0, std::min(1.0, -static_cast<double>(ray.z))));
+		double cosAngle = static_cast<double>(ray.x) * sunRay.x + static_cast<double>(ray.y) * sunRay.y + static_cast<double>(ray.z) * sunRay.z;
+		double sunAngle = acos(std::max(-1.0, std::min(1.0, cosAngle)));
+		radiance[p] = RelativeRadiance(sky, zenith, sunZenith, sunAngle) * solidAngles[p];
+		sum += radiance[p];
+	}
+
+	if (sum <= 0)
+		return;
+
+	//the sky distribution is normalized so that the whole (unobstructed) sky receives 'energy' as in the isotropic case
+	double scale = energy / sum;
+	for (size_t p = 0; p < skyRays.size(); ++p)
+	{
+		weights[p] += radiance[p] * scale;
+	}
+}
+
+bool SOLISSky::TregenzaPatches(std::vector<CCVector3>& rays, std::vector<double>& solidAngles)
+{
+	return SkyDirections(SKY_TREGENZA, 145, rays, solidAngles);
+}
+
+unsigned SOLISSky::SkyResolution(Discretization scheme, unsigned count)
+{
+	unsigned resolution = 1;
+	switch (scheme)
+	{
+	case SKY_PARTSPHERE:
+		resolution = std::max(count, 1u);
+		break;
+	case SKY_REINHART:
+		//144 * mf^2 + 1 directions
+		while (144 * resolution * resolution + 1 < count)
+			++resolution;
+		break;
+	case SKY_HEALPIX:
+		//6 * nside^2 + 2 * nside directions
+		while (6 * resolution * resolution + 2 * resolution < count)
+			++resolution;
+		break;
+	case SKY_TREGENZA:
+	default:
+		break;
+	}
+	return resolution;
+}
+
+bool SOLISSky::SkyDirections(Discretization scheme, unsigned count, std::vector<CCVector3>& rays, std::vector<double>& solidAngles)
+{
+	return CachedSkySet(static_cast<int>(scheme), SkyResolution(scheme, count), rays, solidAngles);
+}
+
+bool SOLISSky::PartsphereDirections(unsigned count, std::vector<CCVector3>& rays)
+{
+	std::vector<double> solidAngles;
+	return CachedSkySet(c_partsphereCentersKey, std::max(count, 1u), rays, solidAngles);
+}
+
+bool SOLISSky::WeatherSkyMatrix(	const std::vector< std::vector<SOLISWeather::Record> >& series,
+									double doyFrom,
+									double doyTo,
+									double lat,
+									double lon,
+									std::vector<CCVector3>& sunRays,
+									std::vector< std::vector<double> >& sunWeights,
+									std::vector<CCVector3>& skyRays,
+									std::vector< std::vector<double> >& skyWeights,
+									Discretization skyScheme/*=SKY_TREGENZA*/,
+									unsigned skyCount/*=145*/,
+									bool anisotropic/*=false*/)
+{
+	sunRays.clear();
+	sunWeights.clear();
+	skyWeights.clear();
+
+	std::vector<double> solidAngles;
+	if (!SkyDirections(skyScheme, skyCount, skyRays, solidAngles))
+		return false;
+
+	try
+	{
+		sunWeights.resize(series.size());
+		skyWeights.resize(series.size(), std::vector<double>(skyRays.size(), 0));
+
+		//sun rays are shared by all series (timestamps rounded to the minute)
+		std::map<int64_t, size_t> sunRayIndexes;
+
+		for (size_t k = 0; k < series.size(); ++k)
+		{
+			//diffuse energy distributed over an isotropic sky
+			double diffuseEnergy = 0;
+			//records depending on the sun position (their sun positions are computed at once)
+			std::vector<const SOLISWeather::Record*> sunRecords;
+			std::vector<double> doys;
+			for (const SOLISWeather::Record& record : series[k])
+			{
+				if (record.doy < doyFrom || record.doy >= doyTo)
+					continue;
+
+				if (record.directNormal > 0 || (anisotropic && record.diffuseHorizontal > 0))
+				{
+					sunRecords.push_back(&record);
+					doys.push_back(record.doy);
+				}
+				else
+				{
+					diffuseEnergy += record.diffuseHorizontal * record.duration;
+				}
+			}
+
+			SolarSeries sun;
+			if (!ComputeSolarSeries(doys, lat, lon, 0, sun, false))
+				return false;
+
+			for (size_t r = 0; r < sunRecords.size(); ++r)
+			{
+				const SOLISWeather::Record& record = *sunRecords[r];
+				double alt = sun.altitude[r];
+
+				if (anisotropic && alt > 0)
+				{
+					AddSkyRadiance(skyRays, solidAngles, alt, sun.azimuth[r], record.directNormal, record.diffuseHorizontal, record.diffuseHorizontal * record.duration, skyWeights[k]);
+				}
+				else
+				{
+					diffuseEnergy += record.diffuseHorizontal * record.duration;
+				}
+
+				if (record.directNormal <= 0 || alt <= 0)
+					continue;
+
+				int64_t key = static_cast<int64_t>(floor(record.doy * 24 * 60 + 0.5));
+				auto it = sunRayIndexes.find(key);
+				size_t rayIndex = 0;
+				if (it == sunRayIndexes.end())
+				{
+					rayIndex = sunRays.size();
+					sunRayIndexes[key] = rayIndex;
+					sunRays.push_back(Direction(alt, sun.azimuth[r]));
+					for (std::vector<double>& weights : sunWeights)
+						weights.push_back(0);
+				}
+				else
+				{
+					rayIndex = it->second;
+				}
+
+				//direct irradiance on the horizontal plane
+				sunWeights[k][rayIndex] += record.directNormal * sin(alt * (M_PI / 180.0)) * record.duration;
+			}
+
+			//isotropic sky
+			for (size_t p = 0; p < skyRays.size(); ++p)
+			{
+				skyWeights[k][p] += diffuseEnergy * solidAngles[p] / (2 * M_PI);
+			}
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return false;
+	}
+
+	return true;
+}
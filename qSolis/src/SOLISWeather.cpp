@@ -0,0 +1,266 @@
+//##########################################################################
+//#                                                                        #
+//#                       CLOUDCOMPARE PLUGIN: qSOLIS                      #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                  COPYRIGHT: David Basler                               #
+//#                                                                        #
+//##########################################################################
+
+#include "SOLISWeather.h"
+
+//System
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+//! Maximum number of fields read per line
+static const int c_maxFields = 20;
+//! Read buffer size
+static const size_t c_bufferSize = (1 << 20);
+
+//EPW columns (0-based)
+static const int EPW_MONTH = 1;
+static const int EPW_DAY = 2;
+static const int EPW_HOUR = 3;
+static const int EPW_DNI = 14;
+static const int EPW_DHI = 15;
+static const double EPW_MISSING = 9999.0;
+
+//! Splits a line in place and parses the numerical fields
+/** \return number of fields (non numerical fields are set to NaN)
+**/
+static int ParseFields(char* line, char separator, double* values, char** fields)
+{
+	int count = 0;
+	char* current = line;
+	while (count < c_maxFields)
+	{
+		//skip leading spaces
+		while (*current == ' ' || *current == '\t')
+			++current;
+
+		char* end = current;
+		if (separator == ' ')
+		{
+			while (*end != '\0' && *end != ' ' && *end != '\t' && *end != ',' && *end != ';')
+				++end;
+		}
+		else
+		{
+			while (*end != '\0' && *end != separator)
+				++end;
+		}
+		bool last = (*end == '\0');
+		*end = '\0';
+
+		fields[count] = current;
+		char* numberEnd = nullptr;
+		values[count] = strtod(current, &numberEnd);
+		if (numberEnd == current)
+			values[count] = NAN;
+		++count;
+
+		if (last)
+			break;
+		current = end + 1;
+	}
+	return count;
+}
+
+static const int s_daysBeforeMonth[13] = { 0, 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 };
+
+bool SOLISWeather::Load(const QString& filename, std::vector<Record>& records, Location* location/*=nullptr*/, QString* error/*=nullptr*/)
+{
+	records.clear();
+
+	bool isEPW = filename.toUpper().endsWith(".EPW");
+
+	FILE* fp = fopen(qPrintable(filename), "rb");
+	if (!fp)
+	{
+		if (error)
+			*error = QString("Failed to open weather file '%1'").arg(filename);
+		return false;
+	}
+
+	Location site;
+	double values[c_maxFields];
+	char* fields[c_maxFields];
+
+	std::vector<char> buffer;
+	try
+	{
+		buffer.resize(c_bufferSize + 1);
+		records.reserve(isEPW ? 8784 : 1024);
+	}
+	catch (const std::bad_alloc&)
+	{
+		fclose(fp);
+		if (error)
+			*error = "Not enough memory";
+		return false;
+	}
+
+	//streaming pass: lines are processed as soon as they are complete
+	size_t pending = 0;
+	bool eof = false;
+	bool success = true;
+	while (success && !eof)
+	{
+		size_t read = fread(buffer.data() + pending, 1, c_bufferSize - pending, fp);
+		eof = (read < c_bufferSize - pending);
+		size_t available = pending + read;
+		if (eof && available != 0 && buffer[available - 1] != '\n')
+		{
+			//terminate the last line
+			buffer[available++] = '\n';
+		}
+
+		char* lineStart = buffer.data();
+		char* bufferEnd = buffer.data() + available;
+		while (true)
+		{
+			char* lineEnd = static_cast<char*>(memchr(lineStart, '\n', bufferEnd - lineStart));
+			if (!lineEnd)
+				break;
+			*lineEnd = '\0';
+			if (lineEnd != lineStart && lineEnd[-1] == '\r')
+				lineEnd[-1] = '\0';
+
+			char* line = lineStart;
+			lineStart = lineEnd + 1;
+
+			if (isEPW)
+			{
+				if (strncmp(line, "LOCATION", 8) == 0)
+				{
+					int n = ParseFields(line, ',', values, fields);
+					if (n >= 10)
+					{
+						site.valid = true;
+						site.latitude = values[6];
+						site.longitude = values[7];
+						site.timeZone = values[8];
+						site.elevation = values[9];
+					}
+					continue;
+				}
+
+				//data lines start with the year
+				if (*line < '0' || *line > '9')
+					continue;
+
+				int n = ParseFields(line, ',', values, fields);
+				if (n <= EPW_DHI)
+					continue;
+
+				int month = static_cast<int>(values[EPW_MONTH]);
+				if (month < 1 || month > 12)
+					continue;
+
+				Record record;
+				//hour 'h' covers [h-1, h] in local standard time
+				record.doy = s_daysBeforeMonth[month] + values[EPW_DAY] + (values[EPW_HOUR] - 0.5) / 24.0;
+				record.duration = 1.0;
+				record.directNormal = (values[EPW_DNI] >= EPW_MISSING ? 0 : std::max(values[EPW_DNI], 0.0));
+				record.diffuseHorizontal = (values[EPW_DHI] >= EPW_MISSING ? 0 : std::max(values[EPW_DHI], 0.0));
+				records.push_back(record);
+			}
+			else
+			{
+				while (*line == ' ' || *line == '\t')
+					++line;
+				//header or comment lines
+				if ((*line < '0' || *line > '9') && *line != '.' && *line != '-' && *line != '+')
+					continue;
+
+				char separator = ' ';
+				if (strchr(line, ','))
+					separator = ',';
+				else if (strchr(line, ';'))
+					separator = ';';
+				else if (strchr(line, '\t'))
+					separator = '\t';
+
+				int n = ParseFields(line, separator, values, fields);
+				if (n < 3 || std::isnan(values[0]) || std::isnan(values[1]) || std::isnan(values[2]))
+				{
+					if (error)
+						*error = QString("Invalid line in weather file '%1' (record #%2)").arg(filename).arg(records.size() + 1);
+					success = false;
+					break;
+				}
+
+				Record record;
+				record.doy = values[0];
+				record.duration = 0; //see below
+				record.directNormal = std::max(values[1], 0.0);
+				record.diffuseHorizontal = std::max(values[2], 0.0);
+				records.push_back(record);
+			}
+		}
+
+		//move the incomplete line to the beginning of the buffer
+		pending = static_cast<size_t>(bufferEnd - lineStart);
+		if (pending == c_bufferSize)
+		{
+			if (error)
+				*error = QString("Line too long in weather file '%1'").arg(filename);
+			success = false;
+			break;
+		}
+		memmove(buffer.data(), lineStart, pending);
+	}
+
+	fclose(fp);
+
+	if (!success)
+	{
+		records.clear();
+		return false;
+	}
+	if (records.empty())
+	{
+		if (error)
+			*error = QString("No irradiance record in weather file '%1'").arg(filename);
+		return false;
+	}
+
+	if (isEPW && site.valid)
+	{
+		//local standard time --> local (mean) solar time
+		double shift = (site.longitude - 15.0 * site.timeZone) / 360.0;
+		for (Record& record : records)
+			record.doy += shift;
+	}
+
+	std::sort(records.begin(), records.end(), [](const Record& a, const Record& b) { return a.doy < b.doy; });
+
+	if (!isEPW)
+	{
+		//each CSV record extends to the next one
+		for (size_t i = 0; i < records.size(); ++i)
+		{
+			if (i + 1 < records.size())
+				records[i].duration = (records[i + 1].doy - records[i].doy) * 24.0;
+			else
+				records[i].duration = (i != 0 ? records[i - 1].duration : 1.0);
+		}
+	}
+
+	if (location)
+		*location = site;
+
+	return true;
+}
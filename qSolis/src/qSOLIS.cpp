@@ -270,4 +270,5 @@ void qSOLIS::doAction()
 void qSOLIS::registerCommands(ccCommandLineInterface* cmd)
 {
 	cmd->registerCommand(ccCommandLineInterface::Command::Shared(new SOLISCommand));
+	cmd->registerCommand(ccCommandLineInterface::Command::Shared(new SOLISMergeCommand));
 }
\ No newline at end of file
@@ -0,0 +1,450 @@
+//##########################################################################
+//#                                                                        #
+//#                       CLOUDCOMPARE PLUGIN: qSOLIS                      #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                  COPYRIGHT: David Basler                               #
+//#                                                                        #
+//##########################################################################
+
+// HEADLESS COMMAND LINE TOOL (solis_core only, without CloudCompare)
+
+#include "SOLIS.h"
+#include "SOLISCache.h"
+#include "SOLISFile.h"
+#include "SOLISRun.h"
+#include "SOLISShard.h"
+
+//CCCoreLib
+#include <GenericProgressCallback.h>
+
+//Qt
+#include <QApplication>
+#include <QStringList>
+
+//System
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+//! Options of the tool only (see SOLISSettings for the options shared with the SOLIS command)
+constexpr char SOLIS_OPTION_INPUT[] = "I";
+constexpr char SOLIS_OPTION_OUTPUT[] = "O";
+constexpr char SOLIS_OPTION_STREAM[] = "STREAM";
+constexpr char SOLIS_OPTION_MERGE[] = "MERGE";
+
+//! Prints the progress of a SOLIS computation on the standard error (every 10%)
+class ConsoleProgress : public CCCoreLib::GenericProgressCallback
+{
+public:
+	void update(float percent) override
+	{
+		int step = static_cast<int>(percent) / 10;
+		if (step > m_lastStep)
+		{
+			m_lastStep = step;
+			fprintf(stderr, "[SOLIS] %s%d%%\n", m_info.c_str(), step * 10);
+		}
+	}
+	void setMethodTitle(const char* /*methodTitle*/) override {}
+	void setInfo(const char* infoStr) override
+	{
+		//first line only (entity name or ray count)
+		m_info = infoStr;
+		m_info = m_info.substr(0, m_info.find('\n')) + ": ";
+	}
+	void start() override { m_lastStep = 0; }
+	void stop() override {}
+	bool isCancelRequested() override { return false; }
+
+private:
+	int m_lastStep = 0;
+	std::string m_info;
+};
+
+static void PrintUsage()
+{
+	printf(	"Usage: solis -I <input> -O <output> [options]\n"
+			"  -I <file>              input cloud or mesh (*.ply, *.xyz/*.txt/*.asc/*.csv/*.pts, *.bin)\n"
+			"  -O <file>              output file with the irradiance fields (same formats)\n"
+			"  -STREAM <value>        out-of-core processing by chunks of <value> points (2.5D sweep engine, faces are ignored)\n"
+			"  -MERGE <dir>           sums the partial results of all the shards found in <dir> and saves the fields to -O\n"
+			"Same options as the -SOLIS command of CloudCompare (see README):\n"
+			"  -TYPE <type>           DIRECT, DIFFUSE or ALL (default)\n"
+			"  -LAT <value>           latitude (degree N, default 45)\n"
+			"  -LON <value>           longitude (degree E, default 0)\n"
+			"  -ELV <value>           elevation (m, default 0)\n"
+			"  -DOY <value>           day of year (with fractional time, default 172)\n"
+			"  -INT <value>           integration time (hours, default 24, -1 for a single timepoint)\n"
+			"  -TS <value>            timestep of the sun positions (minutes, default 1)\n"
+			"  -NRAYS <value>         number of diffuse directions (default 256)\n"
+			"  -SKY <value>           PARTSPHERE (default), TREGENZA, REINHART or HEALPIX\n"
+			"  -SKY_MODEL <value>     ISOTROPIC (default) or PEREZ\n"
+			"  -DIFFUSE_SAMPLING <value> UNIFORM (default), COSINE or SKY\n"
+			"  -IS_CLOSED             the mesh is watertight\n"
+			"  -RESOLUTION <value>    OpenGL context resolution (default 1024)\n"
+			"  -PRECISION <value>     COMPACT (default), FAST or DOUBLE\n"
+			"  -SUN_BINNING <value>   merges the sun directions closer than <value> degrees\n"
+			"  -WEATHER <file>        measured irradiance (*.epw or doy,dni,dhi CSV), can be repeated\n"
+			"  -ADAPTIVE <value>      adaptive sun path sampling with a coarse step of <value> minutes\n"
+			"  -ADAPTIVE_THRESHOLD <value> fraction of the points changing visibility to refine (default 0.001)\n"
+			"  -PERIODS <value>       NONE (default), MONTH or HOUR: one additional field per period\n"
+			"  -SUN_METRICS           sun hours, first and last sun and peak irradiance fields\n"
+			"  -TILE_SIZE <value>     tiles of the scene with their own sun position\n"
+			"  -SVF_CACHE <dir>       cached sky-view factor (isotropic sky)\n"
+			"  -VIS_MATRIX <dir>      cached visibility matrix\n"
+			"  -SH_VISIBILITY <dir>   cached spherical harmonics visibility\n"
+			"  -SH_ORDER <value>      order of the spherical harmonics (default 6)\n"
+			"  -SUN_CACHE <dir>       cached visibility per sun direction bin\n"
+			"  -RESUME <dir>          checkpoints of the rendering loop\n"
+			"  -CHECKPOINT_INTERVAL <value> minimum time between two checkpoints (minutes, default 10)\n"
+			"  -HORIZON_DEM <file>    far-field terrain (ESRI ASCII grid)\n"
+			"  -HORIZON_TILE <value>  size of the far-field horizon tiles (default 200)\n"
+			"  -HEIGHTFIELD <value>   2.5D sweep engine with the given cell size (0 = automatic) instead of OpenGL\n"
+			"  -HEIGHTFIELD_TILE <value> splits the -HEIGHTFIELD grid in tiles processed in parallel (0 = automatic size)\n"
+			"  -SHARD <i/N> <dir>     renders the i-th slice of N of the rays and saves the partial results in <dir> (no -O)\n"
+			"Qt options (e.g. '-platform offscreen' on nodes without display) are also accepted.\n");
+}
+
+//! Sums the partial results of all the shards of a geometry and saves the merged fields
+static int MergeShards(const QString& inputFile, const QString& outputFile, const QString& directory)
+{
+	QString errorStr;
+	SOLISFile::Geometry geometry;
+	if (!SOLISFile::Load(inputFile, geometry, &errorStr))
+	{
+		fprintf(stderr, "%s\n", qPrintable(errorStr));
+		return 1;
+	}
+	unsigned pointCount = geometry.cloud->size();
+
+	std::vector<SOLISShard> runs;
+	if (!SOLISShard::MergeAll(directory, SOLISCache::GeometryKey(geometry.cloud.get(), geometry.mesh.get(), false, 0), pointCount, runs, &errorStr))
+	{
+		fprintf(stderr, "%s\n", qPrintable(errorStr));
+		return 1;
+	}
+
+	//same field order as a single run (direct, then diffuse)
+	std::vector< std::pair<const SOLISShard*, size_t> > outputs;
+	for (const SOLISShard& run : runs)
+	{
+		for (size_t k = 0; k < run.outputCount(); ++k)
+			outputs.emplace_back(&run, k);
+	}
+	std::stable_sort(outputs.begin(), outputs.end(), [](const std::pair<const SOLISShard*, size_t>& a, const std::pair<const SOLISShard*, size_t>& b)
+	{
+		return (a.first->fieldNames()[static_cast<int>(a.second)] == SOLIS_FIELD_LABEL_NAME_DIRECT && b.first->fieldNames()[static_cast<int>(b.second)] != SOLIS_FIELD_LABEL_NAME_DIRECT);
+	});
+
+	std::vector<CCCoreLib::ScalarField*> fields;
+	bool allocated = true;
+	for (const std::pair<const SOLISShard*, size_t>& output : outputs)
+	{
+		fields.push_back(new CCCoreLib::ScalarField(qPrintable(output.first->fieldNames()[static_cast<int>(output.second)])));
+		fields.back()->link();
+		allocated = allocated && fields.back()->resizeSafe(pointCount);
+		if (allocated)
+			output.first->convert(output.second, *fields.back());
+	}
+
+	bool success = allocated && SOLISFile::Save(outputFile, geometry, fields, &errorStr);
+	if (success)
+		printf("[SOLIS] Merged %zu runs of %u shards, saved '%s'\n", runs.size(), runs.front().count(), qPrintable(outputFile));
+	else
+		fprintf(stderr, "%s\n", errorStr.isEmpty() ? "Not enough memory" : qPrintable(errorStr));
+
+	for (CCCoreLib::ScalarField* field : fields)
+		field->release();
+	return success ? 0 : 1;
+}
+
+//! Prints the messages of a SOLIS run (see SOLISRun)
+static void PrintMessages(const QStringList& messages)
+{
+	for (const QString& message : messages)
+		printf("[SOLIS] %s\n", qPrintable(message));
+}
+
+//! Generates the light directions and the outputs of a component
+static bool GenerateComponent(SOLISRun& run, bool direct, SOLISRun::Component& component)
+{
+	printf("[SOLIS] %s\n", qPrintable(run.description(direct)));
+
+	QStringList messages;
+	QString errorStr;
+	bool success = run.component(direct, component, messages, &errorStr);
+	PrintMessages(messages);
+	if (!success)
+		fprintf(stderr, "%s\n", qPrintable(errorStr));
+	return success;
+}
+
+int main(int argc, char** argv)
+{
+	//the OpenGL renders need a (possibly offscreen) GUI application
+	QApplication app(argc, argv);
+
+	QStringList arguments = QApplication::arguments();
+	arguments.removeFirst();
+	if (arguments.empty())
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	//same options as the SOLIS command (see SOLISSettings), plus the files of the tool
+	SOLISSettings settings;
+	QString inputFile;
+	QString outputFile;
+	double streamChunkSize = 0; //in-core by default
+	QString mergeDirectory;
+	QString errorStr;
+
+	while (!arguments.empty())
+	{
+		QString option = arguments.front();
+		bool valid = true;
+
+		if (SOLISSettings::IsOption(option, SOLIS_OPTION_INPUT))
+		{
+			arguments.removeFirst();
+			valid = SOLISSettings::TakeValue(arguments, SOLIS_OPTION_INPUT, inputFile, &errorStr, "filename");
+		}
+		else if (SOLISSettings::IsOption(option, SOLIS_OPTION_OUTPUT))
+		{
+			arguments.removeFirst();
+			valid = SOLISSettings::TakeValue(arguments, SOLIS_OPTION_OUTPUT, outputFile, &errorStr, "filename");
+		}
+		else if (SOLISSettings::IsOption(option, SOLIS_OPTION_STREAM))
+		{
+			arguments.removeFirst();
+			valid = SOLISSettings::TakeNumber(arguments, SOLIS_OPTION_STREAM, streamChunkSize, &errorStr, 1);
+		}
+		else if (SOLISSettings::IsOption(option, SOLIS_OPTION_MERGE))
+		{
+			arguments.removeFirst();
+			valid = SOLISSettings::TakeValue(arguments, SOLIS_OPTION_MERGE, mergeDirectory, &errorStr, "directory");
+		}
+		else if (SOLISSettings::IsOption(option, "H") || SOLISSettings::IsOption(option, "HELP"))
+		{
+			PrintUsage();
+			return 0;
+		}
+		else
+		{
+			bool recognized = false;
+			valid = settings.parse(arguments, recognized, &errorStr);
+			if (valid && !recognized)
+			{
+				fprintf(stderr, "Unknown option \"%s\"\n", qPrintable(option));
+				return 1;
+			}
+		}
+
+		if (!valid)
+		{
+			fprintf(stderr, "%s\n", qPrintable(errorStr));
+			return 1;
+		}
+	}
+
+	if (inputFile.isEmpty() || (outputFile.isEmpty() && settings.shardDirectory.isEmpty()))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	if (!mergeDirectory.isEmpty())
+	{
+		//nothing is rendered
+		return MergeShards(inputFile, outputFile, mergeDirectory);
+	}
+
+	if (settings.incremental)
+	{
+		//the input files don't hold the previous results
+		printf("[SOLIS] Incremental updates are not available in the headless tool (ignored)\n");
+		settings.incremental = false;
+	}
+	if (!settings.shardDirectory.isEmpty() && streamChunkSize >= 1)
+	{
+		//the shards only hold the raw sums of the OpenGL renders
+		printf("[SOLIS] Out-of-core processing is not available with -SHARD (ignored)\n");
+		streamChunkSize = 0;
+	}
+	if (streamChunkSize >= 1)
+	{
+		//the receivers are read only once, chunk by chunk
+		if (settings.adaptiveStep > 0 || settings.tileSize > 0 || settings.sunMetrics || settings.cachedVisibility() || !settings.skyViewCache.isEmpty() || !settings.sunCache.isEmpty() || !settings.checkpointDirectory.isEmpty() || !settings.horizonFile.isEmpty())
+		{
+			printf("[SOLIS] Adaptive sampling, tiled sun positions, sun metrics, caches, checkpoints and the far-field horizon are not available with -STREAM (ignored)\n");
+			settings.adaptiveStep = 0;
+			settings.tileSize = 0;
+			settings.sunMetrics = false;
+			settings.visibilityMatrixCache.clear();
+			settings.harmonicsCache.clear();
+			settings.skyViewCache.clear();
+			settings.sunCache.clear();
+			settings.checkpointDirectory.clear();
+			settings.horizonFile.clear();
+		}
+		if (settings.heightfieldCellSize < 0)
+		{
+			printf("[SOLIS] Out-of-core processing uses the 2.5D sweep engine (automatic cell size)\n");
+			settings.heightfieldCellSize = 0;
+		}
+		if (settings.heightfieldTileSize >= 0)
+		{
+			printf("[SOLIS] -HEIGHTFIELD_TILE is only used by the in-core 2.5D sweep engine (ignored)\n");
+			settings.heightfieldTileSize = -1;
+		}
+	}
+
+	QStringList messages;
+	settings.resolve(messages);
+	PrintMessages(messages);
+
+	SOLISRun run(settings);
+	messages.clear();
+	bool success = run.prepare(messages, &errorStr);
+	PrintMessages(messages);
+	if (!success)
+	{
+		fprintf(stderr, "%s\n", qPrintable(errorStr));
+		return 1;
+	}
+
+	//direct component first (same field order as the SOLIS command)
+	std::vector<bool> componentTypes;
+	if (settings.direct())
+		componentTypes.push_back(true);
+	if (settings.diffuse())
+		componentTypes.push_back(false);
+
+	ConsoleProgress progress;
+	if (streamChunkSize >= 1)
+	{
+		//all the outputs are computed in a single pass over the receivers (with a zero weight for the rays of the other components)
+		std::vector<CCVector3> rays;
+		std::vector< std::vector<double> > weights;
+		std::vector<QString> fieldNames;
+		for (bool direct : componentTypes)
+		{
+			SOLISRun::Component component;
+			if (!GenerateComponent(run, direct, component))
+				return 1;
+
+			size_t offset = rays.size();
+			rays.insert(rays.end(), component.rays.begin(), component.rays.end());
+			for (std::vector<double>& w : weights)
+				w.resize(rays.size(), 0);
+			for (size_t k = 0; k < component.weights.size(); ++k)
+			{
+				weights.emplace_back(offset, 0);
+				weights.back().insert(weights.back().end(), component.weights[k].begin(), component.weights[k].end());
+				fieldNames.push_back(component.fieldNames[static_cast<int>(k)]);
+			}
+		}
+
+		if (!SOLIS::LaunchStreamed(	rays,
+									weights,
+									run.conversion(),
+									settings.heightfieldCellSize,
+									inputFile,
+									outputFile,
+									fieldNames,
+									static_cast<size_t>(streamChunkSize),
+									&progress,
+									settings.precision,
+									&errorStr))
+		{
+			fprintf(stderr, "%s\n", errorStr.isEmpty() ? "Process failed" : qPrintable(errorStr));
+			return 1;
+		}
+		printf("[SOLIS] Saved '%s'\n", qPrintable(outputFile));
+		return 0;
+	}
+
+	SOLISFile::Geometry geometry;
+	if (!SOLISFile::Load(inputFile, geometry, &errorStr))
+	{
+		fprintf(stderr, "%s\n", qPrintable(errorStr));
+		return 1;
+	}
+	unsigned pointCount = geometry.cloud->size();
+	printf("[SOLIS] %s: %u points, %u triangles\n", qPrintable(inputFile), pointCount, geometry.mesh ? geometry.mesh->size() : 0);
+
+	//global = local + shift (while CloudCompare entities store global = local - shift)
+	CCVector3d globalShift(-geometry.shift.x, -geometry.shift.y, -geometry.shift.z);
+
+	//output fields (none for a shard: the partial results are saved in files, see -MERGE)
+	std::vector<CCCoreLib::ScalarField*> fields;
+	auto releaseFields = [&fields]()
+	{
+		for (CCCoreLib::ScalarField* field : fields)
+			field->release();
+	};
+
+	for (bool direct : componentTypes)
+	{
+		SOLISRun::Component component;
+		if (!GenerateComponent(run, direct, component))
+		{
+			releaseFields();
+			return 1;
+		}
+
+		std::vector<CCCoreLib::ScalarField*> outputs;
+		bool allocated = true;
+		for (const QString& name : run.outputNames(component))
+		{
+			fields.push_back(new CCCoreLib::ScalarField(qPrintable(name)));
+			fields.back()->link();
+			outputs.push_back(fields.back());
+			allocated = allocated && fields.back()->resizeSafe(pointCount);
+		}
+		if (!allocated)
+		{
+			fprintf(stderr, "Not enough memory\n");
+			releaseFields();
+			return 1;
+		}
+
+		QStringList warnings;
+		errorStr.clear();
+		success = run.launch(component, geometry.cloud.get(), geometry.mesh.get(), outputs, globalShift, 1.0, &progress, inputFile, &warnings, &errorStr);
+		PrintMessages(warnings);
+		if (!success)
+		{
+			fprintf(stderr, "%s\n", errorStr.isEmpty() ? "Process failed" : qPrintable(errorStr));
+			releaseFields();
+			return 1;
+		}
+
+		messages.clear();
+		run.report(component, messages);
+		PrintMessages(messages);
+	}
+
+	if (settings.shardDirectory.isEmpty())
+	{
+		success = SOLISFile::Save(outputFile, geometry, fields, &errorStr);
+		if (success)
+			printf("[SOLIS] Saved '%s'\n", qPrintable(outputFile));
+		else
+			fprintf(stderr, "%s\n", qPrintable(errorStr));
+	}
+
+	releaseFields();
+	return success ? 0 : 1;
+}
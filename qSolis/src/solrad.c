@@ -113,9 +113,9 @@ double LST (double doy){
  * @param ds Daylight saving in minutes
  */
 double Altitude (double doy, double lat, double lon, double slon, double ds){
-  double delta = Declination(doy);
-  double h  = HourAngle(doy, lon, slon, ds);
-  return(180.0/M_PI*asin(sin(M_PI/180.0*lat)*sin(M_PI/180.0*delta)+cos(M_PI/180.0*lat)*cos(M_PI/180.0*delta)*cos(M_PI/180.0*h)));
+  double altitude;
+  SolarComponents(&doy, 1, lat, lon, slon, ds, 0, 0, 0, NULL, &altitude, NULL, NULL, NULL);
+  return(altitude);
 }
 
 /*! Sunset Time
@@ -156,16 +156,9 @@ double DayLength (double doy, double lat){
  * @param ds Daylight saving in minutes
 */
 double Azimuth (double doy, double lat, double lon, double slon, double ds){
-  double delta    = Declination(doy);
-  double h        = HourAngle(doy, lon, slon, ds);
-  double ast      = AST(doy, lon, slon, ds);
-  double alpha    = Altitude(doy, lat, lon, slon, ds);
-  double rhs      = cos(M_PI/180.0*delta)* sin(M_PI/180.0*h)/cos(M_PI/180.0*alpha);
-  double azimuth1 = 180.0/M_PI*asin(rhs);
-  double c1       = (ast < 12*60)*1;
-  double c2       = (cos(M_PI/180.0*h)> tan(M_PI/180.0*delta)/tan(M_PI/180.0*lat))*1;
-  double azimuth2 = c1*(-180.0 + fabs(azimuth1)) + (1.0-c1)*(180.0 - azimuth1);
-  return (c2*azimuth1 + (1-c2)*azimuth2);
+  double azimuth;
+  SolarComponents(&doy, 1, lat, lon, slon, ds, 0, 0, 0, NULL, NULL, &azimuth, NULL, NULL);
+  return(azimuth);
 }
 
 /*! Solar Incidence Angle
@@ -203,7 +196,8 @@ double Transmittance (double doy, double  lat, double lon, double slon, double d
   double a1     = 0.5055+0.00595*pow((6.5-elevation/1000.0),2);
   double k      = 0.2711+0.01858*pow((2.5-elevation/1000.0),2);
   double alpha  = Altitude(doy, lat, lon, slon, ds);
-  return((a0+a1*exp(-k/sin(M_PI/180.0*alpha)))*(alpha>0));
+  if (alpha <= 0) return (0); // exp() overflows just below the horizon
+  return(a0+a1*exp(-k/sin(M_PI/180.0*alpha)));
 }
 
 /*! Atmospheric Diffusion Factor
@@ -273,9 +267,9 @@ double OpenRadiation (double doy, double lat, double lon, double slon, double ds
  * @param aspect Site aspect with respect to the south in degrees
 */
 double DirectRadiation (double doy, double lat, double lon, double slon, double ds, double elevation, double slope, double aspect){
-  double theta  =   Incidence(doy, lat, lon, slon, ds, slope, aspect);
-  double sopen =  OpenRadiation(doy, lat, lon, slon, ds, elevation);
-  return( sopen*cos(M_PI/180.0*theta) );
+  double direct;
+  SolarComponents(&doy, 1, lat, lon, slon, ds, elevation, slope, aspect, NULL, NULL, NULL, &direct, NULL);
+  return(direct);
 }
 
 /*! Solar Diffuse Radiation on a Surface
@@ -289,10 +283,93 @@ double DirectRadiation (double doy, double lat, double lon, double slon, double
  * @param slope Site slope in degrees
 */
 double DiffuseRadiation (double doy, double lat, double lon, double slon, double ds, double elevation, double slope){
-  double alpha  = Altitude(doy, lat, lon, slon, ds);
-  double sopen =  OpenRadiation(doy, lat, lon, slon, ds, elevation);
-  double td =  DiffusionFactor(doy, lat, lon, slon, ds, elevation);
-  return( sopen*td*pow(sin(M_PI/180.0*alpha),2)*pow(cos(M_PI/180.0*slope/2.),2) );
+  double diffuse;
+  SolarComponents(&doy, 1, lat, lon, slon, ds, elevation, slope, 0, NULL, NULL, NULL, NULL, &diffuse);
+  return(diffuse);
+}
+
+/*! Solar components of a series of timestamps
+* @brief This function computes the solar declination, altitude, azimuth, direct and diffuse radiation of 'n' timestamps at once, in structure-of-arrays form.
+ * Each intermediate value (declination, equation of time, hour angle, altitude, transmittance...) is computed once per timestamp and the site
+ * terms once per call. Outputs are optional (NULL) and match the scalar functions above, which are thin wrappers around it.
+ * The function only writes to its outputs: disjoint ranges of timestamps can be processed concurrently.
+ * @param doy Days of year (n values)
+ * @param n Number of timestamps
+ * @param lat Latitude (in degrees)
+ * @param lon Longitude in degrees
+ * @param slon Standard longitude (based on time zone) in degrees
+ * @param ds Daylight saving in minutes
+ * @param elevation elevation of the site in meters
+ * @param slope Site slope in degrees
+ * @param aspect Site aspect with respect to the south in degrees
+ * @param declination Declination angles (in degrees, n values or NULL)
+ * @param altitude Solar altitude angles (in degrees, n values or NULL)
+ * @param azimuth Solar azimuth angles (in degrees, n values or NULL)
+ * @param direct Direct beam radiation on the surface (in W/m2, n values or NULL)
+ * @param diffuse Diffuse radiation on the surface (in W/m2, n values or NULL)
+*/
+void SolarComponents (const double* doy, size_t n, double lat, double lon, double slon, double ds, double elevation, double slope, double aspect,
+                      double* declination, double* altitude, double* azimuth, double* direct, double* diffuse){
+  size_t i;
+  // site terms
+  const double sinLat    = sin(M_PI/180.0*lat);
+  const double cosLat    = cos(M_PI/180.0*lat);
+  const double tanLat    = tan(M_PI/180.0*lat);
+  const double sinSlope  = sin(M_PI/180.0*slope);
+  const double cosSlope  = cos(M_PI/180.0*slope);
+  const double sinAspect = sin(M_PI/180.0*aspect);
+  const double cosAspect = cos(M_PI/180.0*aspect);
+  const double a0        = 0.4237-0.00821* pow((6-elevation/1000.0),2);
+  const double a1        = 0.5055+0.00595*pow((6.5-elevation/1000.0),2);
+  const double k         = 0.2711+0.01858*pow((2.5-elevation/1000.0),2);
+  const double skyView   = pow(cos(M_PI/180.0*slope/2.),2);
+  const double lonShift  = 4* (slon - lon);
+  const int radiation    = (direct != NULL || diffuse != NULL);
+
+  for (i = 0; i < n; ++i){
+    // Declination, EOT, AST and hour angle (see the scalar functions)
+    double d        = doy[i];
+    double delta    = 23.45*sin(M_PI/180.0*360/365 * (284.0 + d));
+    double b        = (d - 81)*360/365.0;
+    double eot      = 9.87*sin(M_PI/180.0*2*b)- 7.53*cos(M_PI/180.0*b)-1.5*sin(M_PI/180.0*b);
+    double ast      = fmod(d*24*60, (24*60)) + eot + lonShift - ds;
+    double h        = (ast - 12*60.0)/4.0;
+    double sinDelta = sin(M_PI/180.0*delta);
+    double cosDelta = cos(M_PI/180.0*delta);
+    double sinH     = sin(M_PI/180.0*h);
+    double cosH     = cos(M_PI/180.0*h);
+    double alpha    = 180.0/M_PI*asin(sinLat*sinDelta+cosLat*cosDelta*cosH);
+
+    if (declination) declination[i] = delta;
+    if (altitude) altitude[i] = alpha;
+
+    if (azimuth){
+      double rhs      = cosDelta* sinH/cos(M_PI/180.0*alpha);
+      double azimuth1 = 180.0/M_PI*asin(rhs);
+      double c1       = (ast < 12*60)*1;
+      double c2       = (cosH > tan(M_PI/180.0*delta)/tanLat)*1;
+      double azimuth2 = c1*(-180.0 + fabs(azimuth1)) + (1.0-c1)*(180.0 - azimuth1);
+      azimuth[i] = c2*azimuth1 + (1-c2)*azimuth2;
+    }
+
+    if (radiation){
+      // Transmittance (null at night) and open sky radiation
+      double tb    = (alpha > 0 ? a0+a1*exp(-k/sin(M_PI/180.0*alpha)) : 0);
+      double sopen = tb*(SOLAR_CONSTANT*(1+0.033*cos(M_PI/180.0*360*d/365)));
+      if (direct){
+        double theta = 180.0/M_PI*acos(sinLat*sinDelta*cosSlope -
+                        cosLat*sinDelta* sinSlope* cosAspect +
+                        cosLat*cosDelta* cosH*cosSlope+
+                        sinLat*cosDelta* cosH*sinSlope*cosAspect+
+                        cosDelta*sinH*sinSlope*sinAspect);
+        direct[i] = (alpha > 0 ? sopen*cos(M_PI/180.0*theta) : 0);
+      }
+      if (diffuse){
+        double td = 0.271-0.294*tb;
+        diffuse[i] = sopen*td*pow(sin(M_PI/180.0*alpha),2)*skyView;
+      }
+    }
+  }
 }
 
 /*! Calculating Solar Variables